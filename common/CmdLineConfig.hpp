@@ -22,6 +22,7 @@ struct CmdLineConfig {
     std::vector<int> threads = {1,2,4,8,12,14,16};            // List of threads
     std::vector<int> ratios = {1000,100,0};                   // List of ratios (in permil)
     std::vector<int> updateratio = {0};                       // List of update ratios
+    std::vector<int> clients = {1,16,256};                    // List of logical clients per thread (coroutine benchmarks)
     uint64_t rqsize              {0};                         // Size of the range queries. Zero means disabled
     bool histo                   {false};                     // Set to true to enable latency histogram
 
@@ -40,6 +41,7 @@ struct CmdLineConfig {
                 printf("--threads=1,2,4      Comma separated values with the number of threads\n");
                 printf("--ratios=1000,100,0  Comma separated ratios (1000=100%% writes, 100=10%% writes and 90%% reads)\n");
                 printf("--rqsize=1000        Maximum size of a range query\n");
+                printf("--clients=1,16,256   Comma separated values with the number of logical clients per thread\n");
                 printf("--histo              Enable Latency histogram\n");
                 return false;
             }
@@ -79,6 +81,16 @@ struct CmdLineConfig {
                 }
                 continue;
             }
+            if (strstr(argv[iarg], "--clients=") != NULL) {
+                clients.clear();
+                char* args = argv[iarg]+strlen("--clients=");
+                args = strtok(args, ",");
+                while (args != NULL) {
+                    clients.push_back(atoi(args));
+                    args = strtok(NULL, ",");
+                }
+                continue;
+            }
             if (strstr(argv[iarg], "--rqsize=") != NULL) {
                 char* args = strtok(argv[iarg], "--rqsize=");
                 rqsize = atoi(args);
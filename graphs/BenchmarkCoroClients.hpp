@@ -0,0 +1,145 @@
+/*
+ * Copyright 2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include "stms/2PLSFCoro.hpp"
+
+using namespace std;
+using namespace chrono;
+
+
+/**
+ * This is a micro-benchmark where each thread multiplexes many logical clients (coroutines).
+ * Each client executes transactions that increment a few random counters out of a small array,
+ * therefore, transactions conflict often. Between transactions, the client yields to the other
+ * clients in the same thread, as if it was waiting for the next request.
+ *
+ * We compare regular 2PLSF transactions, which spin on the thread when they have to wait,
+ * with coroutine transactions, which suspend and let the other clients run.
+ */
+class BenchmarkCoroClients {
+
+private:
+    int numThreads;
+    // Number of counters incremented in each transaction
+    static const int COUNTERS_PER_TX = 4;
+
+    struct Counter {
+        twoplsf::tmtype<uint64_t> count {0};
+        uint8_t padding[64-8];
+    };
+
+    /**
+     * An imprecise but fast random number generator
+     */
+    static uint64_t randomLong(uint64_t x) {
+        x ^= x >> 12; // a
+        x ^= x << 25; // b
+        x ^= x >> 27; // c
+        return x * 2685821657736338717LL;
+    }
+
+    static twoplsf::coro::Task<void> client(Counter* parray, uint64_t numCounters, bool useCoro, atomic<bool>* quit, long long* ops, uint64_t seed) {
+        while (!quit->load()) {
+            seed = randomLong(seed);
+            uint64_t lseed = seed;
+            auto func = [parray,numCounters,lseed] () {
+                uint64_t s = lseed;
+                for (int i = 0; i < COUNTERS_PER_TX; i++) {
+                    s = randomLong(s);
+                    uint64_t idx = s % numCounters;
+                    parray[idx].count = parray[idx].count+1;
+                }
+            };
+            if (useCoro) {
+                co_await twoplsf::coro::updateTx(func);
+            } else {
+                twoplsf::updateTx(func);
+            }
+            (*ops)++;
+            // Wait for the next request
+            co_await twoplsf::coro::yield();
+        }
+    }
+
+public:
+    BenchmarkCoroClients(int numThreads) {
+        this->numThreads = numThreads;
+    }
+
+    uint64_t benchmark(std::string& className, const int numClients, const bool useCoro, const uint64_t numCounters, const seconds testLengthSeconds, const int numRuns) {
+        long long ops[numThreads][numRuns];
+        long long lengthSec[numRuns];
+        atomic<bool> startFlag = { false };
+        atomic<bool> quit = { false };
+
+        className = twoplsf::STM::className() + (useCoro ? "-coro" : "-blocking");
+        cout << "##### " << className << " #####  \n";
+
+        // Create the array of counters
+        Counter* parray = nullptr;
+        // It's ok to capture by reference, we're running single-threaded now
+        twoplsf::updateTx([&] () {
+            parray = (Counter*)twoplsf::tmMalloc(sizeof(Counter)*numCounters);
+        });
+
+        auto func = [&startFlag,&quit,&parray,numClients,useCoro,numCounters](long long *ops, const int tid) {
+            // Spin until the startFlag is set
+            while (!startFlag.load()) {}
+            *ops = 0;
+            twoplsf::coro::Scheduler& sched = twoplsf::coro::Scheduler::current();
+            for (int ic = 0; ic < numClients; ic++) {
+                sched.spawn(client(parray, numCounters, useCoro, &quit, ops, (tid*numClients+ic+1)*12345678901234567ULL));
+            }
+            sched.run();
+        };
+        for (int irun = 0; irun < numRuns; irun++) {
+            thread clientThreads[numThreads];
+            for (int tid = 0; tid < numThreads; tid++) clientThreads[tid] = thread(func, &ops[tid][irun], tid);
+            auto startBeats = steady_clock::now();
+            startFlag.store(true);
+            this_thread::sleep_for(testLengthSeconds);
+            quit.store(true);
+            auto stopBeats = steady_clock::now();
+            for (int tid = 0; tid < numThreads; tid++) clientThreads[tid].join();
+            lengthSec[irun] = (stopBeats-startBeats).count();
+            startFlag.store(false);
+            quit.store(false);
+        }
+
+        // It's ok to capture by reference, we're running single-threaded now
+        twoplsf::updateTx([&] () {
+            twoplsf::tmFree(parray);
+        });
+
+        // Accounting
+        vector<long long> agg(numRuns);
+        for (int irun = 0; irun < numRuns; irun++) {
+            for (int i = 0; i < numThreads; i++) {
+                agg[irun] += ops[i][irun]*1000000000LL/lengthSec[irun];
+            }
+        }
+        // Compute the median. numRuns should be an odd number
+        sort(agg.begin(),agg.end());
+        auto maxops = agg[numRuns-1];
+        auto minops = agg[0];
+        auto medianops = agg[numRuns/2];
+        auto delta = (long)(100.*(maxops-minops) / ((double)medianops));
+        // Printed value is the median of the number of ops per second that all threads were able to accomplish (on average)
+        std::cout << "Txn/sec = " << medianops << "     delta = " << delta << "%   min = " << minops << "   max = " << maxops << "\n";
+        return medianops;
+    }
+};
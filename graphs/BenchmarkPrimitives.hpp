@@ -0,0 +1,241 @@
+/*
+ * Copyright 2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+using namespace chrono;
+
+
+/**
+ * This is a micro-benchmark of the instrumentation of each STM: the cost of beginning and committing
+ * a transaction, of a single pload() or pstore() in transactions with 1 to 100k of them, of tmNew()
+ * and tmDelete(), and of small update transactions on disjoint or on the same words (contended,
+ * which includes the aborts and restarts) with multiple threads.
+ *
+ * Costs are in TSC cycles, or in nanoseconds on other architectures.
+ */
+class BenchmarkPrimitives {
+
+public:
+    struct Result {
+        std::string primitive;
+        uint64_t    size;           // Number of primitives in each transaction
+        int         threads;
+        double      cyclesPerTx;
+        double      cyclesPerOp;
+    };
+
+private:
+    int numThreads;
+    // Words accessed by each transaction of the multi-threaded tests
+    static const int WORDS_PER_TX = 4;
+    // Distance between the words of two threads in the disjoint test, so that they don't share cache lines or locks
+    static const int DISJOINT_STRIDE = 64;
+
+    static inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Executes func() in batches of batchSize until testLength has passed. Returns the ticks per call.
+    template<typename F> static double measure(const milliseconds testLength, const uint64_t batchSize, F&& func) {
+        uint64_t totalTicks = 0;
+        uint64_t totalCalls = 0;
+        auto startBeats = steady_clock::now();
+        while (steady_clock::now() - startBeats < testLength) {
+            const uint64_t start = ticks();
+            for (uint64_t i = 0; i < batchSize; i++) func(i);
+            totalTicks += ticks() - start;
+            totalCalls += batchSize;
+        }
+        return (double)totalTicks/totalCalls;
+    }
+
+    static void print(std::vector<Result>& results, const Result& r) {
+        std::cout << r.primitive << "\tsize=" << r.size << "\tthreads=" << r.threads << "\tcycles/tx=" << (uint64_t)r.cyclesPerTx << "\tcycles/op=" << r.cyclesPerOp << "\n";
+        results.push_back(r);
+    }
+
+public:
+    BenchmarkPrimitives(int numThreads) : numThreads{numThreads} { }
+
+    /*
+     * Single-threaded costs, with sizes from 1 to maxWords primitives per transaction
+     */
+    template<typename TM, template<typename> class TMTYPE>
+    void benchmarkUncontended(std::vector<Result>& results, const milliseconds testLength, const std::vector<uint64_t>& sizes, const uint64_t maxWords) {
+        struct Obj : public TM::tmbase {
+            TMTYPE<uint64_t> a;
+            TMTYPE<uint64_t> b;
+            Obj(uint64_t v) : a{v}, b{v} { }
+        };
+        TMTYPE<uint64_t>* array = nullptr;
+        TMTYPE<Obj*>* objs = nullptr;
+        TM::template updateTx<uint64_t>([&] () {
+            array = (TMTYPE<uint64_t>*)TM::tmMalloc(sizeof(TMTYPE<uint64_t>)*maxWords);
+            objs = (TMTYPE<Obj*>*)TM::tmMalloc(sizeof(TMTYPE<Obj*>)*maxWords);
+            return 0;
+        });
+        // Break up the initialization into transactions of 1k stores, so it fits in the log
+        for (uint64_t j = 0; j < maxWords; j += 1000) {
+            TM::template updateTx<uint64_t>([=] () {
+                for (uint64_t i = j; i < j+1000 && i < maxWords; i++) {
+                    array[i] = i;
+                    objs[i] = nullptr;
+                }
+                return 0;
+            });
+        }
+
+        // Begin and commit of empty transactions
+        double c = measure(testLength, 1024, [] (uint64_t) {
+            TM::template readTx<uint64_t>([] () { return 0; });
+        });
+        print(results, {"readTx", 0, 1, c, c});
+        c = measure(testLength, 1024, [] (uint64_t) {
+            TM::template updateTx<uint64_t>([] () { return 0; });
+        });
+        print(results, {"updateTx", 0, 1, c, c});
+
+        for (uint64_t size : sizes) {
+            if (size > maxWords) continue;
+            const uint64_t batchSize = std::max<uint64_t>(1, 16*1024/size);
+            c = measure(testLength, batchSize, [=] (uint64_t) {
+                TM::template readTx<uint64_t>([=] () {
+                    uint64_t sum = 0;
+                    for (uint64_t i = 0; i < size; i++) sum += array[i];
+                    return sum;
+                });
+            });
+            print(results, {"pload", size, 1, c, c/size});
+            c = measure(testLength, batchSize, [=] (uint64_t iter) {
+                TM::template updateTx<uint64_t>([=] () {
+                    for (uint64_t i = 0; i < size; i++) array[i] = iter+i;
+                    return 0;
+                });
+            });
+            print(results, {"pstore", size, 1, c, c/size});
+        }
+
+        // Allocations are measured in pairs of transactions, one with size tmNew() and the other with size tmDelete()
+        for (uint64_t size : sizes) {
+            if (size > maxWords || size > 1000) continue;
+            const uint64_t batchSize = std::max<uint64_t>(1, 16*1024/size);
+            uint64_t newTicks = 0, deleteTicks = 0, numTxs = 0;
+            auto startBeats = steady_clock::now();
+            while (steady_clock::now() - startBeats < testLength) {
+                for (uint64_t b = 0; b < batchSize; b++) {
+                    const uint64_t t0 = ticks();
+                    TM::template updateTx<uint64_t>([=] () {
+                        for (uint64_t i = 0; i < size; i++) objs[i] = TM::template tmNew<Obj>(i);
+                        return 0;
+                    });
+                    const uint64_t t1 = ticks();
+                    TM::template updateTx<uint64_t>([=] () {
+                        for (uint64_t i = 0; i < size; i++) {
+                            TM::tmDelete((Obj*)objs[i]);
+                            objs[i] = nullptr;
+                        }
+                        return 0;
+                    });
+                    deleteTicks += ticks() - t1;
+                    newTicks += t1 - t0;
+                    numTxs++;
+                }
+            }
+            print(results, {"tmNew", size, 1, (double)newTicks/numTxs, (double)newTicks/numTxs/size});
+            print(results, {"tmDelete", size, 1, (double)deleteTicks/numTxs, (double)deleteTicks/numTxs/size});
+        }
+
+        TM::template updateTx<uint64_t>([=] () {
+            TM::tmFree(array);
+            TM::tmFree(objs);
+            return 0;
+        });
+    }
+
+    /*
+     * Multi-threaded costs of update transactions that increment WORDS_PER_TX words, either on disjoint
+     * words for each thread or on the same words for all threads, and of read transactions on the same words.
+     * The cycles are per transaction of each thread (elapsed cycles times the number of threads, divided by the transactions).
+     */
+    template<typename TM, template<typename> class TMTYPE>
+    void benchmarkContended(std::vector<Result>& results, const milliseconds testLength) {
+        TMTYPE<uint64_t>* array = nullptr;
+        const uint64_t numWords = (uint64_t)DISJOINT_STRIDE*(numThreads+1);
+        TM::template updateTx<uint64_t>([&] () {
+            array = (TMTYPE<uint64_t>*)TM::tmMalloc(sizeof(TMTYPE<uint64_t>)*numWords);
+            return 0;
+        });
+        TM::template updateTx<uint64_t>([=] () {
+            for (uint64_t i = 0; i < numWords; i++) array[i] = 0;
+            return 0;
+        });
+
+        const char* names[] = { "incr-disjoint", "incr-same", "read-same" };
+        for (int test = 0; test < 3; test++) {
+            atomic<bool> startFlag = { false };
+            atomic<bool> quit = { false };
+            std::vector<uint64_t> numTxs(numThreads*DISJOINT_STRIDE, 0);
+            auto func = [&] (const int tid) {
+                // The same words for all threads are the ones at the end of the array
+                TMTYPE<uint64_t>* words = array + ((test == 0) ? tid : numThreads)*DISJOINT_STRIDE;
+                uint64_t count = 0;
+                while (!startFlag.load()) { }
+                while (!quit.load(std::memory_order_relaxed)) {
+                    if (test == 2) {
+                        TM::template readTx<uint64_t>([=] () {
+                            uint64_t sum = 0;
+                            for (int i = 0; i < WORDS_PER_TX; i++) sum += words[i];
+                            return sum;
+                        });
+                    } else {
+                        TM::template updateTx<uint64_t>([=] () {
+                            for (int i = 0; i < WORDS_PER_TX; i++) words[i] = words[i]+1;
+                            return 0;
+                        });
+                    }
+                    count++;
+                }
+                numTxs[tid*DISJOINT_STRIDE] = count;
+            };
+            vector<thread> threads;
+            for (int tid = 0; tid < numThreads; tid++) threads.push_back(thread(func, tid));
+            const uint64_t start = ticks();
+            startFlag.store(true);
+            this_thread::sleep_for(testLength);
+            quit.store(true);
+            const uint64_t elapsed = ticks() - start;
+            for (int tid = 0; tid < numThreads; tid++) threads[tid].join();
+            uint64_t total = 0;
+            for (int tid = 0; tid < numThreads; tid++) total += numTxs[tid*DISJOINT_STRIDE];
+            const double c = (double)elapsed*numThreads/std::max<uint64_t>(1, total);
+            print(results, {names[test], WORDS_PER_TX, numThreads, c, c/WORDS_PER_TX});
+        }
+
+        TM::template updateTx<uint64_t>([=] () {
+            TM::tmFree(array);
+            return 0;
+        });
+    }
+};
@@ -0,0 +1,217 @@
+/*
+ * Copyright 2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace chrono;
+
+
+/**
+ * This is a micro-benchmark for queues
+ */
+class BenchmarkQueues {
+
+private:
+    struct UserData  {
+        long long seq;
+        int tid;
+        UserData(long long lseq, int ltid) {
+            this->seq = lseq;
+            this->tid = ltid;
+        }
+    };
+
+    int numThreads;
+
+    // Queues with enqueueBatch() and dequeueBatch() do a batch in one call, the others do one call per item
+    template<typename Q, typename T>
+    static auto enqueueMany(Q* queue, T** items, const uint64_t numItems, int) -> decltype(queue->enqueueBatch(items, numItems)) {
+        return queue->enqueueBatch(items, numItems);
+    }
+
+    template<typename Q, typename T>
+    static uint64_t enqueueMany(Q* queue, T** items, const uint64_t numItems, long) {
+        uint64_t i = 0;
+        while (i < numItems && queue->enqueue(items[i])) i++;
+        return i;
+    }
+
+    template<typename Q, typename T>
+    static auto dequeueMany(Q* queue, T** items, const uint64_t maxItems, int) -> decltype(queue->dequeueBatch(items, maxItems)) {
+        return queue->dequeueBatch(items, maxItems);
+    }
+
+    template<typename Q, typename T>
+    static uint64_t dequeueMany(Q* queue, T** items, const uint64_t maxItems, long) {
+        uint64_t i = 0;
+        while (i < maxItems && (items[i] = (T*)queue->dequeue()) != nullptr) i++;
+        return i;
+    }
+
+public:
+    BenchmarkQueues(int numThreads) {
+        this->numThreads = numThreads;
+    }
+
+    /**
+     * enqueue-dequeue pairs: in each iteration a thread executes an enqueue followed by a dequeue.
+     * All threads conflict on the head or on the tail of the queue.
+     * Returns the number of pairs per second.
+     */
+    template<typename Q>
+    long long enqDeq(std::string& className, const seconds testLengthSeconds, const int numRuns) {
+        long long pairs[numThreads][numRuns];
+        long long lengthSec[numRuns];
+        atomic<bool> startFlag = { false };
+        atomic<bool> quit = { false };
+        Q* queue = new Q();
+        className = Q::className();
+        cout << "##### " << className << " #####  \n";
+
+        auto enqdeq_lambda = [this,&startFlag,&quit,&queue](long long *pairs, const int tid) {
+            UserData ud(0,tid);
+            // Spin until the startFlag is set
+            while (!startFlag.load()) {}
+            long long numPairs = 0;
+            while (!quit.load()) {
+                queue->enqueue(&ud);
+                if (queue->dequeue() == nullptr) cout << "Error at measurement pair\n";
+                ++numPairs;
+            }
+            *pairs = numPairs;
+        };
+
+        for (int irun = 0; irun < numRuns; irun++) {
+            thread enqdeqThreads[numThreads];
+            for (int tid = 0; tid < numThreads; tid++) enqdeqThreads[tid] = thread(enqdeq_lambda, &pairs[tid][irun], tid);
+            auto startBeats = steady_clock::now();
+            startFlag.store(true);
+            // Sleep for testLengthSeconds seconds
+            this_thread::sleep_for(testLengthSeconds);
+            quit.store(true);
+            auto stopBeats = steady_clock::now();
+            for (int tid = 0; tid < numThreads; tid++) enqdeqThreads[tid].join();
+            lengthSec[irun] = (stopBeats-startBeats).count();
+            startFlag.store(false);
+            quit.store(false);
+        }
+        delete queue;
+
+        // Accounting
+        vector<long long> agg(numRuns);
+        for (int irun = 0; irun < numRuns; irun++) {
+            for (int tid = 0; tid < numThreads; tid++) {
+                agg[irun] += pairs[tid][irun]*1000000000LL/lengthSec[irun];
+            }
+        }
+        // Compute the median. numRuns must be an odd number
+        sort(agg.begin(),agg.end());
+        auto maxops = agg[numRuns-1];
+        auto minops = agg[0];
+        auto medianops = agg[numRuns/2];
+        auto delta = (long)(100.*(maxops-minops) / ((double)medianops));
+        // Printed value is the median of the number of pairs per second that all threads were able to accomplish (on average)
+        std::cout << "Pairs/sec = " << medianops << "     delta = " << delta << "%   min = " << minops << "   max = " << maxops << "\n";
+        return medianops;
+    }
+
+    /**
+     * producer-consumer: numThreads producers enqueue batches of batchSize items and numThreads consumers
+     * dequeue batches of up to batchSize items. The producers of a full (bounded) queue and the consumers
+     * of an empty queue yield and try again.
+     * Q must be a queue of void.
+     * Returns the number of dequeued items per second.
+     */
+    template<typename Q>
+    long long prodCons(std::string& className, const seconds testLengthSeconds, const int numRuns, const uint64_t batchSize) {
+        long long items[numThreads][numRuns];
+        long long lengthSec[numRuns];
+        atomic<bool> startFlag = { false };
+        atomic<bool> quit = { false };
+        Q* queue = new Q();
+        className = Q::className();
+        cout << "##### " << className << "   batch=" << batchSize << " #####  \n";
+
+        auto producer_lambda = [this,&startFlag,&quit,&queue,batchSize](const int tid) {
+            vector<UserData> uds(batchSize, UserData(0,tid));
+            vector<void*> batch(batchSize);
+            for (uint64_t i = 0; i < batchSize; i++) batch[i] = &uds[i];
+            // Spin until the startFlag is set
+            while (!startFlag.load()) {}
+            while (!quit.load()) {
+                uint64_t numEnqueued = 0;
+                while (numEnqueued < batchSize && !quit.load()) {
+                    const uint64_t n = enqueueMany(queue, batch.data()+numEnqueued, batchSize-numEnqueued, 0);
+                    if (n == 0) this_thread::yield(); // The queue is full, let the consumers run
+                    numEnqueued += n;
+                }
+            }
+        };
+
+        auto consumer_lambda = [this,&startFlag,&quit,&queue,batchSize](long long *items, const int tid) {
+            vector<void*> batch(batchSize);
+            // Spin until the startFlag is set
+            while (!startFlag.load()) {}
+            long long numItems = 0;
+            while (!quit.load()) {
+                const uint64_t n = dequeueMany(queue, batch.data(), batchSize, 0);
+                if (n == 0) this_thread::yield(); // The queue is empty, let the producers run
+                numItems += n;
+            }
+            *items = numItems;
+        };
+
+        for (int irun = 0; irun < numRuns; irun++) {
+            thread producerThreads[numThreads];
+            thread consumerThreads[numThreads];
+            for (int tid = 0; tid < numThreads; tid++) producerThreads[tid] = thread(producer_lambda, tid);
+            for (int tid = 0; tid < numThreads; tid++) consumerThreads[tid] = thread(consumer_lambda, &items[tid][irun], tid);
+            auto startBeats = steady_clock::now();
+            startFlag.store(true);
+            // Sleep for testLengthSeconds seconds
+            this_thread::sleep_for(testLengthSeconds);
+            quit.store(true);
+            auto stopBeats = steady_clock::now();
+            for (int tid = 0; tid < numThreads; tid++) producerThreads[tid].join();
+            for (int tid = 0; tid < numThreads; tid++) consumerThreads[tid].join();
+            lengthSec[irun] = (stopBeats-startBeats).count();
+            startFlag.store(false);
+            quit.store(false);
+            // Drain the items left by the producers, a few at a time because the read-set is bounded
+            void* drain[64];
+            while (dequeueMany(queue, drain, 64, 0) != 0);
+        }
+        delete queue;
+
+        // Accounting
+        vector<long long> agg(numRuns);
+        for (int irun = 0; irun < numRuns; irun++) {
+            for (int tid = 0; tid < numThreads; tid++) {
+                agg[irun] += items[tid][irun]*1000000000LL/lengthSec[irun];
+            }
+        }
+        // Compute the median. numRuns must be an odd number
+        sort(agg.begin(),agg.end());
+        auto maxops = agg[numRuns-1];
+        auto minops = agg[0];
+        auto medianops = agg[numRuns/2];
+        auto delta = (long)(100.*(maxops-minops) / ((double)medianops));
+        // Printed value is the median of the number of dequeued items per second of all consumers
+        std::cout << "Items/sec = " << medianops << "     delta = " << delta << "%   min = " << minops << "   max = " << maxops << "\n";
+        return medianops;
+    }
+};
@@ -99,6 +99,21 @@ private:
 
     int numThreads;
 
+    // Sets with a bulkLoad() are built from the keys in ascending order, the others get one add() per key
+    template<typename S, typename K>
+    auto fillSet(S* set, K** keys, const uint64_t numElements, int) -> decltype(set->bulkLoad((const K*)nullptr, numElements, 1)) {
+        K* sorted = new K[numElements];
+        for (uint64_t i = 0; i < numElements; i++) sorted[i] = *keys[i];
+        std::sort(sorted, sorted + numElements);
+        set->bulkLoad(sorted, numElements, numThreads);
+        delete[] sorted;
+    }
+
+    template<typename S, typename K>
+    void fillSet(S* set, K** keys, const uint64_t numElements, long) {
+        set->addAll(keys, numElements);
+    }
+
 public:
     BenchmarkSets(int numThreads) {
         this->numThreads = numThreads;
@@ -139,7 +154,7 @@ public:
         // Shuffle the insertion order of the keys
         std::shuffle(udarray, udarray + numElements, gen);
         // Add all the items to the list
-        set->addAll(udarray, numElements);
+        fillSet(set, udarray, numElements, 0);
 
         // Can either be a Reader or a Writer
         auto rw_lambda = [this,&quit,&startFlag,&set,&udarray,&numElements,&rqSize](const int updateRatio, long long *ops, const int tid) {
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include "common/CmdLineConfig.hpp"
+// Only 2PLSF has coroutine transactions
+#include "BenchmarkCoroClients.hpp"
+
+#define DATA_FILENAME "data/coro-clients-2plsf.txt"
+
+
+//
+// Use like this:
+// # bin/coro-clients-2plsf --keys=64 --duration=2 --runs=1 --threads=1,2,4 --clients=1,16,256
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.keys = 64;
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    vector<int> threadList = cfg.threads;
+    vector<int> clientList = cfg.clients;
+    const uint64_t numCounters = cfg.keys;                           // Number of counters, the lower, the more conflicts
+    const seconds testLength {cfg.duration};                         // 20s for the paper
+    const int numRuns = cfg.runs;                                    // 5 runs for the paper
+    const int numModes = 2;                                          // blocking and coroutine transactions
+    uint64_t results[threadList.size()][clientList.size()][numModes];
+    std::string cNames[numModes];
+    // Reset results
+    std::memset(results, 0, sizeof(uint64_t)*threadList.size()*clientList.size()*numModes);
+
+    std::cout << "This benchmark takes about " << (threadList.size()*clientList.size()*numModes*numRuns*testLength.count()/(60*60.)) << " hours to complete\n";
+    for (unsigned ic = 0; ic < clientList.size(); ic++) {
+        for (int it = 0; it < threadList.size(); it++) {
+            int nThreads = threadList[it];
+            int nClients = clientList[ic];
+            BenchmarkCoroClients bench(nThreads);
+            std::cout << "\n----- Coroutine clients   counters=" << numCounters << "   clients/thread=" << nClients << "   threads=" << nThreads << "   runs=" << numRuns << "   length=" << testLength.count() << "s -----\n";
+            for (int im = 0; im < numModes; im++) {
+                results[it][ic][im] = bench.benchmark(cNames[im], nClients, im == 1, numCounters, testLength, numRuns);
+            }
+        }
+        std::cout << "\n";
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Threads\t";
+    // Printf class names and clients for each column
+    for (unsigned ic = 0; ic < clientList.size(); ic++) {
+        for (int im = 0; im < numModes; im++) dataFile << cNames[im] << "-" << clientList[ic] << "c\t";
+    }
+    dataFile << "\n";
+    for (int it = 0; it < threadList.size(); it++) {
+        dataFile << threadList[it] << "\t";
+        for (unsigned ic = 0; ic < clientList.size(); ic++) {
+            for (int im = 0; im < numModes; im++) dataFile << results[it][ic][im] << "\t";
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
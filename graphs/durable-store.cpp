@@ -0,0 +1,181 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <random>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/TMRAVLSet.hpp"
+// Only 2PLSF has durable transactions
+#include "stms/2PLSFDurable.hpp"
+
+#define DATA_FILENAME "data/durable-store-2plsf.txt"
+#define STORE_DIR "/tmp/2plsf-durable"
+#define DURABLE_CKPT_MS 500
+
+using namespace std;
+using namespace chrono;
+
+using DurableSet = TMRAVLSet<uint64_t,twoplsf::DurableTM,twoplsf::tmtype>;
+
+struct Result {
+    uint64_t ops;       // Operations per second
+    uint64_t avg;       // Latencies in microseconds
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t numCkpts;  // Checkpoints done during the run
+};
+
+
+// Each thread does 50% add() and 50% remove() of random keys. Every update is durable when it returns.
+// If store is not null, another thread takes a checkpoint of the store every DURABLE_CKPT_MS.
+Result durableUpdates(DurableSet* set, const int numThreads, const uint64_t numKeys, const seconds testLength, twoplsf::DurableStore* store=nullptr) {
+    atomic<bool> startFlag = { false };
+    atomic<bool> quit = { false };
+    vector<vector<uint64_t>> lats(numThreads);
+    auto func = [&] (const int tid) {
+        mt19937_64 rng(tid+1);
+        vector<uint64_t>& lat = lats[tid];
+        lat.reserve(1024*1024);
+        while (!startFlag.load()) { }
+        for (uint64_t iter = 0; !quit.load(std::memory_order_relaxed); iter++) {
+            const uint64_t key = rng() % numKeys;
+            auto start = steady_clock::now();
+            if (iter & 1) set->add(key);
+            else set->remove(key);
+            lat.push_back(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+        }
+    };
+    vector<thread> threads;
+    for (int tid = 0; tid < numThreads; tid++) threads.push_back(thread(func, tid));
+    uint64_t numCkpts = 0;
+    thread ckptThread;
+    if (store != nullptr) ckptThread = thread([&] () {
+        while (!startFlag.load()) { }
+        while (true) {
+            for (int i = 0; i < DURABLE_CKPT_MS/10 && !quit.load(); i++) this_thread::sleep_for(milliseconds(10));
+            if (quit.load()) break;
+            store->checkpoint();
+            numCkpts++;
+        }
+    });
+    auto startBeats = steady_clock::now();
+    startFlag.store(true);
+    this_thread::sleep_for(testLength);
+    quit.store(true);
+    for (int tid = 0; tid < numThreads; tid++) threads[tid].join();
+    auto stopBeats = steady_clock::now();
+    if (store != nullptr) ckptThread.join();
+    vector<uint64_t> all;
+    for (int tid = 0; tid < numThreads; tid++) all.insert(all.end(), lats[tid].begin(), lats[tid].end());
+    sort(all.begin(), all.end());
+    Result r {};
+    r.numCkpts = numCkpts;
+    if (all.empty()) return r;
+    uint64_t sum = 0;
+    for (uint64_t l : all) sum += l;
+    r.ops = all.size()*1000000000ULL/(stopBeats-startBeats).count();
+    r.avg = sum/all.size()/1000;
+    r.p50 = all[all.size()*50/100]/1000;
+    r.p99 = all[all.size()*99/100]/1000;
+    r.p999 = all[all.size()*999/1000]/1000;
+    return r;
+}
+
+// Number of keys in the set, over the range of keys of the benchmark
+uint64_t countKeys(DurableSet* set, const uint64_t numKeys) {
+    uint64_t count = 0;
+    for (uint64_t key = 0; key < numKeys; key++) count += set->contains(key);
+    return count;
+}
+
+
+//
+// Use like this:
+// # bin/durable-store-2plsf --keys=1000000 --duration=2 --threads=1,2,4
+// The store is created in /tmp/2plsf-durable, and is removed at the start of the benchmark.
+// The last run is with group commit and an online checkpoint every DURABLE_CKPT_MS.
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.keys = 1000*1000;
+    cfg.threads = {1,2,4,8};
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    const vector<int> threadList = cfg.threads;
+    const uint64_t numKeys = cfg.keys;
+    const seconds testLength {cfg.duration};
+    const twoplsf::SyncMode modes[] = { twoplsf::SyncMode::EachCommit, twoplsf::SyncMode::GroupCommit, twoplsf::SyncMode::GroupCommit };
+    const char* modeNames[] = { "sync-per-commit", "group-commit", "group-commit-ckpt" };
+    const int numModes = 3;
+    Result results[numModes][threadList.size()];
+
+    // The default domain is not used here. Without it, the checkpoints fork faster.
+    twoplsf::gSTM.excludeFromFork();
+    if (system("rm -rf " STORE_DIR) != 0) return 1;
+    uint64_t expected = 0;
+    for (int imode = 0; imode < numModes; imode++) {
+        twoplsf::DurableStore store {STORE_DIR, twoplsf::DURABLE_HEAP_SIZE, modes[imode]};
+        twoplsf::DurableTM::store() = &store;
+        DurableSet* set = store.getRoot<DurableSet>(0);
+        if (set == nullptr) {
+            std::cout << "Filling the set with " << numKeys/2 << " keys\n";
+            set = store.tmNew<DurableSet>();
+            store.setRoot(0, set);
+            for (uint64_t key = 0; key < numKeys; key += 2*1000) {
+                store.updateTx([&] () {
+                    for (uint64_t k = key; k < key + 2*1000 && k < numKeys; k += 2) set->add(k);
+                });
+            }
+        }
+        std::cout << "\n----- Durable TMRAVLSet " << modeNames[imode] << "   keys=" << numKeys << "   length=" << testLength.count() << "s -----\n";
+        for (int it = 0; it < threadList.size(); it++) {
+            Result& r = results[imode][it];
+            r = durableUpdates(set, threadList[it], numKeys, testLength, (imode == 2) ? &store : nullptr);
+            std::cout << "threads=" << threadList[it] << "   ops/sec = " << r.ops << "   latency(us) avg = " << r.avg;
+            std::cout << "   p50 = " << r.p50 << "   p99 = " << r.p99 << "   p99.9 = " << r.p999;
+            if (imode == 2) std::cout << "   checkpoints = " << r.numCkpts;
+            std::cout << "\n";
+        }
+        expected = countKeys(set, numKeys);
+        std::cout << "checkpoints = " << store.getNumCheckpoints() << "   longest pause(us) = " << store.getMaxPauseUs() << "\n";
+        twoplsf::DurableTM::store() = nullptr;
+    }
+
+    // Reopen the store and check that the set has all the keys
+    {
+        twoplsf::DurableStore store {STORE_DIR};
+        twoplsf::DurableTM::store() = &store;
+        DurableSet* set = store.getRoot<DurableSet>(0);
+        const uint64_t count = (set == nullptr) ? 0 : countKeys(set, numKeys);
+        std::cout << "\nReopened the store with " << count << " keys, expected " << expected << "\n";
+        twoplsf::DurableTM::store() = nullptr;
+        if (count != expected) return 1;
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Threads";
+    for (int imode = 0; imode < numModes; imode++) {
+        dataFile << "\t" << modeNames[imode] << "\t" << modeNames[imode] << "-p50\t" << modeNames[imode] << "-p99\t" << modeNames[imode] << "-p99.9";
+    }
+    dataFile << "\n";
+    for (int it = 0; it < threadList.size(); it++) {
+        dataFile << threadList[it];
+        for (int imode = 0; imode < numModes; imode++) {
+            const Result& r = results[imode][it];
+            dataFile << "\t" << r.ops << "\t" << r.p50 << "\t" << r.p99 << "\t" << r.p999;
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <iostream>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include "common/CmdLineConfig.hpp"
+// Only 2PLSF has parallel nested transactions
+#include "stms/2PLSFFork.hpp"
+#include "pdatastructures/TMRAVLSet.hpp"
+
+using namespace std;
+using namespace chrono;
+
+
+// One lock stripe of 2PLSF (32 bytes). w[0]+w[1] is always zero outside of the transactions of the writers.
+// p[itask] is modified only by the task itask of the fork transactions.
+struct alignas(32) Stripe {
+    twoplsf::tmtype<uint64_t> w[2];
+    twoplsf::tmtype<uint64_t> p[2];
+};
+
+static const int NUM_TASKS = 2;
+
+// Task itask also adds a key to sets[itask], whose transactions join the fork transaction from the worker
+using ForkSet = TMRAVLSet<uint64_t,twoplsf::STM,twoplsf::tmtype>;
+
+
+// The writer threads execute regular transactions that move a random amount from w[1] to w[0] of a random
+// stripe, yielding in between, while the calling thread executes fork transactions whose two tasks read
+// w[0] and w[1] of all the stripes and increment their own p[itask] of each stripe, which means that the
+// workers share the read-locks and the write-locks of the same stripes. Each task then adds the key
+// firstKey+numForkTxs to its own set.
+// Returns the number of times a task saw a broken w[0]+w[1]==0 or a key already in its set, which must be zero.
+uint64_t stressRun(Stripe* stripes, const uint64_t numStripes, ForkSet* sets[NUM_TASKS], const uint64_t firstKey,
+                   const int numWriters, const seconds testLength, uint64_t& numForkTxs) {
+    atomic<bool> quit = { false };
+    atomic<bool> startFlag = { false };
+    atomic<uint64_t> violations = { 0 };
+    vector<uint64_t> writerTxs(numWriters);
+    auto writerFunc = [&] (const int tid) {
+        uint64_t seed = (tid+1)*12345678901234567ULL;
+        uint64_t numTxs = 0;
+        while (!startFlag.load()) ; // spin
+        while (!quit.load()) {
+            seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+            Stripe& s = stripes[(seed >> 16) % numStripes];
+            const uint64_t delta = (seed >> 48) + 1;
+            twoplsf::updateTx([&] () {
+                s.w[0] = s.w[0] + delta;
+                // Let the fork transactions run while w[0] has an uncommitted value
+                this_thread::yield();
+                s.w[1] = s.w[1] - delta;
+            });
+            numTxs++;
+        }
+        writerTxs[tid] = numTxs;
+    };
+    vector<thread> writers;
+    for (int tid = 0; tid < numWriters; tid++) writers.push_back(thread(writerFunc, tid));
+    this_thread::sleep_for(100ms);
+    auto startBeats = steady_clock::now();
+    startFlag.store(true);
+    numForkTxs = 0;
+    while (steady_clock::now() - startBeats < testLength) {
+        const uint64_t key = firstKey + numForkTxs;
+        twoplsf::updateTx([&] () {
+            twoplsf::forkJoin(NUM_TASKS, [&] (int itask) {
+                for (uint64_t i = 0; i < numStripes; i++) {
+                    const uint64_t w0 = stripes[i].w[0];
+                    const uint64_t w1 = stripes[i].w[1];
+                    if (w0 + w1 != 0) violations.fetch_add(1);
+                    stripes[i].p[itask] = stripes[i].p[itask] + 1;
+                }
+                if (!sets[itask]->add(key)) violations.fetch_add(1);
+            });
+        });
+        numForkTxs++;
+    }
+    quit.store(true);
+    for (int tid = 0; tid < numWriters; tid++) writers[tid].join();
+    uint64_t numTxs = 0;
+    for (int tid = 0; tid < numWriters; tid++) numTxs += writerTxs[tid];
+    std::cout << "writers=" << numWriters << "   fork txs = " << numForkTxs << "   writer txs = " << numTxs << "   violations = " << violations.load() << "\n";
+    return violations.load();
+}
+
+
+//
+// Use like this:
+// # bin/fork-join-stress-2plsf --keys=256 --duration=2 --runs=1 --threads=1,2,4
+// Stress test of the read-locks and write-locks shared by the workers of forkJoin(). The list of threads
+// is the number of writer threads and --keys is the number of stripes. The tasks also add keys to a TMRAVLSet each,
+// which joins the fork transaction from the worker thread. Returns 1 if a task saw uncommitted
+// data of a writer or if the final state is not consistent.
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.keys = 256;
+    cfg.threads = {1,2,4};
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const vector<int> writerList = cfg.threads;
+    const uint64_t numStripes = cfg.keys;
+    const seconds testLength {cfg.duration};
+    const int numRuns = cfg.runs;
+
+    Stripe* stripes = (Stripe*)aligned_alloc(alignof(Stripe), numStripes*sizeof(Stripe));
+    ForkSet* sets[NUM_TASKS];
+    for (int itask = 0; itask < NUM_TASKS; itask++) sets[itask] = twoplsf::updateTx<ForkSet*>([] () { return twoplsf::tmNew<ForkSet>(); });
+    for (uint64_t i = 0; i < numStripes; i++) new (&stripes[i]) Stripe();
+    twoplsf::updateTx([&] () {
+        for (uint64_t i = 0; i < numStripes; i++) {
+            stripes[i].w[0] = 0;
+            stripes[i].w[1] = 0;
+            for (int itask = 0; itask < NUM_TASKS; itask++) stripes[i].p[itask] = 0;
+        }
+    });
+
+    std::cout << "\n----- Fork/join stress   stripes=" << numStripes << "   tasks=" << NUM_TASKS << "   runs=" << numRuns << "   length=" << testLength.count() << "s -----\n";
+    uint64_t violations = 0;
+    uint64_t totalForkTxs = 0;
+    for (int iw = 0; iw < writerList.size(); iw++) {
+        for (int irun = 0; irun < numRuns; irun++) {
+            uint64_t numForkTxs;
+            violations += stressRun(stripes, numStripes, sets, totalForkTxs, writerList[iw], testLength, numForkTxs);
+            totalForkTxs += numForkTxs;
+        }
+    }
+
+    // Each committed fork transaction incremented p[itask] of all the stripes once and added its key to all the sets
+    uint64_t badStripes = twoplsf::readTx<uint64_t>([&] () {
+        uint64_t bad = 0;
+        for (uint64_t i = 0; i < numStripes; i++) {
+            bool ok = (stripes[i].w[0] + stripes[i].w[1] == 0);
+            for (int itask = 0; itask < NUM_TASKS; itask++) ok = ok && (stripes[i].p[itask] == totalForkTxs);
+            if (!ok) bad++;
+        }
+        return bad;
+    });
+    uint64_t badKeys = 0;
+    for (int itask = 0; itask < NUM_TASKS; itask++) {
+        // Check and empty the set in batches before deleting it, a single transaction can't free all the nodes
+        for (uint64_t key = 0; key < totalForkTxs; key += 1000) {
+            twoplsf::updateTx([&] () {
+                for (uint64_t k = key; k < key + 1000 && k < totalForkTxs; k++) if (!sets[itask]->remove(k)) badKeys++;
+            });
+        }
+        twoplsf::updateTx([&] () { twoplsf::tmDelete(sets[itask]); });
+    }
+    free(stripes);
+
+    // The workers run their tasks with the tid of the fork transaction, they must not have registered their own
+    const uint64_t maxWriters = *std::max_element(writerList.begin(), writerList.end());
+    if (twoplsf::ThreadRegistry::getMaxThreads() > 1 + maxWriters) {
+        std::cout << "\nFAILED: " << twoplsf::ThreadRegistry::getMaxThreads() << " registered threads, expected at most " << 1 + maxWriters << "\n";
+        return 1;
+    }
+    if (violations != 0 || badStripes != 0 || badKeys != 0) {
+        std::cout << "\nFAILED: " << violations << " reads of uncommitted data or duplicate keys, " << badStripes << " inconsistent stripes and " << badKeys << " missing keys\n";
+        return 1;
+    }
+    std::cout << "\nPassed\n";
+    return 0;
+}
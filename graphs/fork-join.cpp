@@ -0,0 +1,77 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "common/CmdLineConfig.hpp"
+// Only 2PLSF has parallel nested transactions
+#include "stms/2PLSFFork.hpp"
+
+#define DATA_FILENAME "data/fork-join-2plsf.txt"
+
+using namespace std;
+using namespace chrono;
+
+
+// Executes large transactions that increment all the words of an array, split in numTasks tasks
+// with forkJoin(). Returns the number of large transactions per second.
+uint64_t bigTxs(const int numTasks, twoplsf::tmtype<uint64_t>* array, const uint64_t numWords, const seconds testLength, const int numRuns) {
+    vector<uint64_t> agg(numRuns);
+    for (int irun = 0; irun < numRuns; irun++) {
+        uint64_t numTxs = 0;
+        auto startBeats = steady_clock::now();
+        while (steady_clock::now() - startBeats < testLength) {
+            twoplsf::updateTx([&] () {
+                twoplsf::forkJoin(numTasks, [&] (int itask) {
+                    for (uint64_t i = itask*numWords/numTasks; i < (itask+1)*numWords/numTasks; i++) array[i] = array[i] + 1;
+                });
+            });
+            numTxs++;
+        }
+        auto stopBeats = steady_clock::now();
+        agg[irun] = numTxs*1000000000ULL/(stopBeats-startBeats).count();
+    }
+    sort(agg.begin(), agg.end());
+    auto medianops = agg[numRuns/2];
+    std::cout << "tasks=" << numTasks << "   Txs/sec = " << medianops << "   min = " << agg[0] << "   max = " << agg[numRuns-1] << "\n";
+    return medianops;
+}
+
+
+//
+// Use like this:
+// # bin/fork-join-2plsf --keys=65536 --duration=2 --runs=1 --threads=1,2,4
+// The list of threads is the number of tasks in each transaction. The ForkPool has one worker per core.
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.keys = 64*1024;
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    vector<int> taskList = cfg.threads;
+    const uint64_t numWords = cfg.keys;                              // Number of words modified in each transaction
+    const seconds testLength {cfg.duration};
+    const int numRuns = cfg.runs;
+    uint64_t results[taskList.size()];
+
+    twoplsf::tmtype<uint64_t>* array = new twoplsf::tmtype<uint64_t>[numWords];
+    std::cout << "\n----- Large transactions   words=" << numWords << "   runs=" << numRuns << "   length=" << testLength.count() << "s -----\n";
+    for (int it = 0; it < taskList.size(); it++) {
+        results[it] = bigTxs(taskList[it], array, numWords, testLength, numRuns);
+    }
+    delete[] array;
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Tasks\t" << twoplsf::STM::className() << "\n";
+    for (int it = 0; it < taskList.size(); it++) dataFile << taskList[it] << "\t" << results[it] << "\n";
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/TMHashMap.hpp"
+#include "pdatastructures/TMHashMapByRef.hpp"
+// This benchmark compares the incremental resize of TMHashMap against the resize of TMHashMapByRef,
+// which rehashes all the keys in a single transaction. Only for 2PLSF.
+#include "stms/2PLSF.hpp"
+
+#define DATA_FILENAME "data/hash-growth-2plsf.txt"
+#define INITIAL_KEYS 1000
+// The blocking resize reads all the buckets and nodes in one transaction, which has to fit in the read-set of 2PLSF
+#define BLOCKING_MAX_KEYS 40000
+
+using namespace std;
+using namespace chrono;
+
+using IncrementalMap = TMHashMap<uint64_t,uint64_t,twoplsf::STM,twoplsf::tmtype,twoplsf::tmcounter>;
+using BlockingMap = TMHashMapByRef<uint64_t,uint64_t,twoplsf::STM,twoplsf::tmtype>;
+
+struct Result {
+    uint64_t ops;       // Insertions per second
+    uint64_t avg;       // Latencies in nanoseconds
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t p9999;
+    uint64_t max;
+};
+
+
+// Starts with a map of INITIAL_KEYS keys and each thread inserts distinct keys until there are numKeys.
+// The map grows by doubling its capacity about log2(numKeys/INITIAL_KEYS) times during the run.
+template<typename M>
+Result growth(const int numThreads, const uint64_t numKeys) {
+    M* map = twoplsf::STM::template updateTx<M*>([] () { return twoplsf::STM::template tmNew<M>(INITIAL_KEYS); });
+    for (uint64_t key = 0; key < INITIAL_KEYS; key++) map->add(key);
+    atomic<bool> startFlag = { false };
+    vector<vector<uint64_t>> lats(numThreads);
+    auto func = [&] (const int tid) {
+        vector<uint64_t>& lat = lats[tid];
+        lat.reserve((numKeys-INITIAL_KEYS)/numThreads+1);
+        while (!startFlag.load()) { }
+        for (uint64_t key = INITIAL_KEYS+tid; key < numKeys; key += numThreads) {
+            auto start = steady_clock::now();
+            map->add(key);
+            lat.push_back(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+        }
+    };
+    vector<thread> threads;
+    for (int tid = 0; tid < numThreads; tid++) threads.push_back(thread(func, tid));
+    auto startBeats = steady_clock::now();
+    startFlag.store(true);
+    for (int tid = 0; tid < numThreads; tid++) threads[tid].join();
+    auto stopBeats = steady_clock::now();
+    // Outside of a transaction, the destructor frees all the nodes
+    twoplsf::STM::tmDelete(map);
+    vector<uint64_t> all;
+    for (int tid = 0; tid < numThreads; tid++) {
+        all.insert(all.end(), lats[tid].begin(), lats[tid].end());
+        vector<uint64_t>().swap(lats[tid]);
+    }
+    sort(all.begin(), all.end());
+    Result r {};
+    if (all.empty()) return r;
+    uint64_t sum = 0;
+    for (uint64_t l : all) sum += l;
+    r.ops = all.size()*1000000000ULL/(stopBeats-startBeats).count();
+    r.avg = sum/all.size();
+    r.p50 = all[all.size()*50/100];
+    r.p99 = all[all.size()*99/100];
+    r.p999 = all[all.size()*999/1000];
+    r.p9999 = all[all.size()*9999/10000];
+    r.max = all.back();
+    return r;
+}
+
+
+//
+// Use like this:
+// # bin/hash-growth-2plsf --keys=10000000 --threads=1,2,4
+// The blocking resize can't grow the map beyond BLOCKING_MAX_KEYS, so it is compared with the incremental
+// resize up to that size, and the incremental resize is also measured up to --keys.
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.keys = 10*1000*1000;
+    cfg.threads = {1,2,4,8};
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    // The map starts with INITIAL_KEYS keys and must at least double once, otherwise nothing is measured
+    if (cfg.keys < 2*INITIAL_KEYS) {
+        std::cout << "ERROR: --keys must be at least " << 2*INITIAL_KEYS << "\n";
+        return 1;
+    }
+
+    const std::string dataFilename { DATA_FILENAME };
+    const vector<int> threadList = cfg.threads;
+    const uint64_t numKeys = cfg.keys;
+    const uint64_t smallKeys = std::min<uint64_t>(numKeys, BLOCKING_MAX_KEYS);
+    const char* mapNames[] = { "incremental", "incremental-small", "blocking-small" };
+    const uint64_t mapKeys[] = { numKeys, smallKeys, smallKeys };
+    const int numMaps = 3;
+    Result results[numMaps][threadList.size()];
+
+    for (int imap = 0; imap < numMaps; imap++) {
+        std::cout << "\n----- Hash map growth " << mapNames[imap] << "   keys=" << INITIAL_KEYS << " to " << mapKeys[imap] << " -----\n";
+        for (int it = 0; it < threadList.size(); it++) {
+            Result& r = results[imap][it];
+            if (imap != 2) r = growth<IncrementalMap>(threadList[it], mapKeys[imap]);
+            else r = growth<BlockingMap>(threadList[it], mapKeys[imap]);
+            std::cout << "threads=" << threadList[it] << "   ops/sec = " << r.ops << "   latency(ns) avg = " << r.avg;
+            std::cout << "   p50 = " << r.p50 << "   p99 = " << r.p99 << "   p99.9 = " << r.p999;
+            std::cout << "   p99.99 = " << r.p9999 << "   max = " << r.max << "\n";
+        }
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Threads";
+    for (int imap = 0; imap < numMaps; imap++) {
+        dataFile << "\t" << mapNames[imap] << "\t" << mapNames[imap] << "-p99\t" << mapNames[imap] << "-p99.9\t" << mapNames[imap] << "-p99.99\t" << mapNames[imap] << "-max";
+    }
+    dataFile << "\n";
+    for (int it = 0; it < threadList.size(); it++) {
+        dataFile << threadList[it];
+        for (int imap = 0; imap < numMaps; imap++) {
+            const Result& r = results[imap][it];
+            dataFile << "\t" << r.ops << "\t" << r.p99 << "\t" << r.p999 << "\t" << r.p9999 << "\t" << r.max;
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/TMHashMap.hpp"
+#include "pdatastructures/TMHashMapFixedSize.hpp"
+#include "pdatastructures/TMSwissHashMap.hpp"
+
+static const int RECORD_SIZE = 12;            // The default Value is a "Record" with size 96 bytes, where each 8 byte is a word
+
+// Macros suck, but we can't have multiple TMs at the same time (too much memory)
+#if defined USE_TL2_ORIG
+#include "stms/TL2Orig.hpp"
+struct Record  { tl2orig::tmtype<uint64_t> data[RECORD_SIZE]; };
+#define HASH_TM        tl2orig::TL2
+#define HASH_TMTYPE    tl2orig::tmtype
+#define HASH_TMCOUNTER tl2orig::tmtype
+#define DATA_FILENAME "data/map-hash-tl2orig.txt"
+#elif defined USE_TINY
+#include "stms/TinySTM.hpp"
+struct Record  { tinystm::tmtype<uint64_t> data[RECORD_SIZE]; };
+#define HASH_TM        tinystm::TinySTM
+#define HASH_TMTYPE    tinystm::tmtype
+#define HASH_TMCOUNTER tinystm::tmtype
+#define DATA_FILENAME "data/map-hash-tiny.txt"
+#elif defined USE_2PLSF
+#include "stms/2PLSF.hpp"
+struct Record  { twoplsf::tmtype<uint64_t> data[RECORD_SIZE]; };
+#define HASH_TM        twoplsf::STM
+#define HASH_TMTYPE    twoplsf::tmtype
+#define HASH_TMCOUNTER twoplsf::tmcounter
+#define DATA_FILENAME "data/map-hash-2plsf.txt"
+#elif defined USE_2PL_UNDO
+#include "stms/2PLUndo.hpp"
+struct Record  { twoplundo::tmtype<uint64_t> data[RECORD_SIZE]; };
+#define HASH_TM        twoplundo::STM
+#define HASH_TMTYPE    twoplundo::tmtype
+#define HASH_TMCOUNTER twoplundo::tmtype
+#define DATA_FILENAME "data/map-hash-2plundo.txt"
+#elif defined USE_OFWF
+#include "stms/OneFileWF.hpp"
+struct Record : public ofwf::tmbase { ofwf::tmtype<uint64_t> data[RECORD_SIZE]; };
+#define HASH_TM        ofwf::STM
+#define HASH_TMTYPE    ofwf::tmtype
+#define HASH_TMCOUNTER ofwf::tmtype
+#define DATA_FILENAME "data/map-hash-ofwf.txt"
+#elif defined USE_OREC_EAGER
+#include "stms/zardoshti/orec_eager_wrap.hpp"
+struct Record  { orec_eager::tmtype<uint64_t> data[RECORD_SIZE]; };
+#define HASH_TM        orec_eager::STM
+#define HASH_TMTYPE    orec_eager::tmtype
+#define HASH_TMCOUNTER orec_eager::tmtype
+#define DATA_FILENAME "data/map-hash-oreceager.txt"
+#elif defined USE_OREC_LAZY
+#include "stms/zardoshti/orec_lazy_wrap.hpp"
+struct Record  { orec_lazy::tmtype<uint64_t> data[RECORD_SIZE]; };
+#define HASH_TM        orec_lazy::STM
+#define HASH_TMTYPE    orec_lazy::tmtype
+#define HASH_TMCOUNTER orec_lazy::tmtype
+#define DATA_FILENAME "data/map-hash-oreclazy.txt"
+#elif defined USE_TLRW_EAGER
+#include "stms/zardoshti/tlrw_eager_wrap.hpp"
+struct Record { tlrw_eager::tmtype<uint64_t> data[RECORD_SIZE]; };
+#define HASH_TM        tlrw_eager::STM
+#define HASH_TMTYPE    tlrw_eager::tmtype
+#define HASH_TMCOUNTER tlrw_eager::tmtype
+#define DATA_FILENAME "data/map-hash-tlrweager.txt"
+#endif
+
+
+#include "BenchmarkMaps.hpp"
+
+// The chained hash maps (fixed size with 10k buckets, and resizable) and the open addressing hash map.
+// Only 2PLSF has tmcounter, the other TMs use tmtype for the size of the resizable maps.
+static const int numMaps = 3;
+
+
+uint64_t benchmarkHash(const int imap, BenchmarkMaps& bench, std::string& cName, const int insertRatio, const int removeRatio, const int updateRatio,
+                       const seconds testLength, const int numRuns, const long numKeys) {
+    switch (imap) {
+    case 0: return bench.benchmark<TMHashMapFixedSize<uint64_t,Record*,HASH_TM,HASH_TMTYPE>, HASH_TM>               (cName, insertRatio, removeRatio, updateRatio, 0, testLength, numRuns, numKeys);
+    case 1: return bench.benchmark<TMHashMap<uint64_t,Record*,HASH_TM,HASH_TMTYPE,HASH_TMCOUNTER>, HASH_TM>         (cName, insertRatio, removeRatio, updateRatio, 0, testLength, numRuns, numKeys);
+    case 2: return bench.benchmark<TMSwissHashMap<uint64_t,Record*,HASH_TM,HASH_TMTYPE,HASH_TMCOUNTER>, HASH_TM>    (cName, insertRatio, removeRatio, updateRatio, 0, testLength, numRuns, numKeys);
+    }
+    return 0;
+}
+
+
+//
+// Use like this:
+// # bin/map-hash-blabla --keys=10000 --duration=2 --runs=1 --threads=1,2,4 --ratios=1000,100,0
+// The ratio is of insertions plus removals (half each), the remaining operations update the record of a key.
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    std::string dataFilename { DATA_FILENAME };
+    vector<int> threadList = cfg.threads;
+    vector<int> ratioList = cfg.ratios;
+    const long numKeys = cfg.keys;                                   // Number of keys in the map
+    const seconds testLength {cfg.duration};                         // 20s for the paper
+    const int numRuns = cfg.runs;                                    // 5 runs for the paper
+    uint64_t results[numMaps][threadList.size()][ratioList.size()];
+    std::string cNames[numMaps];
+    // Reset results
+    std::memset(results, 0, sizeof(uint64_t)*numMaps*threadList.size()*ratioList.size());
+
+    // Maps benchmarks
+    std::cout << "This benchmark takes about " << (numMaps*threadList.size()*ratioList.size()*numRuns*testLength.count()/(60*60.)) << " hours to complete\n";
+    std::cout << "\n----- Map Benchmark (HashMaps) -----\n";
+    for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+        const int insertRatio = ratioList[ir]/2;
+        const int removeRatio = ratioList[ir]/2;
+        const int updateRatio = 1000 - insertRatio - removeRatio;
+        for (int it = 0; it < threadList.size(); it++) {
+            int nThreads = threadList[it];
+            BenchmarkMaps bench(nThreads);
+            std::cout << "\n----- Maps (HashMaps)   keys=" << numKeys << "  i=" << insertRatio/10. << "% r=" << removeRatio/10. << "% u=" << updateRatio/10. << "%   threads=" << nThreads << "   runs=" << numRuns << "   length=" << testLength.count() << "s -----\n";
+            for (int imap = 0; imap < numMaps; imap++) {
+                results[imap][it][ir] = benchmarkHash(imap, bench, cNames[imap], insertRatio, removeRatio, updateRatio, testLength, numRuns, numKeys);
+            }
+        }
+        std::cout << "\n";
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Threads\t";
+    // Printf class names and ratios for each column
+    for (int imap = 0; imap < numMaps; imap++) {
+        for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+            auto ratio = ratioList[ir];
+            dataFile << cNames[imap] << "-" << ratio/10. << "%"<< "\t";
+        }
+    }
+    dataFile << "\n";
+    for (int it = 0; it < threadList.size(); it++) {
+        dataFile << threadList[it] << "\t";
+        for (int imap = 0; imap < numMaps; imap++) {
+            for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+                dataFile << results[imap][it][ir] << "\t";
+            }
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
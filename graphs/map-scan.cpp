@@ -0,0 +1,229 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/maps/TMRAVLMap.hpp"
+#include "pdatastructures/maps/TMSkipListMap.hpp"
+
+// Macros suck, but we can't have multiple TMs at the same time (too much memory)
+#if defined USE_TL2_ORIG
+#include "stms/TL2Orig.hpp"
+#define SCAN_TM         tl2orig::TL2
+#define SCAN_TMTYPE     tl2orig::tmtype
+#define SCAN_TMCOUNTER  tl2orig::tmtype
+#define DATA_FILENAME "data/map-scan-tl2orig.txt"
+#elif defined USE_TINY
+#include "stms/TinySTM.hpp"
+#define SCAN_TM         tinystm::TinySTM
+#define SCAN_TMTYPE     tinystm::tmtype
+#define SCAN_TMCOUNTER  tinystm::tmtype
+#define DATA_FILENAME "data/map-scan-tiny.txt"
+#elif defined USE_2PLSF
+#include "stms/2PLSF.hpp"
+#define SCAN_TM         twoplsf::STM
+#define SCAN_TMTYPE     twoplsf::tmtype
+#define SCAN_TMCOUNTER  twoplsf::tmcounter
+#define DATA_FILENAME "data/map-scan-2plsf.txt"
+#elif defined USE_OREC_EAGER
+#include "stms/zardoshti/orec_eager_wrap.hpp"
+#define SCAN_TM         orec_eager::STM
+#define SCAN_TMTYPE     orec_eager::tmtype
+#define SCAN_TMCOUNTER  orec_eager::tmtype
+#define DATA_FILENAME "data/map-scan-oreceager.txt"
+#elif defined USE_OREC_LAZY
+#include "stms/zardoshti/orec_lazy_wrap.hpp"
+#define SCAN_TM         orec_lazy::STM
+#define SCAN_TMTYPE     orec_lazy::tmtype
+#define SCAN_TMCOUNTER  orec_lazy::tmtype
+#define DATA_FILENAME "data/map-scan-oreclazy.txt"
+#elif defined USE_TLRW_EAGER
+#include "stms/zardoshti/tlrw_eager_wrap.hpp"
+#define SCAN_TM         tlrw_eager::STM
+#define SCAN_TMTYPE     tlrw_eager::tmtype
+#define SCAN_TMCOUNTER  tlrw_eager::tmtype
+#define DATA_FILENAME "data/map-scan-tlrweager.txt"
+#endif
+
+using namespace std;
+using namespace chrono;
+
+// A scan of the whole map in a single transaction doesn't fit in the read-set of 2PLSF with 1M keys,
+// which is why the largest chunk is much smaller than the map
+static const int numMaps = 2;
+static const int numChunks = 5;
+static const int numModes = 3;
+static const uint64_t chunkSizes[numChunks] = { 16, 64, 256, 1024, 4096 };
+
+
+// An imprecise but fast random number generator
+static uint64_t randomLong(uint64_t x) {
+    x ^= x >> 12; // a
+    x ^= x << 25; // b
+    x ^= x >> 27; // c
+    return x * 2685821657736338717LL;
+}
+
+
+/*
+ * One thread scans the whole map with a cursor, chunkSize keys per transaction, while numThreads writers
+ * remove a random key and add it back. The map tracks changes in all the modes except "untracked" and
+ * the cursor validates each chunk in the "validate" mode.
+ * Returns the number of writer operations per second and the number of scanned keys per second.
+ */
+template<typename M>
+void scan(std::string& className, const int numThreads, const seconds testLength, const uint64_t numKeys,
+          const uint64_t chunkSize, const bool validate, uint64_t& writeOps, uint64_t& scanKeys) {
+    className = M::className();
+    M* map = SCAN_TM::template updateTx<M*>([] () { return SCAN_TM::template tmNew<M>(); });
+    vector<uint64_t> keys(numKeys);
+    for (uint64_t i = 0; i < numKeys; i++) keys[i] = i;
+    vector<uint64_t*> values(numKeys, nullptr);
+    for (uint64_t i = 0; i < numKeys; i += 1024) map->addMany(keys.data()+i, values.data()+i, std::min<uint64_t>(1024, numKeys-i));
+    atomic<bool> quit = { false };
+    atomic<bool> startFlag = { false };
+    vector<uint64_t> ops(numThreads);
+    uint64_t numScanned = 0;
+    uint64_t numScans = 0;
+    uint64_t numChanged = 0;
+    auto writer = [&] (const int tid) {
+        uint64_t numOps = 0;
+        uint64_t seed = (tid+1)+12345678901234567ULL;
+        uint64_t* value = nullptr;
+        while (!startFlag.load()) ; // spin
+        while (!quit.load()) {
+            seed = randomLong(seed);
+            const uint64_t key = seed % numKeys;
+            map->remove(key);
+            map->add(key, value);
+            numOps += 2;
+        }
+        ops[tid] = numOps;
+    };
+    auto scanner = [&] () {
+        vector<uint64_t> rkeys(chunkSize);
+        vector<uint64_t*> rvalues(chunkSize);
+        while (!startFlag.load()) ; // spin
+        while (!quit.load()) {
+            auto cursor = map->cursor(0, numKeys, validate);
+            while (!quit.load()) {
+                uint64_t n = map->nextChunk(cursor, chunkSize, rkeys.data(), rvalues.data());
+                if (n == 0) break;
+                numScanned += n;
+            }
+            if (!cursor.done) break;
+            numScans++;
+            if (cursor.changed) numChanged++;
+        }
+    };
+    vector<thread> threads;
+    for (int tid = 0; tid < numThreads; tid++) threads.push_back(thread(writer, tid));
+    threads.push_back(thread(scanner));
+    this_thread::sleep_for(100ms);
+    auto startBeats = steady_clock::now();
+    startFlag.store(true);
+    this_thread::sleep_for(testLength);
+    quit.store(true);
+    auto stopBeats = steady_clock::now();
+    for (auto& t : threads) t.join();
+    if (validate) std::cout << "   " << numChanged << " of " << numScans << " full scans saw changes\n";
+    // Clear the map, 256 keys per transaction, and then delete the instance
+    for (uint64_t i = 0; i < numKeys; i += 256) map->removeMany(keys.data()+i, std::min<uint64_t>(256, numKeys-i));
+    SCAN_TM::template updateTx<bool>([=] () {
+        SCAN_TM::tmDelete(map);
+        return true;
+    });
+    uint64_t agg = 0;
+    for (int tid = 0; tid < numThreads; tid++) agg += ops[tid];
+    writeOps = agg*1000000000ULL/(stopBeats-startBeats).count();
+    scanKeys = numScanned*1000000000ULL/(stopBeats-startBeats).count();
+}
+
+
+void benchmarkScan(const int imap, const int imode, std::string& cName, const int numThreads, const seconds testLength,
+                   const uint64_t numKeys, const uint64_t chunkSize, uint64_t& writeOps, uint64_t& scanKeys) {
+    const bool validate = imode == 2;
+    if (imode == 0) {
+        switch (imap) {
+        case 0: return scan<TMRAVLMap<uint64_t,uint64_t*,SCAN_TM,SCAN_TMTYPE>>                                 (cName, numThreads, testLength, numKeys, chunkSize, validate, writeOps, scanKeys);
+        case 1: return scan<TMSkipListMap<uint64_t,uint64_t*,SCAN_TM,SCAN_TMTYPE>>                             (cName, numThreads, testLength, numKeys, chunkSize, validate, writeOps, scanKeys);
+        }
+    } else {
+        switch (imap) {
+        case 0: return scan<TMRAVLMap<uint64_t,uint64_t*,SCAN_TM,SCAN_TMTYPE,true,SCAN_TMCOUNTER>>             (cName, numThreads, testLength, numKeys, chunkSize, validate, writeOps, scanKeys);
+        case 1: return scan<TMSkipListMap<uint64_t,uint64_t*,SCAN_TM,SCAN_TMTYPE,true,SCAN_TMCOUNTER>>         (cName, numThreads, testLength, numKeys, chunkSize, validate, writeOps, scanKeys);
+        }
+    }
+}
+
+
+//
+// Use like this:
+// # bin/map-scan-2plsf --keys=1000000 --duration=2 --threads=1,4
+// The number of threads is the number of writers, there is always one extra thread doing the scans.
+// For each chunk size, the map doesn't track changes ("untracked"), tracks changes ("tracked") and
+// tracks changes which the cursor validates after each chunk ("validate").
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.keys = 1000*1000;
+    cfg.threads = {1,4};
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    const vector<int> threadList = cfg.threads;
+    const uint64_t numKeys = cfg.keys;
+    const seconds testLength {cfg.duration};
+    const char* modeNames[] = { "untracked", "tracked", "validate" };
+    uint64_t writeResults[numMaps][numModes][threadList.size()][numChunks];
+    uint64_t scanResults[numMaps][numModes][threadList.size()][numChunks];
+    std::string cNames[numMaps];
+
+    std::cout << "This benchmark takes about " << (numMaps*numModes*numChunks*threadList.size()*testLength.count()/60.) << " minutes to complete\n";
+    for (int imap = 0; imap < numMaps; imap++) {
+        for (unsigned it = 0; it < threadList.size(); it++) {
+            for (int ic = 0; ic < numChunks; ic++) {
+                for (int imode = 0; imode < numModes; imode++) {
+                    uint64_t& w = writeResults[imap][imode][it][ic];
+                    uint64_t& s = scanResults[imap][imode][it][ic];
+                    benchmarkScan(imap, imode, cNames[imap], threadList[it], testLength, numKeys, chunkSizes[ic], w, s);
+                    std::cout << cNames[imap] << "   keys=" << numKeys << "   writers=" << threadList[it] << "   chunk=" << chunkSizes[ic];
+                    std::cout << "   " << modeNames[imode] << "   writes/sec = " << w << "   scanned keys/sec = " << s << "\n";
+                }
+            }
+        }
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Chunk";
+    for (int imap = 0; imap < numMaps; imap++) {
+        for (int imode = 0; imode < numModes; imode++) {
+            for (unsigned it = 0; it < threadList.size(); it++) {
+                dataFile << "\t" << cNames[imap] << "-" << modeNames[imode] << "-" << threadList[it] << "W-writes";
+                dataFile << "\t" << cNames[imap] << "-" << modeNames[imode] << "-" << threadList[it] << "W-scan";
+            }
+        }
+    }
+    dataFile << "\n";
+    for (int ic = 0; ic < numChunks; ic++) {
+        dataFile << chunkSizes[ic];
+        for (int imap = 0; imap < numMaps; imap++) {
+            for (int imode = 0; imode < numModes; imode++) {
+                for (unsigned it = 0; it < threadList.size(); it++) {
+                    dataFile << "\t" << writeResults[imap][imode][it][ic] << "\t" << scanResults[imap][imode][it][ic];
+                }
+            }
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
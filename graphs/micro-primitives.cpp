@@ -0,0 +1,156 @@
+/*
+ * Executes the micro-benchmarks of the STM primitives
+ */
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include "common/CmdLineConfig.hpp"
+#include "BenchmarkPrimitives.hpp"
+// Macros suck, but we can't have multiple TMs at the same time (too much memory)
+// MAX_TX_WORDS is the largest number of loads or stores in a transaction that fits in the logs of the STM
+#if defined USE_TL2_ORIG
+#include "stms/TL2Orig.hpp"
+#define DATA_FILENAME "data/micro-primitives-tl2orig"
+#define MAX_TX_WORDS 100000
+#elif defined USE_TINY
+#include "stms/TinySTM.hpp"
+#define DATA_FILENAME "data/micro-primitives-tiny"
+#define MAX_TX_WORDS 100000
+#elif defined USE_2PL_UNDO
+#include "stms/2PLUndo.hpp"
+#define DATA_FILENAME "data/micro-primitives-2plundo"
+#define MAX_TX_WORDS 100000
+#elif defined USE_2PL_UNDO_DIST
+#include "stms/2PLUndoDist.hpp"
+#define DATA_FILENAME "data/micro-primitives-2plundodist"
+#define MAX_TX_WORDS 10000
+#elif defined USE_2PLSF
+#include "stms/2PLSF.hpp"
+#define DATA_FILENAME "data/micro-primitives-2plsf"
+#define MAX_TX_WORDS 100000
+#elif defined USE_OREC_EAGER
+#include "stms/zardoshti/orec_eager_wrap.hpp"
+#define DATA_FILENAME "data/micro-primitives-oreceager"
+#define MAX_TX_WORDS 100000
+#elif defined USE_OREC_LAZY
+#include "stms/zardoshti/orec_lazy_wrap.hpp"
+#define DATA_FILENAME "data/micro-primitives-oreclazy"
+#define MAX_TX_WORDS 100000
+#elif defined USE_TL2
+#include "stms/zardoshti/tl2_wrap.hpp"
+#define DATA_FILENAME "data/micro-primitives-tl2"
+#define MAX_TX_WORDS 100000
+#elif defined USE_TLRW_EAGER
+#include "stms/zardoshti/tlrw_eager_wrap.hpp"
+#define DATA_FILENAME "data/micro-primitives-tlrweager"
+#define MAX_TX_WORDS 100000
+#elif defined USE_OFWF
+#include "stms/OneFileWF.hpp"
+#define DATA_FILENAME "data/micro-primitives-ofwf"
+#define MAX_TX_WORDS 10000
+#endif
+
+
+//
+// Use like this:
+// # bin/micro-primitives-2plsf --duration=1 --threads=1,2,4
+// Each measure takes a tenth of the duration. The results are saved as tab-separated values in
+// data/micro-primitives-<stm>.txt and as JSON in data/micro-primitives-<stm>.json
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.duration = 1;
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    vector<int> threadList = cfg.threads;
+    const vector<uint64_t> sizes = { 1, 10, 100, 1000, 10000, 100000 };
+    const milliseconds testLength {cfg.duration*100};
+    vector<BenchmarkPrimitives::Result> results;
+    std::string cName;
+
+    std::cout << "\n----- Primitives (uncontended) -----\n";
+    {
+        BenchmarkPrimitives bench(1);
+#if defined USE_TL2_ORIG
+        cName = tl2orig::TL2::className();
+        bench.benchmarkUncontended<tl2orig::TL2,tl2orig::tmtype>                  (results, testLength, sizes, MAX_TX_WORDS);
+#elif defined USE_TINY
+        cName = tinystm::TinySTM::className();
+        bench.benchmarkUncontended<tinystm::TinySTM,tinystm::tmtype>              (results, testLength, sizes, MAX_TX_WORDS);
+#elif defined USE_2PL_UNDO
+        cName = twoplundo::STM::className();
+        bench.benchmarkUncontended<twoplundo::STM,twoplundo::tmtype>              (results, testLength, sizes, MAX_TX_WORDS);
+#elif defined USE_2PL_UNDO_DIST
+        cName = twoplundodist::STM::className();
+        bench.benchmarkUncontended<twoplundodist::STM,twoplundodist::tmtype>      (results, testLength, sizes, MAX_TX_WORDS);
+#elif defined USE_2PLSF
+        cName = twoplsf::STM::className();
+        bench.benchmarkUncontended<twoplsf::STM,twoplsf::tmtype>                  (results, testLength, sizes, MAX_TX_WORDS);
+#elif defined USE_OREC_EAGER
+        cName = orec_eager::STM::className();
+        bench.benchmarkUncontended<orec_eager::STM,orec_eager::tmtype>            (results, testLength, sizes, MAX_TX_WORDS);
+#elif defined USE_OREC_LAZY
+        cName = orec_lazy::STM::className();
+        bench.benchmarkUncontended<orec_lazy::STM,orec_lazy::tmtype>              (results, testLength, sizes, MAX_TX_WORDS);
+#elif defined USE_TL2
+        cName = tl2::STM::className();
+        bench.benchmarkUncontended<tl2::STM,tl2::tmtype>                          (results, testLength, sizes, MAX_TX_WORDS);
+#elif defined USE_TLRW_EAGER
+        cName = tlrw_eager::STM::className();
+        bench.benchmarkUncontended<tlrw_eager::STM,tlrw_eager::tmtype>            (results, testLength, sizes, MAX_TX_WORDS);
+#elif defined USE_OFWF
+        cName = ofwf::STM::className();
+        bench.benchmarkUncontended<ofwf::STM, ofwf::tmtype>                       (results, testLength, sizes, MAX_TX_WORDS);
+#else
+        printf("ERROR: forgot to set a define?\n");
+#endif
+    }
+
+    std::cout << "\n----- Small transactions (disjoint and contended) -----\n";
+    for (int it = 0; it < threadList.size(); it++) {
+        BenchmarkPrimitives bench(threadList[it]);
+#if defined USE_TL2_ORIG
+        bench.benchmarkContended<tl2orig::TL2,tl2orig::tmtype>                  (results, testLength);
+#elif defined USE_TINY
+        bench.benchmarkContended<tinystm::TinySTM,tinystm::tmtype>              (results, testLength);
+#elif defined USE_2PL_UNDO
+        bench.benchmarkContended<twoplundo::STM,twoplundo::tmtype>              (results, testLength);
+#elif defined USE_2PL_UNDO_DIST
+        bench.benchmarkContended<twoplundodist::STM,twoplundodist::tmtype>      (results, testLength);
+#elif defined USE_2PLSF
+        bench.benchmarkContended<twoplsf::STM,twoplsf::tmtype>                  (results, testLength);
+#elif defined USE_OREC_EAGER
+        bench.benchmarkContended<orec_eager::STM,orec_eager::tmtype>            (results, testLength);
+#elif defined USE_OREC_LAZY
+        bench.benchmarkContended<orec_lazy::STM,orec_lazy::tmtype>              (results, testLength);
+#elif defined USE_TL2
+        bench.benchmarkContended<tl2::STM,tl2::tmtype>                          (results, testLength);
+#elif defined USE_TLRW_EAGER
+        bench.benchmarkContended<tlrw_eager::STM,tlrw_eager::tmtype>            (results, testLength);
+#elif defined USE_OFWF
+        bench.benchmarkContended<ofwf::STM, ofwf::tmtype>                       (results, testLength);
+#endif
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel, and JSON for scripts
+    ofstream dataFile;
+    dataFile.open(dataFilename + ".txt");
+    dataFile << "Primitive\tSize\tThreads\t" << cName << "-cycles/tx\t" << cName << "-cycles/op\n";
+    for (auto& r : results) dataFile << r.primitive << "\t" << r.size << "\t" << r.threads << "\t" << (uint64_t)r.cyclesPerTx << "\t" << r.cyclesPerOp << "\n";
+    dataFile.close();
+    dataFile.open(dataFilename + ".json");
+    dataFile << "{\n  \"stm\": \"" << cName << "\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+        dataFile << "    {\"primitive\": \"" << r.primitive << "\", \"size\": " << r.size << ", \"threads\": " << r.threads;
+        dataFile << ", \"cyclesPerTx\": " << (uint64_t)r.cyclesPerTx << ", \"cyclesPerOp\": " << r.cyclesPerOp << "}" << (i+1 < results.size() ? ",\n" : "\n");
+    }
+    dataFile << "  ]\n}\n";
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << ".txt and " << dataFilename << ".json\n";
+
+    return 0;
+}
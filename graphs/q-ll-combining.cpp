@@ -0,0 +1,71 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/TMLinkedListQueue.hpp"
+// Only 2PLSF has flat-combining
+#include "stms/2PLSFCombining.hpp"
+#include "BenchmarkQueues.hpp"
+
+#define DATA_FILENAME "data/q-ll-combining-2plsf.txt"
+
+
+// A queue whose enqueue() and dequeue() call sites are flat-combined
+template<typename Q> class CombiningQueue {
+    Q                  queue {};
+    twoplsf::Combiner  fcEnqueue {};
+    twoplsf::Combiner  fcDequeue {};
+public:
+    static std::string className() { return Q::className() + "-FC"; }
+    template<typename T> bool enqueue(T* item) { return fcEnqueue.updateTx<bool>([&] () { return queue.enqueue(item); }); }
+    auto dequeue() { return fcDequeue.updateTx<decltype(queue.dequeue())>([&] () { return queue.dequeue(); }); }
+};
+
+
+//
+// Use like this:
+// # bin/q-ll-combining-2plsf --duration=2 --runs=1 --threads=1,2,4
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    vector<int> threadList = cfg.threads;
+    const seconds testLength {cfg.duration};                         // 20s for the paper
+    const int numRuns = cfg.runs;                                    // 5 runs for the paper
+    const int numModes = 2;                                          // regular and flat-combining
+    uint64_t results[threadList.size()][numModes];
+    std::string cNames[numModes];
+    // Reset results
+    std::memset(results, 0, sizeof(uint64_t)*threadList.size()*numModes);
+
+    using LLQueue = TMLinkedListQueue<void,twoplsf::STM,twoplsf::tmtype>;
+    std::cout << "This benchmark takes about " << (threadList.size()*numModes*numRuns*testLength.count()/(60*60.)) << " hours to complete\n";
+    for (int it = 0; it < threadList.size(); it++) {
+        int nThreads = threadList[it];
+        BenchmarkQueues bench(nThreads);
+        std::cout << "\n----- Queues (enqueue-dequeue pairs)   threads=" << nThreads << "   runs=" << numRuns << "   length=" << testLength.count() << "s -----\n";
+        results[it][0] = bench.enqDeq<LLQueue>                (cNames[0], testLength, numRuns);
+        results[it][1] = bench.enqDeq<CombiningQueue<LLQueue>>(cNames[1], testLength, numRuns);
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Threads\t";
+    // Printf class names for each column
+    for (int im = 0; im < numModes; im++) dataFile << cNames[im] << "\t";
+    dataFile << "\n";
+    for (int it = 0; it < threadList.size(); it++) {
+        dataFile << threadList[it] << "\t";
+        for (int im = 0; im < numModes; im++) dataFile << results[it][im] << "\t";
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
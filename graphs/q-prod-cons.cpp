@@ -0,0 +1,102 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/TMLinkedListQueue.hpp"
+#include "pdatastructures/TMRingQueue.hpp"
+#include "pdatastructures/TMShardedQueue.hpp"
+
+// Macros suck, but we can't have multiple TMs at the same time (too much memory)
+#if defined USE_TL2_ORIG
+#include "stms/TL2Orig.hpp"
+#define Q_TM            tl2orig::TL2
+#define Q_TMTYPE        tl2orig::tmtype
+#define DATA_FILENAME "data/q-prod-cons-tl2orig.txt"
+#elif defined USE_TINY
+#include "stms/TinySTM.hpp"
+#define Q_TM            tinystm::TinySTM
+#define Q_TMTYPE        tinystm::tmtype
+#define DATA_FILENAME "data/q-prod-cons-tiny.txt"
+#elif defined USE_2PLSF
+#include "stms/2PLSF.hpp"
+#define Q_TM            twoplsf::STM
+#define Q_TMTYPE        twoplsf::tmtype
+#define DATA_FILENAME "data/q-prod-cons-2plsf.txt"
+#elif defined USE_OREC_EAGER
+#include "stms/zardoshti/orec_eager_wrap.hpp"
+#define Q_TM            orec_eager::STM
+#define Q_TMTYPE        orec_eager::tmtype
+#define DATA_FILENAME "data/q-prod-cons-oreceager.txt"
+#elif defined USE_OREC_LAZY
+#include "stms/zardoshti/orec_lazy_wrap.hpp"
+#define Q_TM            orec_lazy::STM
+#define Q_TMTYPE        orec_lazy::tmtype
+#define DATA_FILENAME "data/q-prod-cons-oreclazy.txt"
+#elif defined USE_TLRW_EAGER
+#include "stms/zardoshti/tlrw_eager_wrap.hpp"
+#define Q_TM            tlrw_eager::STM
+#define Q_TMTYPE        tlrw_eager::tmtype
+#define DATA_FILENAME "data/q-prod-cons-tlrweager.txt"
+#endif
+
+#include "BenchmarkQueues.hpp"
+
+static const int numQueues = 3;
+static const int numBatches = 3;
+static const uint64_t batchSizes[numBatches] = { 1, 8, 64 };
+
+
+//
+// Use like this:
+// # bin/q-prod-cons-2plsf --duration=2 --runs=1 --threads=1,2,4
+// The number of threads is the number of producers, and there are as many consumers.
+// TMLinkedListQueue has no batch operations and does one transaction per item for all batch sizes.
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    vector<int> threadList = cfg.threads;
+    const seconds testLength {cfg.duration};
+    const int numRuns = cfg.runs;
+    uint64_t results[threadList.size()][numQueues][numBatches];
+    std::string cNames[numQueues];
+
+    using LLQueue = TMLinkedListQueue<void,Q_TM,Q_TMTYPE>;
+    using RingQueue = TMRingQueue<void,Q_TM,Q_TMTYPE>;
+    using ShardedQueue = TMShardedQueue<void,Q_TM,Q_TMTYPE>;
+    std::cout << "This benchmark takes about " << (threadList.size()*numQueues*numBatches*numRuns*testLength.count()/60.) << " minutes to complete\n";
+    for (unsigned it = 0; it < threadList.size(); it++) {
+        int nThreads = threadList[it];
+        BenchmarkQueues bench(nThreads);
+        std::cout << "\n----- Queues (producer-consumer)   producers=" << nThreads << "   consumers=" << nThreads << "   runs=" << numRuns << "   length=" << testLength.count() << "s -----\n";
+        for (int ib = 0; ib < numBatches; ib++) {
+            results[it][0][ib] = bench.prodCons<LLQueue>     (cNames[0], testLength, numRuns, batchSizes[ib]);
+            results[it][1][ib] = bench.prodCons<RingQueue>   (cNames[1], testLength, numRuns, batchSizes[ib]);
+            results[it][2][ib] = bench.prodCons<ShardedQueue>(cNames[2], testLength, numRuns, batchSizes[ib]);
+        }
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Threads";
+    for (int iq = 0; iq < numQueues; iq++) {
+        for (int ib = 0; ib < numBatches; ib++) dataFile << "\t" << cNames[iq] << "-" << batchSizes[ib];
+    }
+    dataFile << "\n";
+    for (unsigned it = 0; it < threadList.size(); it++) {
+        dataFile << threadList[it];
+        for (int iq = 0; iq < numQueues; iq++) {
+            for (int ib = 0; ib < numBatches; ib++) dataFile << "\t" << results[it][iq][ib];
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/TMRAVLSet.hpp"
+#include "pdatastructures/TMBTree.hpp"
+#include "pdatastructures/TMARTSet.hpp"
+
+// Macros suck, but we can't have multiple TMs at the same time (too much memory)
+#if defined USE_TL2_ORIG
+#include "stms/TL2Orig.hpp"
+#define ART_TM          tl2orig::TL2
+#define ART_TMTYPE      tl2orig::tmtype
+#define DATA_FILENAME "data/set-art-tl2orig.txt"
+#elif defined USE_TINY
+#include "stms/TinySTM.hpp"
+#define ART_TM          tinystm::TinySTM
+#define ART_TMTYPE      tinystm::tmtype
+#define DATA_FILENAME "data/set-art-tiny.txt"
+#elif defined USE_2PLSF
+#include "stms/2PLSF.hpp"
+#define ART_TM          twoplsf::STM
+#define ART_TMTYPE      twoplsf::tmtype
+#define DATA_FILENAME "data/set-art-2plsf.txt"
+#elif defined USE_OREC_EAGER
+#include "stms/zardoshti/orec_eager_wrap.hpp"
+#define ART_TM          orec_eager::STM
+#define ART_TMTYPE      orec_eager::tmtype
+#define DATA_FILENAME "data/set-art-oreceager.txt"
+#elif defined USE_OREC_LAZY
+#include "stms/zardoshti/orec_lazy_wrap.hpp"
+#define ART_TM          orec_lazy::STM
+#define ART_TMTYPE      orec_lazy::tmtype
+#define DATA_FILENAME "data/set-art-oreclazy.txt"
+#elif defined USE_TLRW_EAGER
+#include "stms/zardoshti/tlrw_eager_wrap.hpp"
+#define ART_TM          tlrw_eager::STM
+#define ART_TMTYPE      tlrw_eager::tmtype
+#define DATA_FILENAME "data/set-art-tlrweager.txt"
+#endif
+
+using namespace std;
+using namespace chrono;
+
+static const int numSets = 3;
+static const int numSizes = 2;
+
+
+// An imprecise but fast random number generator
+static uint64_t randomLong(uint64_t x) {
+    x ^= x >> 12; // a
+    x ^= x << 25; // b
+    x ^= x >> 27; // c
+    return x * 2685821657736338717LL;
+}
+
+
+/*
+ * Fills the set with numKeys random 64 bit keys, then for each ratio and number of threads, each thread picks
+ * one of the keys and either, with a probability of updateRatio, removes it and adds it back, or looks it up.
+ * The set is filled only once because with 10M keys it takes longer than the runs.
+ * Places the number of operations per second of each run in results[ratio][threads].
+ */
+template<typename S>
+void art(std::string& className, const vector<int>& threadList, const vector<int>& ratioList, const seconds testLength,
+         const uint64_t numKeys, vector<vector<uint64_t>>& results) {
+    className = S::className();
+    S* set = ART_TM::template updateTx<S*>([] () { return ART_TM::template tmNew<S>(); });
+    vector<uint64_t> keys(numKeys);
+    uint64_t seed = 1234567890123ULL;
+    for (uint64_t i = 0; i < numKeys; i++) {
+        seed = randomLong(seed);
+        keys[i] = seed;
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    set->bulkLoad(keys.data(), keys.size());
+    const uint64_t numUnique = keys.size();
+    for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+        for (unsigned it = 0; it < threadList.size(); it++) {
+            const int numThreads = threadList[it];
+            const int updateRatio = ratioList[ir];
+            atomic<bool> quit = { false };
+            atomic<bool> startFlag = { false };
+            vector<uint64_t> ops(numThreads);
+            auto func = [&] (const int tid) {
+                uint64_t numOps = 0;
+                uint64_t seed = (tid+1)+12345678901234567ULL;
+                while (!startFlag.load()) ; // spin
+                while (!quit.load()) {
+                    seed = randomLong(seed);
+                    const bool update = (int)(seed%1000) < updateRatio;
+                    seed = randomLong(seed);
+                    const uint64_t key = keys[seed%numUnique];
+                    if (update) {
+                        set->remove(key);
+                        set->add(key);
+                        numOps += 2;
+                    } else {
+                        set->contains(key);
+                        numOps++;
+                    }
+                }
+                ops[tid] = numOps;
+            };
+            vector<thread> threads;
+            for (int tid = 0; tid < numThreads; tid++) threads.push_back(thread(func, tid));
+            this_thread::sleep_for(100ms);
+            auto startBeats = steady_clock::now();
+            startFlag.store(true);
+            this_thread::sleep_for(testLength);
+            quit.store(true);
+            auto stopBeats = steady_clock::now();
+            for (int tid = 0; tid < numThreads; tid++) threads[tid].join();
+            uint64_t agg = 0;
+            for (int tid = 0; tid < numThreads; tid++) agg += ops[tid];
+            results[ir][it] = agg*1000000000ULL/(stopBeats-startBeats).count();
+            std::cout << className << "   keys=" << numKeys << "   ratio=" << updateRatio/10. << "%   threads=" << numThreads;
+            std::cout << "   ops/sec = " << results[ir][it] << "\n";
+        }
+    }
+    // Clear the set, one key per transaction, and then delete the instance
+    for (uint64_t i = 0; i < numUnique; i++) set->remove(keys[i]);
+    ART_TM::template updateTx<bool>([=] () {
+        ART_TM::tmDelete(set);
+        return true;
+    });
+}
+
+
+void benchmarkArt(const int iset, std::string& cName, const vector<int>& threadList, const vector<int>& ratioList,
+                  const seconds testLength, const uint64_t numKeys, vector<vector<uint64_t>>& results) {
+    switch (iset) {
+    case 0: return art<TMARTSet<uint64_t,ART_TM,ART_TMTYPE>>                                        (cName, threadList, ratioList, testLength, numKeys, results);
+    case 1: return art<TMRAVLSet<uint64_t,ART_TM,ART_TMTYPE>>                                       (cName, threadList, ratioList, testLength, numKeys, results);
+    case 2: return art<TMBTree<uint64_t,ART_TM,ART_TMTYPE>>                                         (cName, threadList, ratioList, testLength, numKeys, results);
+    }
+}
+
+
+//
+// Use like this:
+// # bin/set-art-2plsf --duration=2 --keys=1000000 --threads=1,4 --ratios=1000,100,0
+// Each set is filled with --keys and then with 10 times --keys random keys, and runs all the ratios and numbers of threads.
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.keys = 1000*1000;
+    cfg.threads = {1,4};
+    cfg.ratios = {1000,100,0};
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    const vector<int> threadList = cfg.threads;
+    const vector<int> ratioList = cfg.ratios;
+    const seconds testLength {cfg.duration};
+    const uint64_t setSizes[numSizes] = { cfg.keys, 10*cfg.keys };
+    vector<vector<uint64_t>> results[numSets][numSizes];
+    std::string cNames[numSets];
+
+    std::cout << "This benchmark takes about " << (numSets*numSizes*threadList.size()*ratioList.size()*testLength.count()/60.) << " minutes to complete, plus filling the sets\n";
+    for (int iset = 0; iset < numSets; iset++) {
+        for (int is = 0; is < numSizes; is++) {
+            results[iset][is].assign(ratioList.size(), vector<uint64_t>(threadList.size()));
+            benchmarkArt(iset, cNames[iset], threadList, ratioList, testLength, setSizes[is], results[iset][is]);
+        }
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Keys";
+    for (int iset = 0; iset < numSets; iset++) {
+        for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+            for (unsigned it = 0; it < threadList.size(); it++) {
+                dataFile << "\t" << cNames[iset] << "-" << ratioList[ir]/10. << "%-" << threadList[it] << "T";
+            }
+        }
+    }
+    dataFile << "\n";
+    for (int is = 0; is < numSizes; is++) {
+        dataFile << setSizes[is];
+        for (int iset = 0; iset < numSets; iset++) {
+            for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+                for (unsigned it = 0; it < threadList.size(); it++) {
+                    dataFile << "\t" << results[iset][is][ir][it];
+                }
+            }
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
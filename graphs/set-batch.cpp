@@ -0,0 +1,221 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/TMSkipList.hpp"
+#include "pdatastructures/TMRAVLSet.hpp"
+#include "pdatastructures/TMBPlusTree.hpp"
+
+// Macros suck, but we can't have multiple TMs at the same time (too much memory)
+#if defined USE_TL2_ORIG
+#include "stms/TL2Orig.hpp"
+#define BATCH_TM        tl2orig::TL2
+#define BATCH_TMTYPE    tl2orig::tmtype
+#define DATA_FILENAME "data/set-batch-tl2orig.txt"
+#elif defined USE_TINY
+#include "stms/TinySTM.hpp"
+#define BATCH_TM        tinystm::TinySTM
+#define BATCH_TMTYPE    tinystm::tmtype
+#define DATA_FILENAME "data/set-batch-tiny.txt"
+#elif defined USE_2PLSF
+#include "stms/2PLSF.hpp"
+#define BATCH_TM        twoplsf::STM
+#define BATCH_TMTYPE    twoplsf::tmtype
+#define DATA_FILENAME "data/set-batch-2plsf.txt"
+#elif defined USE_OREC_EAGER
+#include "stms/zardoshti/orec_eager_wrap.hpp"
+#define BATCH_TM        orec_eager::STM
+#define BATCH_TMTYPE    orec_eager::tmtype
+#define DATA_FILENAME "data/set-batch-oreceager.txt"
+#elif defined USE_OREC_LAZY
+#include "stms/zardoshti/orec_lazy_wrap.hpp"
+#define BATCH_TM        orec_lazy::STM
+#define BATCH_TMTYPE    orec_lazy::tmtype
+#define DATA_FILENAME "data/set-batch-oreclazy.txt"
+#elif defined USE_TLRW_EAGER
+#include "stms/zardoshti/tlrw_eager_wrap.hpp"
+#define BATCH_TM        tlrw_eager::STM
+#define BATCH_TMTYPE    tlrw_eager::tmtype
+#define DATA_FILENAME "data/set-batch-tlrweager.txt"
+#endif
+
+using namespace std;
+using namespace chrono;
+
+// The hash map isn't here because its destructor reads all the buckets in one transaction, which doesn't fit
+// in the read-set of 2PLSF with 1M keys
+static const int numSets = 3;
+static const int numBatches = 9;
+static const int numModes = 4;
+static const uint64_t batchSizes[numBatches] = { 1, 2, 4, 8, 16, 32, 64, 128, 256 };
+
+
+// An imprecise but fast random number generator
+static uint64_t randomLong(uint64_t x) {
+    x ^= x >> 12; // a
+    x ^= x << 25; // b
+    x ^= x >> 27; // c
+    return x * 2685821657736338717LL;
+}
+
+
+/*
+ * Each thread picks batchSize random keys and either looks them up or, with a probability of updateRatio,
+ * removes them and adds them back. When doBatch is set, each of these is one call to containsMany(),
+ * removeMany() or addMany(), otherwise it's one contains(), remove() or add() per key.
+ * The keys are picked from the whole set, or from a random range of 4*batchSize keys if clustered is set.
+ * Returns the number of keys per second, where an update counts as two keys.
+ */
+template<typename S>
+uint64_t batch(std::string& className, const int numThreads, const int updateRatio, const seconds testLength,
+               const uint64_t numKeys, const uint64_t batchSize, const bool doBatch, const bool clustered) {
+    className = S::className();
+    S* set = BATCH_TM::template updateTx<S*>([] () { return BATCH_TM::template tmNew<S>(); });
+    vector<uint64_t> keys(numKeys);
+    for (uint64_t i = 0; i < numKeys; i++) keys[i] = i;
+    set->bulkLoad(keys.data(), numKeys);
+    atomic<bool> quit = { false };
+    atomic<bool> startFlag = { false };
+    vector<uint64_t> ops(numThreads);
+    auto func = [&] (const int tid) {
+        uint64_t numOps = 0;
+        uint64_t seed = (tid+1)+12345678901234567ULL;
+        vector<uint64_t> bkeys(batchSize);
+        while (!startFlag.load()) ; // spin
+        while (!quit.load()) {
+            seed = randomLong(seed);
+            const bool update = (int)(seed%1000) < updateRatio;
+            seed = randomLong(seed);
+            const uint64_t base = seed % numKeys;
+            for (uint64_t i = 0; i < batchSize; i++) {
+                seed = randomLong(seed);
+                bkeys[i] = clustered ? (base + seed % (4*batchSize)) % numKeys : seed % numKeys;
+            }
+            if (update) {
+                if (doBatch) {
+                    set->removeMany(bkeys.data(), batchSize);
+                    set->addMany(bkeys.data(), batchSize);
+                } else {
+                    for (uint64_t i = 0; i < batchSize; i++) set->remove(bkeys[i]);
+                    for (uint64_t i = 0; i < batchSize; i++) set->add(bkeys[i]);
+                }
+                numOps += 2*batchSize;
+            } else {
+                if (doBatch) {
+                    set->containsMany(bkeys.data(), batchSize);
+                } else {
+                    for (uint64_t i = 0; i < batchSize; i++) set->contains(bkeys[i]);
+                }
+                numOps += batchSize;
+            }
+        }
+        ops[tid] = numOps;
+    };
+    vector<thread> threads;
+    for (int tid = 0; tid < numThreads; tid++) threads.push_back(thread(func, tid));
+    this_thread::sleep_for(100ms);
+    auto startBeats = steady_clock::now();
+    startFlag.store(true);
+    this_thread::sleep_for(testLength);
+    quit.store(true);
+    auto stopBeats = steady_clock::now();
+    for (int tid = 0; tid < numThreads; tid++) threads[tid].join();
+    // Clear the set, 256 keys per transaction, and then delete the instance
+    for (uint64_t i = 0; i < numKeys; i += 256) set->removeMany(keys.data()+i, std::min<uint64_t>(256, numKeys-i));
+    BATCH_TM::template updateTx<bool>([=] () {
+        BATCH_TM::tmDelete(set);
+        return true;
+    });
+    uint64_t agg = 0;
+    for (int tid = 0; tid < numThreads; tid++) agg += ops[tid];
+    return agg*1000000000ULL/(stopBeats-startBeats).count();
+}
+
+
+uint64_t benchmarkBatch(const int iset, std::string& cName, const int numThreads, const int ratio, const seconds testLength,
+                        const uint64_t numKeys, const uint64_t batchSize, const bool doBatch, const bool clustered) {
+    switch (iset) {
+    case 0: return batch<TMSkipList<uint64_t,BATCH_TM,BATCH_TMTYPE>>                                (cName, numThreads, ratio, testLength, numKeys, batchSize, doBatch, clustered);
+    case 1: return batch<TMRAVLSet<uint64_t,BATCH_TM,BATCH_TMTYPE>>                                 (cName, numThreads, ratio, testLength, numKeys, batchSize, doBatch, clustered);
+    case 2: return batch<TMBPlusTree<uint64_t,BATCH_TM,BATCH_TMTYPE>>                               (cName, numThreads, ratio, testLength, numKeys, batchSize, doBatch, clustered);
+    }
+    return 0;
+}
+
+
+//
+// Use like this:
+// # bin/set-batch-2plsf --keys=1000000 --duration=2 --threads=1,4 --ratios=100,0
+// For each batch size, the keys are done one transaction per key ("single") and then with the
+// batched methods in one transaction per batch ("batch"), first with keys from the whole set and then
+// with keys that are close to each other ("clustered").
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.keys = 1000*1000;
+    cfg.threads = {1,4};
+    cfg.ratios = {100,0};
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    const vector<int> threadList = cfg.threads;
+    const vector<int> ratioList = cfg.ratios;
+    const uint64_t numKeys = cfg.keys;
+    const seconds testLength {cfg.duration};
+    const char* modeNames[] = { "single", "batch", "single-clustered", "batch-clustered" };
+    uint64_t results[numSets][numModes][threadList.size()][ratioList.size()][numBatches];
+    std::string cNames[numSets];
+
+    std::cout << "This benchmark takes about " << (numSets*numModes*numBatches*threadList.size()*ratioList.size()*testLength.count()/60.) << " minutes to complete\n";
+    for (int iset = 0; iset < numSets; iset++) {
+        for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+            for (unsigned it = 0; it < threadList.size(); it++) {
+                for (int ib = 0; ib < numBatches; ib++) {
+                    for (int imode = 0; imode < numModes; imode++) {
+                        uint64_t& r = results[iset][imode][it][ir][ib];
+                        r = benchmarkBatch(iset, cNames[iset], threadList[it], ratioList[ir], testLength, numKeys, batchSizes[ib], imode%2 == 1, imode >= 2);
+                        std::cout << cNames[iset] << "   keys=" << numKeys << "   ratio=" << ratioList[ir]/10. << "%   threads=" << threadList[it];
+                        std::cout << "   batch=" << batchSizes[ib] << "   " << modeNames[imode] << "   keys/sec = " << r << "\n";
+                    }
+                }
+            }
+        }
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Batch";
+    for (int iset = 0; iset < numSets; iset++) {
+        for (int imode = 0; imode < numModes; imode++) {
+            for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+                for (unsigned it = 0; it < threadList.size(); it++) {
+                    dataFile << "\t" << cNames[iset] << "-" << modeNames[imode] << "-" << ratioList[ir]/10. << "%-" << threadList[it] << "T";
+                }
+            }
+        }
+    }
+    dataFile << "\n";
+    for (int ib = 0; ib < numBatches; ib++) {
+        dataFile << batchSizes[ib];
+        for (int iset = 0; iset < numSets; iset++) {
+            for (int imode = 0; imode < numModes; imode++) {
+                for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+                    for (unsigned it = 0; it < threadList.size(); it++) {
+                        dataFile << "\t" << results[iset][imode][it][ir][ib];
+                    }
+                }
+            }
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
@@ -74,84 +74,120 @@
 
 #include "BenchmarkSets.hpp"
 
+// With BTREE_FANOUT_SWEEP, the benchmark is done for each fanout and the results are saved in data/set-btree-fanout-1m-*.txt
+#ifdef BTREE_FANOUT_SWEEP
+static const int FANOUTS[] = { 8, 16, 32, 64, 128 };
+#else
+static const int FANOUTS[] = { 16 };
+#endif
 
-//
-// Use like this:
-// # bin/set-ravl-1m-blabla --keys=1000 --duration=2 --runs=1 --threads=1,2,4 --ratios=1000,100,0
-//
-int main(int argc, char* argv[]) {
-    CmdLineConfig cfg;
-    cfg.parseCmdLine(argc,argv);
-    cfg.print();
-
-    const std::string dataFilename { DATA_FILENAME };
-    // Use 96 for c5.24xlarge   { 1, 2, 3, 4, 8, 12, 14, 16/*, 24, 32, 36, 40, 48, 64, 80, 96, 128*/ }
-    vector<int> threadList = cfg.threads;
-    vector<int> ratioList = cfg.ratios;
-    const long numElements = cfg.keys;                               // Number of keys in the set
-    const seconds testLength {cfg.duration};                         // 20s for the paper
-    const int numRuns = cfg.runs;                                    // 5 runs for the paper
-    uint64_t results[threadList.size()][ratioList.size()];
-    std::string cName;
-    // Reset results
-    std::memset(results, 0, sizeof(uint64_t)*threadList.size()*ratioList.size());
 
-    // Sets benchmarks
-    std::cout << "This benchmark takes about " << (threadList.size()*ratioList.size()*numRuns*testLength.count()/(60*60.)) << " hours to complete\n";
-    std::cout << "\n----- Set Benchmark (B-Tree) -----\n";
-    for (unsigned ir = 0; ir < ratioList.size(); ir++) {
-        auto ratio = ratioList[ir];
-        for (int it = 0; it < threadList.size(); it++) {
-            int nThreads = threadList[it];
-            BenchmarkSets bench(nThreads);
-            std::cout << "\n----- Sets (B-Trees)   keys=" << numElements << "   ratio=" << ratio/10. << "%   threads=" << nThreads << "   runs=" << numRuns << "   length=" << testLength.count() << "s -----\n";
+// Runs the benchmark on a B-tree with nodes of FANOUT keys
+template<int FANOUT>
+uint64_t benchmarkBTree(BenchmarkSets& bench, std::string& cName, const int ratio, const seconds testLength, const int numRuns, const long numElements) {
 #if defined USE_TL2_ORIG
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,tl2orig::TL2,tl2orig::tmtype>, uint64_t, tl2orig::TL2>                  (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,tl2orig::TL2,tl2orig::tmtype,FANOUT>, uint64_t, tl2orig::TL2>                  (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_TL2LR
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,tl2lr::TL2LR,tl2lr::tmtype>, uint64_t, tl2lr::TL2LR>                    (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,tl2lr::TL2LR,tl2lr::tmtype,FANOUT>, uint64_t, tl2lr::TL2LR>                    (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_TL2_REDO
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,tl2redo::TL2,tl2redo::tmtype>, uint64_t, tl2redo::TL2>                  (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,tl2redo::TL2,tl2redo::tmtype,FANOUT>, uint64_t, tl2redo::TL2>                  (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_TL2_UNDO
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,tl2undo::TL2,tl2undo::tmtype>, uint64_t, tl2undo::TL2>                  (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,tl2undo::TL2,tl2undo::tmtype,FANOUT>, uint64_t, tl2undo::TL2>                  (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_2PL_UNDO
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,twoplundo::STM,twoplundo::tmtype>, uint64_t, twoplundo::STM>            (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,twoplundo::STM,twoplundo::tmtype,FANOUT>, uint64_t, twoplundo::STM>            (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_2PL_UNDO_DIST
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,twoplundodist::STM,twoplundodist::tmtype>, uint64_t, twoplundodist::STM>(cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,twoplundodist::STM,twoplundodist::tmtype,FANOUT>, uint64_t, twoplundodist::STM>(cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_2PLSF
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,twoplsf::STM,twoplsf::tmtype>, uint64_t, twoplsf::STM>(cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,twoplsf::STM,twoplsf::tmtype,FANOUT>, uint64_t, twoplsf::STM>(cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_DZ_TL2_SF
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,dztl2sf::STM,dztl2sf::tmtype>, uint64_t, dztl2sf::STM>                  (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,dztl2sf::STM,dztl2sf::tmtype,FANOUT>, uint64_t, dztl2sf::STM>                  (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_TL2
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,tl2::STM,tl2::tmtype>, uint64_t, tl2::STM>                              (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,tl2::STM,tl2::tmtype,FANOUT>, uint64_t, tl2::STM>                              (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_TLRW_EAGER
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,tlrw_eager::STM,tlrw_eager::tmtype>, uint64_t, tlrw_eager::STM>         (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,tlrw_eager::STM,tlrw_eager::tmtype,FANOUT>, uint64_t, tlrw_eager::STM>         (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_OREC_EAGER
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,orec_eager::STM,orec_eager::tmtype>, uint64_t, orec_eager::STM>         (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,orec_eager::STM,orec_eager::tmtype,FANOUT>, uint64_t, orec_eager::STM>         (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_OREC_LAZY
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,orec_lazy::STM,orec_lazy::tmtype>, uint64_t, orec_lazy::STM>            (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,orec_lazy::STM,orec_lazy::tmtype,FANOUT>, uint64_t, orec_lazy::STM>            (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_OFWF
-            results[it][ir] = bench.benchmark<TMBTree<uint64_t,ofwf::STM,ofwf::tmtype>, uint64_t, ofwf::STM>                                (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTree<uint64_t,ofwf::STM,ofwf::tmtype,FANOUT>, uint64_t, ofwf::STM>                                (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_FREEDAP
-            results[it][ir] = bench.benchmark<TMBTree<uint64_t,freedap::FreeDAP,freedap::tmtype>, uint64_t, freedap::FreeDAP>               (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTree<uint64_t,freedap::FreeDAP,freedap::tmtype,FANOUT>, uint64_t, freedap::FreeDAP>               (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_TINY
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,tinystm::TinySTM,tinystm::tmtype>, uint64_t, tinystm::TinySTM>          (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,tinystm::TinySTM,tinystm::tmtype,FANOUT>, uint64_t, tinystm::TinySTM>          (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_ROM_LR
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,romuluslr::RomulusLR,romuluslr::tmtype>, uint64_t, romuluslr::RomulusLR>(cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,romuluslr::RomulusLR,romuluslr::tmtype,FANOUT>, uint64_t, romuluslr::RomulusLR>(cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_OMEGA_L
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,omegal::STM,omegal::tmtype>, uint64_t, omegal::STM>                     (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,omegal::STM,omegal::tmtype,FANOUT>, uint64_t, omegal::STM>                     (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_LL_FREE
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,llfree::STM,llfree::tmtype>, uint64_t, llfree::STM>                     (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,llfree::STM,llfree::tmtype,FANOUT>, uint64_t, llfree::STM>                     (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_PRWLOCK
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,prwlockstm::STM,prwlockstm::tmtype>, uint64_t, prwlockstm::STM>         (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,prwlockstm::STM,prwlockstm::tmtype,FANOUT>, uint64_t, prwlockstm::STM>         (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_SIM_RWLOCK
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,simrwlock::STM,simrwlock::tmtype>, uint64_t, simrwlock::STM>            (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,simrwlock::STM,simrwlock::tmtype,FANOUT>, uint64_t, simrwlock::STM>            (cName, ratio, testLength, numRuns, numElements, false);
 #elif defined USE_SIM_RWLOCK_FC
-            results[it][ir] = bench.benchmark<TMBTreeByRef<uint64_t,simrwlockfc::STM,simrwlockfc::tmtype>, uint64_t, simrwlockfc::STM>      (cName, ratio, testLength, numRuns, numElements, false);
+    return bench.benchmark<TMBTreeByRef<uint64_t,simrwlockfc::STM,simrwlockfc::tmtype,FANOUT>, uint64_t, simrwlockfc::STM>      (cName, ratio, testLength, numRuns, numElements, false);
 #else
-            printf("ERROR: forgot to set a define?\n");
+    printf("ERROR: forgot to set a define?\n");
+    return 0;
+#endif
+}
+
+uint64_t benchmarkBTree(const int fanout, BenchmarkSets& bench, std::string& cName, const int ratio, const seconds testLength, const int numRuns, const long numElements) {
+    switch (fanout) {
+    case 16:  return benchmarkBTree<16> (bench, cName, ratio, testLength, numRuns, numElements);
+#ifdef BTREE_FANOUT_SWEEP
+    case 8:   return benchmarkBTree<8>  (bench, cName, ratio, testLength, numRuns, numElements);
+    case 32:  return benchmarkBTree<32> (bench, cName, ratio, testLength, numRuns, numElements);
+    case 64:  return benchmarkBTree<64> (bench, cName, ratio, testLength, numRuns, numElements);
+    case 128: return benchmarkBTree<128>(bench, cName, ratio, testLength, numRuns, numElements);
+#endif
+    }
+    printf("ERROR: fanout %d is not supported\n", fanout);
+    return 0;
+}
+
+//
+// Use like this:
+// # bin/set-ravl-1m-blabla --keys=1000 --duration=2 --runs=1 --threads=1,2,4 --ratios=1000,100,0
+// # bin/set-btree-fanout-1m-blabla --keys=1000000 --duration=2 --threads=1,4 --ratios=100,0
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    std::string dataFilename { DATA_FILENAME };
+#ifdef BTREE_FANOUT_SWEEP
+    dataFilename.insert(std::string("data/set-btree").size(), "-fanout");
 #endif
+    const int numFanouts = sizeof(FANOUTS)/sizeof(FANOUTS[0]);
+    // Use 96 for c5.24xlarge   { 1, 2, 3, 4, 8, 12, 14, 16/*, 24, 32, 36, 40, 48, 64, 80, 96, 128*/ }
+    vector<int> threadList = cfg.threads;
+    vector<int> ratioList = cfg.ratios;
+    const long numElements = cfg.keys;                               // Number of keys in the set
+    const seconds testLength {cfg.duration};                         // 20s for the paper
+    const int numRuns = cfg.runs;                                    // 5 runs for the paper
+    uint64_t results[numFanouts][threadList.size()][ratioList.size()];
+    std::string cNames[numFanouts];
+    // Reset results
+    std::memset(results, 0, sizeof(uint64_t)*numFanouts*threadList.size()*ratioList.size());
+
+    // Sets benchmarks
+    std::cout << "This benchmark takes about " << (numFanouts*threadList.size()*ratioList.size()*numRuns*testLength.count()/(60*60.)) << " hours to complete\n";
+    std::cout << "\n----- Set Benchmark (B-Tree) -----\n";
+    for (int ifa = 0; ifa < numFanouts; ifa++) {
+        const int fanout = FANOUTS[ifa];
+        for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+            auto ratio = ratioList[ir];
+            for (int it = 0; it < threadList.size(); it++) {
+                int nThreads = threadList[it];
+                BenchmarkSets bench(nThreads);
+                std::cout << "\n----- Sets (B-Trees)   keys=" << numElements << "   fanout=" << fanout << "   ratio=" << ratio/10. << "%   threads=" << nThreads << "   runs=" << numRuns << "   length=" << testLength.count() << "s -----\n";
+                results[ifa][it][ir] = benchmarkBTree(fanout, bench, cNames[ifa], ratio, testLength, numRuns, numElements);
+            }
+            std::cout << "\n";
         }
-        std::cout << "\n";
     }
 
     // Export tab-separated values to a file to be imported in gnuplot or excel
@@ -159,15 +195,19 @@ int main(int argc, char* argv[]) {
     dataFile.open(dataFilename);
     dataFile << "Threads\t";
     // Printf class names and ratios for each column
-    for (unsigned ir = 0; ir < ratioList.size(); ir++) {
-        auto ratio = ratioList[ir];
-        dataFile << cName << "-" << ratio/10. << "%"<< "\t";
+    for (int ifa = 0; ifa < numFanouts; ifa++) {
+        for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+            auto ratio = ratioList[ir];
+            dataFile << cNames[ifa] << "-" << ratio/10. << "%"<< "\t";
+        }
     }
     dataFile << "\n";
     for (int it = 0; it < threadList.size(); it++) {
         dataFile << threadList[it] << "\t";
-        for (unsigned ir = 0; ir < ratioList.size(); ir++) {
-            dataFile << results[it][ir] << "\t";
+        for (int ifa = 0; ifa < numFanouts; ifa++) {
+            for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+                dataFile << results[ifa][it][ir] << "\t";
+            }
         }
         dataFile << "\n";
     }
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/TMHashMap.hpp"
+
+// This benchmark compares the resizable hash map with a regular size counter against the same
+// hash map with a counter that has escrow updates (tmcounter). Only 2PLSF has tmcounter.
+#if defined USE_2PLSF
+#include "stms/2PLSF.hpp"
+#define DATA_FILENAME "data/set-hash-resizable-2plsf.txt"
+#endif
+
+#include "BenchmarkSets.hpp"
+
+
+//
+// Use like this:
+// # bin/set-hash-resizable-2plsf --keys=100000 --duration=2 --runs=1 --threads=1,2,4 --ratios=1000,100,0
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    uint64_t rqSize = cfg.rqsize;
+    std::string dataFilename { DATA_FILENAME };
+    vector<int> threadList = cfg.threads;
+    vector<int> ratioList = cfg.ratios;
+    const long numElements = cfg.keys;                               // Number of keys in the set
+    const seconds testLength {cfg.duration};                         // 20s for the paper
+    const int numRuns = cfg.runs;                                    // 5 runs for the paper
+    const bool doDedicated = false;
+    const int numCounters = 2;                                       // tmtype and tmcounter
+    uint64_t results[threadList.size()][ratioList.size()][numCounters];
+    std::string cName;
+    // Reset results
+    std::memset(results, 0, sizeof(uint64_t)*threadList.size()*ratioList.size()*numCounters);
+
+    // Sets benchmarks
+    std::cout << "This benchmark takes about " << (threadList.size()*ratioList.size()*numRuns*numCounters*testLength.count()/(60*60.)) << " hours to complete\n";
+    std::cout << "\n----- Set Benchmark (Resizable HashSet) -----\n";
+    for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+        auto ratio = ratioList[ir];
+        for (int it = 0; it < threadList.size(); it++) {
+            int nThreads = threadList[it];
+            BenchmarkSets bench(nThreads);
+            std::cout << "\n----- Sets (HashSet)   keys=" << numElements << "   ratio=" << ratio/10. << "%   threads=" << nThreads << "   runs=" << numRuns << "   length=" << testLength.count() << "s -----\n";
+#if defined USE_2PLSF
+            std::cout << "size with tmtype:\n";
+            results[it][ir][0] = bench.benchmark<TMHashMap<uint64_t,uint64_t,twoplsf::STM,twoplsf::tmtype>, uint64_t, twoplsf::STM>                        (cName, ratio, testLength, numRuns, numElements, doDedicated, rqSize);
+            std::cout << "size with tmcounter:\n";
+            results[it][ir][1] = bench.benchmark<TMHashMap<uint64_t,uint64_t,twoplsf::STM,twoplsf::tmtype,twoplsf::tmcounter>, uint64_t, twoplsf::STM>  (cName, ratio, testLength, numRuns, numElements, doDedicated, rqSize);
+#else
+            printf("ERROR: forgot to set a define?\n");
+#endif
+        }
+        std::cout << "\n";
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    const char* counterNames[numCounters] = { "tmtype", "tmcounter" };
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Threads\t";
+    // Printf class names, counter types and ratios for each column
+    for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+        auto ratio = ratioList[ir];
+        for (int ic = 0; ic < numCounters; ic++) dataFile << cName << "-" << counterNames[ic] << "-" << ratio/10. << "%"<< "\t";
+    }
+    dataFile << "\n";
+    for (int it = 0; it < threadList.size(); it++) {
+        dataFile << threadList[it] << "\t";
+        for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+            for (int ic = 0; ic < numCounters; ic++) dataFile << results[it][ir][ic] << "\t";
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/TMHashMap.hpp"
+#include "pdatastructures/TMHashMapFixedSize.hpp"
+#include "pdatastructures/TMSwissHashMap.hpp"
+
+// Macros suck, but we can't have multiple TMs at the same time (too much memory)
+#if defined USE_TL2_ORIG
+#include "stms/TL2Orig.hpp"
+#define HASH_TM        tl2orig::TL2
+#define HASH_TMTYPE    tl2orig::tmtype
+#define HASH_TMCOUNTER tl2orig::tmtype
+#define DATA_FILENAME "data/set-hash-tl2orig.txt"
+#elif defined USE_TINY
+#include "stms/TinySTM.hpp"
+#define HASH_TM        tinystm::TinySTM
+#define HASH_TMTYPE    tinystm::tmtype
+#define HASH_TMCOUNTER tinystm::tmtype
+#define DATA_FILENAME "data/set-hash-tiny.txt"
+#elif defined USE_2PLSF
+#include "stms/2PLSF.hpp"
+#define HASH_TM        twoplsf::STM
+#define HASH_TMTYPE    twoplsf::tmtype
+#define HASH_TMCOUNTER twoplsf::tmcounter
+#define DATA_FILENAME "data/set-hash-2plsf.txt"
+#elif defined USE_2PL_UNDO
+#include "stms/2PLUndo.hpp"
+#define HASH_TM        twoplundo::STM
+#define HASH_TMTYPE    twoplundo::tmtype
+#define HASH_TMCOUNTER twoplundo::tmtype
+#define DATA_FILENAME "data/set-hash-2plundo.txt"
+#elif defined USE_OFWF
+#include "stms/OneFileWF.hpp"
+#define HASH_TM        ofwf::STM
+#define HASH_TMTYPE    ofwf::tmtype
+#define HASH_TMCOUNTER ofwf::tmtype
+#define DATA_FILENAME "data/set-hash-ofwf.txt"
+#elif defined USE_OREC_EAGER
+#include "stms/zardoshti/orec_eager_wrap.hpp"
+#define HASH_TM        orec_eager::STM
+#define HASH_TMTYPE    orec_eager::tmtype
+#define HASH_TMCOUNTER orec_eager::tmtype
+#define DATA_FILENAME "data/set-hash-oreceager.txt"
+#elif defined USE_OREC_LAZY
+#include "stms/zardoshti/orec_lazy_wrap.hpp"
+#define HASH_TM        orec_lazy::STM
+#define HASH_TMTYPE    orec_lazy::tmtype
+#define HASH_TMCOUNTER orec_lazy::tmtype
+#define DATA_FILENAME "data/set-hash-oreclazy.txt"
+#elif defined USE_TLRW_EAGER
+#include "stms/zardoshti/tlrw_eager_wrap.hpp"
+#define HASH_TM        tlrw_eager::STM
+#define HASH_TMTYPE    tlrw_eager::tmtype
+#define HASH_TMCOUNTER tlrw_eager::tmtype
+#define DATA_FILENAME "data/set-hash-tlrweager.txt"
+#endif
+
+#include "BenchmarkSets.hpp"
+
+// The chained hash maps (fixed size with 10k buckets, and resizable) and the open addressing hash map.
+// Only 2PLSF has tmcounter, the other TMs use tmtype for the size of the resizable maps.
+static const int numMaps = 3;
+
+
+uint64_t benchmarkHash(const int imap, BenchmarkSets& bench, std::string& cName, const int ratio, const seconds testLength, const int numRuns, const long numElements) {
+    switch (imap) {
+    case 0: return bench.benchmark<TMHashMapFixedSize<uint64_t,uint64_t,HASH_TM,HASH_TMTYPE>, uint64_t, HASH_TM>               (cName, ratio, testLength, numRuns, numElements, false);
+    case 1: return bench.benchmark<TMHashMap<uint64_t,uint64_t,HASH_TM,HASH_TMTYPE,HASH_TMCOUNTER>, uint64_t, HASH_TM>         (cName, ratio, testLength, numRuns, numElements, false);
+    case 2: return bench.benchmark<TMSwissHashMap<uint64_t,uint64_t,HASH_TM,HASH_TMTYPE,HASH_TMCOUNTER>, uint64_t, HASH_TM>    (cName, ratio, testLength, numRuns, numElements, false);
+    }
+    return 0;
+}
+
+
+//
+// Use like this:
+// # bin/set-hash-blabla --keys=10000 --duration=2 --runs=1 --threads=1,2,4 --ratios=1000,100,0
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    std::string dataFilename { DATA_FILENAME };
+    vector<int> threadList = cfg.threads;
+    vector<int> ratioList = cfg.ratios;
+    const long numElements = cfg.keys;                               // Number of keys in the set
+    const seconds testLength {cfg.duration};                         // 20s for the paper
+    const int numRuns = cfg.runs;                                    // 5 runs for the paper
+    uint64_t results[numMaps][threadList.size()][ratioList.size()];
+    std::string cNames[numMaps];
+    // Reset results
+    std::memset(results, 0, sizeof(uint64_t)*numMaps*threadList.size()*ratioList.size());
+
+    // Sets benchmarks
+    std::cout << "This benchmark takes about " << (numMaps*threadList.size()*ratioList.size()*numRuns*testLength.count()/(60*60.)) << " hours to complete\n";
+    std::cout << "\n----- Set Benchmark (HashSets) -----\n";
+    for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+        auto ratio = ratioList[ir];
+        for (int it = 0; it < threadList.size(); it++) {
+            int nThreads = threadList[it];
+            BenchmarkSets bench(nThreads);
+            std::cout << "\n----- Sets (HashSets)   keys=" << numElements << "   ratio=" << ratio/10. << "%   threads=" << nThreads << "   runs=" << numRuns << "   length=" << testLength.count() << "s -----\n";
+            for (int imap = 0; imap < numMaps; imap++) {
+                results[imap][it][ir] = benchmarkHash(imap, bench, cNames[imap], ratio, testLength, numRuns, numElements);
+            }
+        }
+        std::cout << "\n";
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Threads\t";
+    // Printf class names and ratios for each column
+    for (int imap = 0; imap < numMaps; imap++) {
+        for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+            auto ratio = ratioList[ir];
+            dataFile << cNames[imap] << "-" << ratio/10. << "%"<< "\t";
+        }
+    }
+    dataFile << "\n";
+    for (int it = 0; it < threadList.size(); it++) {
+        dataFile << threadList[it] << "\t";
+        for (int imap = 0; imap < numMaps; imap++) {
+            for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+                dataFile << results[imap][it][ir] << "\t";
+            }
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
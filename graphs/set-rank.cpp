@@ -0,0 +1,209 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <chrono>
+
+#include "common/CmdLineConfig.hpp"
+#include "pdatastructures/TMRAVLSet.hpp"
+#include "pdatastructures/TMRAVLRankSet.hpp"
+
+// Macros suck, but we can't have multiple TMs at the same time (too much memory)
+#if defined USE_TL2_ORIG
+#include "stms/TL2Orig.hpp"
+#define RANK_TM         tl2orig::TL2
+#define RANK_TMTYPE     tl2orig::tmtype
+#define RANK_TMCOUNTER  tl2orig::tmtype
+#define DATA_FILENAME "data/set-rank-tl2orig.txt"
+#elif defined USE_TINY
+#include "stms/TinySTM.hpp"
+#define RANK_TM         tinystm::TinySTM
+#define RANK_TMTYPE     tinystm::tmtype
+#define RANK_TMCOUNTER  tinystm::tmtype
+#define DATA_FILENAME "data/set-rank-tiny.txt"
+#elif defined USE_2PLSF
+#include "stms/2PLSF.hpp"
+#define RANK_TM         twoplsf::STM
+#define RANK_TMTYPE     twoplsf::tmtype
+#define RANK_TMCOUNTER  twoplsf::tmcounter
+#define DATA_FILENAME "data/set-rank-2plsf.txt"
+#elif defined USE_OREC_EAGER
+#include "stms/zardoshti/orec_eager_wrap.hpp"
+#define RANK_TM         orec_eager::STM
+#define RANK_TMTYPE     orec_eager::tmtype
+#define RANK_TMCOUNTER  orec_eager::tmtype
+#define DATA_FILENAME "data/set-rank-oreceager.txt"
+#elif defined USE_OREC_LAZY
+#include "stms/zardoshti/orec_lazy_wrap.hpp"
+#define RANK_TM         orec_lazy::STM
+#define RANK_TMTYPE     orec_lazy::tmtype
+#define RANK_TMCOUNTER  orec_lazy::tmtype
+#define DATA_FILENAME "data/set-rank-oreclazy.txt"
+#elif defined USE_TLRW_EAGER
+#include "stms/zardoshti/tlrw_eager_wrap.hpp"
+#define RANK_TM         tlrw_eager::STM
+#define RANK_TMTYPE     tlrw_eager::tmtype
+#define RANK_TMCOUNTER  tlrw_eager::tmtype
+#define DATA_FILENAME "data/set-rank-tlrweager.txt"
+#endif
+
+using namespace std;
+using namespace chrono;
+
+static const int numSets = 3;
+static const int numRanges = 4;
+static const uint64_t rangeSizes[numRanges] = { 10, 100, 1000, 10000 };
+
+
+// An imprecise but fast random number generator
+static uint64_t randomLong(uint64_t x) {
+    x ^= x >> 12; // a
+    x ^= x << 25; // b
+    x ^= x >> 27; // c
+    return x * 2685821657736338717LL;
+}
+
+
+// TMRAVLSet has no order statistics, it counts the keys with a range query
+template<typename S> static uint64_t countKeys(S* set, uint64_t lo, uint64_t hi, uint64_t* buffer, long) {
+    return set->rangeQuery(lo, hi, buffer);
+}
+
+template<typename S> static auto countKeys(S* set, uint64_t lo, uint64_t hi, uint64_t* buffer, int) -> decltype(set->countRange(lo, hi)) {
+    return set->countRange(lo, hi);
+}
+
+
+/*
+ * Each thread picks a random key and either, with a probability of updateRatio, removes it and adds it back,
+ * or counts the keys in [key,key+rangeSize). Half of the even keys up to 2*numKeys are in the set.
+ * Returns the number of operations per second.
+ */
+template<typename S>
+uint64_t rankCount(std::string& className, const int numThreads, const int updateRatio, const seconds testLength,
+                   const uint64_t numKeys, const uint64_t rangeSize) {
+    className = S::className();
+    S* set = RANK_TM::template updateTx<S*>([] () { return RANK_TM::template tmNew<S>(); });
+    vector<uint64_t> keys(numKeys);
+    for (uint64_t i = 0; i < numKeys; i++) keys[i] = 2*i;
+    set->bulkLoad(keys.data(), numKeys);
+    atomic<bool> quit = { false };
+    atomic<bool> startFlag = { false };
+    vector<uint64_t> ops(numThreads);
+    auto func = [&] (const int tid) {
+        uint64_t numOps = 0;
+        uint64_t seed = (tid+1)+12345678901234567ULL;
+        vector<uint64_t> buffer(rangeSize);
+        while (!startFlag.load()) ; // spin
+        while (!quit.load()) {
+            seed = randomLong(seed);
+            const bool update = (int)(seed%1000) < updateRatio;
+            seed = randomLong(seed);
+            const uint64_t key = 2*(seed%numKeys);
+            if (update) {
+                set->remove(key);
+                set->add(key);
+                numOps += 2;
+            } else {
+                countKeys(set, key, key+2*rangeSize, buffer.data(), 0);
+                numOps++;
+            }
+        }
+        ops[tid] = numOps;
+    };
+    vector<thread> threads;
+    for (int tid = 0; tid < numThreads; tid++) threads.push_back(thread(func, tid));
+    this_thread::sleep_for(100ms);
+    auto startBeats = steady_clock::now();
+    startFlag.store(true);
+    this_thread::sleep_for(testLength);
+    quit.store(true);
+    auto stopBeats = steady_clock::now();
+    for (int tid = 0; tid < numThreads; tid++) threads[tid].join();
+    // Clear the set, one key per transaction, and then delete the instance
+    for (uint64_t i = 0; i < numKeys; i++) set->remove(keys[i]);
+    RANK_TM::template updateTx<bool>([=] () {
+        RANK_TM::tmDelete(set);
+        return true;
+    });
+    uint64_t agg = 0;
+    for (int tid = 0; tid < numThreads; tid++) agg += ops[tid];
+    return agg*1000000000ULL/(stopBeats-startBeats).count();
+}
+
+
+uint64_t benchmarkRank(const int iset, std::string& cName, const int numThreads, const int ratio, const seconds testLength,
+                       const uint64_t numKeys, const uint64_t rangeSize) {
+    switch (iset) {
+    case 0: return rankCount<TMRAVLSet<uint64_t,RANK_TM,RANK_TMTYPE>>                                   (cName, numThreads, ratio, testLength, numKeys, rangeSize);
+    case 1: return rankCount<TMRAVLRankSet<uint64_t,RANK_TM,RANK_TMTYPE>>                               (cName, numThreads, ratio, testLength, numKeys, rangeSize);
+    case 2: return rankCount<TMRAVLRankSet<uint64_t,RANK_TM,RANK_TMTYPE,RANK_TMCOUNTER>>                (cName, numThreads, ratio, testLength, numKeys, rangeSize);
+    }
+    return 0;
+}
+
+
+//
+// Use like this:
+// # bin/set-rank-2plsf --keys=1000000 --duration=2 --threads=1,4 --ratios=1000,100,0
+// The third set has counters with commutative increments for the sizes of the subtrees, on the STMs that
+// have them (2PLSF), otherwise it's the same as the second.
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.keys = 1000*1000;
+    cfg.threads = {1,4};
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    const vector<int> threadList = cfg.threads;
+    const vector<int> ratioList = cfg.ratios;
+    const uint64_t numKeys = cfg.keys;
+    const seconds testLength {cfg.duration};
+    const char* setNames[] = { "scan", "rank", "rank-counter" };
+    uint64_t results[numSets][threadList.size()][ratioList.size()][numRanges];
+    std::string cNames[numSets];
+
+    std::cout << "This benchmark takes about " << (numSets*numRanges*threadList.size()*ratioList.size()*testLength.count()/60.) << " minutes to complete\n";
+    for (int iset = 0; iset < numSets; iset++) {
+        for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+            for (unsigned it = 0; it < threadList.size(); it++) {
+                for (int ig = 0; ig < numRanges; ig++) {
+                    uint64_t& r = results[iset][it][ir][ig];
+                    r = benchmarkRank(iset, cNames[iset], threadList[it], ratioList[ir], testLength, numKeys, rangeSizes[ig]);
+                    std::cout << cNames[iset] << "   keys=" << numKeys << "   ratio=" << ratioList[ir]/10. << "%   threads=" << threadList[it];
+                    std::cout << "   range=" << rangeSizes[ig] << "   " << setNames[iset] << "   ops/sec = " << r << "\n";
+                }
+            }
+        }
+    }
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Range";
+    for (int iset = 0; iset < numSets; iset++) {
+        for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+            for (unsigned it = 0; it < threadList.size(); it++) {
+                dataFile << "\t" << cNames[iset] << "-" << setNames[iset] << "-" << ratioList[ir]/10. << "%-" << threadList[it] << "T";
+            }
+        }
+    }
+    dataFile << "\n";
+    for (int ig = 0; ig < numRanges; ig++) {
+        dataFile << rangeSizes[ig];
+        for (int iset = 0; iset < numSets; iset++) {
+            for (unsigned ir = 0; ir < ratioList.size(); ir++) {
+                for (unsigned it = 0; it < threadList.size(); it++) {
+                    dataFile << "\t" << results[iset][it][ir][ig];
+                }
+            }
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
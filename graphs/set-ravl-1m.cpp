@@ -42,7 +42,11 @@
 #define DATA_FILENAME "data/set-ravl-1m-2plundodist.txt"
 #elif defined USE_2PLSF
 #include "stms/2PLSF.hpp"
+#ifdef TWOPLSF_OBJECT_LOCKS
+#define DATA_FILENAME "data/set-ravl-1m-2plsfobj.txt"
+#else
 #define DATA_FILENAME "data/set-ravl-1m-2plsf.txt"
+#endif
 #elif defined USE_DZ_TL2_SF
 #include "stms/DualZoneTL2SF.hpp"
 #define DATA_FILENAME "data/set-ravl-1m-dztl2sf.txt"
@@ -44,7 +44,13 @@
 #define DATA_FILENAME "data/set-tree-1m-2plundodist.txt"
 #elif defined USE_2PLSF
 #include "stms/2PLSF.hpp"
+#ifdef TWOPLSF_ASYMMETRIC_FENCE
+#define DATA_FILENAME "data/set-tree-1m-2plsfmb.txt"
+#elif defined TWOPLSF_HYBRID
+#define DATA_FILENAME "data/set-tree-1m-2plsfhy.txt"
+#else
 #define DATA_FILENAME "data/set-tree-1m-2plsf.txt"
+#endif
 #elif defined USE_DZ_TL2_SF
 #include "stms/DualZoneTL2SF.hpp"
 #define DATA_FILENAME "data/set-tree-1m-dztl2sf.txt"
@@ -0,0 +1,168 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "common/CmdLineConfig.hpp"
+// Only 2PLSF has domains
+#include "stms/2PLSF.hpp"
+#include "pdatastructures/TMRAVLSet.hpp"
+
+#define DATA_FILENAME "data/two-domains-2plsf.txt"
+
+using namespace std;
+using namespace chrono;
+
+using DomainSet = TMRAVLSet<uint64_t,twoplsf::STM,twoplsf::tmtype>;
+
+// Number of rw-locks of each of the two domains
+static const uint64_t DOMAIN_RWL = 1024*1024;
+
+twoplsf::STM domainA {DOMAIN_RWL};
+twoplsf::STM domainB {DOMAIN_RWL};
+
+
+// Half of the threads work on the first set and the other half on the second set. Each thread picks a random key
+// of its set and either, with a probability of updateRatio, removes it and adds it back, or looks it up.
+// The operations of set i run in transactions of domains[i], which the set joins. Returns the operations per second.
+uint64_t twoSets(DomainSet* sets[2], twoplsf::STM* domains[2], const int numThreads, const int updateRatio,
+                 const uint64_t numKeys, const seconds testLength) {
+    atomic<bool> quit = { false };
+    atomic<bool> startFlag = { false };
+    vector<uint64_t> ops(numThreads);
+    auto func = [&] (const int tid) {
+        DomainSet* set = sets[tid%2];
+        twoplsf::STM& domain = *domains[tid%2];
+        uint64_t numOps = 0;
+        uint64_t seed = (tid+1)*12345678901234567ULL;
+        while (!startFlag.load()) ; // spin
+        while (!quit.load()) {
+            seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+            const uint64_t key = (seed >> 16) % numKeys;
+            if ((int)((seed >> 48) % 1000) < updateRatio) {
+                twoplsf::updateTx(domain, [&] () {
+                    set->remove(key);
+                    set->add(key);
+                });
+                numOps += 2;
+            } else {
+                twoplsf::readTx(domain, [&] () { set->contains(key); });
+                numOps++;
+            }
+        }
+        ops[tid] = numOps;
+    };
+    vector<thread> threads;
+    for (int tid = 0; tid < numThreads; tid++) threads.push_back(thread(func, tid));
+    this_thread::sleep_for(100ms);
+    auto startBeats = steady_clock::now();
+    startFlag.store(true);
+    this_thread::sleep_for(testLength);
+    quit.store(true);
+    auto stopBeats = steady_clock::now();
+    for (int tid = 0; tid < numThreads; tid++) threads[tid].join();
+    uint64_t agg = 0;
+    for (int tid = 0; tid < numThreads; tid++) agg += ops[tid];
+    return agg*1000000000ULL/(stopBeats-startBeats).count();
+}
+
+
+// Number of keys in [0,numKeys) that are in the set, one transaction of the domain for all of them
+uint64_t countKeys(DomainSet* set, twoplsf::STM& domain, const uint64_t numKeys) {
+    return twoplsf::readTx<uint64_t>(domain, [&] () {
+        uint64_t count = 0;
+        for (uint64_t key = 0; key < numKeys; key++) if (set->contains(key)) count++;
+        return count;
+    });
+}
+
+
+//
+// Use like this:
+// # bin/two-domains-2plsf --keys=100000 --duration=2 --threads=2,4,8 --ratios=1000,100
+// Two sets with --keys keys each. In the first configuration both sets are in the default domain (gSTM),
+// in the second one each set is in its own domain.
+//
+int main(int argc, char* argv[]) {
+    CmdLineConfig cfg;
+    cfg.keys = 100*1000;
+    cfg.threads = {2,4,8};
+    cfg.ratios = {1000,100};
+    cfg.parseCmdLine(argc,argv);
+    cfg.print();
+
+    const std::string dataFilename { DATA_FILENAME };
+    const vector<int> threadList = cfg.threads;
+    const vector<int> ratioList = cfg.ratios;
+    const uint64_t numKeys = cfg.keys;
+    const seconds testLength {cfg.duration};
+    const int numConfigs = 2;
+    const char* configNames[numConfigs] = { "one-domain", "two-domains" };
+    twoplsf::STM* configDomains[numConfigs][2] = { { &twoplsf::gSTM, &twoplsf::gSTM }, { &domainA, &domainB } };
+    uint64_t results[numConfigs][ratioList.size()][threadList.size()];
+
+    for (int ic = 0; ic < numConfigs; ic++) {
+        twoplsf::STM** domains = configDomains[ic];
+        DomainSet* sets[2];
+        for (int i = 0; i < 2; i++) {
+            // The set is allocated and filled in transactions of its domain
+            sets[i] = twoplsf::updateTx<DomainSet*>(*domains[i], [] () { return twoplsf::tmNew<DomainSet>(); });
+            for (uint64_t key = 0; key < numKeys; key += 1000) {
+                twoplsf::updateTx(*domains[i], [&] () {
+                    for (uint64_t k = key; k < key + 1000 && k < numKeys; k++) sets[i]->add(k);
+                });
+            }
+        }
+        std::cout << "\n----- Two TMRAVLSets, " << configNames[ic] << "   keys=" << numKeys << "   length=" << testLength.count() << "s -----\n";
+        const uint64_t defaultCommits = twoplsf::gSTM.getNumCommits();
+        for (int ir = 0; ir < ratioList.size(); ir++) {
+            for (int it = 0; it < threadList.size(); it++) {
+                results[ic][ir][it] = twoSets(sets, domains, threadList[it], ratioList[ir], numKeys, testLength);
+                std::cout << "ratio=" << ratioList[ir]/10. << "%   threads=" << threadList[it] << "   ops/sec = " << results[ic][ir][it] << "\n";
+            }
+        }
+        // In the second configuration, none of the transactions of the sets may have run on the default domain
+        if (ic == 1 && twoplsf::gSTM.getNumCommits() != defaultCommits) {
+            std::cout << "ERROR: " << twoplsf::gSTM.getNumCommits()-defaultCommits << " transactions ran on the default domain\n";
+            return 1;
+        }
+        for (int i = 0; i < 2; i++) {
+            const uint64_t count = countKeys(sets[i], *domains[i], numKeys);
+            if (count != numKeys) {
+                std::cout << "ERROR: set " << i << " has " << count << " keys, expected " << numKeys << "\n";
+                return 1;
+            }
+            // Empty the set in batches before deleting it, a single transaction can't free all the nodes
+            for (uint64_t key = 0; key < numKeys; key += 1000) {
+                twoplsf::updateTx(*domains[i], [&] () {
+                    for (uint64_t k = key; k < key + 1000 && k < numKeys; k++) sets[i]->remove(k);
+                });
+            }
+            twoplsf::updateTx(*domains[i], [&] () { twoplsf::tmDelete(sets[i]); });
+        }
+    }
+    std::cout << "domainA: commits=" << domainA.getNumCommits() << "   aborts=" << domainA.getNumAborts() << "\n";
+    std::cout << "domainB: commits=" << domainB.getNumCommits() << "   aborts=" << domainB.getNumAborts() << "\n";
+
+    // Export tab-separated values to a file to be imported in gnuplot or excel
+    ofstream dataFile;
+    dataFile.open(dataFilename);
+    dataFile << "Threads";
+    for (int ic = 0; ic < numConfigs; ic++) {
+        for (int ir = 0; ir < ratioList.size(); ir++) dataFile << "\t" << configNames[ic] << "-" << ratioList[ir]/10. << "%";
+    }
+    dataFile << "\n";
+    for (int it = 0; it < threadList.size(); it++) {
+        dataFile << threadList[it];
+        for (int ic = 0; ic < numConfigs; ic++) {
+            for (int ir = 0; ir < ratioList.size(); ir++) dataFile << "\t" << results[ic][ir][it];
+        }
+        dataFile << "\n";
+    }
+    dataFile.close();
+    std::cout << "\nSuccessfuly saved results in " << dataFilename << "\n";
+
+    return 0;
+}
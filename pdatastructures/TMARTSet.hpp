@@ -0,0 +1,851 @@
+/*
+ * Copyright 2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#pragma once
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*
+ * Order preserving conversion of the keys of TMARTSet to strings of bytes: k1 < k2 if and only if the bytes
+ * of k1 are lexicographically lower than the bytes of k2. The bytes of a key are never a prefix of the bytes
+ * of another key, which means that the keys end in the leaves and never in the middle of the tree.
+ */
+template<typename K, typename Enable = void> struct ARTKey;
+
+// Integers are stored big-endian, with the sign bit flipped for the signed types
+template<typename K> struct ARTKey<K, typename std::enable_if<std::is_integral<K>::value>::type> {
+    static void encode(const K& key, std::string& bytes) {
+        uint64_t v = (uint64_t)key;
+        if (std::is_signed<K>::value) v ^= 1ULL << (8*sizeof(K)-1);
+        bytes.resize(sizeof(K));
+        for (size_t i = 0; i < sizeof(K); i++) bytes[i] = (char)(v >> (8*(sizeof(K)-1-i)));
+    }
+    static K decode(const uint8_t* bytes, const size_t len) {
+        uint64_t v = 0;
+        for (size_t i = 0; i < sizeof(K); i++) v = (v << 8) | bytes[i];
+        if (std::is_signed<K>::value) v ^= 1ULL << (8*sizeof(K)-1);
+        return (K)v;
+    }
+};
+
+// Byte strings may have any byte, so the zeros are escaped as 0x00 0xFF and the string ends with 0x00 0x00
+template<> struct ARTKey<std::string> {
+    static void encode(const std::string& key, std::string& bytes) {
+        bytes.clear();
+        for (const char c : key) {
+            bytes.push_back(c);
+            if (c == 0) bytes.push_back((char)0xFF);
+        }
+        bytes.push_back(0);
+        bytes.push_back(0);
+    }
+    static std::string decode(const uint8_t* bytes, const size_t len) {
+        std::string key;
+        for (size_t i = 0; i+2 < len; i++) {
+            key.push_back((char)bytes[i]);
+            if (bytes[i] == 0) i++;
+        }
+        return key;
+    }
+};
+
+
+/**
+ * <h1> An Adaptive Radix Tree set for usage with STMs </h1>
+ *
+ * Paper: "The Adaptive Radix Tree: ARTful Indexing for Main-Memory Databases", Leis, Kemper, Neumann, ICDE 2013
+ * The algorithms follow libart: https://github.com/armon/libart
+ *
+ * Each level of the tree consumes one byte of the key (see ARTKey). The inner nodes have room for 4, 16,
+ * 48 or 256 children and are replaced by the next larger (smaller) type when they are full (have few
+ * children left). The search for a byte reads one word of keys in a Node4, two words compared with SSE2
+ * in a Node16, one word of the index in a Node48 and nothing in a Node256, plus the child.
+ * A subtree with a single key is a leaf, and a chain of nodes with a single child is removed and its bytes
+ * become the prefix of the next node. The first PREFIX_BYTES bytes of the prefix are stored in the node and
+ * the others aren't checked on the way down (the leaf has the whole key), and are taken from the leftmost
+ * leaf of the node when an insertion or a range query needs them.
+ *
+ * With 1M random 64 bit keys, a lookup goes through 3 or 4 inner nodes and the leaf, each being one or two
+ * lock stripes, while a binary tree goes through about 20 nodes.
+ *
+ * The pointers to the children are tagged with the lowest bit when they are leaves.
+ * The leaves are allocated with tmMalloc() and have the length of the bytes of the key followed by the bytes.
+ */
+template<typename K, typename TM, template <typename> class TMTYPE>
+class TMARTSet : public TM::tmbase {
+
+private:
+    enum node_type_e : uint64_t {
+        NODE4,
+        NODE16,
+        NODE48,
+        NODE256
+    };
+
+    // Number of bytes of the prefix stored in each node
+    static const uint64_t PREFIX_BYTES = 8;
+
+    struct Leaf {
+        TMTYPE<uint64_t>  len;
+        TMTYPE<uint64_t>  words[1];   // The bytes of the key, in as many words as needed
+    };
+
+    struct Node : public TM::tmbase {
+        TMTYPE<uint64_t>  meta;       // Type in bits 0-7, number of children in bits 8-23, prefix length in bits 32-63
+        TMTYPE<uint64_t>  prefix;     // The first PREFIX_BYTES bytes of the prefix
+        Node(uint64_t meta, uint64_t prefix) : meta{meta}, prefix{prefix} { }
+    };
+
+    struct Node4 : public Node {
+        TMTYPE<uint64_t>  keys;       // In ascending order
+        TMTYPE<uintptr_t> children[4];
+        Node4(uint64_t meta, uint64_t prefix) : Node(meta, prefix) {
+            keys = 0;
+            for (int i = 0; i < 4; i++) children[i] = 0;
+        }
+    };
+
+    struct Node16 : public Node {
+        TMTYPE<uint64_t>  keys[2];    // In ascending order
+        TMTYPE<uintptr_t> children[16];
+        Node16(uint64_t meta, uint64_t prefix) : Node(meta, prefix) {
+            keys[0] = 0;
+            keys[1] = 0;
+            for (int i = 0; i < 16; i++) children[i] = 0;
+        }
+    };
+
+    struct Node48 : public Node {
+        TMTYPE<uint64_t>  index[32];  // For each byte, the position of the child plus one, or zero if there is none
+        TMTYPE<uintptr_t> children[48];
+        Node48(uint64_t meta, uint64_t prefix) : Node(meta, prefix) {
+            for (int i = 0; i < 32; i++) index[i] = 0;
+            for (int i = 0; i < 48; i++) children[i] = 0;
+        }
+    };
+
+    struct Node256 : public Node {
+        TMTYPE<uintptr_t> children[256];
+        Node256(uint64_t meta, uint64_t prefix) : Node(meta, prefix) {
+            for (int i = 0; i < 256; i++) children[i] = 0;
+        }
+    };
+
+    // The bytes of a key outside of the tree, with zeros up to a multiple of 8, to compare them with the leaves a word at a time
+    struct Bytes {
+        std::string buf;
+        uint64_t    len {0};
+        Bytes() { }
+        Bytes(const K& key) {
+            ARTKey<K>::encode(key, buf);
+            setLen(buf.size());
+        }
+        void setLen(uint64_t l) {
+            len = l;
+            buf.resize((len+7) & ~7ULL, 0);
+        }
+        inline uint8_t at(uint64_t i) const { return (uint8_t)buf[i]; }
+        inline uint64_t numWords() const { return (len+7)/8; }
+        inline uint64_t word(uint64_t i) const {
+            uint64_t w;
+            std::memcpy(&w, buf.data()+8*i, sizeof(w));
+            return w;
+        }
+        // The bytes [i,i+n) in the layout of the prefix of a node, up to PREFIX_BYTES
+        uint64_t prefix(uint64_t i, uint64_t n) const {
+            uint64_t w = 0;
+            for (uint64_t j = 0; j < n && j < PREFIX_BYTES && i+j < len; j++) w |= (uint64_t)at(i+j) << (8*j);
+            return w;
+        }
+    };
+
+    alignas(128) TMTYPE<uintptr_t> root {0};
+
+    // Maximum number of keys inserted by each transaction of bulkLoad()
+    static const uint64_t BULK_KEYS = 1024;
+
+public:
+    TMARTSet() {
+    }
+
+    ~TMARTSet() {
+        TM::template updateTx<bool>([=] () {
+            clear(root);
+            root = 0;
+            return true; // Needed for CX
+        });
+    }
+
+    static std::string className() { return TM::className() + "-ART"; }
+
+    /*
+     * Adds a key, returns false if the key is already in the set
+     */
+    bool add(const K& key, const int tid=0) {
+        const Bytes kb(key);
+        const Bytes* kbp = &kb;
+        return TM::template updateTx<bool>([=] () {
+            return insert(*kbp);
+        });
+    }
+
+    /*
+     * Removes a key, returns false if the key is not in the set
+     */
+    bool remove(const K& key, const int tid=0) {
+        const Bytes kb(key);
+        const Bytes* kbp = &kb;
+        return TM::template updateTx<bool>([=] () {
+            const Bytes& kb = *kbp;
+            uintptr_t p = root;
+            if (p == 0) return false;
+            if (isLeaf(p)) {
+                if (!leafMatches(toLeaf(p), kb)) return false;
+                root = 0;
+                TM::tmFree(toLeaf(p));
+                return true;
+            }
+            TMTYPE<uintptr_t>* ref = (TMTYPE<uintptr_t>*)&root;
+            uint64_t depth = 0;
+            while (true) {
+                Node* n = (Node*)p;
+                const uint64_t meta = n->meta;
+                const uint64_t plen = prefixLen(meta);
+                if (plen > 0) {
+                    if (matchPrefix(n->prefix, plen, kb, depth) != std::min(plen, PREFIX_BYTES)) return false;
+                    depth += plen;
+                }
+                if (depth >= kb.len) return false;
+                const uint8_t c = kb.at(depth);
+                TMTYPE<uintptr_t>* slot = findChild(n, meta, c);
+                if (slot == nullptr) return false;
+                const uintptr_t child = *slot;
+                if (isLeaf(child)) {
+                    if (!leafMatches(toLeaf(child), kb)) return false;
+                    removeChild(ref, n, meta, c, slot);
+                    TM::tmFree(toLeaf(child));
+                    return true;
+                }
+                ref = slot;
+                p = child;
+                depth++;
+            }
+        });
+    }
+
+    /*
+     * Returns true if the key is in the set
+     */
+    bool contains(const K& key, const int tid=0) {
+        const Bytes kb(key);
+        const Bytes* kbp = &kb;
+        return TM::template readTx<bool>([=] () {
+            const Bytes& kb = *kbp;
+            uintptr_t p = root;
+            uint64_t depth = 0;
+            while (p != 0) {
+                if (isLeaf(p)) return leafMatches(toLeaf(p), kb);
+                Node* n = (Node*)p;
+                const uint64_t meta = n->meta;
+                const uint64_t plen = prefixLen(meta);
+                if (plen > 0) {
+                    // The bytes of the prefix that aren't stored in the node are checked in the leaf
+                    if (matchPrefix(n->prefix, plen, kb, depth) != std::min(plen, PREFIX_BYTES)) return false;
+                    depth += plen;
+                }
+                if (depth >= kb.len) return false;
+                TMTYPE<uintptr_t>* slot = findChild(n, meta, kb.at(depth));
+                if (slot == nullptr) return false;
+                p = *slot;
+                depth++;
+            }
+            return false;
+        });
+    }
+
+    // Used only for benchmarks
+    bool addAll(K** keys, const int size, const int tid=0) {
+        for (int i = 0; i < size; i++) add(*keys[i]);
+        return true;
+    }
+
+    /*
+     * Fills the set with keys sorted in ascending order and without duplicates.
+     * The keys are split in numThreads contiguous ranges, and each thread inserts its range in transactions
+     * of BULK_KEYS keys, which go down the same path of the tree and touch the same few nodes.
+     */
+    void bulkLoad(const K* keys, uint64_t size, const int numThreads=1) {
+        auto func = [this,keys] (uint64_t first, uint64_t last) {
+            for (uint64_t i = first; i < last; i += BULK_KEYS) {
+                const uint64_t num = std::min(BULK_KEYS, last-i);
+                std::vector<Bytes> kbs(num);
+                for (uint64_t j = 0; j < num; j++) kbs[j] = Bytes(keys[i+j]);
+                const Bytes* kbp = kbs.data();
+                TM::template updateTx<bool>([=] () {
+                    for (uint64_t j = 0; j < num; j++) insert(kbp[j]);
+                    return true;
+                });
+            }
+        };
+        if (numThreads <= 1) {
+            func(0, size);
+            return;
+        }
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; t++) threads.push_back(std::thread(func, size*t/numThreads, size*(t+1)/numThreads));
+        for (auto& th : threads) th.join();
+    }
+
+    // Places the keys in [lo,hi) in resultKeys, in ascending order. Returns the number of keys
+    int rangeQuery(const K& lo, const K& hi, K* const resultKeys) {
+        const Bytes lob(lo);
+        const Bytes hib(hi);
+        const Bytes* lop = &lob;
+        const Bytes* hip = &hib;
+        return TM::template readTx<int>([=] () {
+            int numKeys = 0;
+            scan(root, 0, true, *lop, *hip, resultKeys, numKeys);
+            return numKeys;
+        });
+    }
+
+private:
+    static inline bool isLeaf(uintptr_t p) { return (p & 1) != 0; }
+    static inline Leaf* toLeaf(uintptr_t p) { return (Leaf*)(p & ~(uintptr_t)1); }
+    static inline uintptr_t fromLeaf(Leaf* l) { return (uintptr_t)l | 1; }
+
+    static inline uint64_t nodeType(uint64_t meta) { return meta & 0xFF; }
+    static inline uint64_t numChildren(uint64_t meta) { return (meta >> 8) & 0xFFFF; }
+    static inline uint64_t prefixLen(uint64_t meta) { return meta >> 32; }
+    static inline uint64_t makeMeta(uint64_t type, uint64_t num, uint64_t plen) { return type | (num << 8) | (plen << 32); }
+
+    static inline uint8_t getByte(uint64_t w, uint64_t i) { return (uint8_t)(w >> (8*i)); }
+    static inline uint64_t setByte(uint64_t w, uint64_t i, uint8_t c) {
+        return (w & ~(0xFFULL << (8*i))) | ((uint64_t)c << (8*i));
+    }
+
+    // Bitmask of the bytes of a Node16 that are equal to c
+    static inline uint32_t matchByte(const uint64_t lo, const uint64_t hi, const uint8_t c) {
+#if defined(__SSE2__)
+        const __m128i keys = _mm_set_epi64x((long long)hi, (long long)lo);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(keys, _mm_set1_epi8((char)c)));
+#else
+        uint32_t mask = 0;
+        for (int i = 0; i < 16; i++) if (getByte((i < 8) ? lo : hi, i%8) == c) mask |= 1u << i;
+        return mask;
+#endif
+    }
+
+    static Leaf* newLeaf(const Bytes& kb) {
+        const uint64_t nw = kb.numWords();
+        Leaf* l = (Leaf*)TM::tmMalloc(sizeof(TMTYPE<uint64_t>)*(1+nw));
+        l->len = kb.len;
+        for (uint64_t i = 0; i < nw; i++) l->words[i] = kb.word(i);
+        return l;
+    }
+
+    static void loadLeaf(Leaf* l, Bytes& lb) {
+        lb.setLen(l->len);
+        for (uint64_t i = 0; i < lb.numWords(); i++) {
+            const uint64_t w = l->words[i];
+            std::memcpy(&lb.buf[8*i], &w, sizeof(w));
+        }
+    }
+
+    static bool leafMatches(Leaf* l, const Bytes& kb) {
+        if (l->len != kb.len) return false;
+        for (uint64_t i = 0; i < kb.numWords(); i++) {
+            if (l->words[i] != kb.word(i)) return false;
+        }
+        return true;
+    }
+
+    // Returns a negative number if the key of the leaf is lower than kb, zero if it's equal and positive if it's higher
+    static int leafCompare(Leaf* l, const Bytes& kb) {
+        const uint64_t len = l->len;
+        const uint64_t nw = std::min((len+7)/8, kb.numWords());
+        for (uint64_t i = 0; i < nw; i++) {
+            const uint64_t a = __builtin_bswap64(l->words[i]);
+            const uint64_t b = __builtin_bswap64(kb.word(i));
+            if (a != b) return (a < b) ? -1 : 1;
+        }
+        return (len < kb.len) ? -1 : ((len > kb.len) ? 1 : 0);
+    }
+
+    // Number of stored bytes of a prefix (up to PREFIX_BYTES) which are equal to the bytes of the key at depth
+    static uint64_t matchPrefix(const uint64_t prefix, const uint64_t plen, const Bytes& kb, const uint64_t depth) {
+        const uint64_t maxCmp = std::min(std::min(plen, PREFIX_BYTES), kb.len - depth);
+        uint64_t i = 0;
+        while (i < maxCmp && getByte(prefix, i) == kb.at(depth+i)) i++;
+        return i;
+    }
+
+    // Returns the leaf with the lowest key in the subtree of p
+    static Leaf* minimumLeaf(uintptr_t p) {
+        while (!isLeaf(p)) {
+            Node* n = (Node*)p;
+            const uint64_t meta = n->meta;
+            switch (nodeType(meta)) {
+            case NODE4:
+                p = ((Node4*)n)->children[0];
+                break;
+            case NODE16:
+                p = ((Node16*)n)->children[0];
+                break;
+            case NODE48: {
+                Node48* n48 = (Node48*)n;
+                uint64_t i = 0;
+                uint64_t w = n48->index[0];
+                while (w == 0) w = n48->index[++i];
+                p = n48->children[getByte(w, __builtin_ctzll(w)/8)-1];
+                break;
+            }
+            default: {
+                Node256* n256 = (Node256*)n;
+                uint64_t c = 0;
+                while ((p = n256->children[c]) == 0) c++;
+            }
+            }
+        }
+        return toLeaf(p);
+    }
+
+    // A Node4 with two children, for when a leaf or a prefix is split
+    static uintptr_t newNode4(const uint64_t prefix, const uint64_t plen, uint8_t c1, uintptr_t ch1, uint8_t c2, uintptr_t ch2) {
+        if (c2 < c1) {
+            std::swap(c1, c2);
+            std::swap(ch1, ch2);
+        }
+        Node4* n4 = TM::template tmNew<Node4>(makeMeta(NODE4, 2, plen), prefix);
+        n4->keys = (uint64_t)c1 | ((uint64_t)c2 << 8);
+        n4->children[0] = ch1;
+        n4->children[1] = ch2;
+        return (uintptr_t)n4;
+    }
+
+    // Inserts a key, must be called from within a transaction
+    bool insert(const Bytes& kb) {
+        TMTYPE<uintptr_t>* ref = (TMTYPE<uintptr_t>*)&root;
+        uint64_t depth = 0;
+        while (true) {
+            const uintptr_t p = *ref;
+            if (p == 0) {
+                *ref = fromLeaf(newLeaf(kb));
+                return true;
+            }
+            if (isLeaf(p)) {
+                // Replace the leaf with a Node4 whose prefix is the rest of the bytes in common with the new key
+                Leaf* l = toLeaf(p);
+                if (leafMatches(l, kb)) return false;
+                Bytes lb;
+                loadLeaf(l, lb);
+                uint64_t lcp = 0;
+                while (depth+lcp < lb.len && depth+lcp < kb.len && lb.at(depth+lcp) == kb.at(depth+lcp)) lcp++;
+                assert(depth+lcp < lb.len && depth+lcp < kb.len);
+                *ref = newNode4(kb.prefix(depth, lcp), lcp, lb.at(depth+lcp), p, kb.at(depth+lcp), fromLeaf(newLeaf(kb)));
+                return true;
+            }
+            Node* n = (Node*)p;
+            const uint64_t meta = n->meta;
+            const uint64_t plen = prefixLen(meta);
+            if (plen > 0) {
+                const uint64_t prefix = n->prefix;
+                uint64_t m = matchPrefix(prefix, plen, kb, depth);
+                Bytes lb;
+                if (m == PREFIX_BYTES && plen > PREFIX_BYTES) {
+                    // The rest of the prefix is in all the leaves of n
+                    loadLeaf(minimumLeaf(p), lb);
+                    while (m < plen && depth+m < kb.len && lb.at(depth+m) == kb.at(depth+m)) m++;
+                }
+                if (m < plen) {
+                    // Split the prefix: a Node4 gets the first m bytes, with n and the new leaf as children
+                    assert(depth+m < kb.len);
+                    uint8_t c;
+                    if (plen <= PREFIX_BYTES) {
+                        c = getByte(prefix, m);
+                        n->prefix = (m+1 < PREFIX_BYTES) ? prefix >> (8*(m+1)) : 0;
+                    } else {
+                        if (lb.len == 0) loadLeaf(minimumLeaf(p), lb);
+                        c = lb.at(depth+m);
+                        n->prefix = lb.prefix(depth+m+1, plen-m-1);
+                    }
+                    n->meta = makeMeta(nodeType(meta), numChildren(meta), plen-m-1);
+                    *ref = newNode4(kb.prefix(depth, m), m, c, p, kb.at(depth+m), fromLeaf(newLeaf(kb)));
+                    return true;
+                }
+                depth += plen;
+            }
+            assert(depth < kb.len);
+            TMTYPE<uintptr_t>* slot = findChild(n, meta, kb.at(depth));
+            if (slot == nullptr) {
+                addChild(ref, n, meta, kb.at(depth), fromLeaf(newLeaf(kb)));
+                return true;
+            }
+            ref = slot;
+            depth++;
+        }
+    }
+
+    // Returns the slot of the child of n for the byte c, or nullptr if there is no such child
+    static TMTYPE<uintptr_t>* findChild(Node* n, const uint64_t meta, const uint8_t c) {
+        switch (nodeType(meta)) {
+        case NODE4: {
+            Node4* n4 = (Node4*)n;
+            const uint64_t keys = n4->keys;
+            for (uint64_t i = 0; i < numChildren(meta); i++) {
+                if (getByte(keys, i) == c) return (TMTYPE<uintptr_t>*)&n4->children[i];
+            }
+            return nullptr;
+        }
+        case NODE16: {
+            Node16* n16 = (Node16*)n;
+            const uint32_t mask = matchByte(n16->keys[0], n16->keys[1], c) & ((1u << numChildren(meta)) - 1);
+            if (mask == 0) return nullptr;
+            return (TMTYPE<uintptr_t>*)&n16->children[__builtin_ctz(mask)];
+        }
+        case NODE48: {
+            Node48* n48 = (Node48*)n;
+            const uint8_t pos = getByte(n48->index[c/8], c%8);
+            if (pos == 0) return nullptr;
+            return (TMTYPE<uintptr_t>*)&n48->children[pos-1];
+        }
+        default: {
+            Node256* n256 = (Node256*)n;
+            if (n256->children[c] == 0) return nullptr;
+            return (TMTYPE<uintptr_t>*)&n256->children[c];
+        }
+        }
+    }
+
+    // Adds a child to n for the byte c. When n is full, it's replaced in *ref by a node of the next larger type
+    void addChild(TMTYPE<uintptr_t>* ref, Node* n, const uint64_t meta, const uint8_t c, const uintptr_t child) {
+        const uint64_t num = numChildren(meta);
+        const uint64_t plen = prefixLen(meta);
+        switch (nodeType(meta)) {
+        case NODE4: {
+            Node4* n4 = (Node4*)n;
+            if (num < 4) {
+                uint64_t keys = n4->keys;
+                uint64_t i = 0;
+                while (i < num && getByte(keys, i) < c) i++;
+                for (uint64_t j = num; j > i; j--) {
+                    keys = setByte(keys, j, getByte(keys, j-1));
+                    n4->children[j] = n4->children[j-1];
+                }
+                n4->keys = setByte(keys, i, c);
+                n4->children[i] = child;
+                n4->meta = makeMeta(NODE4, num+1, plen);
+                return;
+            }
+            Node16* n16 = TM::template tmNew<Node16>(makeMeta(NODE16, num, plen), n4->prefix);
+            n16->keys[0] = n4->keys;
+            for (uint64_t i = 0; i < num; i++) n16->children[i] = n4->children[i];
+            *ref = (uintptr_t)n16;
+            TM::tmDelete(n4);
+            return addChild(ref, n16, makeMeta(NODE16, num, plen), c, child);
+        }
+        case NODE16: {
+            Node16* n16 = (Node16*)n;
+            if (num < 16) {
+                uint64_t keys[2] = { n16->keys[0], n16->keys[1] };
+                uint64_t i = 0;
+                while (i < num && getByte(keys[i/8], i%8) < c) i++;
+                for (uint64_t j = num; j > i; j--) {
+                    keys[j/8] = setByte(keys[j/8], j%8, getByte(keys[(j-1)/8], (j-1)%8));
+                    n16->children[j] = n16->children[j-1];
+                }
+                keys[i/8] = setByte(keys[i/8], i%8, c);
+                n16->keys[0] = keys[0];
+                n16->keys[1] = keys[1];
+                n16->children[i] = child;
+                n16->meta = makeMeta(NODE16, num+1, plen);
+                return;
+            }
+            Node48* n48 = TM::template tmNew<Node48>(makeMeta(NODE48, num, plen), n16->prefix);
+            const uint64_t keys[2] = { n16->keys[0], n16->keys[1] };
+            for (uint64_t i = 0; i < num; i++) {
+                const uint8_t k = getByte(keys[i/8], i%8);
+                n48->index[k/8] = setByte(n48->index[k/8], k%8, (uint8_t)(i+1));
+                n48->children[i] = n16->children[i];
+            }
+            *ref = (uintptr_t)n48;
+            TM::tmDelete(n16);
+            return addChild(ref, n48, makeMeta(NODE48, num, plen), c, child);
+        }
+        case NODE48: {
+            Node48* n48 = (Node48*)n;
+            if (num < 48) {
+                uint64_t pos = 0;
+                while (n48->children[pos] != 0) pos++;
+                n48->children[pos] = child;
+                n48->index[c/8] = setByte(n48->index[c/8], c%8, (uint8_t)(pos+1));
+                n48->meta = makeMeta(NODE48, num+1, plen);
+                return;
+            }
+            Node256* n256 = TM::template tmNew<Node256>(makeMeta(NODE256, num, plen), n48->prefix);
+            for (uint64_t w = 0; w < 32; w++) {
+                const uint64_t idx = n48->index[w];
+                for (uint64_t i = 0; idx != 0 && i < 8; i++) {
+                    const uint8_t pos = getByte(idx, i);
+                    if (pos != 0) n256->children[8*w+i] = n48->children[pos-1];
+                }
+            }
+            *ref = (uintptr_t)n256;
+            TM::tmDelete(n48);
+            return addChild(ref, n256, makeMeta(NODE256, num, plen), c, child);
+        }
+        default: {
+            Node256* n256 = (Node256*)n;
+            n256->children[c] = child;
+            n256->meta = makeMeta(NODE256, num+1, plen);
+        }
+        }
+    }
+
+    /*
+     * Removes the child of n for the byte c, which is in slot. When n has few children left it's replaced in
+     * *ref by a node of the next smaller type, and a Node4 with a single child is replaced by its child.
+     */
+    void removeChild(TMTYPE<uintptr_t>* ref, Node* n, const uint64_t meta, const uint8_t c, TMTYPE<uintptr_t>* slot) {
+        const uint64_t num = numChildren(meta)-1;
+        const uint64_t plen = prefixLen(meta);
+        switch (nodeType(meta)) {
+        case NODE4: {
+            Node4* n4 = (Node4*)n;
+            uint64_t keys = n4->keys;
+            for (uint64_t j = slot - n4->children; j < num; j++) {
+                keys = setByte(keys, j, getByte(keys, j+1));
+                n4->children[j] = n4->children[j+1];
+            }
+            if (num > 1) {
+                n4->keys = setByte(keys, num, 0);
+                n4->children[num] = 0;
+                n4->meta = makeMeta(NODE4, num, plen);
+                return;
+            }
+            // The prefix of the remaining child becomes the prefix of n, its byte, and its own prefix
+            const uintptr_t only = n4->children[0];
+            if (!isLeaf(only)) {
+                Node* cn = (Node*)only;
+                const uint64_t cmeta = cn->meta;
+                uint64_t prefix = n4->prefix;
+                if (plen < PREFIX_BYTES) {
+                    prefix = setByte(prefix, plen, getByte(keys, 0));
+                    const uint64_t cprefix = cn->prefix;
+                    for (uint64_t i = plen+1; i < PREFIX_BYTES; i++) prefix = setByte(prefix, i, getByte(cprefix, i-plen-1));
+                }
+                cn->prefix = prefix;
+                cn->meta = makeMeta(nodeType(cmeta), numChildren(cmeta), plen+1+prefixLen(cmeta));
+            }
+            *ref = only;
+            TM::tmDelete(n4);
+            return;
+        }
+        case NODE16: {
+            Node16* n16 = (Node16*)n;
+            uint64_t keys[2] = { n16->keys[0], n16->keys[1] };
+            for (uint64_t j = slot - n16->children; j < num; j++) {
+                keys[j/8] = setByte(keys[j/8], j%8, getByte(keys[(j+1)/8], (j+1)%8));
+                n16->children[j] = n16->children[j+1];
+            }
+            if (num > 3) {
+                keys[num/8] = setByte(keys[num/8], num%8, 0);
+                n16->keys[0] = keys[0];
+                n16->keys[1] = keys[1];
+                n16->children[num] = 0;
+                n16->meta = makeMeta(NODE16, num, plen);
+                return;
+            }
+            Node4* n4 = TM::template tmNew<Node4>(makeMeta(NODE4, num, plen), n16->prefix);
+            n4->keys = keys[0] & 0xFFFFFF;
+            for (uint64_t i = 0; i < num; i++) n4->children[i] = n16->children[i];
+            *ref = (uintptr_t)n4;
+            TM::tmDelete(n16);
+            return;
+        }
+        case NODE48: {
+            Node48* n48 = (Node48*)n;
+            n48->index[c/8] = setByte(n48->index[c/8], c%8, 0);
+            *slot = 0;
+            if (num > 12) {
+                n48->meta = makeMeta(NODE48, num, plen);
+                return;
+            }
+            Node16* n16 = TM::template tmNew<Node16>(makeMeta(NODE16, num, plen), n48->prefix);
+            uint64_t keys[2] = { 0, 0 };
+            uint64_t j = 0;
+            for (uint64_t w = 0; w < 32; w++) {
+                const uint64_t idx = n48->index[w];
+                for (uint64_t i = 0; idx != 0 && i < 8; i++) {
+                    const uint8_t pos = getByte(idx, i);
+                    if (pos == 0) continue;
+                    keys[j/8] = setByte(keys[j/8], j%8, (uint8_t)(8*w+i));
+                    n16->children[j++] = n48->children[pos-1];
+                }
+            }
+            n16->keys[0] = keys[0];
+            n16->keys[1] = keys[1];
+            *ref = (uintptr_t)n16;
+            TM::tmDelete(n48);
+            return;
+        }
+        default: {
+            Node256* n256 = (Node256*)n;
+            *slot = 0;
+            if (num > 37) {
+                n256->meta = makeMeta(NODE256, num, plen);
+                return;
+            }
+            Node48* n48 = TM::template tmNew<Node48>(makeMeta(NODE48, num, plen), n256->prefix);
+            uint64_t index[32] = { 0 };
+            uint64_t j = 0;
+            for (uint64_t k = 0; k < 256; k++) {
+                const uintptr_t ch = n256->children[k];
+                if (ch == 0) continue;
+                index[k/8] = setByte(index[k/8], k%8, (uint8_t)(j+1));
+                n48->children[j++] = ch;
+            }
+            for (uint64_t w = 0; w < 32; w++) n48->index[w] = index[w];
+            *ref = (uintptr_t)n48;
+            TM::tmDelete(n256);
+        }
+        }
+    }
+
+    /*
+     * In-order traversal of the subtree of p, placing the keys in [lo,hi) in resultKeys. While checkLo is set,
+     * the keys of the subtree start with the same first depth bytes as lo, otherwise they are all higher than lo.
+     * Returns false when it reaches a key equal or higher than hi.
+     */
+    static bool scan(uintptr_t p, uint64_t depth, bool checkLo, const Bytes& lo, const Bytes& hi, K* const resultKeys, int& numKeys) {
+        if (p == 0) return true;
+        if (isLeaf(p)) {
+            Leaf* l = toLeaf(p);
+            if (checkLo && leafCompare(l, lo) < 0) return true;
+            if (leafCompare(l, hi) >= 0) return false;
+            Bytes lb;
+            loadLeaf(l, lb);
+            resultKeys[numKeys++] = ARTKey<K>::decode((const uint8_t*)lb.buf.data(), lb.len);
+            return true;
+        }
+        Node* n = (Node*)p;
+        const uint64_t meta = n->meta;
+        const uint64_t plen = prefixLen(meta);
+        if (checkLo && plen > 0) {
+            // Skip the subtree if its prefix is lower than the bytes of lo, and stop checking lo if it's higher
+            const uint64_t prefix = n->prefix;
+            Bytes lb;
+            for (uint64_t i = 0; i < plen && checkLo; i++) {
+                if (depth+i >= lo.len) {
+                    checkLo = false;
+                    break;
+                }
+                if (i >= PREFIX_BYTES && lb.len == 0) loadLeaf(minimumLeaf(p), lb);
+                const uint8_t b = (i < PREFIX_BYTES) ? getByte(prefix, i) : lb.at(depth+i);
+                if (b < lo.at(depth+i)) return true;
+                if (b > lo.at(depth+i)) checkLo = false;
+            }
+        }
+        depth += plen;
+        if (checkLo && depth >= lo.len) checkLo = false;
+        const uint8_t first = checkLo ? lo.at(depth) : 0;
+        switch (nodeType(meta)) {
+        case NODE4:
+        case NODE16: {
+            const uint64_t num = numChildren(meta);
+            uint64_t keys[2];
+            TMTYPE<uintptr_t>* children;
+            if (nodeType(meta) == NODE4) {
+                keys[0] = ((Node4*)n)->keys;
+                keys[1] = 0;
+                children = ((Node4*)n)->children;
+            } else {
+                keys[0] = ((Node16*)n)->keys[0];
+                keys[1] = ((Node16*)n)->keys[1];
+                children = ((Node16*)n)->children;
+            }
+            for (uint64_t i = 0; i < num; i++) {
+                const uint8_t c = getByte(keys[i/8], i%8);
+                if (c < first) continue;
+                if (!scan(children[i], depth+1, checkLo && c == first, lo, hi, resultKeys, numKeys)) return false;
+            }
+            return true;
+        }
+        case NODE48: {
+            Node48* n48 = (Node48*)n;
+            for (uint64_t w = first/8; w < 32; w++) {
+                const uint64_t idx = n48->index[w];
+                for (uint64_t i = 0; idx != 0 && i < 8; i++) {
+                    const uint64_t c = 8*w+i;
+                    const uint8_t pos = getByte(idx, i);
+                    if (c < first || pos == 0) continue;
+                    if (!scan(n48->children[pos-1], depth+1, checkLo && c == first, lo, hi, resultKeys, numKeys)) return false;
+                }
+            }
+            return true;
+        }
+        default: {
+            Node256* n256 = (Node256*)n;
+            for (uint64_t c = first; c < 256; c++) {
+                const uintptr_t ch = n256->children[c];
+                if (ch == 0) continue;
+                if (!scan(ch, depth+1, checkLo && c == first, lo, hi, resultKeys, numKeys)) return false;
+            }
+            return true;
+        }
+        }
+    }
+
+    static void clear(uintptr_t p) {
+        if (p == 0) return;
+        if (isLeaf(p)) {
+            TM::tmFree(toLeaf(p));
+            return;
+        }
+        Node* n = (Node*)p;
+        switch (nodeType(n->meta)) {
+        case NODE4: {
+            Node4* n4 = (Node4*)n;
+            for (int i = 0; i < 4; i++) clear(n4->children[i]);
+            TM::tmDelete(n4);
+            break;
+        }
+        case NODE16: {
+            Node16* n16 = (Node16*)n;
+            for (int i = 0; i < 16; i++) clear(n16->children[i]);
+            TM::tmDelete(n16);
+            break;
+        }
+        case NODE48: {
+            Node48* n48 = (Node48*)n;
+            for (int i = 0; i < 48; i++) clear(n48->children[i]);
+            TM::tmDelete(n48);
+            break;
+        }
+        default: {
+            Node256* n256 = (Node256*)n;
+            for (int i = 0; i < 256; i++) clear(n256->children[i]);
+            TM::tmDelete(n256);
+        }
+        }
+    }
+};
+
+// std::min() takes its arguments by reference, so the constants need a definition
+template<typename K, typename TM, template <typename> class TMTYPE> const uint64_t TMARTSet<K,TM,TMTYPE>::PREFIX_BYTES;
+template<typename K, typename TM, template <typename> class TMTYPE> const uint64_t TMARTSet<K,TM,TMTYPE>::BULK_KEYS;
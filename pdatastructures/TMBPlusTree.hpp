@@ -0,0 +1,504 @@
+/*
+ * Copyright 2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * <h1> A B+tree set for usage with STMs </h1>
+ *
+ * Unlike TMBTree, all the keys are in the leaves and the keys in the internal nodes are just separators:
+ * children[i] has the keys lower than keys[i] and children[i+1] has the keys equal or higher than keys[i].
+ * The leaves are linked to their siblings in both directions, so that a range query does a single descent
+ * to the first leaf and then touches only the leaves in the range, in ascending or descending order.
+ *
+ * Insertions split full nodes and removals fix nodes with the minimum number of keys on the way down,
+ * so that each operation is a single pass from the root to a leaf.
+ * The separators are not updated when a key is removed from a leaf, they are still valid for routing.
+ */
+template <typename K, typename TM, template <typename> class TMTYPE>
+class TMBPlusTree : public TM::tmbase {
+
+    static const int32_t MAXKEYS { 16 };
+    // Nodes other than the root have at least MINKEYS keys. Merging two nodes with MINKEYS (plus a separator) must fit in a node
+    static const int32_t MINKEYS { MAXKEYS/2 - 1 };
+
+    struct Node : public TM::tmbase {
+        TMTYPE<int32_t> length {0};
+        TMTYPE<K>       keys[MAXKEYS];
+        // Internal nodes have length+1 children. The leaves have children[0] == nullptr
+        TMTYPE<Node*>   children[MAXKEYS+1];
+        // Sibling leaves, only used in the leaves
+        TMTYPE<Node*>   next {nullptr};
+        TMTYPE<Node*>   prev {nullptr};
+
+        Node(bool leaf) {
+            if (leaf) children[0] = nullptr;
+        }
+
+        inline bool isLeaf() const { return children[0] == nullptr; }
+
+        // Index of the first key equal or higher than key
+        inline int32_t lowerBound(const K& key) const {
+            int32_t i = 0;
+            const int32_t len = length;
+            while (i < len && keys[i] < key) i++;
+            return i;
+        }
+
+        // Index of the child where key is
+        inline int32_t childIndex(const K& key) const {
+            int32_t i = 0;
+            const int32_t len = length;
+            while (i < len && !(key < keys[i])) i++;
+            return i;
+        }
+    };
+
+    TMTYPE<Node*> root {nullptr};
+
+    // Maximum number of nodes created by each transaction of bulkLoad()
+    static const uint64_t BULK_NODES = 64;
+
+public:
+    TMBPlusTree() {
+        root = TM::template tmNew<Node>(true);
+    }
+
+    ~TMBPlusTree() {
+        deleteAll(root);
+    }
+
+    static std::string className() { return TM::className() + "-BPlusTree"; }
+
+
+private:
+    void deleteAll(Node* node) {
+        if (!node->isLeaf()) {
+            for (int32_t i = 0; i < node->length+1; i++) deleteAll(node->children[i]);
+        }
+        TM::tmDelete(node);
+    }
+
+    // Calls build(i) for each i in [0,numNodes), in transactions of up to BULK_NODES calls, by up to numThreads threads
+    template<typename F> void bulkLevel(uint64_t numNodes, const int numThreads, F& build) {
+        const uint64_t numChunks = (numNodes + BULK_NODES - 1)/BULK_NODES;
+        auto func = [&] (const int tid) {
+            for (uint64_t ic = tid; ic < numChunks; ic += numThreads) {
+                const uint64_t lo = ic*BULK_NODES;
+                const uint64_t hi = std::min(numNodes, lo + BULK_NODES);
+                TM::template updateTx<bool>([=,&build] () {
+                    for (uint64_t i = lo; i < hi; i++) build(i);
+                    return true;
+                });
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int tid = 1; tid < numThreads; tid++) threads.push_back(std::thread(func, tid));
+        func(0);
+        for (auto& th : threads) th.join();
+    }
+
+    // Descends to the leaf where key is, or where it would be
+    Node* findLeaf(const K& key) const {
+        Node* node = root;
+        while (!node->isLeaf()) node = node->children[node->childIndex(key)];
+        return node;
+    }
+
+    // Returns the leaf where key is, if it's anywhere, given the leaf of a previous lower key (or nullptr).
+    // The keys in the linked leaves are sorted, so if key is not after the last key of that leaf, it can only be
+    // in it. Otherwise we descend from the root, which is cheaper than going through the next leaves when the keys
+    // are far apart, because the nodes near the root are already in the read-set of the transaction.
+    Node* fingerLeaf(Node* leaf, const K& key) const {
+        if (leaf != nullptr) {
+            const int32_t len = leaf->length;
+            if (len > 0 && !(leaf->keys[len-1] < key)) return leaf;
+        }
+        return findLeaf(key);
+    }
+
+    // Returns the indexes of the keys in ascending order of the keys, and of the index for equal keys
+    static std::vector<uint64_t> sortedOrder(const K* keys, uint64_t size) {
+        std::vector<uint64_t> order(size);
+        for (uint64_t i = 0; i < size; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [keys] (uint64_t a, uint64_t b) {
+            return keys[a] < keys[b] || (!(keys[b] < keys[a]) && a < b);
+        });
+        return order;
+    }
+
+    // Moves the upper half of the full child at index to a new node, and adds the new node and its separator to parent
+    void splitChild(Node* parent, int32_t index) {
+        Node* left = parent->children[index];
+        const bool leaf = left->isLeaf();
+        Node* right = TM::template tmNew<Node>(leaf);
+        const int32_t len = left->length;
+        const int32_t half = len/2;
+        K separator;
+        if (leaf) {
+            // The separator is a copy of the first key of the right leaf
+            for (int32_t i = half; i < len; i++) right->keys[i-half] = left->keys[i];
+            right->length = len-half;
+            left->length = half;
+            separator = right->keys[0];
+            Node* lnext = left->next;
+            right->next = lnext;
+            right->prev = left;
+            if (lnext != nullptr) lnext->prev = right;
+            left->next = right;
+        } else {
+            // The separator moves up to the parent
+            separator = left->keys[half];
+            for (int32_t i = half+1; i < len; i++) right->keys[i-half-1] = left->keys[i];
+            for (int32_t i = half+1; i < len+1; i++) right->children[i-half-1] = left->children[i];
+            right->length = len-half-1;
+            left->length = half;
+        }
+        const int32_t plen = parent->length;
+        for (int32_t i = plen; i > index; i--) parent->keys[i] = parent->keys[i-1];
+        for (int32_t i = plen+1; i > index+1; i--) parent->children[i] = parent->children[i-1];
+        parent->keys[index] = separator;
+        parent->children[index+1] = right;
+        parent->length = plen+1;
+    }
+
+    // Merges the child at index+1 into the child at index, and removes the separator between them from parent
+    void mergeChildren(Node* parent, int32_t index) {
+        Node* left = parent->children[index];
+        Node* right = parent->children[index+1];
+        int32_t llen = left->length;
+        const int32_t rlen = right->length;
+        if (left->isLeaf()) {
+            for (int32_t i = 0; i < rlen; i++) left->keys[llen+i] = right->keys[i];
+            left->length = llen+rlen;
+            Node* rnext = right->next;
+            left->next = rnext;
+            if (rnext != nullptr) rnext->prev = left;
+        } else {
+            left->keys[llen] = parent->keys[index];
+            for (int32_t i = 0; i < rlen; i++) left->keys[llen+1+i] = right->keys[i];
+            for (int32_t i = 0; i < rlen+1; i++) left->children[llen+1+i] = right->children[i];
+            left->length = llen+1+rlen;
+        }
+        const int32_t plen = parent->length;
+        for (int32_t i = index; i < plen-1; i++) parent->keys[i] = parent->keys[i+1];
+        for (int32_t i = index+1; i < plen; i++) parent->children[i] = parent->children[i+1];
+        parent->length = plen-1;
+        TM::tmDelete(right);
+    }
+
+    // Makes sure the child at index has more than MINKEYS keys, so that a removal in it doesn't go below the minimum.
+    // Returns the child where the removal should continue, which is the left sibling if the child was merged into it.
+    Node* ensureChildRemove(Node* parent, int32_t index) {
+        Node* child = parent->children[index];
+        const int32_t clen = child->length;
+        if (clen > MINKEYS) return child;
+        const int32_t plen = parent->length;
+        Node* left = (index > 0) ? parent->children[index-1].pload() : nullptr;
+        Node* right = (index < plen) ? parent->children[index+1].pload() : nullptr;
+        if (left != nullptr && left->length > MINKEYS) {
+            // Take the last key of the left sibling
+            const int32_t llen = left->length;
+            for (int32_t i = clen; i > 0; i--) child->keys[i] = child->keys[i-1];
+            if (child->isLeaf()) {
+                child->keys[0] = left->keys[llen-1];
+                parent->keys[index-1] = left->keys[llen-1];
+            } else {
+                for (int32_t i = clen+1; i > 0; i--) child->children[i] = child->children[i-1];
+                child->keys[0] = parent->keys[index-1];
+                child->children[0] = left->children[llen];
+                parent->keys[index-1] = left->keys[llen-1];
+            }
+            child->length = clen+1;
+            left->length = llen-1;
+            return child;
+        }
+        if (right != nullptr && right->length > MINKEYS) {
+            // Take the first key of the right sibling
+            const int32_t rlen = right->length;
+            if (child->isLeaf()) {
+                child->keys[clen] = right->keys[0];
+                for (int32_t i = 0; i < rlen-1; i++) right->keys[i] = right->keys[i+1];
+                parent->keys[index] = right->keys[0];
+            } else {
+                child->keys[clen] = parent->keys[index];
+                child->children[clen+1] = right->children[0];
+                parent->keys[index] = right->keys[0];
+                for (int32_t i = 0; i < rlen-1; i++) right->keys[i] = right->keys[i+1];
+                for (int32_t i = 0; i < rlen; i++) right->children[i] = right->children[i+1];
+            }
+            child->length = clen+1;
+            right->length = rlen-1;
+            return child;
+        }
+        if (left != nullptr) {
+            mergeChildren(parent, index-1);
+            return left;
+        }
+        mergeChildren(parent, index);
+        return child;
+    }
+
+    bool insert(const K& key) {
+        Node* node = root;
+        if (node->length == MAXKEYS) {
+            // Increase the height of the tree
+            Node* newRoot = TM::template tmNew<Node>(false);
+            newRoot->children[0] = node;
+            splitChild(newRoot, 0);
+            root = newRoot;
+            node = newRoot;
+        }
+        while (!node->isLeaf()) {
+            int32_t index = node->childIndex(key);
+            Node* child = node->children[index];
+            if (child->length == MAXKEYS) {
+                splitChild(node, index);
+                if (!(key < node->keys[index])) index++;
+                child = node->children[index];
+            }
+            node = child;
+        }
+        const int32_t len = node->length;
+        const int32_t index = node->lowerBound(key);
+        if (index < len && node->keys[index] == key) return false;
+        for (int32_t i = len; i > index; i--) node->keys[i] = node->keys[i-1];
+        node->keys[index] = key;
+        node->length = len+1;
+        return true;
+    }
+
+    bool erase(const K& key) {
+        Node* node = root;
+        while (!node->isLeaf()) {
+            Node* child = ensureChildRemove(node, node->childIndex(key));
+            if (node == root && node->length == 0) {
+                // Decrease the height of the tree
+                root = child;
+                TM::tmDelete(node);
+            }
+            node = child;
+        }
+        const int32_t len = node->length;
+        const int32_t index = node->lowerBound(key);
+        if (index == len || !(node->keys[index] == key)) return false;
+        for (int32_t i = index; i < len-1; i++) node->keys[i] = node->keys[i+1];
+        node->length = len-1;
+        return true;
+    }
+
+    bool find(const K& key) const {
+        Node* node = findLeaf(key);
+        const int32_t index = node->lowerBound(key);
+        return index < node->length && node->keys[index] == key;
+    }
+
+
+public:
+    // Inserts a key only if it's not already present
+    bool add(K key, const int tid=0) {
+        return TM::template updateTx<bool>([this,key] () {
+            return insert(key);
+        });
+    }
+
+    // Returns true only if the key was present
+    bool remove(K key, const int tid=0) {
+        return TM::template updateTx<bool>([this,key] () {
+            return erase(key);
+        });
+    }
+
+    bool contains(K key, const int tid=0) {
+        return TM::template readTx<bool>([this,key] () {
+            return find(key);
+        });
+    }
+
+    /*
+     * Batched versions of contains(), add() and remove(), which do all the keys in a single transaction, in
+     * ascending order. containsMany() looks for each key in the leaf of the previous key before descending
+     * from the root (finger search). Insertions and removals split and merge nodes on the way down, so each
+     * key is searched from the root, but the nodes near the root are already in the read-set.
+     * Returns the number of keys found, added or removed, and if results is not nullptr, sets results[i]
+     * to the outcome for keys[i]. All the keys must fit in one transaction.
+     */
+    uint64_t containsMany(const K* keys, uint64_t size, bool* results=nullptr) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template readTx<uint64_t>([=] () {
+            Node* leaf = nullptr;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const K key = keys[ord[j]];
+                leaf = fingerLeaf(leaf, key);
+                const int32_t index = leaf->lowerBound(key);
+                const bool found = index < leaf->length && leaf->keys[index] == key;
+                if (results != nullptr) results[ord[j]] = found;
+                if (found) count++;
+            }
+            return count;
+        });
+    }
+
+    uint64_t addMany(const K* keys, uint64_t size, bool* results=nullptr, const int tid=0) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template updateTx<uint64_t>([=] () {
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const bool added = insert(keys[ord[j]]);
+                if (results != nullptr) results[ord[j]] = added;
+                if (added) count++;
+            }
+            return count;
+        });
+    }
+
+    uint64_t removeMany(const K* keys, uint64_t size, bool* results=nullptr, const int tid=0) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template updateTx<uint64_t>([=] () {
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const bool removed = erase(keys[ord[j]]);
+                if (results != nullptr) results[ord[j]] = removed;
+                if (removed) count++;
+            }
+            return count;
+        });
+    }
+
+    void addAll(K** keys, uint64_t size, const int tid=0) {
+        for (uint64_t i = 0; i < size; i++) add(*keys[i], tid);
+    }
+
+    /*
+     * Fills an empty tree with keys sorted in ascending order and without duplicates.
+     * The keys are spread evenly over the fewest leaves, then each level of internal nodes is built on top
+     * of the level below with the fewest nodes, until there is a single node, which becomes the root.
+     * Each level is built by up to numThreads threads, in transactions of at most BULK_NODES nodes,
+     * and nobody else can see the nodes until the root is published.
+     */
+    void bulkLoad(const K* keys, uint64_t size, const int numThreads=1) {
+        if (size == 0) return;
+        // The nodes of the current level and the lowest key in the subtree of each node
+        std::vector<Node*> nodes((size + MAXKEYS - 1)/MAXKEYS);
+        std::vector<K> mins(nodes.size());
+        uint64_t numNodes = nodes.size();
+        auto buildLeaf = [&] (uint64_t i) {
+            const uint64_t lo = i*size/numNodes;
+            const uint64_t hi = (i+1)*size/numNodes;
+            Node* leaf = TM::template tmNew<Node>(true);
+            for (uint64_t j = lo; j < hi; j++) leaf->keys[j-lo] = keys[j];
+            leaf->length = (int32_t)(hi-lo);
+            nodes[i] = leaf;
+            mins[i] = keys[lo];
+        };
+        bulkLevel(numNodes, numThreads, buildLeaf);
+        auto linkLeaf = [&] (uint64_t i) {
+            if (i > 0) nodes[i]->prev = nodes[i-1];
+            if (i+1 < numNodes) nodes[i]->next = nodes[i+1];
+        };
+        bulkLevel(numNodes, numThreads, linkLeaf);
+        while (nodes.size() > 1) {
+            const uint64_t numChildren = nodes.size();
+            numNodes = (numChildren + MAXKEYS)/(MAXKEYS+1);
+            std::vector<Node*> parents(numNodes);
+            std::vector<K> parentMins(numNodes);
+            auto buildInternal = [&] (uint64_t i) {
+                const uint64_t lo = i*numChildren/numNodes;
+                const uint64_t hi = (i+1)*numChildren/numNodes;
+                Node* node = TM::template tmNew<Node>(false);
+                for (uint64_t j = lo; j < hi; j++) node->children[j-lo] = nodes[j];
+                for (uint64_t j = lo+1; j < hi; j++) node->keys[j-lo-1] = mins[j];
+                node->length = (int32_t)(hi-lo-1);
+                parents[i] = node;
+                parentMins[i] = mins[lo];
+            };
+            bulkLevel(numNodes, numThreads, buildInternal);
+            nodes.swap(parents);
+            mins.swap(parentMins);
+        }
+        Node* newRoot = nodes[0];
+        TM::template updateTx<bool>([=] () {
+            Node* oldRoot = root;
+            assert(oldRoot->isLeaf() && oldRoot->length == 0);
+            root = newRoot;
+            TM::tmDelete(oldRoot);
+            return true;
+        });
+    }
+
+    // Number of keys visited in ascending order starting at key, up to numKeys
+    uint64_t traversal(K key, uint64_t numKeys) {
+        return TM::template readTx<uint64_t>([this,key,numKeys] () {
+            uint64_t numTraversals = 0;
+            Node* leaf = findLeaf(key);
+            int32_t i = leaf->lowerBound(key);
+            while (leaf != nullptr && numTraversals < numKeys) {
+                const int32_t len = leaf->length;
+                for (; i < len && numTraversals < numKeys; i++) numTraversals++;
+                leaf = leaf->next;
+                i = 0;
+            }
+            return numTraversals;
+        });
+    }
+
+    // Places the keys in [lo,hi) in resultKeys, in ascending order. Returns the number of keys
+    int rangeQuery(const K &lo, const K &hi, K *const resultKeys) {
+        return TM::template readTx<int>([=] () {
+            int numKeys = 0;
+            Node* leaf = findLeaf(lo);
+            int32_t i = leaf->lowerBound(lo);
+            while (leaf != nullptr) {
+                const int32_t len = leaf->length;
+                for (; i < len; i++) {
+                    K key = leaf->keys[i];
+                    if (!(key < hi)) return numKeys;
+                    resultKeys[numKeys++] = key;
+                }
+                leaf = leaf->next;
+                i = 0;
+            }
+            return numKeys;
+        });
+    }
+
+    // Places the keys in [lo,hi) in resultKeys, in descending order. Returns the number of keys
+    int rangeQueryReverse(const K &lo, const K &hi, K *const resultKeys) {
+        return TM::template readTx<int>([=] () {
+            int numKeys = 0;
+            Node* leaf = findLeaf(hi);
+            int32_t i = leaf->lowerBound(hi)-1;
+            while (leaf != nullptr) {
+                for (; i >= 0; i--) {
+                    K key = leaf->keys[i];
+                    if (key < lo) return numKeys;
+                    resultKeys[numKeys++] = key;
+                }
+                leaf = leaf->prev;
+                if (leaf != nullptr) i = leaf->length-1;
+            }
+            return numKeys;
+        });
+    }
+};
+
+// The tmtype comparison operators of some STMs take their argument by reference, so the constants need a definition
+template <typename K, typename TM, template <typename> class TMTYPE> const int32_t TMBPlusTree<K,TM,TMTYPE>::MAXKEYS;
+template <typename K, typename TM, template <typename> class TMTYPE> const int32_t TMBPlusTree<K,TM,TMTYPE>::MINKEYS;
@@ -34,12 +34,18 @@
 #include <stdexcept>
 #include <utility>
 #include <vector>
+#include <string>
+#include <thread>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 
-template <typename E, typename TM, template <typename> class TMTYPE>
+// FANOUT is the number of keys in a node. The default degree uses FANOUT-1 keys and FANOUT children.
+template <typename E, typename TM, template <typename> class TMTYPE, int FANOUT=16>
 class TMBTree : public TM::tmbase {
 
-    private: static const int MAXKEYS { 16 };
+    private: static const int MAXKEYS { FANOUT };
 
 	private: class Node;  // Forward declaration
 
@@ -49,18 +55,23 @@ class TMBTree : public TM::tmbase {
 	private: TMTYPE<int32_t> minKeys;  // At least 1, equal to degree-1
 	private: TMTYPE<int32_t> maxKeys;  // At least 3, odd number, equal to minKeys*2+1
 
+	// Maximum number of nodes created by each transaction of bulkLoad()
+	private: static const uint64_t BULK_NODES = 64;
+
 
 
 	/*---- Constructors ----*/
 
 	// The degree is the minimum number of children each non-root internal node must have.
-	public: explicit TMBTree(std::int32_t degree=8) :
+	public: explicit TMBTree(std::int32_t degree=FANOUT/2) :
 			minKeys(degree - 1),
 			maxKeys(degree <= UINT32_MAX / 2 ? degree * 2 - 1 : 0) {  // Avoid overflow
 		if (degree < 2)
 			throw std::domain_error("Degree must be at least 2");
 		if (degree > UINT32_MAX / 2)  // In other words, need maxChildren <= UINT32_MAX
 			throw std::domain_error("Degree too large");
+		if (degree * 2 - 1 > MAXKEYS)
+			throw std::domain_error("Degree too large for the FANOUT of the nodes");
 		clear();
 	}
 
@@ -89,6 +100,75 @@ class TMBTree : public TM::tmbase {
 	}
 
 
+	// Fills an empty tree with keys sorted in ascending order and without duplicates, bottom-up.
+	// A level with numChildren subtrees (the leaf level has size+1 empty subtrees) and the numChildren-1 keys
+	// between them is split evenly in the fewest nodes. The key between two consecutive nodes moves up to the
+	// level above, until there is a single node, which becomes the root. The nodes of each level are built by
+	// up to numThreads threads, in transactions of at most BULK_NODES nodes, and nobody else can see them until
+	// the root is published.
+	public: void bulkLoad(const E* keys, uint64_t size, const int numThreads=1) {
+		if (size == 0) return;
+		const std::int32_t maxk = TM::template readTx<std::int32_t>([this] () {
+			assert(root.pload()->length == 0);
+			return maxKeys.pload();
+		});
+		std::vector<Node*> nodes;
+		std::vector<E> separators;
+		const E* seps = keys;
+		uint64_t numChildren = size+1;
+		while (true) {
+			const uint64_t numNodes = (numChildren + maxk)/(maxk+1);
+			std::vector<Node*> parents(numNodes);
+			std::vector<E> parentSeps(numNodes-1);
+			auto buildNode = [&] (uint64_t i) {
+				const uint64_t lo = i*numChildren/numNodes;
+				const uint64_t hi = (i+1)*numChildren/numNodes;
+				Node* node = TM::template tmNew<Node>(maxk, nodes.empty());
+				if (!nodes.empty()) {
+					for (uint64_t j = lo; j < hi; j++) node->children[j-lo] = nodes[j];
+				}
+				for (uint64_t j = lo; j < hi-1; j++) node->keys[j-lo] = seps[j];
+				node->length = (std::int32_t)(hi-lo-1);
+				parents[i] = node;
+				if (i+1 < numNodes) parentSeps[i] = seps[hi-1];
+			};
+			bulkLevel(numNodes, numThreads, buildNode);
+			nodes.swap(parents);
+			separators.swap(parentSeps);
+			seps = separators.data();
+			numChildren = numNodes;
+			if (numNodes == 1) break;
+		}
+		Node* newRoot = nodes[0];
+		TM::template updateTx<bool>([=] () {
+			Node* oldRoot = root;
+			root = newRoot;
+			TM::template tmDelete<Node>(oldRoot);
+			return true;
+		});
+	}
+
+
+	// Calls build(i) for each i in [0,numNodes), in transactions of up to BULK_NODES calls, by up to numThreads threads
+	private: template<typename F> void bulkLevel(uint64_t numNodes, const int numThreads, F& build) {
+		const uint64_t numChunks = (numNodes + BULK_NODES - 1)/BULK_NODES;
+		auto func = [&] (const int tid) {
+			for (uint64_t ic = tid; ic < numChunks; ic += numThreads) {
+				const uint64_t lo = ic*BULK_NODES;
+				const uint64_t hi = std::min(numNodes, lo + BULK_NODES);
+				TM::template updateTx<bool>([=,&build] () {
+					for (uint64_t i = lo; i < hi; i++) build(i);
+					return true;
+				});
+			}
+		};
+		std::vector<std::thread> threads;
+		for (int tid = 1; tid < numThreads; tid++) threads.push_back(std::thread(func, tid));
+		func(0);
+		for (auto& th : threads) th.join();
+	}
+
+
 	using SearchResult = std::pair<bool,std::int32_t>;
 
 	public: bool seqContains(const E &val) const {
@@ -241,9 +321,10 @@ class TMBTree : public TM::tmbase {
 
 		/*-- Fields --*/
 
-		public: TMTYPE<int32_t> length {0};
         // Size is in the range [0, maxKeys] for root node, [minKeys, maxKeys] for all other nodes.
-        public: TMTYPE<E>       keys[MAXKEYS];
+        // The keys are at the start of the node, aligned to a cache line, so that they take as few lock stripes as possible.
+        public: alignas(64) TMTYPE<E> keys[MAXKEYS];
+		public: TMTYPE<int32_t> length {0};
 		// If leaf then size is 0, otherwise if internal node then size always equals keys.size()+1.
 		public: TMTYPE<Node*>   children[MAXKEYS+1];
 
@@ -268,23 +349,71 @@ class TMBTree : public TM::tmbase {
 		}
 
 		// Searches this node's keys vector and returns (true, i) if obj equals keys[i],
-		// otherwise returns (false, i) if children[i] should be explored. For simplicity,
-		// the implementation uses linear search. It's possible to replace it with binary search for speed.
+		// otherwise returns (false, i) if children[i] should be explored.
 		public: SearchResult search(const E &val) const {
+			return searchKeys<TM>(val, length, 0);
+		}
+
+		// STMs with ploadBlock() (2PLSF) lock the stripes of the keys once and copy them, then the copy is searched
+		// with AVX2 when the keys are 64 bit integers.
+		private: template <typename T> auto searchKeys(const E &val, std::int32_t len, int) const
+				-> decltype(T::ploadBlock(keys, (E*)nullptr, 0), SearchResult()) {
+			E buf[MAXKEYS];
+			T::ploadBlock(keys, buf, len);
+			std::int32_t i = lowerBound(buf, len, val, std::integral_constant<bool, std::is_integral<E>::value && sizeof(E) == 8>());
+			return SearchResult(i < len && buf[i] == val, i);
+		}
+
+		// Other STMs do a binary search, with one load for each key that is visited
+		private: template <typename T> SearchResult searchKeys(const E &val, std::int32_t len, long) const {
+			std::int32_t lo = 0, hi = len;
+			while (lo < hi) {
+				std::int32_t mid = (lo + hi) / 2;
+				const E elem = keys[mid];
+				if (elem < val)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			if (lo < len) {
+				const E elem = keys[lo];
+				if (elem == val)
+					return SearchResult(true, lo);  // Key found
+			}
+			return SearchResult(false, lo);  // Not found, caller should recurse on child
+		}
+
+		// Number of keys lower than val, in a sorted array of keys
+		private: static std::int32_t lowerBound(const E *buf, std::int32_t len, const E &val, std::false_type) {
+			std::int32_t i = 0;
+			while (i < len && buf[i] < val) i++;
+			return i;
+		}
+
+		private: static std::int32_t lowerBound(const E *buf, std::int32_t len, const E &val, std::true_type) {
+#if defined(__x86_64__)
+			static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+			if (hasAVX2) return lowerBoundAVX2(buf, len, val);
+#endif
+			return lowerBound(buf, len, val, std::false_type());
+		}
+
+#if defined(__x86_64__)
+		// Compares 4 keys at a time. The unsigned keys are compared as signed, after flipping their sign bit.
+		private: __attribute__((target("avx2"))) static std::int32_t lowerBoundAVX2(const E *buf, std::int32_t len, const E &val) {
+			const __m256i flip = _mm256_set1_epi64x(std::is_signed<E>::value ? 0 : (long long)(1ULL << 63));
+			const __m256i vval = _mm256_xor_si256(_mm256_set1_epi64x((long long)val), flip);
 			std::int32_t i = 0;
-			while (i < length) {
-				const E& elem = keys[i];
-				if (val == elem) {
-					assert(i < length);
-					return SearchResult(true, i);  // Key found
-				} else if (val > elem)
-					i++;
-				else  // val < elem
-					break;
+			for (; i + 4 <= len; i += 4) {
+				const __m256i vkeys = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(buf + i)), flip);
+				// One bit for each key lower than val
+				const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vval, vkeys)));
+				if (mask != 0xF) return i + __builtin_popcount(mask);
 			}
-			assert(i <= length);
-			return SearchResult(false, i);  // Not found, caller should recurse on child
+			while (i < len && buf[i] < val) i++;
+			return i;
 		}
+#endif
 
 
 		/*-- Methods for insertion --*/
@@ -501,6 +630,6 @@ public:
         return 0;
     }
 
-    static std::string className() { return TM::className() + "-BTree"; }
+    static std::string className() { return TM::className() + "-BTree" + ((FANOUT == 16) ? "" : std::to_string(FANOUT)); }
 
 };
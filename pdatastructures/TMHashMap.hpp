@@ -2,11 +2,23 @@
 #define _PERSISTENT_TM_RESIZABLE_HASH_MAP_H_
 
 #include <string>
+#include <cstdint>
 
 /**
  * <h1> A Resizable Hash Map for PTMs </h1>
+ *
+ * TMCOUNTER is the type used for the size of the hash map. Every insertion and removal modifies the size,
+ * so passing a type with commutative increments (like twoplsf::tmcounter) prevents all the updates from
+ * conflicting on it.
+ *
+ * The resize is incremental: when the load factor is exceeded, an array of buckets with twice the capacity
+ * is allocated and each put() or remove() moves the next MIGRATE_BUCKETS buckets to it. The nodes of bucket i
+ * go to the buckets i and i+capacity of the new array, and bucket i of the old array is marked as moved,
+ * which tells the lookups to use the new array for it. When all the buckets have been moved, the old array
+ * is freed. No transaction touches more than MIGRATE_BUCKETS buckets of the resize, and lookups are never
+ * blocked by a resize on buckets other than the ones being moved.
  */
-template<typename K, typename V, typename TM, template <typename> class TMTYPE>
+template<typename K, typename V, typename TM, template <typename> class TMTYPE, template <typename> class TMCOUNTER = TMTYPE>
 class TMHashMap : public TM::tmbase {
 
 private:
@@ -20,10 +32,18 @@ private:
 
 
     TMTYPE<uint64_t>                    capacity;
-    TMTYPE<uint64_t>                    sizeHM = 0;
+    TMCOUNTER<uint64_t>                 sizeHM = 0;
     //TMTYPE<double>					loadFactor = 0.75;
     static constexpr double             loadFactor = 0.75;
+    // Number of buckets moved to the new array by each put() or remove() during a resize
+    static const uint64_t               MIGRATE_BUCKETS = 8;
     alignas(128) TMTYPE<TMTYPE<Node*>*> buckets;      // An array of pointers to Nodes
+    TMTYPE<TMTYPE<Node*>*>              newBuckets {nullptr};  // Array with twice the capacity during a resize, or nullptr
+    // Next bucket to move during a resize. Only the updates access it, so it has its own cache line
+    alignas(128) TMTYPE<uint64_t>       migrateIdx {0};
+
+    // Marks a bucket of the old array that has been moved to the new array
+    static Node* movedMark() { return (Node*)1; }
 
 
 public:
@@ -34,39 +54,99 @@ public:
 
 
     ~TMHashMap() {
-		for(int i = 0; i < capacity; i++){
+        const uint64_t cap = capacity;
+        TMTYPE<Node*>* nb = newBuckets;
+		for (uint64_t i = 0; i < cap; i++) {
 			Node* node = buckets[i];
-			while (node!=nullptr) {
-				Node* next = node->next;
-				TM::tmDelete(node);
-				node = next;
-			}
+			if (node != movedMark()) deleteChain(node);
 		}
 		TM::tmFree(buckets);
+		if (nb == nullptr) return;
+		// The moved buckets are [0,migrateIdx)
+		for (uint64_t i = 0; i < migrateIdx; i++) {
+			deleteChain(nb[i]);
+			deleteChain(nb[i+cap]);
+		}
+		TM::tmFree(nb);
+    }
+
+
+    void deleteChain(Node* node) {
+        while (node != nullptr) {
+            Node* next = node->next;
+            TM::tmDelete(node);
+            node = next;
+        }
     }
 
 
     static std::string className() { return TM::className() + "-HashMap"; }
 
 
-    void rebuild() {
-        uint64_t newcapacity = 2*capacity;
-        //printf("increasing capacity to %d\n", newcapacity);
-        TMTYPE<Node*>* newbuckets = (TMTYPE<Node*>*)TM::tmMalloc(newcapacity*sizeof(TMTYPE<Node*>));
-        for (int i = 0; i < newcapacity; i++) newbuckets[i] = nullptr;
-        for (int i = 0; i < capacity; i++) {
+    // Counters with escrow updates can give an estimate of their value without locking, which is good enough
+    // to decide when to resize. For the other types we do a regular load.
+    template<typename C> static auto estimateSize(const C& c, int) -> decltype(c.estimate()) { return c.estimate(); }
+    template<typename C> static uint64_t estimateSize(const C& c, long) { return c.pload(); }
+
+    // Counters with escrow updates have commutative increments. The other types don't all have compound
+    // assignments, so we do a regular load and store. Call with 0 as the last argument.
+    template<typename C> static auto addToSize(C& c, uint64_t delta, int) -> decltype(c.estimate(), void()) { c += delta; }
+    template<typename C> static void addToSize(C& c, uint64_t delta, long) { c = c + delta; }
+
+
+    // Starts a resize. The buckets of the new array don't need to be initialized because each one is
+    // written when its bucket in the old array is moved, and it isn't read before that.
+    void startResize() {
+        // The estimate may be stale, check the real size before resizing
+        if (sizeHM.pload() <= capacity.pload()*loadFactor) return;
+        //printf("increasing capacity to %ld\n", 2*capacity);
+        newBuckets = (TMTYPE<Node*>*)TM::tmMalloc(2*capacity*sizeof(TMTYPE<Node*>));
+        migrateIdx = 0;
+    }
+
+
+    // Moves the next MIGRATE_BUCKETS buckets to the new array, and finishes the resize after the last one
+    void migrate() {
+        TMTYPE<Node*>* nb = newBuckets;
+        const uint64_t cap = capacity;
+        uint64_t i = migrateIdx;
+        const uint64_t end = (i + MIGRATE_BUCKETS < cap) ? i + MIGRATE_BUCKETS : cap;
+        for (; i < end; i++) {
+            Node* lo = nullptr;
+            Node* hi = nullptr;
             Node* node = buckets[i];
-            while(node!=nullptr){
+            while (node != nullptr) {
                 Node* next = node->next;
-                auto h = std::hash<K>{}(node->key) % newcapacity;
-                node->next = newbuckets[h];
-                newbuckets[h] = node;
+                if (std::hash<K>{}(node->key) % (2*cap) == i) {
+                    node->next = lo;
+                    lo = node;
+                } else {
+                    node->next = hi;
+                    hi = node;
+                }
                 node = next;
             }
+            nb[i] = lo;
+            nb[i+cap] = hi;
+            buckets[i] = movedMark();
+        }
+        if (i == cap) {
+            TM::tmFree(buckets);
+            buckets = nb;
+            capacity = 2*cap;
+            newBuckets = nullptr;
         }
-        TM::tmFree(buckets);
-        buckets = newbuckets;
-        capacity = newcapacity;
+        migrateIdx = i;
+    }
+
+
+    // Returns the bucket where the key is, in the new array if its bucket was already moved
+    TMTYPE<Node*>* getBucket(const K& key) {
+        const uint64_t h = std::hash<K>{}(key);
+        const uint64_t cap = capacity;
+        TMTYPE<Node*>* bucket = buckets.pload() + (h % cap);
+        if (bucket->pload() != movedMark()) return bucket;
+        return newBuckets.pload() + (h % (2*cap));
     }
 
 
@@ -78,9 +158,13 @@ public:
      */
     bool innerPut(const K& key, const V& value, V& oldValue, const bool saveOldValue) {
     	//printf("innerPut %d %d %f\n", sizeHM.pload(), capacity.pload(), loadFactor.pload()*capacity.pload());
-        if (sizeHM.pload() > capacity.pload()*loadFactor) rebuild();
-        auto h = std::hash<K>{}(key) % capacity;
-        Node* node = buckets[h];
+        if (newBuckets.pload() != nullptr) {
+            migrate();
+        } else if (estimateSize(sizeHM, 0) > capacity.pload()*loadFactor) {
+            startResize();
+        }
+        TMTYPE<Node*>* bucket = getBucket(key);
+        Node* node = *bucket;
         Node* prev = node;
         while (true) {
             if (node == nullptr) {
@@ -90,11 +174,11 @@ public:
                 //newnode->val = value;
                 //newnode->next = nullptr;
                 if (node == prev) {
-                    buckets[h] = newnode;
+                    *bucket = newnode;
                 } else {
                     prev->next = newnode;
                 }
-                sizeHM=sizeHM+1;
+                addToSize(sizeHM, 1, 0);
                 return true;  // New insertion
             }
             if (key == node->key) {
@@ -115,19 +199,20 @@ public:
      * Returns returns true if a matching key was found
      */
     bool innerRemove(const K& key, V& oldValue, const bool saveOldValue) {
-        auto h = std::hash<K>{}(key) % capacity;
-        Node* node = buckets[h];
+        if (newBuckets.pload() != nullptr) migrate();
+        TMTYPE<Node*>* bucket = getBucket(key);
+        Node* node = *bucket;
         Node* prev = node;
         while (true) {
             if (node == nullptr) return false;
             if (key == node->key) {
                 if (saveOldValue) oldValue = node->val; // Makes a copy of V
                 if (node == prev) {
-                    buckets[h] = node->next;
+                    *bucket = node->next;
                 } else {
                     prev->next = node->next;
                 }
-                sizeHM=sizeHM-1;
+                addToSize(sizeHM, (uint64_t)-1, 0);
                 TM::tmDelete(node);
                 return true;
             }
@@ -141,8 +226,7 @@ public:
      * Returns true if key is present. Saves a copy of 'value' in 'oldValue' if 'saveOldValue' is set.
      */
     bool innerGet(const K& key, V& oldValue, const bool saveOldValue) {
-        auto h = std::hash<K>{}(key) % capacity;
-        Node* node = buckets[h];
+        Node* node = *getBucket(key);
         while (true) {
             if (node == nullptr) return false;
             if (key == node->key) {
@@ -181,6 +265,51 @@ public:
         });
     }
 
+    /*
+     * Batched versions of contains(), add() and remove(), which do all the keys in a single transaction.
+     * The keys are in different buckets, so unlike the trees there is no path to share between them and the
+     * keys are not sorted. Returns the number of keys found, added or removed, and if results is not nullptr,
+     * sets results[i] to the outcome for keys[i]. All the keys must fit in one transaction.
+     */
+    uint64_t containsMany(const K* keys, uint64_t size, bool* results=nullptr) {
+        return TM::template readTx<uint64_t>([=] () {
+            uint64_t count = 0;
+            V notused;
+            for (uint64_t i = 0; i < size; i++) {
+                const bool found = innerGet(keys[i],notused,false);
+                if (results != nullptr) results[i] = found;
+                if (found) count++;
+            }
+            return count;
+        });
+    }
+
+    uint64_t addMany(const K* keys, uint64_t size, bool* results=nullptr) {
+        return TM::template updateTx<uint64_t>([=] () {
+            uint64_t count = 0;
+            V notused;
+            for (uint64_t i = 0; i < size; i++) {
+                const bool added = innerPut(keys[i],keys[i],notused,false);
+                if (results != nullptr) results[i] = added;
+                if (added) count++;
+            }
+            return count;
+        });
+    }
+
+    uint64_t removeMany(const K* keys, uint64_t size, bool* results=nullptr) {
+        return TM::template updateTx<uint64_t>([=] () {
+            uint64_t count = 0;
+            V notused;
+            for (uint64_t i = 0; i < size; i++) {
+                const bool removed = innerRemove(keys[i],notused,false);
+                if (results != nullptr) results[i] = removed;
+                if (removed) count++;
+            }
+            return count;
+        });
+    }
+
     // Used only for benchmarks
     bool addAll(K** keys, const int size) {
         for (int i = 0; i < size; i++) add(*keys[i]);
@@ -191,6 +320,60 @@ public:
         printf("rangeQuery() not implemented\n");
         return 0;
     }
+
+
+    //
+    // Map methods for running the usual tests and benchmarks
+    //
+
+    // Inserts a key with a value, or replaces the value if the key is already present
+    bool add(const K& key, const V& value) {
+        return TM::template updateTx<bool>([this,key,value] () {
+            V notused;
+            return innerPut(key,value,notused,false);
+        });
+    }
+
+    // Returns the value of the key, or V{} if the key is not present
+    V get(const K& key) {
+        return TM::template readTx<V>([this,key] () {
+            V value {};
+            innerGet(key,value,true);
+            return value;
+        });
+    }
+
+    // Sets values[i] to the value of keys[i], or V{} if it's not present, in a single transaction.
+    // Returns the number of keys found.
+    uint64_t getMany(const K* keys, uint64_t size, V* values) {
+        return TM::template readTx<uint64_t>([=] () {
+            uint64_t count = 0;
+            for (uint64_t i = 0; i < size; i++) {
+                values[i] = V{};
+                if (innerGet(keys[i],values[i],true)) count++;
+            }
+            return count;
+        });
+    }
+
+    // Inserts or replaces the value of each keys[i] with values[i], in a single transaction.
+    // Returns the number of new keys.
+    uint64_t addMany(const K* keys, const V* values, uint64_t size) {
+        return TM::template updateTx<uint64_t>([=] () {
+            uint64_t count = 0;
+            V notused;
+            for (uint64_t i = 0; i < size; i++) {
+                if (innerPut(keys[i],values[i],notused,false)) count++;
+            }
+            return count;
+        });
+    }
+
+    // Used only for benchmarks
+    bool addAll(K* keys, V* values, uint64_t size, const int tid=0) {
+        for (uint64_t i = 0; i < size; i++) add(keys[i], values[i]);
+        return true;
+    }
 };
 
 #endif /* _PERSISTENT_TM_RESIZABLE_HASH_MAP_H_ */
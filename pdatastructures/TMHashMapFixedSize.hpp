@@ -182,6 +182,21 @@ public:
         return 0;
     }
 
+    // Returns the value of the key, or V{} if the key is not present
+    V get(const K& key) {
+        return TM::template readTx<V>([=] () {
+            V value {};
+            innerGet(key,value,true);
+            return value;
+        });
+    }
+
+    // Used only for benchmarks
+    bool addAll(K* keys, V* values, uint64_t size, const int tid=0) {
+        for (uint64_t i = 0; i < size; i++) add(keys[i], values[i]);
+        return true;
+    }
+
 };
 
 #endif /* _PTM_FIXED_SIZE_HASH_MAP_H_ */
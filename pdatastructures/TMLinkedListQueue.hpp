@@ -18,8 +18,9 @@ private:
         Node(T* userItem) : item{userItem} { }
     };
 
-    alignas(128) TMTYPE<Node*>  head {nullptr};
-    alignas(128) TMTYPE<Node*>  tail {nullptr};
+    // Initialized in the constructor's transaction, some STMs can't store outside of a transaction
+    alignas(128) TMTYPE<Node*>  head;
+    alignas(128) TMTYPE<Node*>  tail;
 
 
 public:
@@ -65,6 +66,19 @@ public:
             return head->item;
         });
     }
+
+
+    // Same as dequeue() but if the queue is empty, blocks until there is an item to dequeue.
+    // Requires a TM with retry(), like 2PLSF.
+    T* dequeueBlocking() {
+        return TM::template updateTx<T*>([=] () -> T* {
+            Node* lhead = head;
+            if (lhead == tail) TM::retry();
+            head = lhead->next;
+            TM::tmDelete(lhead);
+            return head->item;
+        });
+    }
 };
 
 #endif /* _TM_LINKED_LIST_QUEUE_H_ */
@@ -67,6 +67,21 @@ public:
         });
         return retval;
     }
+
+
+    // Same as dequeue() but if the queue is empty, blocks until there is an item to dequeue.
+    // Requires a TM with retry(), like 2PLSF.
+    T* dequeueBlocking() {
+        T* retval = nullptr;
+        TM::template updateTx([&] () {
+            Node* lhead = head;
+            if (lhead == tail) TM::retry();
+            head = lhead->next;
+            TM::tmDelete(lhead);
+            retval = head->item;
+        });
+        return retval;
+    }
 };
 
 #endif /* _TM_LINKED_LIST_QUEUE_BY_REF_H_ */
@@ -0,0 +1,439 @@
+/*
+ * Copyright 2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#pragma once
+#include <string>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+
+
+/**
+ * <h1> A Relaxed AVL Set with order statistics meant to be used with PTMs </h1>
+ *
+ * Same tree as TMRAVLSet, where each node also has the number of nodes of its subtree, which gives
+ * rank(), select() and countRange() in O(log n) instead of a traversal of the range.
+ * The sizes are incremented (decremented) on the path from the root to the inserted (removed) node and
+ * recomputed in the rotations. Removals don't rebalance, so the rotations are only done by insertions.
+ *
+ * Every insertion and removal modifies the size of the root, and therefore all the updates conflict on it.
+ * TMCOUNTER is the type of the sizes: passing a type with commutative increments (like twoplsf::tmcounter)
+ * prevents the updates from conflicting on the sizes of the upper levels, but then reading an exact
+ * size takes the write-lock, which means that rank(), select() and countRange() conflict with each other.
+ */
+template<typename K, typename TM, template <typename> class TMTYPE, template <typename> class TMCOUNTER = TMTYPE>
+class TMRAVLRankSet : public TM::tmbase {
+
+private:
+    enum slot_type_e {
+        RAVL_LEFT,
+        RAVL_RIGHT,
+        MAX_SLOTS,
+        RAVL_ROOT
+    };
+
+    struct Node : public TM::tmbase {
+        TMTYPE<Node*>       slots[MAX_SLOTS];
+        TMTYPE<K>           key;
+        TMTYPE<Node*>       parent;
+        TMTYPE<int64_t>     rank;  /* cannot be greater than height of the subtree */
+        TMCOUNTER<uint64_t> size;  /* number of nodes in the subtree, including this one */
+        Node(const K& key) : key{key} {
+            parent = nullptr;
+            slots[RAVL_LEFT] = nullptr;
+            slots[RAVL_RIGHT] = nullptr;
+            rank = 0;
+            size = 1;
+        }
+    };
+
+    alignas(128) TMTYPE<Node*> root {nullptr};
+
+    // Maximum number of nodes created by each transaction of bulkLoad()
+    static const uint64_t BULK_KEYS = 1024;
+
+public:
+    TMRAVLRankSet() {
+    }
+
+    ~TMRAVLRankSet() {
+        TM::template updateTx<bool>([=] () {
+            clear();
+            return true; // Needed for CX
+        });
+    }
+
+    static std::string className() { return TM::className() + "-RAVL-Rank"; }
+
+    /*
+     * Adds a node with a key, returns false if the key is already in the set
+     */
+    bool add(K key, const int tid=0) {
+        bool ret = TM::template updateTx<bool>([=] () {
+            // Walk down the tree and insert the new node into a missing slot
+            TMTYPE<Node*>* dstp = (TMTYPE<Node*>*)&root;
+            Node *dst = nullptr;
+            while (*dstp != nullptr) {
+                dst = *dstp;
+                if (key == dst->key) return false;
+                dstp = (TMTYPE<Node*>*)&dst->slots[(key < dst->key) ? RAVL_LEFT : RAVL_RIGHT];
+            }
+            Node* n = TM::template tmNew<Node>(key);
+            n->parent = dst;
+            *dstp = n;
+            for (Node* p = dst; p != nullptr; p = p->parent) p->size++;
+            balance(n);
+            return true;
+        });
+        return ret;
+    }
+
+    /*
+     * Removes a node with an key, returns false if the key is not in the set
+     */
+    bool remove(K key, const int tid=0) {
+        bool ret = TM::template updateTx<bool>([=] () {
+            Node* n = root;
+            while (n != nullptr) {
+                if (key == n->key) {
+                    nodeRemove(n);
+                    return true;
+                }
+                n = n->slots[(key < n->key) ? RAVL_LEFT : RAVL_RIGHT];
+            }
+            return false;
+        });
+        return ret;
+    }
+
+    /*
+     * Returns true if it finds a node with a matching key
+     */
+    bool contains(K key, const int tid=0) {
+        return TM::template readTx<bool>([=] () {
+            Node* n = root;
+            while (n != nullptr) {
+                if (key == n->key) return true;
+                n = n->slots[(key < n->key) ? RAVL_LEFT : RAVL_RIGHT];
+            }
+            return false;
+        });
+    }
+
+    // Returns the number of keys in the set
+    uint64_t size() {
+        return TM::template readTx<uint64_t>([=] () { return nodeSize(root); });
+    }
+
+    // Returns the number of keys in the set that are lower than key
+    uint64_t rank(K key) {
+        return TM::template readTx<uint64_t>([=] () { return nodeCountLower(key); });
+    }
+
+    // Places in key the i-th lowest key of the set, starting at zero. Returns false if the set has i keys or less
+    bool select(uint64_t i, K& key) {
+        K* pkey = &key;
+        return TM::template readTx<bool>([=] () {
+            uint64_t j = i;
+            Node* n = root;
+            while (n != nullptr) {
+                const uint64_t leftSize = nodeSize(n->slots[RAVL_LEFT]);
+                if (j < leftSize) {
+                    n = n->slots[RAVL_LEFT];
+                } else if (j == leftSize) {
+                    *pkey = n->key;
+                    return true;
+                } else {
+                    j -= leftSize + 1;
+                    n = n->slots[RAVL_RIGHT];
+                }
+            }
+            return false;
+        });
+    }
+
+    // Returns the number of keys in [lo,hi), the same interval as rangeQuery()
+    uint64_t countRange(const K &lo, const K &hi) {
+        return TM::template readTx<uint64_t>([=] () {
+            if (!(lo < hi)) return (uint64_t)0;
+            return nodeCountLower(hi) - nodeCountLower(lo);
+        });
+    }
+
+    // Used only for benchmarks
+    bool addAll(K** keys, const int size, const int tid=0) {
+        for (int i = 0; i < size; i++) add(*keys[i]);
+        return true;
+    }
+
+    /*
+     * Fills an empty set with keys sorted in ascending order and without duplicates.
+     * Same as TMRAVLSet::bulkLoad(), where the size of each subtree is known when its root is created.
+     */
+    void bulkLoad(const K* keys, uint64_t size, const int numThreads=1) {
+        Node* n = bulkBuild(keys, 0, size, numThreads);
+        TM::template updateTx<bool>([=] () {
+            assert(root == nullptr);
+            root = n;
+            return true;
+        });
+    }
+
+    // Places the keys in [lo,hi) in resultKeys, in ascending order. Returns the number of keys
+    int rangeQuery(const K &lo, const K &hi, K *const resultKeys) {
+        return TM::template readTx<int>([=] () {
+            int numKeys = 0;
+            // Find the lowest key equal or higher than 'lo'
+            Node* n = root;
+            Node* first = nullptr;
+            while (n != nullptr) {
+                if (lo == n->key) {
+                    first = n;
+                    break;
+                }
+                if (lo < n->key) {
+                    first = n;
+                    n = n->slots[RAVL_LEFT];
+                } else {
+                    n = n->slots[RAVL_RIGHT];
+                }
+            }
+            // Traverse until we reach a key equal or higher than 'hi'
+            for (n = first; n != nullptr; n = nodeSuccessor(n)) {
+                K key = n->key;
+                if (!(key < hi)) break;
+                resultKeys[numKeys++] = key;
+            }
+            return numKeys;
+        });
+    }
+
+
+private:
+    // Internal: returns the number of nodes in the subtree, zero for nullptr
+    uint64_t nodeSize(Node* n) {
+        return n == nullptr ? 0 : n->size.pload();
+    }
+
+    // Internal: returns the number of keys lower than key. Must be called from within a transaction
+    uint64_t nodeCountLower(const K& key) {
+        uint64_t count = 0;
+        Node* n = root;
+        while (n != nullptr) {
+            const K nkey = n->key;
+            if (key < nkey) {
+                n = n->slots[RAVL_LEFT];
+                continue;
+            }
+            count += nodeSize(n->slots[RAVL_LEFT]);
+            if (key == nkey) break;
+            count++;
+            n = n->slots[RAVL_RIGHT];
+        }
+        return count;
+    }
+
+    // Internal: builds the subtree with the keys in [lo,hi), one transaction for each subtree of up to BULK_KEYS nodes
+    Node* bulkBuild(const K* keys, uint64_t lo, uint64_t hi, const int numThreads) {
+        if (hi - lo <= BULK_KEYS) {
+            return TM::template updateTx<Node*>([=] () { return bulkSubtree(keys, lo, hi); });
+        }
+        const uint64_t mid = lo + (hi - lo)/2;
+        Node* left;
+        Node* right;
+        if (numThreads > 1) {
+            std::thread th([&] () { left = bulkBuild(keys, lo, mid, numThreads/2); });
+            right = bulkBuild(keys, mid+1, hi, numThreads - numThreads/2);
+            th.join();
+        } else {
+            left = bulkBuild(keys, lo, mid, 1);
+            right = bulkBuild(keys, mid+1, hi, 1);
+        }
+        return TM::template updateTx<Node*>([=] () { return bulkNode(keys[mid], left, right, hi - lo); });
+    }
+
+    // Internal: builds the subtree with the keys in [lo,hi). Must be called from within a transaction
+    Node* bulkSubtree(const K* keys, uint64_t lo, uint64_t hi) {
+        if (lo == hi) return nullptr;
+        const uint64_t mid = lo + (hi - lo)/2;
+        return bulkNode(keys[mid], bulkSubtree(keys, lo, mid), bulkSubtree(keys, mid+1, hi), hi - lo);
+    }
+
+    // Internal: a subtree with 'size' nodes split in the middle has a height of floor(log2(size))
+    Node* bulkNode(const K& key, Node* left, Node* right, uint64_t size) {
+        Node* n = TM::template tmNew<Node>(key);
+        n->slots[RAVL_LEFT] = left;
+        n->slots[RAVL_RIGHT] = right;
+        if (left != nullptr) left->parent = n;
+        if (right != nullptr) right->parent = n;
+        n->rank = 63 - __builtin_clzll(size);
+        n->size = size;
+        return n;
+    }
+
+    // Internal: Recursively clears the given subtree. Frees the given node.
+    void clearNode(Node* n) {
+        if (n == nullptr) return;
+        clearNode(n->slots[RAVL_LEFT]);
+        clearNode(n->slots[RAVL_RIGHT]);
+        TM::tmDelete(n);
+    }
+
+    // Clears the entire tree, starting from the root
+    void clear() {
+        clearNode(root);
+        root = nullptr;
+    }
+
+    // Internal: returns the opposite slot type, cannot be called for root type
+    slot_type_e slotOpposite(slot_type_e t) {
+        assert(t != RAVL_ROOT);
+        return t == RAVL_LEFT ? RAVL_RIGHT : RAVL_LEFT;
+    }
+
+    // Internal: returns the type of the given node: left child, right child or root
+    slot_type_e slotType(Node* n) {
+        if (n->parent == nullptr) return RAVL_ROOT;
+        return n->parent->slots[RAVL_LEFT] == n ? RAVL_LEFT : RAVL_RIGHT;
+    }
+
+    // Internal: returns the sibling of the given node, nullptr if the node is root (has no parent)
+    Node* nodeSibling(Node* n) {
+        slot_type_e t = slotType(n);
+        if (t == RAVL_ROOT) return nullptr;
+        return n->parent->slots[t == RAVL_LEFT ? RAVL_RIGHT : RAVL_LEFT];
+    }
+
+    // Internal: returns the pointer to the memory location in  which the given node resides
+    TMTYPE<Node*>* nodeRef(Node* n) {
+        slot_type_e t = slotType(n);
+        return (TMTYPE<Node*>*)(t == RAVL_ROOT ? &root : &(n->parent->slots[t]));
+    }
+
+    // Internal: performs a rotation around a given node:
+    // The node swaps place with its parent. If 'node' is right child, parent becomes
+    // the left child of node, otherwise parent becomes right child of node.
+    // The node takes the size of the parent, which is the same subtree, and the size
+    // of the parent is recomputed from its new children.
+    void rotate(Node* n) {
+        assert(n->parent != nullptr);
+        Node* p = n->parent;
+        TMTYPE<Node*>* pref = nodeRef(p);
+        slot_type_e t = slotType(n);
+        slot_type_e t_opposite = slotOpposite(t);
+        const uint64_t psize = p->size;
+        n->parent = p->parent;
+        p->parent = n;
+        *pref = n;
+        if ((p->slots[t] = n->slots[t_opposite]) != nullptr) p->slots[t]->parent = p;
+        n->slots[t_opposite] = p;
+        p->size = nodeSize(p->slots[RAVL_LEFT]) + nodeSize(p->slots[RAVL_RIGHT]) + 1;
+        n->size = psize;
+    }
+
+    // (internal) returns the rank of the node:
+    // For the purpose of balancing, nullptr nodes have rank -1.
+    int64_t nodeRank(Node* n) {
+        return n == nullptr ? -1 : n->rank.pload();
+    }
+
+    // Internal: returns the rank different between parent node p and its child n
+    // Every rank difference must be positive. Either of these can be nullptr.
+    int64_t nodeRankDifferenceParent(Node* p, Node* n) {
+        return nodeRank(p) - nodeRank(n);
+    }
+
+    int64_t nodeRankDifference(Node* n) {
+        return nodeRankDifferenceParent(n->parent, n);
+    }
+
+    // Internal: checks if a given node is strictly i,j-node
+    bool nodeIs_i_j(Node* n, int i, int j) {
+        return (nodeRankDifferenceParent(n, n->slots[RAVL_LEFT]) == i &&
+                nodeRankDifferenceParent(n, n->slots[RAVL_RIGHT]) == j);
+    }
+
+    // Internal: checks if a given node is i,j-node or j,i-node
+    bool nodeIs(Node* n, int i, int j) {
+        return nodeIs_i_j(n, i, j) || nodeIs_i_j(n, j, i);
+    }
+
+    // Promotes a given node by increasing its rank
+    void nodePromote(Node* n) {
+        n->rank++;
+    }
+
+    // Demotes a given node by decreasing its rank
+    void nodeDemote(Node* n) {
+        assert( n->rank.pload() > 0 );
+        n->rank--;
+    }
+
+    void balance(Node *n) {
+        // Walk up the tree, promoting nodes
+        while (n->parent.pload() != nullptr && nodeIs(n->parent, 0, 1)) {
+            nodePromote(n->parent);
+            n = n->parent;
+        }
+        // Either the rank rule holds or n is a 0-child whose sibling is an i-child with i > 1.
+        Node* s = nodeSibling(n);
+        if (!(nodeRankDifference(n) == 0 && nodeRankDifferenceParent(n->parent, s) > 1)) return;
+        Node *y = n->parent;
+        // if n is a left child, let z be n's right child and vice versa */
+        slot_type_e t = slotOpposite(slotType(n));
+        Node* z = n->slots[t];
+        if (z == nullptr || nodeRankDifference(z) == 2) {
+            rotate(n);
+            nodeDemote(y);
+        } else if (nodeRankDifference(z) == 1) {
+            rotate(z);
+            rotate(z);
+            nodePromote(z);
+            nodeDemote(n);
+            nodeDemote(y);
+        }
+    }
+
+    // Internal: returns left-most or right-most node in the subtree
+    Node* nodeTypeMost(Node* n, slot_type_e t) {
+        while (n->slots[t] != nullptr) n = n->slots[t];
+        return n;
+    }
+
+    // Internal: returns the successor or predecessor of the node
+    Node* nodeCessor(Node* n, slot_type_e t) {
+        // If t child is present, we are looking for t-opposite-most node in t child subtree
+        if (n->slots[t]) return nodeTypeMost(n->slots[t], slotOpposite(t));
+        // otherwise get the first parent on the t path
+        while (n->parent != nullptr && n == n->parent->slots[t]) n = n->parent;
+        return n->parent;
+    }
+
+    // Internal: returns node's successor. It's the first node larger than n.
+    Node* nodeSuccessor(Node* n) {
+        return nodeCessor(n, RAVL_RIGHT);
+    }
+
+    void nodeRemove(Node* n) {
+        if (n->slots[RAVL_LEFT] != nullptr && n->slots[RAVL_RIGHT] != nullptr) {
+            // If both children are present, remove the successor instead
+            Node* s = nodeSuccessor(n);
+            n->key = s->key;  // TODO: this won't work for intrusive stuff
+            nodeRemove(s);
+        } else {
+            // Swap n with the child that may exist
+            Node* r = n->slots[RAVL_LEFT] != nullptr ? n->slots[RAVL_LEFT] : n->slots[RAVL_RIGHT];
+            Node* p = n->parent;
+            if (r != nullptr) r->parent = p;
+            *nodeRef(n) = r;
+            for (; p != nullptr; p = p->parent) p->size--;
+            TM::tmDelete(n);
+        }
+    }
+
+};
@@ -9,6 +9,9 @@
 #pragma once
 #include <string>
 #include <cassert>
+#include <thread>
+#include <vector>
+#include <algorithm>
 
 
 /**
@@ -47,6 +50,12 @@ private:
 
     alignas(128) TMTYPE<Node*> root {nullptr};
 
+    // Maximum number of nodes created by each transaction of bulkLoad()
+    static const uint64_t BULK_KEYS = 1024;
+
+    // Number of levels that the finger search goes up before starting again from the root
+    static const int FINGER_LEVELS = 4;
+
 public:
     TMRAVLSet() {
     }
@@ -114,12 +123,96 @@ public:
         });
     }
 
+    /*
+     * Batched versions of contains(), add() and remove(), which do all the keys in a single transaction.
+     * The keys are visited in ascending order and the search of each key starts from the node of the previous
+     * key (finger search), going up only to the first ancestor whose subtree has the key, so keys that are
+     * close to each other share most of the path. Returns the number of keys found, added or removed, and if
+     * results is not nullptr, sets results[i] to the outcome for keys[i]. All the keys must fit in one transaction.
+     */
+    uint64_t containsMany(const K* keys, uint64_t size, bool* results=nullptr) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template readTx<uint64_t>([=] () {
+            Node* finger = nullptr;
+            Node* parent;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const bool found = fingerFind(finger, keys[ord[j]], parent) != nullptr;
+                if (results != nullptr) results[ord[j]] = found;
+                if (found) count++;
+            }
+            return count;
+        });
+    }
+
+    uint64_t addMany(const K* keys, uint64_t size, bool* results=nullptr, const int tid=0) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template updateTx<uint64_t>([=] () {
+            Node* finger = nullptr;
+            Node* parent;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const K key = keys[ord[j]];
+                const bool added = fingerFind(finger, key, parent) == nullptr;
+                if (added) {
+                    Node* n = TM::template tmNew<Node>(key);
+                    n->parent = parent;
+                    if (parent == nullptr) root = n;
+                    else parent->slots[(key < parent->key) ? RAVL_LEFT : RAVL_RIGHT] = n;
+                    balance(n);
+                    finger = n;
+                    count++;
+                }
+                if (results != nullptr) results[ord[j]] = added;
+            }
+            return count;
+        });
+    }
+
+    uint64_t removeMany(const K* keys, uint64_t size, bool* results=nullptr, const int tid=0) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template updateTx<uint64_t>([=] () {
+            Node* finger = nullptr;
+            Node* parent;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                Node* n = fingerFind(finger, keys[ord[j]], parent);
+                if (n != nullptr) {
+                    // Either n or its successor is freed, but never its predecessor
+                    finger = nodePredecessor(n);
+                    nodeRemove(n);
+                    count++;
+                }
+                if (results != nullptr) results[ord[j]] = n != nullptr;
+            }
+            return count;
+        });
+    }
+
     // Used only for benchmarks
     bool addAll(K** keys, const int size, const int tid=0) {
         for (int i = 0; i < size; i++) add(*keys[i]);
         return true;
     }
 
+    /*
+     * Fills an empty set with keys sorted in ascending order and without duplicates.
+     * The tree is built bottom-up as a perfectly balanced tree where the rank of each node is its height.
+     * The subtrees are built by up to numThreads threads, in transactions of at most BULK_KEYS nodes,
+     * and nobody else can see them until the root is published.
+     */
+    void bulkLoad(const K* keys, uint64_t size, const int numThreads=1) {
+        Node* n = bulkBuild(keys, 0, size, numThreads);
+        TM::template updateTx<bool>([=] () {
+            assert(root == nullptr);
+            root = n;
+            return true;
+        });
+    }
+
     // Traverses numKeys keys of the set starting at key and returns the number of traversed nodes
     uint64_t traversal(K key, uint64_t numKeys) {
         return TM::template readTx<bool>([=] () {
@@ -168,6 +261,94 @@ public:
 
 
 private:
+    // Internal: returns the indexes of the keys in ascending order of the keys, and of the index for equal keys
+    static std::vector<uint64_t> sortedOrder(const K* keys, uint64_t size) {
+        std::vector<uint64_t> order(size);
+        for (uint64_t i = 0; i < size; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [keys] (uint64_t a, uint64_t b) {
+            return keys[a] < keys[b] || (!(keys[b] < keys[a]) && a < b);
+        });
+        return order;
+    }
+
+    // Internal: searches key starting from the finger, a node with a key equal or lower than key, or from the
+    // root if the finger is nullptr. The subtree of a node goes up to the key of the first ancestor that has it
+    // on the left, so we go up from the finger until that key is higher than key, and then down. If that's more
+    // than FINGER_LEVELS up, the keys are far apart and it's cheaper to go down from the root, whose path is
+    // already locked by this transaction.
+    // Returns the node with key, or nullptr and sets parent to the node where key would be inserted.
+    // The finger is moved to the last node on the path with a key equal or lower than key.
+    // Must be called from within a transaction
+    Node* fingerFind(Node*& finger, const K& key, Node*& parent) {
+        Node* n = finger;
+        if (n == nullptr) {
+            n = root;
+        } else {
+            Node* p = n->parent;
+            for (int i = 0; p != nullptr && !(p->slots[RAVL_LEFT] == n && key < p->key); i++) {
+                if (i == FINGER_LEVELS) {
+                    n = root;
+                    break;
+                }
+                n = p;
+                p = n->parent;
+            }
+        }
+        parent = nullptr;
+        while (n != nullptr) {
+            const K nkey = n->key;
+            if (key == nkey) {
+                finger = n;
+                return n;
+            }
+            parent = n;
+            if (key < nkey) {
+                n = n->slots[RAVL_LEFT];
+            } else {
+                finger = n;
+                n = n->slots[RAVL_RIGHT];
+            }
+        }
+        return nullptr;
+    }
+
+    // Internal: builds the subtree with the keys in [lo,hi), one transaction for each subtree of up to BULK_KEYS nodes
+    Node* bulkBuild(const K* keys, uint64_t lo, uint64_t hi, const int numThreads) {
+        if (hi - lo <= BULK_KEYS) {
+            return TM::template updateTx<Node*>([=] () { return bulkSubtree(keys, lo, hi); });
+        }
+        const uint64_t mid = lo + (hi - lo)/2;
+        Node* left;
+        Node* right;
+        if (numThreads > 1) {
+            std::thread th([&] () { left = bulkBuild(keys, lo, mid, numThreads/2); });
+            right = bulkBuild(keys, mid+1, hi, numThreads - numThreads/2);
+            th.join();
+        } else {
+            left = bulkBuild(keys, lo, mid, 1);
+            right = bulkBuild(keys, mid+1, hi, 1);
+        }
+        return TM::template updateTx<Node*>([=] () { return bulkNode(keys[mid], left, right, hi - lo); });
+    }
+
+    // Internal: builds the subtree with the keys in [lo,hi). Must be called from within a transaction
+    Node* bulkSubtree(const K* keys, uint64_t lo, uint64_t hi) {
+        if (lo == hi) return nullptr;
+        const uint64_t mid = lo + (hi - lo)/2;
+        return bulkNode(keys[mid], bulkSubtree(keys, lo, mid), bulkSubtree(keys, mid+1, hi), hi - lo);
+    }
+
+    // Internal: a subtree with 'size' nodes split in the middle has a height of floor(log2(size))
+    Node* bulkNode(const K& key, Node* left, Node* right, uint64_t size) {
+        Node* n = TM::template tmNew<Node>(key);
+        n->slots[RAVL_LEFT] = left;
+        n->slots[RAVL_RIGHT] = right;
+        if (left != nullptr) left->parent = n;
+        if (right != nullptr) right->parent = n;
+        n->rank = 63 - __builtin_clzll(size);
+        return n;
+    }
+
     // Internal: Recursively clears the given subtree. Frees the given node.
     void clearNode(Node* n) {
         if (n == nullptr) return;
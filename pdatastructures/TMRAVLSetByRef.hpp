@@ -10,6 +10,7 @@
 
 #include <string>
 #include <cassert>
+#include <thread>
 
 
 /**
@@ -48,6 +49,9 @@ private:
 
     alignas(128) TMTYPE<Node*> root {nullptr};
 
+    // Maximum number of nodes created by each transaction of bulkLoad()
+    static const uint64_t BULK_KEYS = 1024;
+
 public:
     TMRAVLSetByRef() {
     }
@@ -126,6 +130,20 @@ public:
         return true;
     }
 
+    /*
+     * Fills an empty set with keys sorted in ascending order and without duplicates.
+     * The tree is built bottom-up as a perfectly balanced tree where the rank of each node is its height.
+     * The subtrees are built by up to numThreads threads, in transactions of at most BULK_KEYS nodes,
+     * and nobody else can see them until the root is published.
+     */
+    void bulkLoad(const K* keys, uint64_t size, const int numThreads=1) {
+        Node* n = bulkBuild(keys, 0, size, numThreads);
+        TM::updateTx([&] () {
+            assert(root == nullptr);
+            root = n;
+        });
+    }
+
     // Traverses numKeys keys of the set starting at key and returns the number of traversed nodes
     uint64_t traversal(K key, uint64_t numKeys) {
         uint64_t numTraversals = 0;
@@ -176,6 +194,46 @@ public:
 
 
 private:
+    // Internal: builds the subtree with the keys in [lo,hi), one transaction for each subtree of up to BULK_KEYS nodes
+    Node* bulkBuild(const K* keys, uint64_t lo, uint64_t hi, const int numThreads) {
+        Node* n = nullptr;
+        if (hi - lo <= BULK_KEYS) {
+            TM::updateTx([&] () { n = bulkSubtree(keys, lo, hi); });
+            return n;
+        }
+        const uint64_t mid = lo + (hi - lo)/2;
+        Node* left;
+        Node* right;
+        if (numThreads > 1) {
+            std::thread th([&] () { left = bulkBuild(keys, lo, mid, numThreads/2); });
+            right = bulkBuild(keys, mid+1, hi, numThreads - numThreads/2);
+            th.join();
+        } else {
+            left = bulkBuild(keys, lo, mid, 1);
+            right = bulkBuild(keys, mid+1, hi, 1);
+        }
+        TM::updateTx([&] () { n = bulkNode(keys[mid], left, right, hi - lo); });
+        return n;
+    }
+
+    // Internal: builds the subtree with the keys in [lo,hi). Must be called from within a transaction
+    Node* bulkSubtree(const K* keys, uint64_t lo, uint64_t hi) {
+        if (lo == hi) return nullptr;
+        const uint64_t mid = lo + (hi - lo)/2;
+        return bulkNode(keys[mid], bulkSubtree(keys, lo, mid), bulkSubtree(keys, mid+1, hi), hi - lo);
+    }
+
+    // Internal: a subtree with 'size' nodes split in the middle has a height of floor(log2(size))
+    Node* bulkNode(const K& key, Node* left, Node* right, uint64_t size) {
+        Node* n = TM::template tmNew<Node>(key);
+        n->slots[RAVL_LEFT] = left;
+        n->slots[RAVL_RIGHT] = right;
+        if (left != nullptr) left->parent = n;
+        if (right != nullptr) right->parent = n;
+        n->rank = 63 - __builtin_clzll(size);
+        return n;
+    }
+
     // Internal: Recursively clears the given subtree. Frees the given node.
     void clearNode(Node* n) {
         if (n == nullptr) return;
@@ -3,6 +3,7 @@
 #include <cassert>
 #include <stdexcept>
 #include <algorithm>
+#include <thread>
 
 
 // Adapted from Java to C++ from the original at http://algs4.cs.princeton.edu/code/edu/princeton/cs/algs4/RedBlackBST.java
@@ -24,6 +25,9 @@ class TMRedBlackTreeByRef : public TM::tmbase {
 
     TMTYPE<Node*> root {nullptr};   // root of the BST
 
+    // Maximum number of nodes created by each transaction of bulkLoad()
+    static const uint64_t BULK_KEYS = 1024;
+
     inline void assignAndFreeIfNull(TMTYPE<Node*>& z, Node* w) {
         Node* tofree = z;
         z = w;
@@ -609,6 +613,98 @@ public:
     }
 
 
+    /***************************************************************************
+     *  Bulk load.
+     ***************************************************************************/
+
+    /**
+     * Fills an empty tree with keys sorted in ascending order and without duplicates, each with a value equal to the key.
+     * The tree is built bottom-up as the 2-3 tree of height floor(log2(size+1)), made of 2-nodes (a black node)
+     * and, where the keys don't fit in 2-nodes, of 3-nodes (a black node with a red left child).
+     * The subtrees are built by up to numThreads threads, in transactions of at most BULK_KEYS nodes,
+     * and nobody else can see them until the root is published.
+     */
+    void bulkLoad(const K* keys, uint64_t size, const int numThreads=1) {
+        Node* n = bulkBuild(keys, 0, size, 63 - __builtin_clzll(size+1), numThreads);
+        TM::template updateTx([&] () {
+            assert(root == nullptr);
+            root = n;
+        });
+    }
+
+    // maximum number of keys in a 2-3 tree of the given height, when all the nodes are 3-nodes
+    static uint64_t bulkMaxKeys(int height) {
+        uint64_t max = 1;
+        for (int i = 0; i < height && max < UINT64_MAX/3; i++) max *= 3;
+        return max - 1;
+    }
+
+    // places in mids the keys of the 2-node or 3-node at the top of the 2-3 tree with the keys in [lo,hi).
+    // The subtrees between them have between 2^(height-1)-1 and 3^(height-1)-1 keys. Returns the number of keys in the node
+    int bulkSplit(uint64_t lo, uint64_t hi, int height, uint64_t* mids) {
+        const uint64_t size = hi - lo;
+        if (size/2 <= bulkMaxKeys(height-1)) {
+            mids[0] = lo + (size-1)/2;
+            return 1;
+        }
+        mids[0] = lo + (size-2)/3;
+        mids[1] = mids[0] + 1 + (size-1)/3;
+        return 2;
+    }
+
+    // builds the subtree with the keys in [lo,hi), one transaction for each subtree of up to BULK_KEYS nodes
+    Node* bulkBuild(const K* keys, uint64_t lo, uint64_t hi, int height, const int numThreads) {
+        Node* n = nullptr;
+        if (hi - lo <= BULK_KEYS) {
+            TM::template updateTx([&] () { n = bulkSubtree(keys, lo, hi, height); });
+            return n;
+        }
+        uint64_t mids[2];
+        const int numMids = bulkSplit(lo, hi, height, mids);
+        Node* children[3] = {};
+        if (numThreads > 1) {
+            std::thread th([&] () { children[0] = bulkBuild(keys, lo, mids[0], height-1, numThreads/2); });
+            for (int i = 1; i <= numMids; i++) {
+                children[i] = bulkBuild(keys, mids[i-1]+1, (i == numMids) ? hi : mids[i], height-1, numThreads - numThreads/2);
+            }
+            th.join();
+        } else {
+            for (int i = 0; i <= numMids; i++) {
+                children[i] = bulkBuild(keys, (i == 0) ? lo : mids[i-1]+1, (i == numMids) ? hi : mids[i], height-1, 1);
+            }
+        }
+        TM::template updateTx([&] () { n = bulkNode(keys, lo, hi, mids, numMids, children); });
+        return n;
+    }
+
+    // builds the subtree with the keys in [lo,hi). Must be called from within a transaction
+    Node* bulkSubtree(const K* keys, uint64_t lo, uint64_t hi, int height) {
+        if (lo == hi) return nullptr;
+        uint64_t mids[2];
+        const int numMids = bulkSplit(lo, hi, height, mids);
+        Node* children[3] = {};
+        for (int i = 0; i <= numMids; i++) {
+            children[i] = bulkSubtree(keys, (i == 0) ? lo : mids[i-1]+1, (i == numMids) ? hi : mids[i], height-1);
+        }
+        return bulkNode(keys, lo, hi, mids, numMids, children);
+    }
+
+    // creates the 2-node or 3-node at the top of the subtree with the keys in [lo,hi). Must be called from within a transaction
+    Node* bulkNode(const K* keys, uint64_t lo, uint64_t hi, const uint64_t* mids, int numMids, Node* const* children) {
+        Node* left = children[0];
+        if (numMids == 2) {
+            left = TM::template tmNew<Node>(keys[mids[0]], keys[mids[0]], COLOR_RED, (int64_t)(mids[1]-lo));
+            left->left = children[0];
+            left->right = children[1];
+        }
+        const uint64_t top = mids[numMids-1];
+        Node* n = TM::template tmNew<Node>(keys[top], keys[top], COLOR_BLACK, (int64_t)(hi-lo));
+        n->left = left;
+        n->right = children[numMids];
+        return n;
+    }
+
+
 
     // Inserts a key only if it's not already present
     bool add(K key, const int tid=0) {
@@ -0,0 +1,115 @@
+#ifndef _TM_RING_QUEUE_H_
+#define _TM_RING_QUEUE_H_
+
+#include <string>
+#include <cstdint>
+
+
+/**
+ * <h1> A bounded Ring Buffer queue for usage with STMs and PTMs </h1>
+ *
+ * The items are stored in an array of CAPACITY slots inside the queue, so there are no allocations.
+ * An empty slot is nullptr, which means the items can't be nullptr.
+ * head and tail are only incremented and the slot of an index is index % CAPACITY. The enqueuers find out that
+ * the queue is full because the slot of tail is taken and the dequeuers find out that it's empty because the
+ * slot of head is empty, which means that the enqueuers don't read head and the dequeuers don't read tail.
+ * Enqueuers and dequeuers only conflict with each other on the slots, when the queue is nearly empty or full.
+ */
+template<typename T, typename TM, template <typename> class TMTYPE, uint64_t CAPACITY = 4096>
+class TMRingQueue : public TM::tmbase {
+
+private:
+    alignas(128) TMTYPE<uint64_t>  head;
+    alignas(128) TMTYPE<uint64_t>  tail;
+    alignas(128) TMTYPE<T*>        slots[CAPACITY];
+
+
+public:
+    TMRingQueue() {
+        TM::template updateTx<bool>([=] () {
+            head = 0;
+            tail = 0;
+            for (uint64_t i = 0; i < CAPACITY; i++) slots[i] = nullptr;
+            return true;
+        });
+    }
+
+
+    ~TMRingQueue() { }
+
+
+    static std::string className() { return TM::className() + "-RingQueue"; }
+
+
+    // Returns false if the queue is full
+    bool enqueue(T* item) {
+        return TM::template updateTx<bool>([=] () {
+            const uint64_t ltail = tail;
+            if (slots[ltail % CAPACITY] != nullptr) return false;
+            slots[ltail % CAPACITY] = item;
+            tail = ltail+1;
+            return true;
+        });
+    }
+
+
+    // Returns nullptr if the queue is empty
+    T* dequeue() {
+        return TM::template updateTx<T*>([=] () -> T* {
+            const uint64_t lhead = head;
+            T* item = slots[lhead % CAPACITY];
+            if (item == nullptr) return nullptr;
+            slots[lhead % CAPACITY] = nullptr;
+            head = lhead+1;
+            return item;
+        });
+    }
+
+
+    // Enqueues as many of the numItems items as fit in the queue, in a single transaction. Returns the number of enqueued items
+    uint64_t enqueueBatch(T** items, const uint64_t numItems) {
+        return TM::template updateTx<uint64_t>([=] () {
+            const uint64_t ltail = tail;
+            uint64_t i = 0;
+            for (; i < numItems; i++) {
+                if (slots[(ltail+i) % CAPACITY] != nullptr) break;
+                slots[(ltail+i) % CAPACITY] = items[i];
+            }
+            if (i > 0) tail = ltail+i;
+            return i;
+        });
+    }
+
+
+    // Dequeues up to maxItems items into items, in a single transaction. Returns the number of dequeued items
+    uint64_t dequeueBatch(T** items, const uint64_t maxItems) {
+        return TM::template updateTx<uint64_t>([=] () {
+            const uint64_t lhead = head;
+            uint64_t i = 0;
+            for (; i < maxItems; i++) {
+                T* item = slots[(lhead+i) % CAPACITY];
+                if (item == nullptr) break;
+                slots[(lhead+i) % CAPACITY] = nullptr;
+                items[i] = item;
+            }
+            if (i > 0) head = lhead+i;
+            return i;
+        });
+    }
+
+
+    // Same as dequeue() but if the queue is empty, blocks until there is an item to dequeue.
+    // Requires a TM with retry(), like 2PLSF.
+    T* dequeueBlocking() {
+        return TM::template updateTx<T*>([=] () -> T* {
+            const uint64_t lhead = head;
+            T* item = slots[lhead % CAPACITY];
+            if (item == nullptr) TM::retry();
+            slots[lhead % CAPACITY] = nullptr;
+            head = lhead+1;
+            return item;
+        });
+    }
+};
+
+#endif /* _TM_RING_QUEUE_H_ */
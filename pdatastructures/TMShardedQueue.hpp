@@ -0,0 +1,168 @@
+#ifndef _TM_SHARDED_QUEUE_H_
+#define _TM_SHARDED_QUEUE_H_
+
+#include <string>
+#include <cstdint>
+#include <atomic>
+
+
+/**
+ * <h1> A relaxed FIFO queue (memory unbounded) made of linked list sub-queues, for usage with STMs and PTMs </h1>
+ *
+ * Each thread is assigned one of the NUM_SHARDS sub-queues the first time it calls the queue, in round-robin.
+ * A thread enqueues in its own sub-queue and dequeues from the first non-empty sub-queue starting with the
+ * last one where it found items (initially its own), which means that a thread that only dequeues doesn't
+ * scan all the sub-queues each time when the threads that enqueue are fewer than NUM_SHARDS.
+ * There is one order per sub-queue: the items enqueued by the same thread are dequeued in order, and the
+ * items of different threads can be dequeued in any order.
+ *
+ * Each sub-queue is like TMLinkedListQueue, except that the dequeuers test if it's empty with the next of
+ * the sentinel node instead of reading tail, which means that they only conflict with the enqueuers of the
+ * same sub-queue when it's empty or has a single item.
+ */
+template<typename T, typename TM, template <typename> class TMTYPE, int NUM_SHARDS = 16>
+class TMShardedQueue : public TM::tmbase {
+
+private:
+    struct Node : public TM::tmbase {
+        TMTYPE<T*>    item;
+        TMTYPE<Node*> next {nullptr};
+        Node(T* userItem) : item{userItem} { }
+    };
+
+    struct Shard {
+        alignas(128) TMTYPE<Node*>  head;
+        alignas(128) TMTYPE<Node*>  tail;
+    };
+
+    Shard shards[NUM_SHARDS];
+
+    // The sub-queue of the calling thread
+    static int myShard() {
+        static std::atomic<int> numThreads {0};
+        static thread_local int shard = numThreads.fetch_add(1) % NUM_SHARDS;
+        return shard;
+    }
+
+    // The sub-queue where the calling thread starts to dequeue: its own, or the last one where it found items
+    static int& dequeueShard() {
+        static thread_local int shard = myShard();
+        return shard;
+    }
+
+    // Must be called from within a transaction
+    T* dequeueFrom(Shard& shard) {
+        Node* lhead = shard.head;
+        Node* lnext = lhead->next;
+        if (lnext == nullptr) return nullptr;
+        shard.head = lnext;
+        TM::tmDelete(lhead);
+        return lnext->item;
+    }
+
+
+public:
+    TMShardedQueue() {
+        TM::template updateTx<bool>([=] () {
+            for (int i = 0; i < NUM_SHARDS; i++) {
+                Node* sentinelNode = TM::template tmNew<Node>(nullptr);
+                shards[i].head = sentinelNode;
+                shards[i].tail = sentinelNode;
+            }
+            return true;
+        });
+    }
+
+
+    ~TMShardedQueue() {
+        TM::template updateTx<bool>([=] () {
+            for (int i = 0; i < NUM_SHARDS; i++) {
+                while (dequeueFrom(shards[i]) != nullptr); // Drain the sub-queue
+                Node* lhead = shards[i].head;
+                TM::tmDelete(lhead);
+            }
+            return true;
+        });
+    }
+
+
+    static std::string className() { return TM::className() + "-ShardedQueue"; }
+
+
+    bool enqueue(T* item) {
+        Shard* shard = &shards[myShard()];
+        return TM::template updateTx<bool>([=] () {
+            Node* newNode = TM::template tmNew<Node>(item);
+            Node* ltail = shard->tail;
+            ltail->next = newNode;
+            shard->tail = newNode;
+            return true;
+        });
+    }
+
+
+    // Returns nullptr if all the sub-queues are empty
+    T* dequeue() {
+        const int first = dequeueShard();
+        int found = first;
+        int* foundp = &found;
+        T* item = TM::template updateTx<T*>([=] () -> T* {
+            for (int i = 0; i < NUM_SHARDS; i++) {
+                T* item = dequeueFrom(shards[(first+i) % NUM_SHARDS]);
+                if (item == nullptr) continue;
+                *foundp = (first+i) % NUM_SHARDS;
+                return item;
+            }
+            return nullptr;
+        });
+        dequeueShard() = found;
+        return item;
+    }
+
+
+    // Enqueues the numItems items in the sub-queue of the calling thread, in a single transaction
+    uint64_t enqueueBatch(T** items, const uint64_t numItems) {
+        if (numItems == 0) return 0;
+        Shard* shard = &shards[myShard()];
+        return TM::template updateTx<uint64_t>([=] () {
+            // Link the new nodes first, then append them to the sub-queue with a single write to tail
+            Node* first = TM::template tmNew<Node>(items[0]);
+            Node* last = first;
+            for (uint64_t i = 1; i < numItems; i++) {
+                Node* newNode = TM::template tmNew<Node>(items[i]);
+                last->next = newNode;
+                last = newNode;
+            }
+            Node* ltail = shard->tail;
+            ltail->next = first;
+            shard->tail = last;
+            return numItems;
+        });
+    }
+
+
+    // Dequeues up to maxItems items into items, in a single transaction, going through the sub-queues
+    // like dequeue(). Returns the number of dequeued items
+    uint64_t dequeueBatch(T** items, const uint64_t maxItems) {
+        const int first = dequeueShard();
+        int found = first;
+        int* foundp = &found;
+        uint64_t n = TM::template updateTx<uint64_t>([=] () {
+            uint64_t n = 0;
+            for (int i = 0; i < NUM_SHARDS && n < maxItems; i++) {
+                Shard& shard = shards[(first+i) % NUM_SHARDS];
+                while (n < maxItems) {
+                    T* item = dequeueFrom(shard);
+                    if (item == nullptr) break;
+                    items[n++] = item;
+                    *foundp = (first+i) % NUM_SHARDS;
+                }
+            }
+            return n;
+        });
+        dequeueShard() = found;
+        return n;
+    }
+};
+
+#endif /* _TM_SHARDED_QUEUE_H_ */
@@ -12,7 +12,9 @@
 #include <cmath>
 #include <memory>
 #include <stdexcept>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #define SK_MAX_LEVEL   23
 
@@ -37,6 +39,15 @@ class TMSkipList : public TM::tmbase {
     TMTYPE<SNode*>  header;
     TMTYPE<int64_t> level;
 
+    // Maximum number of nodes created by each transaction of bulkLoad()
+    static const uint64_t BULK_KEYS = 1024;
+
+    // First and last node of each level in a chunk of keys of bulkLoad()
+    struct BulkChunk {
+        SNode* first[SK_MAX_LEVEL+1];
+        SNode* last[SK_MAX_LEVEL+1];
+    };
+
 
 
 	/*---- Constructors ----*/
@@ -173,10 +184,153 @@ class TMSkipList : public TM::tmbase {
 
 public:
 
+    /*
+     * Batched versions of contains(), add() and remove(), which do all the keys in a single transaction.
+     * The keys are visited in ascending order and the predecessors of each key are searched starting from
+     * the predecessors of the previous key (finger search), so keys that are close to each other share most
+     * of the path. Returns the number of keys found, added or removed, and if results is not nullptr, sets
+     * results[i] to the outcome for keys[i]. All the keys must fit in one transaction.
+     */
+    uint64_t containsMany(const E* keys, uint64_t size, bool* results=nullptr) const {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template readTx<uint64_t>([=] () {
+            SNode* update[SK_MAX_LEVEL + 1];
+            SNode* hd = header;
+            for (int i = 0; i < SK_MAX_LEVEL + 1; i++) update[i] = hd;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const E key = keys[ord[j]];
+                fingerSearch(key, update);
+                SNode* x = update[0]->forw[0];
+                const bool found = x != nullptr && x->key == key;
+                if (results != nullptr) results[ord[j]] = found;
+                if (found) count++;
+            }
+            return count;
+        });
+    }
+
+    uint64_t addMany(const E* keys, uint64_t size, bool* results=nullptr, const int tid=0) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template updateTx<uint64_t>([=] () {
+            SNode* update[SK_MAX_LEVEL + 1];
+            SNode* hd = header;
+            for (int i = 0; i < SK_MAX_LEVEL + 1; i++) update[i] = hd;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const E key = keys[ord[j]];
+                fingerSearch(key, update);
+                SNode* x = update[0]->forw[0];
+                const bool added = x == nullptr || x->key != key;
+                if (added) {
+                    int lvl = random_level();
+                    if (lvl > level) {
+                        for (int i = level + 1;i <= lvl;i++){
+                            update[i] = header;
+                        }
+                        level = lvl;
+                    }
+                    x = TM::template tmNew<SNode>(lvl, key);
+                    for (int i = 0;i <= lvl;i++){
+                        x->forw[i] = update[i]->forw[i];
+                        update[i]->forw[i] = x;
+                    }
+                    count++;
+                }
+                if (results != nullptr) results[ord[j]] = added;
+            }
+            return count;
+        });
+    }
+
+    uint64_t removeMany(const E* keys, uint64_t size, bool* results=nullptr, const int tid=0) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template updateTx<uint64_t>([=] () {
+            SNode* update[SK_MAX_LEVEL + 1];
+            SNode* hd = header;
+            for (int i = 0; i < SK_MAX_LEVEL + 1; i++) update[i] = hd;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const E key = keys[ord[j]];
+                fingerSearch(key, update);
+                SNode* x = update[0]->forw[0];
+                const bool removed = x != nullptr && x->key == key;
+                if (removed) {
+                    for (int i = 0;i <= level;i++){
+                        if (update[i]->forw[i] != x) break;
+                        update[i]->forw[i] = x->forw[i];
+                    }
+                    TM::template tmDelete<SNode>(x);
+                    while (level.pload() > 0 && header->forw[level] == nullptr){
+                        level--;
+                    }
+                    count++;
+                }
+                if (results != nullptr) results[ord[j]] = removed;
+            }
+            return count;
+        });
+    }
+
     void addAll(E** keys, uint64_t size, const int tid=0) {
         for (uint64_t i = 0; i < size; i++) add(*keys[i], tid);
     }
 
+    /*
+     * Fills an empty set with keys sorted in ascending order and without duplicates.
+     * Instead of a random level, the i-th key gets a level equal to the number of trailing zeros of i+1,
+     * which has the same distribution as random_level() and spreads the levels evenly.
+     * The nodes are created and linked in chunks of BULK_KEYS keys, one transaction per chunk, by up to
+     * numThreads threads. Then the chunks are linked to each other and published in the header.
+     */
+    void bulkLoad(const E* keys, uint64_t size, const int numThreads=1) {
+        const uint64_t numChunks = (size + BULK_KEYS - 1)/BULK_KEYS;
+        std::vector<BulkChunk> chunks(numChunks);
+        auto func = [&] (const int tid) {
+            for (uint64_t ic = tid; ic < numChunks; ic += numThreads) {
+                BulkChunk* chunk = &chunks[ic];
+                TM::template updateTx<bool>([=] () {
+                    bulkChunk(keys, ic*BULK_KEYS, std::min(size, (ic+1)*BULK_KEYS), *chunk);
+                    return true;
+                });
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int tid = 1; tid < numThreads; tid++) threads.push_back(std::thread(func, tid));
+        func(0);
+        for (auto& th : threads) th.join();
+        // The last node of each level in a chunk points to the first node of that level in the next chunks
+        SNode* first[SK_MAX_LEVEL+1] = {};
+        SNode* last[SK_MAX_LEVEL+1] = {};
+        for (uint64_t ic = 0; ic < numChunks; ic++) {
+            const BulkChunk* chunk = &chunks[ic];
+            TM::template updateTx<bool>([=] () {
+                for (int i = 0; i <= SK_MAX_LEVEL; i++) {
+                    if (chunk->first[i] != nullptr && last[i] != nullptr) last[i]->forw[i] = chunk->first[i];
+                }
+                return true;
+            });
+            for (int i = 0; i <= SK_MAX_LEVEL; i++) {
+                if (chunk->first[i] == nullptr) continue;
+                if (first[i] == nullptr) first[i] = chunk->first[i];
+                last[i] = chunk->last[i];
+            }
+        }
+        TM::template updateTx<bool>([=] () {
+            assert(header->forw[0] == nullptr);
+            int64_t lvl = 0;
+            for (int i = 0; i <= SK_MAX_LEVEL; i++) {
+                header->forw[i] = first[i];
+                if (first[i] != nullptr) lvl = i;
+            }
+            level = lvl;
+            return true;
+        });
+    }
+
     // Range query in the interval [lo;hi]
     int rangeQuery(const E &lo, const E &hi, E *const resultKeys) {
         return TM::template readTx<int>([=] () {
@@ -207,4 +361,57 @@ public:
 
     static std::string className() { return TM::className() + "-SkipList"; }
 
+private:
+    // Internal: returns the indexes of the keys in ascending order of the keys, and of the index for equal keys
+    static std::vector<uint64_t> sortedOrder(const E* keys, uint64_t size) {
+        std::vector<uint64_t> order(size);
+        for (uint64_t i = 0; i < size; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [keys] (uint64_t a, uint64_t b) {
+            return keys[a] < keys[b] || (!(keys[b] < keys[a]) && a < b);
+        });
+        return order;
+    }
+
+    // Internal: update[] has the predecessors on each level of a previous key (or the header) and they are moved
+    // forward to the predecessors of key, which can't be lower than the previous key. If the successor on a level
+    // is already equal or higher than key, then so are the successors on the levels above it, which means the
+    // search goes up only until such a level and then down as usual. Must be called from within a transaction
+    void fingerSearch(const E& key, SNode** update) const {
+        const int64_t lvl = level;
+        // When the predecessor is the header on all the levels, this is a search from the header
+        int h = (update[0] == header) ? lvl+1 : 0;
+        while (h <= lvl) {
+            SNode* forwh = update[h]->forw[h];
+            if (forwh == nullptr || forwh->key >= key) break;
+            h++;
+        }
+        if (h == 0) return;
+        SNode* x = update[h-1];
+        for (int i = h-1; i >= 0; i--) {
+            while (true) {
+                SNode* forwi = x->forw[i];
+                if (forwi == nullptr || forwi->key >= key) break;
+                x = forwi;
+            }
+            update[i] = x;
+        }
+    }
+
+    // Internal: creates and links the nodes of the keys in [lo,hi). Must be called from within a transaction
+    void bulkChunk(const E* keys, uint64_t lo, uint64_t hi, BulkChunk& chunk) {
+        for (int i = 0; i <= SK_MAX_LEVEL; i++) {
+            chunk.first[i] = nullptr;
+            chunk.last[i] = nullptr;
+        }
+        for (uint64_t ik = lo; ik < hi; ik++) {
+            const int lvl = std::min(__builtin_ctzll(ik+1), SK_MAX_LEVEL);
+            SNode* x = TM::template tmNew<SNode>(lvl, keys[ik]);
+            for (int i = 0; i <= lvl; i++) {
+                if (chunk.last[i] == nullptr) chunk.first[i] = x;
+                else chunk.last[i]->forw[i] = x;
+                chunk.last[i] = x;
+            }
+        }
+    }
+
 };
@@ -12,7 +12,9 @@
 #include <cmath>
 #include <memory>
 #include <stdexcept>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #define SK_MAX_LEVEL   23
 
@@ -37,6 +39,15 @@ class TMSkipListByRef : public TM::tmbase {
     TMTYPE<SNode*>  header;
     TMTYPE<int64_t> level;
 
+    // Maximum number of nodes created by each transaction of bulkLoad()
+    static const uint64_t BULK_KEYS = 1024;
+
+    // First and last node of each level in a chunk of keys of bulkLoad()
+    struct BulkChunk {
+        SNode* first[SK_MAX_LEVEL+1];
+        SNode* last[SK_MAX_LEVEL+1];
+    };
+
 
 
 	/*---- Constructors ----*/
@@ -182,6 +193,54 @@ public:
         for (uint64_t i = 0; i < size; i++) add(*keys[i], tid);
     }
 
+    /*
+     * Fills an empty set with keys sorted in ascending order and without duplicates.
+     * Instead of a random level, the i-th key gets a level equal to the number of trailing zeros of i+1,
+     * which has the same distribution as random_level() and spreads the levels evenly.
+     * The nodes are created and linked in chunks of BULK_KEYS keys, one transaction per chunk, by up to
+     * numThreads threads. Then the chunks are linked to each other and published in the header.
+     */
+    void bulkLoad(const K* keys, uint64_t size, const int numThreads=1) {
+        const uint64_t numChunks = (size + BULK_KEYS - 1)/BULK_KEYS;
+        std::vector<BulkChunk> chunks(numChunks);
+        auto func = [&] (const int tid) {
+            for (uint64_t ic = tid; ic < numChunks; ic += numThreads) {
+                TM::updateTx([&] () {
+                    bulkChunk(keys, ic*BULK_KEYS, std::min(size, (ic+1)*BULK_KEYS), chunks[ic]);
+                });
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int tid = 1; tid < numThreads; tid++) threads.push_back(std::thread(func, tid));
+        func(0);
+        for (auto& th : threads) th.join();
+        // The last node of each level in a chunk points to the first node of that level in the next chunks
+        SNode* first[SK_MAX_LEVEL+1] = {};
+        SNode* last[SK_MAX_LEVEL+1] = {};
+        for (uint64_t ic = 0; ic < numChunks; ic++) {
+            const BulkChunk& chunk = chunks[ic];
+            TM::updateTx([&] () {
+                for (int i = 0; i <= SK_MAX_LEVEL; i++) {
+                    if (chunk.first[i] != nullptr && last[i] != nullptr) last[i]->forw[i] = chunk.first[i];
+                }
+            });
+            for (int i = 0; i <= SK_MAX_LEVEL; i++) {
+                if (chunk.first[i] == nullptr) continue;
+                if (first[i] == nullptr) first[i] = chunk.first[i];
+                last[i] = chunk.last[i];
+            }
+        }
+        TM::updateTx([&] () {
+            assert(header->forw[0] == nullptr);
+            int64_t lvl = 0;
+            for (int i = 0; i <= SK_MAX_LEVEL; i++) {
+                header->forw[i] = first[i];
+                if (first[i] != nullptr) lvl = i;
+            }
+            level = lvl;
+        });
+    }
+
     // Range query in the interval [lo;hi]
     int rangeQuery(const K &lo, const K &hi, K *const resultKeys) {
         int numKeys;
@@ -214,4 +273,22 @@ public:
 
     static std::string className() { return TM::className() + "-SkipList"; }
 
+private:
+    // Internal: creates and links the nodes of the keys in [lo,hi). Must be called from within a transaction
+    void bulkChunk(const K* keys, uint64_t lo, uint64_t hi, BulkChunk& chunk) {
+        for (int i = 0; i <= SK_MAX_LEVEL; i++) {
+            chunk.first[i] = nullptr;
+            chunk.last[i] = nullptr;
+        }
+        for (uint64_t ik = lo; ik < hi; ik++) {
+            const int lvl = std::min(__builtin_ctzll(ik+1), SK_MAX_LEVEL);
+            SNode* x = TM::template tmNew<SNode>(lvl, keys[ik]);
+            for (int i = 0; i <= lvl; i++) {
+                if (chunk.last[i] == nullptr) chunk.first[i] = x;
+                else chunk.last[i]->forw[i] = x;
+                chunk.last[i] = x;
+            }
+        }
+    }
+
 };
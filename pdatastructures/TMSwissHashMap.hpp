@@ -0,0 +1,388 @@
+/*
+ * Copyright 2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#ifndef _TM_SWISS_HASH_MAP_H_
+#define _TM_SWISS_HASH_MAP_H_
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * <h1> An open addressing Hash Map for usage with STMs </h1>
+ *
+ * The table is an array of groups of GROUP_SIZE slots, like in SwissTable. Each group starts with one
+ * control byte per slot, followed by the keys and values of its slots. The control byte of a slot is
+ * EMPTY, DELETED, or FULL with the 7 low bits of the hash of the key. A lookup compares the control bytes
+ * of a group with the hash of the key using SSE2 and only reads the keys of the slots that match, so it
+ * typically reads the control bytes and a single slot of a single group, which with 16 byte slots are
+ * one or two lock stripes and no pointers to follow. The groups are probed in triangular order.
+ *
+ * The keys and values are stored in the table, so K and V should be trivially copyable.
+ *
+ * When the FULL and DELETED slots go above 7/8 of the capacity, a new table is allocated (with twice the
+ * capacity, unless most slots are DELETED) and each put() or remove() moves the next MIGRATE_GROUPS groups
+ * of the old table to it, like TMHashMap. During the resize, the lookups search the new table and then
+ * the old table, where the moved slots are DELETED.
+ *
+ * TMCOUNTER is the type used for the counters of keys and of used slots, like in TMHashMap.
+ */
+template<typename K, typename V, typename TM, template <typename> class TMTYPE, template <typename> class TMCOUNTER = TMTYPE>
+class TMSwissHashMap : public TM::tmbase {
+
+private:
+    static const int      GROUP_SIZE = 16;
+    // EMPTY is zero, so that a zeroed table is empty. DELETED doesn't stop the probing. FULL slots have the top bit set.
+    static const uint8_t  EMPTY = 0x00;
+    static const uint8_t  DELETED = 0x01;
+    static const uint8_t  FULL = 0x80;
+    // Number of groups moved to the new table by each put() or remove() during a resize
+    static const uint64_t MIGRATE_GROUPS = 4;
+
+    struct Slot {
+        TMTYPE<K>        key;
+        TMTYPE<V>        val;
+    };
+
+    struct Group {
+        TMTYPE<uint64_t> ctrl[2];             // One control byte for each slot
+        Slot             slots[GROUP_SIZE];
+    };
+
+    alignas(128) TMTYPE<Group*>      groups;
+    TMTYPE<uint64_t>                 groupMask;           // Number of groups minus one
+    TMTYPE<Group*>                   oldGroups {nullptr}; // Table being moved during a resize, or nullptr
+    TMTYPE<uint64_t>                 oldMask {0};
+    // Number of keys, and number of FULL or DELETED slots in 'groups'
+    alignas(128) TMCOUNTER<uint64_t> sizeHM = 0;
+    TMCOUNTER<uint64_t>              usedHM = 0;
+    // Next group of the old table to move during a resize. Only the updates access it, so it has its own cache line
+    alignas(128) TMTYPE<uint64_t>    migrateIdx {0};
+
+
+public:
+    TMSwissHashMap(uint64_t capacity=GROUP_SIZE) {
+        uint64_t numGroups = 1;
+        while (maxUsed(numGroups) < capacity) numGroups *= 2;
+        groups = allocGroups(numGroups);
+        groupMask = numGroups-1;
+    }
+
+
+    ~TMSwissHashMap() {
+        TM::tmFree(groups);
+        if (oldGroups != nullptr) TM::tmFree(oldGroups);
+    }
+
+
+    static std::string className() { return TM::className() + "-SwissHashMap"; }
+
+
+private:
+    static inline uint64_t maxUsed(const uint64_t numGroups) { return numGroups*GROUP_SIZE*7/8; }
+
+    // The control bytes of a new table are all EMPTY, which is zero. The table isn't visible to other
+    // transactions until it's published, so it can be zeroed without going through the TM.
+    static Group* allocGroups(const uint64_t numGroups) {
+        Group* grps = (Group*)TM::tmMalloc(numGroups*sizeof(Group));
+        std::memset((void*)grps, 0, numGroups*sizeof(Group));
+        return grps;
+    }
+
+    // std::hash is the identity for integers, so the bits are mixed before taking the group and the control byte
+    static inline uint64_t hashOf(const K& key) {
+        uint64_t h = std::hash<K>{}(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static inline uint8_t ctrlOf(const uint64_t h) { return FULL | (h & 0x7F); }
+
+    static inline uint8_t ctrlByte(const uint64_t lo, const uint64_t hi, const int i) {
+        return (uint8_t)(((i < 8) ? lo : hi) >> (8*(i%8)));
+    }
+
+    // Bitmask of the slots whose control byte is c
+    static inline uint32_t matchByte(const uint64_t lo, const uint64_t hi, const uint8_t c) {
+#if defined(__SSE2__)
+        const __m128i ctrl = _mm_set_epi64x((long long)hi, (long long)lo);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+#else
+        uint32_t mask = 0;
+        for (int i = 0; i < GROUP_SIZE; i++) if (ctrlByte(lo, hi, i) == c) mask |= 1u << i;
+        return mask;
+#endif
+    }
+
+    // Bitmask of the FULL slots
+    static inline uint32_t matchFull(const uint64_t lo, const uint64_t hi) {
+#if defined(__SSE2__)
+        return (uint32_t)_mm_movemask_epi8(_mm_set_epi64x((long long)hi, (long long)lo));
+#else
+        uint32_t mask = 0;
+        for (int i = 0; i < GROUP_SIZE; i++) if (ctrlByte(lo, hi, i) & FULL) mask |= 1u << i;
+        return mask;
+#endif
+    }
+
+    static void setCtrl(Group* grp, const int i, const uint8_t c) {
+        const uint64_t shift = 8*(i%8);
+        const uint64_t w = grp->ctrl[i/8];
+        grp->ctrl[i/8] = (w & ~(0xFFULL << shift)) | ((uint64_t)c << shift);
+    }
+
+    // Returns the slot of key in the table, or nullptr. Saves the group of the slot in 'grp'.
+    static Slot* findSlot(Group* grps, const uint64_t mask, const K& key, const uint64_t h, Group*& grp) {
+        const uint8_t c = ctrlOf(h);
+        uint64_t g = (h >> 7) & mask;
+        // Triangular probing visits all the groups because the number of groups is a power of two
+        for (uint64_t step = 1; ; step++) {
+            grp = grps + g;
+            const uint64_t lo = grp->ctrl[0];
+            const uint64_t hi = grp->ctrl[1];
+            for (uint32_t m = matchByte(lo, hi, c); m != 0; m &= m-1) {
+                Slot* slot = &grp->slots[__builtin_ctz(m)];
+                if (key == slot->key) return slot;
+            }
+            if (matchByte(lo, hi, EMPTY) != 0) return nullptr;
+            g = (g + step) & mask;
+        }
+    }
+
+    // Places key and value in the first EMPTY or DELETED slot of the probe sequence. Returns true if the slot was EMPTY.
+    static bool insertSlot(Group* grps, const uint64_t mask, const K& key, const V& value, const uint64_t h) {
+        uint64_t g = (h >> 7) & mask;
+        for (uint64_t step = 1; ; step++) {
+            Group* grp = grps + g;
+            const uint64_t lo = grp->ctrl[0];
+            const uint64_t hi = grp->ctrl[1];
+            const uint32_t m = ~matchFull(lo, hi) & ((1u << GROUP_SIZE)-1);
+            if (m != 0) {
+                const int i = __builtin_ctz(m);
+                grp->slots[i].key = key;
+                grp->slots[i].val = value;
+                setCtrl(grp, i, ctrlOf(h));
+                return ctrlByte(lo, hi, i) == EMPTY;
+            }
+            g = (g + step) & mask;
+        }
+    }
+
+    // If the group has an EMPTY slot then it was never full, no probe sequence goes past it and the slot can be
+    // EMPTY again. Otherwise it has to be DELETED. Returns true if the slot is now EMPTY.
+    static bool eraseSlot(Group* grp, Slot* slot) {
+        const uint64_t lo = grp->ctrl[0];
+        const uint64_t hi = grp->ctrl[1];
+        const bool wasNeverFull = matchByte(lo, hi, EMPTY) != 0;
+        setCtrl(grp, (int)(slot - grp->slots), wasNeverFull ? EMPTY : DELETED);
+        return wasNeverFull;
+    }
+
+
+public:
+    // TMCOUNTER may have a cheaper estimate of its value, which is enough to decide whether to resize
+    template<typename C> static auto estimateSize(const C& c, int) -> decltype(c.estimate()) { return c.estimate(); }
+    template<typename C> static uint64_t estimateSize(const C& c, long) { return c.pload(); }
+
+    // Increments of TMCOUNTER are commutative only if it has escrow updates, the other types may not have compound assignments
+    template<typename C> static auto addToSize(C& c, uint64_t delta, int) -> decltype(c.estimate(), void()) { c += delta; }
+    template<typename C> static void addToSize(C& c, uint64_t delta, long) { c = c + delta; }
+
+
+    void startResize() {
+        // The estimate may be stale, check the real number of used slots before resizing
+        const uint64_t numGroups = groupMask.pload()+1;
+        if (usedHM.pload() <= maxUsed(numGroups)) return;
+        const uint64_t newNumGroups = (sizeHM.pload() > maxUsed(numGroups)/2) ? 2*numGroups : numGroups;
+        oldGroups = groups.pload();
+        oldMask = numGroups-1;
+        groups = allocGroups(newNumGroups);
+        groupMask = newNumGroups-1;
+        usedHM = 0;
+        migrateIdx = 0;
+    }
+
+
+    // Moves the next MIGRATE_GROUPS groups of the old table to the new table, and frees the old table after the last one
+    void migrate() {
+        Group* old = oldGroups;
+        const uint64_t oldNumGroups = oldMask+1;
+        Group* grps = groups;
+        const uint64_t mask = groupMask;
+        uint64_t g = migrateIdx;
+        const uint64_t end = (g + MIGRATE_GROUPS < oldNumGroups) ? g + MIGRATE_GROUPS : oldNumGroups;
+        uint64_t numUsed = 0;
+        for (; g < end; g++) {
+            Group* grp = old + g;
+            for (int w = 0; w < 2; w++) {
+                const uint64_t ctrl = grp->ctrl[w];
+                // 0x01 in the FULL bytes, which become DELETED
+                const uint64_t full = (ctrl & 0x8080808080808080ULL) >> 7;
+                if (full == 0) continue;
+                for (int i = 0; i < 8; i++) {
+                    if (!((ctrl >> (8*i)) & FULL)) continue;
+                    Slot& slot = grp->slots[w*8+i];
+                    const K key = slot.key;
+                    if (insertSlot(grps, mask, key, slot.val, hashOf(key))) numUsed++;
+                }
+                grp->ctrl[w] = (ctrl & ~(full*0xFF)) | full;
+            }
+        }
+        if (numUsed != 0) addToSize(usedHM, numUsed, 0);
+        if (g == oldNumGroups) {
+            TM::tmFree(old);
+            oldGroups = nullptr;
+        }
+        migrateIdx = g;
+    }
+
+
+    /*
+     * Adds a key with a value if the key is not present, otherwise replaces the value.
+     * Returns true if the key was not present.
+     */
+    bool innerPut(const K& key, const V& value, V& oldValue, const bool saveOldValue) {
+        if (oldGroups.pload() != nullptr) {
+            migrate();
+        } else if (estimateSize(usedHM, 0) > maxUsed(groupMask.pload()+1)) {
+            startResize();
+        }
+        const uint64_t h = hashOf(key);
+        Group* grp;
+        Slot* slot = findSlot(groups, groupMask, key, h, grp);
+        if (slot == nullptr) {
+            Group* old = oldGroups;
+            if (old != nullptr) slot = findSlot(old, oldMask, key, h, grp);
+        }
+        if (slot != nullptr) {
+            if (saveOldValue) oldValue = slot->val;
+            slot->val = value;
+            return false;
+        }
+        if (insertSlot(groups, groupMask, key, value, h)) addToSize(usedHM, 1, 0);
+        addToSize(sizeHM, 1, 0);
+        return true;
+    }
+
+
+    /*
+     * Removes a key. Returns true if the key was present, and saves its value in oldValue if saveOldValue is set.
+     */
+    bool innerRemove(const K& key, V& oldValue, const bool saveOldValue) {
+        if (oldGroups.pload() != nullptr) migrate();
+        const uint64_t h = hashOf(key);
+        Group* grp;
+        Slot* slot = findSlot(groups, groupMask, key, h, grp);
+        if (slot != nullptr) {
+            if (saveOldValue) oldValue = slot->val;
+            if (eraseSlot(grp, slot)) addToSize(usedHM, (uint64_t)-1, 0);
+            addToSize(sizeHM, (uint64_t)-1, 0);
+            return true;
+        }
+        Group* old = oldGroups;
+        if (old == nullptr) return false;
+        slot = findSlot(old, oldMask, key, h, grp);
+        if (slot == nullptr) return false;
+        if (saveOldValue) oldValue = slot->val;
+        eraseSlot(grp, slot);
+        addToSize(sizeHM, (uint64_t)-1, 0);
+        return true;
+    }
+
+
+    /*
+     * Returns true if key is present. Saves a copy of the value in 'oldValue' if 'saveOldValue' is set.
+     */
+    bool innerGet(const K& key, V& oldValue, const bool saveOldValue) {
+        const uint64_t h = hashOf(key);
+        Group* grp;
+        Slot* slot = findSlot(groups, groupMask, key, h, grp);
+        if (slot == nullptr) {
+            Group* old = oldGroups;
+            if (old == nullptr) return false;
+            slot = findSlot(old, oldMask, key, h, grp);
+            if (slot == nullptr) return false;
+        }
+        if (saveOldValue) oldValue = slot->val;
+        return true;
+    }
+
+
+    //
+    // Set methods for running the usual tests and benchmarks
+    //
+
+    // Inserts a key only if it's not already present
+    bool add(const K& key) {
+        return TM::template updateTx<bool>([this,key] () {
+            V notused;
+            return innerPut(key,key,notused,false);
+        });
+    }
+
+    // Returns true only if the key was present
+    bool remove(const K& key) {
+        return TM::template updateTx<bool>([this,key] () {
+            V notused;
+            return innerRemove(key,notused,false);
+        });
+    }
+
+    bool contains(const K& key) {
+        return TM::template readTx<bool>([this,key] () {
+            V notused;
+            return innerGet(key,notused,false);
+        });
+    }
+
+    // Used only for benchmarks
+    bool addAll(K** keys, const int size) {
+        for (int i = 0; i < size; i++) add(*keys[i]);
+        return true;
+    }
+
+    int rangeQuery(const K &lo, const K &hi, K *const resultKeys) {
+        printf("rangeQuery() not implemented\n");
+        return 0;
+    }
+
+
+    //
+    // Map methods for running the usual tests and benchmarks
+    //
+
+    // Inserts a key with a value, or replaces the value if the key is already present
+    bool add(const K& key, const V& value) {
+        return TM::template updateTx<bool>([this,key,value] () {
+            V notused;
+            return innerPut(key,value,notused,false);
+        });
+    }
+
+    // Returns the value of the key, or V{} if the key is not present
+    V get(const K& key) {
+        return TM::template readTx<V>([this,key] () {
+            V value {};
+            innerGet(key,value,true);
+            return value;
+        });
+    }
+
+    // Used only for benchmarks
+    bool addAll(K* keys, V* values, uint64_t size, const int tid=0) {
+        for (uint64_t i = 0; i < size; i++) add(keys[i], values[i]);
+        return true;
+    }
+};
+
+#endif /* _TM_SWISS_HASH_MAP_H_ */
@@ -10,6 +10,7 @@
 
 #include <string>
 #include <cassert>
+#include <thread>
 
 
 /**
@@ -58,6 +59,9 @@ private:
 
     alignas(128) TMTYPE<Node*> root {nullptr};
 
+    // Maximum number of nodes created by each transaction of bulkLoad()
+    static const uint64_t BULK_KEYS = 1024;
+
 public:
     TMZipTreeSet() { }
 
@@ -108,12 +112,69 @@ public:
         return true;
     }
 
+    /*
+     * Fills an empty set with keys sorted in ascending order and without duplicates.
+     * Instead of a random rank, the i-th key gets a rank equal to the number of trailing zeros of i+1.
+     * These ranks have the same geometric distribution and they give a perfectly balanced zip tree.
+     * The subtrees are built by up to numThreads threads, in transactions of at most BULK_KEYS nodes,
+     * and nobody else can see them until the root is published.
+     */
+    void bulkLoad(const K* keys, uint64_t size, const int numThreads=1) {
+        Node* n = bulkBuild(keys, 0, size, numThreads);
+        TM::template updateTx<bool>([=] () {
+            assert(root == nullptr);
+            root = n;
+            return true;
+        });
+    }
+
     int rangeQuery(const K &lo, const K &hi, K *const resultKeys) {
         printf("rangeQuery() not implemented\n");
         return 0;
     }
 
 private:
+    // Internal: the key in [lo,hi) with the highest rank is the one whose position i+1 has the most trailing zeros
+    static uint64_t bulkRoot(uint64_t lo, uint64_t hi) {
+        if (lo+1 == hi) return lo;
+        return (hi & (~0ULL << (63 - __builtin_clzll((lo+1) ^ hi)))) - 1;
+    }
+
+    // Internal: builds the subtree with the keys in [lo,hi), one transaction for each subtree of up to BULK_KEYS nodes
+    Node* bulkBuild(const K* keys, uint64_t lo, uint64_t hi, const int numThreads) {
+        if (hi - lo <= BULK_KEYS) {
+            return TM::template updateTx<Node*>([=] () { return bulkSubtree(keys, lo, hi); });
+        }
+        const uint64_t mid = bulkRoot(lo, hi);
+        Node* left;
+        Node* right;
+        if (numThreads > 1) {
+            std::thread th([&] () { left = bulkBuild(keys, lo, mid, numThreads/2); });
+            right = bulkBuild(keys, mid+1, hi, numThreads - numThreads/2);
+            th.join();
+        } else {
+            left = bulkBuild(keys, lo, mid, 1);
+            right = bulkBuild(keys, mid+1, hi, 1);
+        }
+        return TM::template updateTx<Node*>([=] () { return bulkNode(keys, mid, left, right); });
+    }
+
+    // Internal: builds the subtree with the keys in [lo,hi). Must be called from within a transaction
+    Node* bulkSubtree(const K* keys, uint64_t lo, uint64_t hi) {
+        if (lo == hi) return nullptr;
+        const uint64_t mid = bulkRoot(lo, hi);
+        return bulkNode(keys, mid, bulkSubtree(keys, lo, mid), bulkSubtree(keys, mid+1, hi));
+    }
+
+    // Internal: must be called from within a transaction
+    Node* bulkNode(const K* keys, uint64_t i, Node* left, Node* right) {
+        Node* n = TM::template tmNew<Node>(keys[i]);
+        n->rank = __builtin_ctzll(i+1);
+        n->left = left;
+        n->right = right;
+        return n;
+    }
+
     // Used internally. Must be called from within a transaction
     bool iterativeInsert(Node* x) {
         int64_t rank = x->rank;
@@ -9,6 +9,8 @@
 #pragma once
 #include <string>
 #include <cassert>
+#include <vector>
+#include <algorithm>
 
 
 /**
@@ -17,11 +19,16 @@
  * Originally taken from https://github.com/pmem/pmdk/blob/master/src/libpmemobj/ravl.c
  * This was adapted to C++ and added instrumentation.
  *
+ * When TRACK_CHANGES is set, every insertion and removal increments a version counter of type TMCOUNTER,
+ * which cursors can use to find out if the map was modified between two chunks. Passing a type with
+ * commutative increments (like twoplsf::tmcounter) prevents all the updates from conflicting on it.
+ *
  * TODO:
  * - Change the node*() methods to be methods in the Node class
  * -
  */
-template<typename K, typename V, typename TM, template <typename> class TMTYPE>
+template<typename K, typename V, typename TM, template <typename> class TMTYPE,
+         bool TRACK_CHANGES = false, template <typename> class TMCOUNTER = TMTYPE>
 class TMRAVLMap : public TM::tmbase {
 
 private:
@@ -48,6 +55,10 @@ private:
 
     alignas(128) TMTYPE<Node*> root {nullptr};
     alignas(128) TMTYPE<V> NO_VALUE {};
+    alignas(128) TMCOUNTER<uint64_t> version {0};
+
+    // Number of levels that the finger search goes up before starting again from the root
+    static const int FINGER_LEVELS = 4;
 
 public:
     TMRAVLMap() {
@@ -85,6 +96,7 @@ public:
             n->parent = dst;
             *dstp = n;
             balance(n);
+            if (TRACK_CHANGES) version++;
             return true;
         });
         return ret;
@@ -106,6 +118,7 @@ public:
             n->parent = dst;
             *dstp = n;
             balance(n);
+            if (TRACK_CHANGES) version++;
             return value;
         });
     }
@@ -120,6 +133,7 @@ public:
                 K nkey = n->key;
                 if (key == nkey) {
                     nodeRemove(n);
+                    if (TRACK_CHANGES) version++;
                     return true;
                 }
                 n = n->slots[(key < nkey) ? RAVL_LEFT : RAVL_RIGHT];
@@ -136,8 +150,11 @@ public:
             while (n != nullptr) {
                 K nkey = n->key;
                 if (key == nkey) {
+                    // nodeRemove() may free n or move the successor into it
+                    V value = n->value;
                     nodeRemove(n);
-                    return n->value.pload();
+                    if (TRACK_CHANGES) version++;
+                    return value;
                 }
                 n = n->slots[(key < nkey) ? RAVL_LEFT : RAVL_RIGHT];
             }
@@ -172,6 +189,70 @@ public:
         });
     }
 
+    /*
+     * Batched versions of contains(), get(), add() and remove(), which do all the keys in a single transaction.
+     * The keys are visited in ascending order and the search of each key starts from the node of the previous
+     * key (finger search), going up only to the first ancestor whose subtree has the key, so keys that are
+     * close to each other share most of the path. Return the number of keys found, added or removed. For each
+     * keys[i], getMany() sets values[i] to its value or nullptr, and the others set results[i] to the outcome
+     * if results is not nullptr. All the keys must fit in one transaction.
+     */
+    uint64_t containsMany(const K* keys, uint64_t size, bool* results=nullptr) {
+        return findMany(keys, size, results, nullptr);
+    }
+
+    uint64_t getMany(const K* keys, uint64_t size, V* values) {
+        return findMany(keys, size, nullptr, values);
+    }
+
+    uint64_t addMany(const K* keys, V* values, uint64_t size, bool* results=nullptr, const int tid=0) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template updateTx<uint64_t>([=] () {
+            Node* finger = nullptr;
+            Node* parent;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const K key = keys[ord[j]];
+                const bool added = fingerFind(finger, key, parent) == nullptr;
+                if (added) {
+                    Node* n = TM::template tmNew<Node>(key, values[ord[j]]);
+                    n->parent = parent;
+                    if (parent == nullptr) root = n;
+                    else parent->slots[(key < parent->key) ? RAVL_LEFT : RAVL_RIGHT] = n;
+                    balance(n);
+                    finger = n;
+                    count++;
+                }
+                if (results != nullptr) results[ord[j]] = added;
+            }
+            if (TRACK_CHANGES && count > 0) version++;
+            return count;
+        });
+    }
+
+    uint64_t removeMany(const K* keys, uint64_t size, bool* results=nullptr, const int tid=0) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template updateTx<uint64_t>([=] () {
+            Node* finger = nullptr;
+            Node* parent;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                Node* n = fingerFind(finger, keys[ord[j]], parent);
+                if (n != nullptr) {
+                    // Either n or its successor is freed, but never its predecessor
+                    finger = nodePredecessor(n);
+                    nodeRemove(n);
+                    count++;
+                }
+                if (results != nullptr) results[ord[j]] = n != nullptr;
+            }
+            if (TRACK_CHANGES && count > 0) version++;
+            return count;
+        });
+    }
+
     // Used only for benchmarks
     bool addAll(K* keys, V* values, uint64_t size, const int tid=0) {
         for (uint64_t i = 0; i < size; i++) add(keys[i], values[i]);
@@ -206,8 +287,151 @@ public:
         });
     }
 
+    /*
+     * A cursor for long scans, which reads the keys in [lo,hi) in ascending order in chunks, one short read
+     * transaction per chunk, instead of read-locking the whole range in a single transaction like rangeQuery().
+     * Each chunk starts after the last key of the previous one, so the keys that are in the map during the
+     * whole scan are returned exactly once, but the scan is not a snapshot. If validate is set (and the map has
+     * TRACK_CHANGES) each chunk reads the version of the map and 'changed' is set if the map was modified
+     * since the previous chunk. Reading the version exactly makes the chunks conflict with the writers.
+     */
+    struct Cursor {
+        K        key;               // The next chunk starts at this key, or after it if started is set
+        K        hi;
+        bool     validate;
+        bool     started {false};   // At least one key was returned
+        bool     done {false};      // All the keys in the range were returned
+        bool     changed {false};   // The map was modified during the scan
+        uint64_t version {0};       // Version of the map in the last chunk
+    };
+
+    Cursor cursor(const K& lo, const K& hi, const bool validate=false) const {
+        return Cursor{lo, hi, validate};
+    }
+
+    // Places up to maxKeys keys of the cursor's range in resultKeys, and their values in resultValues if not nullptr,
+    // and moves the cursor after them. Returns the number of keys, which is zero only when cursor.done is set.
+    uint64_t nextChunk(Cursor& cursor, const uint64_t maxKeys, K* const resultKeys, V* const resultValues=nullptr) {
+        if (cursor.done) return 0;
+        Cursor* cur = &cursor;
+        return TM::template readTx<uint64_t>([=] () {
+            const uint64_t ver = cur->validate ? version.pload() : 0;
+            const K hi = cur->hi;
+            uint64_t numKeys = 0;
+            Node* n = nodeCeiling(cur->key, cur->started);
+            while (n != nullptr && numKeys < maxKeys) {
+                const K nkey = n->key;
+                if (!(nkey < hi)) break;
+                resultKeys[numKeys] = nkey;
+                if (resultValues != nullptr) resultValues[numKeys] = n->value;
+                numKeys++;
+                n = nodeSuccessor(n);
+            }
+            // n is the first node after the chunk, check if it's still in the range so that the last chunk is not empty
+            const bool done = n == nullptr || !(n->key < hi);
+            // No aborts after this point, it's safe to modify the cursor
+            if (cur->validate) {
+                if (cur->started && ver != cur->version) cur->changed = true;
+                cur->version = ver;
+            }
+            if (numKeys > 0) {
+                cur->key = resultKeys[numKeys-1];
+                cur->started = true;
+            }
+            cur->done = done;
+            return numKeys;
+        });
+    }
+
 
 private:
+    // Internal: returns the indexes of the keys in ascending order of the keys, and of the index for equal keys
+    static std::vector<uint64_t> sortedOrder(const K* keys, uint64_t size) {
+        std::vector<uint64_t> order(size);
+        for (uint64_t i = 0; i < size; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [keys] (uint64_t a, uint64_t b) {
+            return keys[a] < keys[b] || (!(keys[b] < keys[a]) && a < b);
+        });
+        return order;
+    }
+
+    // Internal: searches key starting from the finger, a node with a key equal or lower than key, or from the
+    // root if the finger is nullptr. The subtree of a node goes up to the key of the first ancestor that has it
+    // on the left, so we go up from the finger until that key is higher than key, and then down. If that's more
+    // than FINGER_LEVELS up, the keys are far apart and it's cheaper to go down from the root, whose path is
+    // already locked by this transaction.
+    // Returns the node with key, or nullptr and sets parent to the node where key would be inserted.
+    // The finger is moved to the last node on the path with a key equal or lower than key.
+    // Must be called from within a transaction
+    Node* fingerFind(Node*& finger, const K& key, Node*& parent) {
+        Node* n = finger;
+        if (n == nullptr) {
+            n = root;
+        } else {
+            Node* p = n->parent;
+            for (int i = 0; p != nullptr && !(p->slots[RAVL_LEFT] == n && key < p->key); i++) {
+                if (i == FINGER_LEVELS) {
+                    n = root;
+                    break;
+                }
+                n = p;
+                p = n->parent;
+            }
+        }
+        parent = nullptr;
+        while (n != nullptr) {
+            const K nkey = n->key;
+            if (key == nkey) {
+                finger = n;
+                return n;
+            }
+            parent = n;
+            if (key < nkey) {
+                n = n->slots[RAVL_LEFT];
+            } else {
+                finger = n;
+                n = n->slots[RAVL_RIGHT];
+            }
+        }
+        return nullptr;
+    }
+
+    // Internal: returns the node with the lowest key equal or higher than key (higher if exclusive is set), or nullptr.
+    // Must be called from within a transaction
+    Node* nodeCeiling(const K& key, const bool exclusive) {
+        Node* n = root;
+        Node* ceil = nullptr;
+        while (n != nullptr) {
+            const K nkey = n->key;
+            if (!exclusive && key == nkey) return n;
+            if (key < nkey) {
+                ceil = n;
+                n = n->slots[RAVL_LEFT];
+            } else {
+                n = n->slots[RAVL_RIGHT];
+            }
+        }
+        return ceil;
+    }
+
+    // Internal: shared by containsMany() and getMany()
+    uint64_t findMany(const K* keys, uint64_t size, bool* results, V* values) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template readTx<uint64_t>([=] () {
+            Node* finger = nullptr;
+            Node* parent;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                Node* n = fingerFind(finger, keys[ord[j]], parent);
+                if (results != nullptr) results[ord[j]] = n != nullptr;
+                if (values != nullptr) values[ord[j]] = (n != nullptr) ? n->value.pload() : (V)nullptr;
+                if (n != nullptr) count++;
+            }
+            return count;
+        });
+    }
+
     // Internal: Recursively clears the given subtree. Frees the given node.
     void clearNode(Node* n) {
         if (n == nullptr) return;
@@ -366,6 +590,7 @@ private:
             // If both children are present, remove the successor instead
             Node* s = nodeSuccessor(n);
             n->key = s->key;  // TODO: this won't work for intrusive stuff
+            n->value = s->value;
             nodeRemove(s);
         } else {
             // Swap n with the child that may exist
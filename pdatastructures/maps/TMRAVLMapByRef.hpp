@@ -332,6 +332,7 @@ private:
             // If both children are present, remove the successor instead
             Node* s = nodeSuccessor(n);
             n->key = s->key;  // TODO: this won't work for intrusive stuff
+            n->value = s->value;
             nodeRemove(s);
         } else {
             // Swap n with the child that may exist
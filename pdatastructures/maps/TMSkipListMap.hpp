@@ -13,10 +13,17 @@
 #include <memory>
 #include <stdexcept>
 #include <utility>
+#include <vector>
 
 #define SK_MAX_LEVEL   23
 
-template <typename K, typename V, typename TM, template <typename> class TMTYPE>
+/*
+ * When TRACK_CHANGES is set, every insertion and removal increments a version counter of type TMCOUNTER,
+ * which cursors can use to find out if the map was modified between two chunks. Passing a type with
+ * commutative increments (like twoplsf::tmcounter) prevents all the updates from conflicting on it.
+ */
+template <typename K, typename V, typename TM, template <typename> class TMTYPE,
+          bool TRACK_CHANGES = false, template <typename> class TMCOUNTER = TMTYPE>
 class TMSkipListMap : public TM::tmbase {
 
     struct SNode : public TM::tmbase {
@@ -38,6 +45,7 @@ class TMSkipListMap : public TM::tmbase {
 
     TMTYPE<SNode*>  header;
     TMTYPE<int64_t> level;
+    alignas(128) TMCOUNTER<uint64_t> version {0};
 
 
 
@@ -142,6 +150,7 @@ class TMSkipListMap : public TM::tmbase {
                     x->forw[i] = update[i]->forw[i];
                     update[i]->forw[i] = x;
                 }
+                if (TRACK_CHANGES) version++;
                 return true;
             }
             return false;
@@ -175,6 +184,7 @@ class TMSkipListMap : public TM::tmbase {
                 while (level.pload() > 0 && header->forw[level] == nullptr){
                     level--;
                 }
+                if (TRACK_CHANGES) version++;
                 return true;
             }
             return false;
@@ -183,6 +193,88 @@ class TMSkipListMap : public TM::tmbase {
 
 public:
 
+    /*
+     * Batched versions of contains(), get(), add() and remove(), which do all the keys in a single transaction.
+     * The keys are visited in ascending order and the predecessors of each key are searched starting from
+     * the predecessors of the previous key (finger search), so keys that are close to each other share most
+     * of the path. Return the number of keys found, added or removed. For each keys[i], getMany() sets values[i]
+     * to its value or nullptr, and the others set results[i] to the outcome if results is not nullptr.
+     * All the keys must fit in one transaction.
+     */
+    uint64_t containsMany(const K* keys, uint64_t size, bool* results=nullptr) const {
+        return findMany(keys, size, results, nullptr);
+    }
+
+    uint64_t getMany(const K* keys, uint64_t size, V* values) const {
+        return findMany(keys, size, nullptr, values);
+    }
+
+    uint64_t addMany(const K* keys, V* values, uint64_t size, bool* results=nullptr, const int tid=0) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template updateTx<uint64_t>([=] () {
+            SNode* update[SK_MAX_LEVEL + 1];
+            SNode* hd = header;
+            for (int i = 0; i < SK_MAX_LEVEL + 1; i++) update[i] = hd;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const K key = keys[ord[j]];
+                fingerSearch(key, update);
+                SNode* x = update[0]->forw[0];
+                const bool added = x == nullptr || x->key != key;
+                if (added) {
+                    int lvl = random_level();
+                    if (lvl > level) {
+                        for (int i = level + 1;i <= lvl;i++){
+                            update[i] = header;
+                        }
+                        level = lvl;
+                    }
+                    x = TM::template tmNew<SNode>(lvl, key, values[ord[j]]);
+                    for (int i = 0;i <= lvl;i++){
+                        x->forw[i] = update[i]->forw[i];
+                        update[i]->forw[i] = x;
+                    }
+                    count++;
+                }
+                if (results != nullptr) results[ord[j]] = added;
+            }
+            if (TRACK_CHANGES && count > 0) version++;
+            return count;
+        });
+    }
+
+    uint64_t removeMany(const K* keys, uint64_t size, bool* results=nullptr, const int tid=0) {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template updateTx<uint64_t>([=] () {
+            SNode* update[SK_MAX_LEVEL + 1];
+            SNode* hd = header;
+            for (int i = 0; i < SK_MAX_LEVEL + 1; i++) update[i] = hd;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const K key = keys[ord[j]];
+                fingerSearch(key, update);
+                SNode* x = update[0]->forw[0];
+                const bool removed = x != nullptr && x->key == key;
+                if (removed) {
+                    for (int i = 0;i <= level;i++){
+                        if (update[i]->forw[i] != x) break;
+                        update[i]->forw[i] = x->forw[i];
+                    }
+                    TM::template tmDelete<SNode>(x);
+                    while (level.pload() > 0 && header->forw[level] == nullptr){
+                        level--;
+                    }
+                    count++;
+                }
+                if (results != nullptr) results[ord[j]] = removed;
+            }
+            if (TRACK_CHANGES && count > 0) version++;
+            return count;
+        });
+    }
+
     void addAll(K* keys, V* values, uint64_t size, const int tid=0) {
         for (uint64_t i = 0; i < size; i++) add(keys[i], values[i], tid);
     }
@@ -218,6 +310,132 @@ public:
         return numKeys;
     }
 
+    /*
+     * A cursor for long scans, which reads the keys in [lo,hi) in ascending order in chunks, one short read
+     * transaction per chunk, instead of read-locking the whole range in a single transaction like rangeQuery().
+     * Each chunk starts after the last key of the previous one, so the keys that are in the map during the
+     * whole scan are returned exactly once, but the scan is not a snapshot. If validate is set (and the map has
+     * TRACK_CHANGES) each chunk reads the version of the map and 'changed' is set if the map was modified
+     * since the previous chunk. Reading the version exactly makes the chunks conflict with the writers.
+     */
+    struct Cursor {
+        K        key;               // The next chunk starts at this key, or after it if started is set
+        K        hi;
+        bool     validate;
+        bool     started {false};   // At least one key was returned
+        bool     done {false};      // All the keys in the range were returned
+        bool     changed {false};   // The map was modified during the scan
+        uint64_t version {0};       // Version of the map in the last chunk
+    };
+
+    Cursor cursor(const K& lo, const K& hi, const bool validate=false) const {
+        return Cursor{lo, hi, validate};
+    }
+
+    // Places up to maxKeys keys of the cursor's range in resultKeys, and their values in resultValues if not nullptr,
+    // and moves the cursor after them. Returns the number of keys, which is zero only when cursor.done is set.
+    uint64_t nextChunk(Cursor& cursor, const uint64_t maxKeys, K* const resultKeys, V* const resultValues=nullptr) const {
+        if (cursor.done) return 0;
+        Cursor* cur = &cursor;
+        return TM::template readTx<uint64_t>([=] () {
+            const uint64_t ver = cur->validate ? version.pload() : 0;
+            const K hi = cur->hi;
+            uint64_t numKeys = 0;
+            SNode* x = findCeiling(cur->key, cur->started);
+            while (x != nullptr && numKeys < maxKeys) {
+                const K xkey = x->key;
+                if (!(xkey < hi)) break;
+                resultKeys[numKeys] = xkey;
+                if (resultValues != nullptr) resultValues[numKeys] = x->value;
+                numKeys++;
+                x = x->forw[0];
+            }
+            // x is the first node after the chunk, check if it's still in the range so that the last chunk is not empty
+            const bool done = x == nullptr || !(x->key < hi);
+            // No aborts after this point, it's safe to modify the cursor
+            if (cur->validate) {
+                if (cur->started && ver != cur->version) cur->changed = true;
+                cur->version = ver;
+            }
+            if (numKeys > 0) {
+                cur->key = resultKeys[numKeys-1];
+                cur->started = true;
+            }
+            cur->done = done;
+            return numKeys;
+        });
+    }
+
     static std::string className() { return TM::className() + "-SkipListMap"; }
 
+private:
+    // Internal: returns the indexes of the keys in ascending order of the keys, and of the index for equal keys
+    static std::vector<uint64_t> sortedOrder(const K* keys, uint64_t size) {
+        std::vector<uint64_t> order(size);
+        for (uint64_t i = 0; i < size; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [keys] (uint64_t a, uint64_t b) {
+            return keys[a] < keys[b] || (!(keys[b] < keys[a]) && a < b);
+        });
+        return order;
+    }
+
+    // Internal: update[] has the predecessors on each level of a previous key (or the header) and they are moved
+    // forward to the predecessors of key, which can't be lower than the previous key. If the successor on a level
+    // is already equal or higher than key, then so are the successors on the levels above it, which means the
+    // search goes up only until such a level and then down as usual. Must be called from within a transaction
+    void fingerSearch(const K& key, SNode** update) const {
+        const int64_t lvl = level;
+        // When the predecessor is the header on all the levels, this is a search from the header
+        int h = (update[0] == header) ? lvl+1 : 0;
+        while (h <= lvl) {
+            SNode* forwh = update[h]->forw[h];
+            if (forwh == nullptr || !(forwh->key.pload() < key)) break;
+            h++;
+        }
+        if (h == 0) return;
+        SNode* x = update[h-1];
+        for (int i = h-1; i >= 0; i--) {
+            while (x->forw[i] != nullptr && x->forw[i].pload()->key < key){
+                x = x->forw[i];
+            }
+            update[i] = x;
+        }
+    }
+
+    // Internal: returns the node with the lowest key equal or higher than key (higher if exclusive is set), or nullptr.
+    // Must be called from within a transaction
+    SNode* findCeiling(const K& key, const bool exclusive) const {
+        SNode* x = header;
+        for (int i = level; i >= 0; i--) {
+            SNode* forwi = x->forw[i];
+            while (forwi != nullptr && (forwi->key < key || (exclusive && forwi->key == key))) {
+                x = forwi;
+                forwi = x->forw[i];
+            }
+        }
+        return x->forw[0];
+    }
+
+    // Internal: shared by containsMany() and getMany()
+    uint64_t findMany(const K* keys, uint64_t size, bool* results, V* values) const {
+        std::vector<uint64_t> order = sortedOrder(keys, size);
+        const uint64_t* ord = order.data();
+        return TM::template readTx<uint64_t>([=] () {
+            SNode* update[SK_MAX_LEVEL + 1];
+            SNode* hd = header;
+            for (int i = 0; i < SK_MAX_LEVEL + 1; i++) update[i] = hd;
+            uint64_t count = 0;
+            for (uint64_t j = 0; j < size; j++) {
+                const K key = keys[ord[j]];
+                fingerSearch(key, update);
+                SNode* x = update[0]->forw[0];
+                const bool found = x != nullptr && x->key == key;
+                if (results != nullptr) results[ord[j]] = found;
+                if (values != nullptr) values[ord[j]] = found ? x->value.pload() : (V)nullptr;
+                if (found) count++;
+            }
+            return count;
+        });
+    }
+
 };
@@ -14,8 +14,18 @@
 #include <iostream>
 #include <vector>
 #include <functional>
+#include <type_traits>
+#include <mutex>
+#include <condition_variable>
 #include <cstring>      // std::memcpy()
+#include <cstddef>      // std::max_align_t
 #include <csetjmp>      // Needed by sigjmp_buf
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#include <sys/mman.h>
+#endif
 
 // 2PL with Distributed rw-lock Undo-log - Starvation-Free
 // This concurrency control uses the same rw-lock as 2PLUndoDist but with a
@@ -40,6 +50,52 @@ static const int REGISTRY_MAX_THREADS = 256;
 static const uint64_t TX_MAX_ALLOCS = 10*1024;
 // Maximum number of deallocations in one transaction
 static const uint64_t TX_MAX_RETIRES = 10*1024;
+// Maximum number of distinct tmcounter instances incremented in one transaction
+static const int32_t TX_MAX_COUNTERS = 1024;
+// Number of entries of the cache of write-locks that a worker of a fork has already checked for readers
+static const uint32_t FORK_LOCK_CACHE = 64;
+// Default mode of the read-indicators. When set, readers arrive with a plain store instead of an atomic
+// exchange (a full fence on x86) and the writers do the fence for them with a membarrier() system call.
+// A reader does a single fenced store per transaction, to announce that it has arrivals without a fence,
+// and writers skip the membarrier() when no other transaction has announced.
+// Compile with -DTWOPLSF_ASYMMETRIC_FENCE for read-dominated workloads. Only available on Linux.
+#ifdef TWOPLSF_ASYMMETRIC_FENCE
+static const bool ASYMMETRIC_FENCE = true;
+#else
+static const bool ASYMMETRIC_FENCE = false;
+#endif
+// Object-granularity locks. Each rw-lock covers a block of 2^LOCK_SHIFT bytes. By default this is a stripe of 32
+// bytes, and a node of a data structure spans multiple stripes. Compile with -DTWOPLSF_OBJECT_LOCKS to have the
+// objects derived from tmbase allocated by tmNew() aligned to a block of 64 bytes (a cache line). An object that
+// fits in one block is covered by a single lock, which is taken once for all its fields. Larger objects still
+// take one lock per block, and the memory that isn't a tmbase object is locked in blocks of 64 bytes as well.
+#ifdef TWOPLSF_OBJECT_LOCKS
+static const bool OBJECT_LOCKS = true;
+static const uint64_t LOCK_SHIFT = 6;
+#else
+static const bool OBJECT_LOCKS = false;
+static const uint64_t LOCK_SHIFT = 5;
+#endif
+// Default mode of the domains. A hybrid domain switches at runtime between the 2PLSF protocol and an optimistic
+// protocol with lazy versioning, depending on the workload (see hyEvaluate()). Compile with -DTWOPLSF_HYBRID
+// to make the default domain hybrid.
+#ifdef TWOPLSF_HYBRID
+static const bool HYBRID = true;
+#else
+static const bool HYBRID = false;
+#endif
+// Number of commits of a thread between two evaluations of the protocol of a hybrid domain
+static const uint64_t HY_WINDOW = 4096;
+// A hybrid domain goes optimistic when less than HY_OPT_MAX_WRITES percent of the accesses are stores and less
+// than HY_OPT_MAX_CONFLICTS percent of the transactions had to wait or abort. It goes back to 2PLSF when more
+// than HY_PES_MIN_WRITES percent of the accesses are stores or more than HY_PES_MIN_ABORTS percent of the
+// transactions abort.
+static const uint64_t HY_OPT_MAX_WRITES = 5;
+static const uint64_t HY_OPT_MAX_CONFLICTS = 2;
+static const uint64_t HY_PES_MIN_WRITES = 8;
+static const uint64_t HY_PES_MIN_ABORTS = 10;
+// Number of times that an optimistic read spins on a lock of a committing transaction before aborting
+static const uint64_t OPT_MAX_SPINS = 1024;
 
 
 
@@ -49,6 +105,8 @@ static const int TX_IS_UPDATE = 2;
 
 static const uint64_t NO_TIMESTAMP = 0xFFFFFFFFFFFFFFFFULL;
 
+static const uint32_t NO_WIDX = 0xFFFFFFFF;
+
 #ifdef __x86_64__
 #define Pause()  __asm__ __volatile__ ( "pause" : : : )
 #else
@@ -145,30 +203,127 @@ struct tmbase { };
 struct Deletable {
     void* obj {nullptr};         // Pointer to object to be deleted
     void (*reclaim)(void*);      // A wrapper to keep the type of the underlying object
+    uint64_t size {0};           // Size of the allocation, needed to detect accesses to captured memory
+};
+
+
+// A callback registered with onCommit() or onAbort()
+struct Callback {
+    std::function<void()> fn;
+    bool                  async;       // If set, it's executed by the AsyncExecutor instead of the transaction's thread
+};
+
+
+/*
+ * <h1> Background executor for asynchronous callbacks </h1>
+ *
+ * A single thread that executes the callbacks registered with async=true, in the order they were submitted.
+ * The thread is started the first time it's needed and is joined at exit, after executing the pending callbacks.
+ */
+class AsyncExecutor {
+private:
+    std::mutex                  mtx;
+    std::condition_variable     cv;
+    std::vector<Callback>       pending;
+    uint64_t                    numSubmitted {0};    // Protected by mtx
+    uint64_t                    numExecuted {0};     // Protected by mtx
+    bool                        quit {false};
+    std::thread                 worker;
+
+    void workerLoop() {
+        std::vector<Callback> batch;
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            cv.wait(lock, [this] () { return quit || !pending.empty(); });
+            if (pending.empty()) return;
+            batch.swap(pending);
+            lock.unlock();
+            for (size_t i = 0; i < batch.size(); i++) batch[i].fn();
+            lock.lock();
+            numExecuted += batch.size();
+            batch.clear();
+            cv.notify_all();
+        }
+    }
+
+public:
+    AsyncExecutor() : worker{&AsyncExecutor::workerLoop, this} { }
+
+    ~AsyncExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            quit = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    static AsyncExecutor& get() {
+        static AsyncExecutor executor {};
+        return executor;
+    }
+
+    // Moves the callbacks to the executor, one lock acquisition per batch
+    void submit(std::vector<Callback>& callbacks) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (size_t i = 0; i < callbacks.size(); i++) pending.push_back(std::move(callbacks[i]));
+            numSubmitted += callbacks.size();
+        }
+        cv.notify_all();
+        callbacks.clear();
+    }
+
+    // Waits until all the callbacks submitted so far have been executed
+    void flush() {
+        std::unique_lock<std::mutex> lock(mtx);
+        const uint64_t target = numSubmitted;
+        cv.wait(lock, [this,target] () { return numExecuted >= target; });
+    }
 };
 
+// Executes the synchronous callbacks in the current thread and hands the asynchronous ones to the AsyncExecutor
+inline static void runCallbacks(std::vector<Callback>& callbacks) {
+    std::vector<Callback> asyncCallbacks;
+    for (size_t i = 0; i < callbacks.size(); i++) {
+        if (callbacks[i].async) {
+            asyncCallbacks.push_back(std::move(callbacks[i]));
+        } else {
+            callbacks[i].fn();
+        }
+    }
+    if (!asyncCallbacks.empty()) AsyncExecutor::get().submit(asyncCallbacks);
+}
+
 
-// Number of rw-locks. _Must_ be a power of 2.
+// Default number of rw-locks of a domain. _Must_ be a power of 2.
 static const uint64_t NUM_RWL = 4*1024*1024;
 // Number of read-indicators per wstate. At least 1 but more if we want to share a read-indicator
 // across multiple rw-locks, as doing so will make it faster to acquire read-locks on consecutive data.
 // Preferably this should be a power of 2 so that the division can be optimized into a shift.
 static const uint32_t RI_PER_RWL = 1;
-// Number of read indicators.
-static const uint64_t NUM_RI = NUM_RWL;
-// Number of words needed for the read-indicators
-static const uint64_t NUM_RI_WORDS = NUM_RI*REGISTRY_MAX_THREADS/64;
 // We reserve 16 bits for the tid of the write lock. Use 0 to represent UNLOCKED and the others are tid+1
 static const uint16_t UNLOCKED = (1UL << 16)-1;
 
-// Function that hashes an address to a write-indicator index.
-// 2^5 => one lock for every 32 bytes (half a cache line)
-inline static uint64_t addr2writeIdx(const void* addr) { return (((uint64_t)(addr) >> 5) & (NUM_RWL-1)); }
+// Registers the process for expedited membarrier(). Returns false if the kernel doesn't support it.
+inline static bool registerHeavyFence() {
+#if defined(__linux__) && defined(__NR_membarrier)
+    return syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+#else
+    return false;
+#endif
+}
 
-// This function converts a widx to a ridx
-inline static uint32_t writeIdx2readIdx(uint32_t widx, int16_t tid) {
-    // Get the word of the ri based on the widx and the tid
-    return tid*NUM_RI_WORDS/REGISTRY_MAX_THREADS + ((widx/RI_PER_RWL)/64);
+// Executes a full fence on all the running threads of the process. Must be registered first.
+inline static void heavyFence() {
+#if defined(__linux__) && defined(__NR_membarrier)
+    syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+#endif
+}
+
+// Returns the bit of a reader-writer lock in the filter of the stripes that a transaction blocked in retry() waits on
+inline static uint64_t retryBit(uint32_t widx) {
+    return (1ULL << (((uint64_t)widx * 0x9E3779B97F4A7C15ULL) >> 58));
 }
 
 // Returns the read-indicator bit for a specific reader-writer lock
@@ -199,10 +354,10 @@ struct ReadSet {
     }
 
     // TODO: make a proper growable read-set
-    inline void addEntry(const void* addr) {
+    inline void addEntry(uint32_t widx) {
         // If you see this assert(), then increase MAX_READ_SET_ENTRIES
         assert(size != MAX_READ_SET_ENTRIES);
-        entries[size].widx = addr2writeIdx(addr);
+        entries[size].widx = widx;
         size++;
     }
 };
@@ -220,11 +375,34 @@ struct WriteSet {
         uint64_t  data;  // old value
     };
 
+    // Number of slots of the hash index of the redo log. Only the first REDO_INDEX_SLOTS/2 entries are indexed.
+    static const int32_t REDO_INDEX_SLOTS = 8*1024;
+
     WriteSetEntry entries[MAX_WRITE_SET_ENTRIES];     // undo log of stores
     int32_t       size {0};          // Number of stores in the writeSet for the current transaction
+    uint64_t      filter {0};        // Filter of the addresses in the redo log
+    uint64_t      redoGen {0};       // The slots of the index that don't have this generation are empty. Zero until the first use.
+    uint64_t*     redoIndex {nullptr};  // (generation << 32) | entry. Allocated on the first use, only hybrid domains need it.
+
+    WriteSet() = default;
+    WriteSet(const WriteSet&) = delete;
+    WriteSet& operator=(const WriteSet&) = delete;
+    ~WriteSet() { std::free(redoIndex); }
 
     inline void reset() {
         size = 0;
+        if (filter != 0 && ++redoGen == (1ULL << 32)) clearRedoIndex();
+        filter = 0;
+    }
+
+    void clearRedoIndex() {
+        if (redoIndex == nullptr) {
+            redoIndex = (uint64_t*)std::calloc(REDO_INDEX_SLOTS, sizeof(uint64_t));
+            assert(redoIndex != nullptr);
+        } else {
+            std::memset(redoIndex, 0, REDO_INDEX_SLOTS*sizeof(uint64_t));
+        }
+        redoGen = 1;
     }
 
     // Adds a modification to the undo log
@@ -239,13 +417,107 @@ struct WriteSet {
         WriteSetEntry* entry = &entries[i];
         *(uint64_t*)entry->addr = entry->data;
     }
+
+    // In the optimistic mode of a hybrid domain the write-set is a redo log instead, and data is the new value.
+    // There is one entry per (aligned) word.
+    inline void addRedo(void* addr, uint64_t val) {
+        if (redoGen == 0) clearRedoIndex();
+        uint32_t slot = redoSlot(addr);
+        const int32_t i = findRedo(addr, slot);
+        if (i >= 0) {
+            entries[i].data = val;
+            return;
+        }
+        assert(size != MAX_WRITE_SET_ENTRIES);
+        filter |= redoBit(addr);
+        if (size < REDO_INDEX_SLOTS/2) redoIndex[slot] = (redoGen << 32) | size;
+        entries[size].addr = addr;
+        entries[size].data = val;
+        size++;
+    }
+
+    // Returns true if the word is in the redo log, and its buffered value in val
+    inline bool lookupRedo(const void* addr, uint64_t& val) const {
+        if ((filter & redoBit(addr)) == 0) return false;
+        uint32_t slot = redoSlot(addr);
+        const int32_t i = findRedo(addr, slot);
+        if (i < 0) return false;
+        val = entries[i].data;
+        return true;
+    }
+
+    // Returns the entry of addr, or -1. Leaves in slot the empty slot of the index where addr would go.
+    inline int32_t findRedo(const void* addr, uint32_t& slot) const {
+        while ((redoIndex[slot] >> 32) == redoGen) {
+            const int32_t i = (int32_t)(redoIndex[slot] & 0xFFFFFFFF);
+            if (entries[i].addr == addr) return i;
+            slot = (slot+1) & (REDO_INDEX_SLOTS-1);
+        }
+        for (int32_t i = REDO_INDEX_SLOTS/2; i < size; i++) {
+            if (entries[i].addr == addr) return i;
+        }
+        return -1;
+    }
+
+    static inline uint64_t redoBit(const void* addr) { return 1ULL << (((uint64_t)addr >> 3) & 63); }
+    static inline uint32_t redoSlot(const void* addr) { return (uint32_t)((((uint64_t)addr >> 3) * 0x9E3779B97F4A7C15ULL) >> 51); }
+};
+
+
+// The counter-set buffers the increments done on tmcounter instances during the transaction.
+// The counters are held in shared (read) mode, therefore, other transactions may be incrementing
+// the same counter and the deltas have to be applied with a fetch_add() at commit time.
+// There is nothing to undo on abort, we just drop the buffered deltas.
+struct CounterSet {
+    struct CounterSetEntry {
+        uint64_t* addr;
+        uint64_t  delta;
+    };
+
+    CounterSetEntry entries[TX_MAX_COUNTERS];
+    int32_t         size {0};
+
+    inline void reset() {
+        size = 0;
+    }
+
+    // Accumulates the delta on the entry for this counter. Transactions touch few counters so a linear search is ok.
+    inline void add(uint64_t* addr, uint64_t delta) {
+        for (int32_t i = 0; i < size; i++) {
+            if (entries[i].addr != addr) continue;
+            entries[i].delta += delta;
+            return;
+        }
+        // If you see this assert(), then increase TX_MAX_COUNTERS
+        assert(size != TX_MAX_COUNTERS);
+        entries[size].addr = addr;
+        entries[size].delta = delta;
+        size++;
+    }
+
+    // Removes the entry for this counter (if there is one) and returns its buffered delta
+    inline uint64_t take(uint64_t* addr) {
+        for (int32_t i = 0; i < size; i++) {
+            if (entries[i].addr != addr) continue;
+            uint64_t delta = entries[i].delta;
+            entries[i] = entries[--size];
+            return delta;
+        }
+        return 0;
+    }
+
+    // Must be called before releasing the locks
+    inline void apply() {
+        for (int32_t i = 0; i < size; i++) __atomic_fetch_add(entries[i].addr, entries[i].delta, __ATOMIC_RELAXED);
+    }
 };
 
 
 
 
-// Forward declaration
+// Forward declarations
 struct OpData;
+class STM;
 // This is used by addToLog() to know which OpDesc instance to use for the current transaction
 extern thread_local OpData* tl_opdata;
 // This is used by tmtype::load() to figure out if it needs to save a load on the read-set or not
@@ -254,27 +526,65 @@ extern thread_local OpData* tl_opdata;
 // Its purpose is to hold thread-local data
 struct OpData {
     std::jmp_buf          env;
+    STM*                  stm {nullptr};               // Domain that this OpData belongs to
     uint64_t              attempt {0};
     uint64_t              tid;
     WriteSet              writeSet;                    // The write set
     ReadSet               readSet;                     // The read set
+    CounterSet            counterSet;                  // Buffered increments of tmcounter instances
     uint64_t              myTS {NO_TIMESTAMP};
     uint64_t              oTS {NO_TIMESTAMP};
     uint16_t              otid {REGISTRY_MAX_THREADS};
+    bool                  noWait {false};              // If set, abort instead of waiting for a younger transaction
+    uint32_t              waitWidx {NO_WIDX};          // Lock that made us abort in noWait mode, or NO_WIDX if we had to "Die"
+    bool                  waitWrite {false};           // Set if waitWidx was for a write-lock
     uint64_t              numAborts {0};
     uint64_t              numCommits {0};
     uint64_t              numFrees {0};                // Number of calls to tmDelete() in this transaction (owner thread only)
     void*                 flog[TX_MAX_RETIRES];        // List of retired objects during the transaction (owner thread only)
     uint64_t              numAllocs {0};               // Number of calls to tmNew() in this transaction (owner thread only)
     Deletable             alog[TX_MAX_ALLOCS];         // List of newly allocated objects during the transaction (owner thread only)
+    std::vector<Callback> commitHooks;                 // Callbacks to execute after the transaction commits (owner thread only)
+    std::vector<Callback> abortHooks;                  // Callbacks to execute if the transaction aborts (owner thread only)
+    uintptr_t             capLo {UINTPTR_MAX};         // Range of the most recent allocation of this transaction (owner thread only)
+    uintptr_t             capHi {0};
+    void                  (*restartFn)(OpData*) {nullptr}; // If set, restarts the transaction instead of longjmp(env). Used by the libitm ABI
+    std::atomic<uint64_t> retryFilter {0};             // Filter of the stripes that we're waiting on in retry(), or zero
+    bool                  retryWake {false};           // Set by the writer that wakes us up from retry(). Protected by retryMutex
+    std::mutex            retryMutex;
+    std::condition_variable retryCV;
+    OpData*               parent {nullptr};            // Transaction of the fork, if this is a worker of a fork (see 2PLSFFork.hpp)
+    bool                  optimistic {false};          // Set if the transaction runs in the optimistic mode of a hybrid domain
+    uint64_t              rv {0};                      // Snapshot of the optimistic mode
+    std::vector<std::pair<uint32_t,uint64_t>> orecLocks; // Orecs locked by the commit of the optimistic mode, and their previous value
+    std::atomic<uint64_t> hyState {0};                 // Sequence and mode of the ongoing transaction of a hybrid domain, or zero
+    uint64_t              hySeq {0};
+    bool                  hyWindowMode {false};        // Statistics of a hybrid domain, since the last evaluation (owner thread only)
+    uint64_t              hyCommits {0};
+    uint64_t              hyAborts {0};
+    uint64_t              hyWaits {0};
+    uint64_t              hyReads {0};
+    uint64_t              hyWrites {0};
+    bool                  hyOverflow {false};          // Set if the read-set overflowed in the optimistic mode
+    std::atomic<bool>     asymReading {false};         // Set while the transaction may have read-locks taken without a fence
+    uint32_t              forkLocks[FORK_LOCK_CACHE];  // Write-locks of the fork already checked for readers by this worker (direct-mapped)
 };
 
 
 [[noreturn]] void abortTx(OpData* myd);
 
-class STM;
 extern STM gSTM;
 
+template<typename T> struct tmtype;
+
+
+// Receives the modifications of each update transaction at commit time, while the transaction still holds
+// its locks, therefore, the order of the calls is a serialization order of the transactions (see 2PLSFDurable.hpp)
+struct CommitLog {
+    virtual void append(OpData* myd) = 0;
+    virtual ~CommitLog() { }
+};
+
 
 // Two-Phase locking with Distributed reader-writer lock based on C-RW-WP with read-indicator and tid for writer.
 // Each read-indicator cover multiple write indicators. In other words, the read lock protects multiple rw-locks.
@@ -285,10 +595,32 @@ public:
     struct tmbase : public twoplsf::tmbase { };
 
     static const int CLPAD = 128/sizeof(uint64_t);
+    static const uint64_t HY_PESSIMISTIC = 0;
+    static const uint64_t HY_OPTIMISTIC = 1;
+    static const uint64_t HY_SWITCHING = 2;
     // Contains thread-local metadata
     alignas(128) OpData                *opDesc;
+    // Number of rw-locks of this domain
+    const uint64_t                      numRWL;
+    // Number of words of read-indicators for each thread
+    const uint64_t                      riWordsPerThread;
+    // If set, readers arrive without a fence and writers call heavyFence() before they see an empty read-indicator
+    bool                                asymmetricFence;
     // Global clock
     alignas(128) std::atomic<uint64_t>  conflictClock {1};
+    // Number of threads blocked in retry()
+    alignas(128) std::atomic<uint64_t>  numRetryWaiters {0};
+    // If set, the domain switches between the 2PLSF protocol and the optimistic protocol
+    const bool                          hybrid;
+    // Protocol of a hybrid domain: HY_PESSIMISTIC or HY_OPTIMISTIC, plus HY_SWITCHING while the transactions drain
+    alignas(128) std::atomic<uint64_t>  hyMode {HY_PESSIMISTIC};
+    std::atomic<uint64_t>               numSwitches {0};
+    // Clock of the optimistic protocol
+    alignas(128) std::atomic<uint64_t>  optClock {0};
+    // Array of versioned locks of the optimistic protocol (version << 1, or (tid << 1) | 1 when locked)
+    alignas(128) std::atomic<uint64_t>* orecs {nullptr};
+    // If set, the update transactions are appended to it when they commit
+    CommitLog*                          commitLog {nullptr};
     // Array of write-indicators
     alignas(128) std::atomic<uint64_t>* wlocks;
     // Array of read-indicators
@@ -297,47 +629,118 @@ public:
     alignas(128) std::atomic<uint64_t>  txnTS[CLPAD*REGISTRY_MAX_THREADS];
 
 
-    STM() {
+    // Each instance is an independent domain, with its own locks, timestamps and statistics.
+    // Data accessed in the transactions of a domain should not be accessed in transactions of other domains.
+    // numRWL is the number of rw-locks of the domain. It _must_ be a power of 2, larger or equal to 64.
+    // asymmetricFence is ignored if the kernel doesn't support membarrier().
+    // A hybrid domain starts with the 2PLSF protocol.
+    STM(uint64_t numRWL=NUM_RWL, bool asymmetricFence=ASYMMETRIC_FENCE, bool hybrid=HYBRID) :
+        numRWL{numRWL}, riWordsPerThread{numRWL/RI_PER_RWL/64}, hybrid{hybrid} {
+        assert(numRWL >= 64 && (numRWL & (numRWL-1)) == 0);
+        this->asymmetricFence = asymmetricFence && registerHeavyFence();
+        if (asymmetricFence && !this->asymmetricFence) fprintf(stderr, "2PLSF: membarrier() is not available, using fenced read-indicators\n");
         opDesc = new OpData[REGISTRY_MAX_THREADS];
         for (int i=0; i < REGISTRY_MAX_THREADS; i++) opDesc[i].tid = i;
+        for (int i=0; i < REGISTRY_MAX_THREADS; i++) opDesc[i].stm = this;
         for (int i=0; i < REGISTRY_MAX_THREADS; i++) txnTS[i*CLPAD].store(NO_TIMESTAMP, std::memory_order_release);
-        wlocks = new std::atomic<uint64_t>[NUM_RWL];
-        for (uint64_t i = 0; i < NUM_RWL; i++) wlocks[i].store(UNLOCKED, std::memory_order_relaxed);
-        readIndicators = new std::atomic<uint64_t>[NUM_RI_WORDS];
-        for (uint64_t i = 0; i < NUM_RI_WORDS; i++) readIndicators[i].store(0, std::memory_order_relaxed);
+        wlocks = new std::atomic<uint64_t>[numRWL];
+        for (uint64_t i = 0; i < numRWL; i++) wlocks[i].store(UNLOCKED, std::memory_order_relaxed);
+        readIndicators = new std::atomic<uint64_t>[riWordsPerThread*REGISTRY_MAX_THREADS];
+        for (uint64_t i = 0; i < riWordsPerThread*REGISTRY_MAX_THREADS; i++) readIndicators[i].store(0, std::memory_order_relaxed);
+        if (hybrid) {
+            orecs = new std::atomic<uint64_t>[numRWL];
+            for (uint64_t i = 0; i < numRWL; i++) orecs[i].store(0, std::memory_order_relaxed);
+        }
     }
 
     ~STM() {
-        uint64_t totalAborts = 0;
-        uint64_t totalCommits = 0;
-        for (int i=0; i < REGISTRY_MAX_THREADS; i++) {
-            totalAborts += opDesc[i].numAborts;
-            totalCommits += opDesc[i].numCommits;
-        }
+        uint64_t totalAborts = getNumAborts();
+        uint64_t totalCommits = getNumCommits();
         printf("totalAborts=%ld  totalCommits=%ld  restartRatio=%.1f%% \n", totalAborts, totalCommits, 100.*totalAborts/(1+totalCommits));
+        if (hybrid) printf("protocolSwitches=%ld  finalProtocol=%s\n", numSwitches.load(), (hyMode.load() == HY_OPTIMISTIC) ? "optimistic" : "2PLSF");
         delete[] opDesc;
         delete[] wlocks;
         delete[] readIndicators;
+        delete[] orecs;
+    }
+
+    static std::string className() { return std::string("2PLSF") + (ASYMMETRIC_FENCE ? "-MB" : "") + (OBJECT_LOCKS ? "-OBJ" : "") + (HYBRID ? "-HY" : ""); }
+
+#ifdef __linux__
+    // Excludes the locks and the logs of this domain from the child processes of fork(), which then
+    // don't have to copy their page tables. The children must not use this domain.
+    void excludeFromFork() {
+        auto dontFork = [] (void* ptr, uint64_t size) {
+            const uintptr_t lo = ((uintptr_t)ptr + 4095) & ~(uintptr_t)4095;
+            const uintptr_t hi = ((uintptr_t)ptr + size) & ~(uintptr_t)4095;
+            if (lo < hi) madvise((void*)lo, hi - lo, MADV_DONTFORK);
+        };
+        dontFork(opDesc, sizeof(OpData)*REGISTRY_MAX_THREADS);
+        dontFork(wlocks, sizeof(std::atomic<uint64_t>)*numRWL);
+        dontFork(readIndicators, sizeof(std::atomic<uint64_t>)*riWordsPerThread*REGISTRY_MAX_THREADS);
+        if (orecs != nullptr) dontFork(orecs, sizeof(std::atomic<uint64_t>)*numRWL);
+    }
+#endif
+
+    // Statistics of this domain
+    uint64_t getNumCommits() const {
+        uint64_t total = 0;
+        for (int i=0; i < REGISTRY_MAX_THREADS; i++) total += opDesc[i].numCommits;
+        return total;
+    }
+
+    uint64_t getNumAborts() const {
+        uint64_t total = 0;
+        for (int i=0; i < REGISTRY_MAX_THREADS; i++) total += opDesc[i].numAborts;
+        return total;
     }
 
-    static std::string className() { return "2PLSF"; }
+    // Function that hashes an address to a write-indicator index.
+    // 2^5 => one lock for every 32 bytes (half a cache line), 2^6 => one lock for every object (see OBJECT_LOCKS)
+    inline uint32_t addr2writeIdx(const void* addr) const { return (((uint64_t)(addr) >> LOCK_SHIFT) & (numRWL-1)); }
+
+    // This function converts a widx to a ridx
+    inline uint32_t writeIdx2readIdx(uint32_t widx, int16_t tid) const {
+        // Get the word of the ri based on the widx and the tid
+        return tid*riWordsPerThread + ((widx/RI_PER_RWL)/64);
+    }
 
     inline void beginTx(OpData* myd) {
         // Clear the logs of the previous transaction
         myd->numAllocs = 0;
+        myd->capLo = UINTPTR_MAX;
+        myd->capHi = 0;
         myd->numFrees = 0;
         myd->writeSet.reset();
         myd->readSet.reset();
+        myd->counterSet.reset();
+        myd->waitWidx = NO_WIDX;
+        myd->commitHooks.clear();
+        myd->abortHooks.clear();
         if (myd->attempt > 0) waitForConflictingTxn(myd);
+        // Announce that our read-locks are taken without a fence. This is the only fence of the readers.
+        if (asymmetricFence) myd->asymReading.exchange(true);
         myd->attempt++;
+        if (hybrid) hyBegin(myd);
     }
 
     // Once we get to the commit stage, there is no longer the possibility of aborts
     inline void endTx(OpData* myd, const int tid) {
-        // Unlock write locks
-        for (uint64_t i=0; i < myd->writeSet.size; i++) unlockWrite(myd->writeSet.entries[i].addr, tid);
-        // Unlock the read locks
-        unlockAllReadLocks(myd, tid);
+        if (myd->optimistic) {
+            // The commit of the optimistic protocol can still abort
+            optCommit(myd);
+        } else {
+            // Apply the increments to the counters while we still hold them in shared mode
+            myd->counterSet.apply();
+            if (commitLog != nullptr) commitLog->append(myd);
+            // Unlock write locks
+            for (uint64_t i=0; i < myd->writeSet.size; i++) unlockWrite(myd->writeSet.entries[i].addr, tid);
+            // Unlock the read locks
+            unlockAllReadLocks(myd, tid);
+        }
+        // Wake up the transactions blocked in retry() on the stripes we modified
+        if (numRetryWaiters.load() != 0) wakeRetryWaiters(myd);
+        if (hybrid) hyCommit(myd);
         // Execute de-allocations
         for (uint64_t i = 0; i < myd->numFrees; i++) std::free(myd->flog[i]);
         myd->numCommits++;
@@ -348,27 +751,51 @@ public:
         myd->oTS = NO_TIMESTAMP;
         myd->otid = REGISTRY_MAX_THREADS;
         tl_opdata = nullptr;
+        // Execute the commit callbacks now that the locks are released. They may start new transactions,
+        // which would clear the hooks, so we take them out of myd first.
+        if (!myd->commitHooks.empty()) {
+            std::vector<Callback> hooks;
+            hooks.swap(myd->commitHooks);
+            runCallbacks(hooks);
+        }
     }
 
     inline void abortTx(OpData* myd, bool enableRollback=true) {
-        // Undo the modifications in reverse order
-        if (enableRollback && myd->writeSet.size != 0) {
-            for (int32_t i=myd->writeSet.size-1; i >= 0; i--) myd->writeSet.rollbackSingleEntry(i);
-        }
-        // Unlock write-locks
-        for (int i=0; i < myd->writeSet.size; i++) unlockWrite(myd->writeSet.entries[i].addr, myd->tid);
-        // Unlock the read locks
-        unlockAllReadLocks(myd, myd->tid);
+        if (myd->optimistic) {
+            // Nothing to undo, the redo log is discarded
+            optAbort(myd);
+        } else {
+            // Undo the modifications in reverse order
+            if (enableRollback && myd->writeSet.size != 0) {
+                for (int32_t i=myd->writeSet.size-1; i >= 0; i--) myd->writeSet.rollbackSingleEntry(i);
+            }
+            // Unlock write-locks
+            for (int i=0; i < myd->writeSet.size; i++) unlockWrite(myd->writeSet.entries[i].addr, myd->tid);
+            // Unlock the read locks
+            unlockAllReadLocks(myd, myd->tid);
+        }
+        if (hybrid) {
+            myd->hyState.store(0, std::memory_order_release);
+            myd->hyAborts++;
+        }
         // Undo allocations
         for (unsigned i = 0; i < myd->numAllocs; i++) myd->alog[i].reclaim(myd->alog[i].obj);
         myd->numAborts++;
+        // The attempt is over. The callbacks will be registered again if the transaction is retried.
+        myd->commitHooks.clear();
+        if (!myd->abortHooks.empty()) runCallbacks(myd->abortHooks);
+        myd->abortHooks.clear();
     }
 
     // Transaction with a non-void return
+    // A nested transaction joins the ongoing one before getTID(), which a worker of forkJoin() must not call.
     template<typename R, typename F> R transaction(F&& func, int txType=TX_IS_UPDATE) {
+        if (tl_opdata != nullptr) {
+            if (tl_opdata->stm != this) crossDomainError();
+            return func();
+        }
         const int tid = ThreadRegistry::getTID();
         OpData* myd = &opDesc[tid];
-        if (tl_opdata != nullptr) return func();
         tl_opdata = myd;
         setjmp(myd->env);
         beginTx(myd);
@@ -379,12 +806,13 @@ public:
 
     // Same as above, but returns void
     template<typename F> void transaction(F&& func, int txType=TX_IS_UPDATE) {
-        const int tid = ThreadRegistry::getTID();
-        OpData* myd = &opDesc[tid];
         if (tl_opdata != nullptr) {
+            if (tl_opdata->stm != this) crossDomainError();
             func();
             return ;
         }
+        const int tid = ThreadRegistry::getTID();
+        OpData* myd = &opDesc[tid];
         tl_opdata = myd;
         setjmp(myd->env);
         beginTx(myd);
@@ -392,11 +820,54 @@ public:
         endTx(myd, tid);
     }
 
-    // It's silly that these have to be static, but we need them for the (SPS) benchmarks due to templatization
-    template<typename R, typename F> static R updateTx(F&& func) { return gSTM.transaction<R>(func, TX_IS_UPDATE); }
-    template<typename R, typename F> static R readTx(F&& func) { return gSTM.transaction<R>(func, TX_IS_READ); }
-    template<typename F> static void updateTx(F&& func) { gSTM.transaction(func, TX_IS_UPDATE); }
-    template<typename F> static void readTx(F&& func) { gSTM.transaction(func, TX_IS_READ); }
+    // Executes a single attempt of a transaction, without waiting for the conflicting transaction of
+    // the previous attempt. This is used by the coroutine transactions in 2PLSFCoro.hpp, which wait
+    // (suspended) until isConflictOver() before calling this again.
+    // Returns true if the transaction committed.
+    template<typename F> bool transactionAttempt(OpData* myd, F&& func) {
+        myd->attempt = 0;
+        tl_opdata = myd;
+        if (setjmp(myd->env) != 0) {
+            tl_opdata = nullptr;
+            return false;
+        }
+        beginTx(myd);
+        func();
+        endTx(myd, myd->tid);
+        return true;
+    }
+
+    // Returns true if the conflict that aborted the last attempt is gone. When we had to "Die" it
+    // means the older transaction has finished, otherwise (noWait mode) it means the lock is available.
+    inline bool isConflictOver(uint16_t tid, uint16_t otid, uint64_t oTS, uint32_t widx, bool isWrite) {
+        if (widx == NO_WIDX) return txnTS[otid*CLPAD].load() != oTS;
+        if (wlocks[widx].load(std::memory_order_acquire) != UNLOCKED) return false;
+        return !isWrite || scanReadIndicators(widx, tid);
+    }
+
+    // Clears the timestamp of an aborted transaction that is going to wait without holding the thread,
+    // so that other transactions can be executed in the same thread.
+    inline void suspendTx(OpData* myd) {
+        txnTS[myd->tid*CLPAD].store(NO_TIMESTAMP, std::memory_order_release);
+        myd->myTS = NO_TIMESTAMP;
+        myd->oTS = NO_TIMESTAMP;
+        myd->otid = REGISTRY_MAX_THREADS;
+        myd->noWait = false;
+    }
+
+    // It's silly that these have to be static, but we need them for the (SPS) benchmarks due to templatization.
+    // They join the ongoing transaction of the calling thread, whatever its domain, which means that the data
+    // structures can be used inside updateTx(domain, func). Otherwise they start a transaction on gSTM.
+    template<typename R, typename F> static R updateTx(F&& func) { return current().transaction<R>(func, TX_IS_UPDATE); }
+    template<typename R, typename F> static R readTx(F&& func) { return current().transaction<R>(func, TX_IS_READ); }
+    template<typename F> static void updateTx(F&& func) { current().transaction(func, TX_IS_UPDATE); }
+    template<typename F> static void readTx(F&& func) { current().transaction(func, TX_IS_READ); }
+
+    // Domain of the ongoing transaction of the calling thread, or gSTM if there is none
+    static inline STM& current() {
+        OpData* const myd = tl_opdata;
+        return (myd != nullptr) ? *myd->stm : gSTM;
+    }
 
     // When inside a transaction, the user can't call "new" directly because if
     // the transaction fails, it would leak the memory of these allocations.
@@ -404,13 +875,14 @@ public:
     // in a log, and in the event of a failed commit of the transaction, it will
     // delete the objects so that there are no leaks.
     template <typename T, typename... Args> static T* tmNew(Args&&... args) {
-        T* ptr = (T*)std::malloc(sizeof(T));
+        T* ptr = allocObject<T>();
         OpData* myd = tl_opdata;
         if (myd != nullptr) {
             assert(myd->numAllocs != TX_MAX_ALLOCS);
             Deletable& del = myd->alog[myd->numAllocs++];
             del.obj = ptr;
             del.reclaim = [](void* obj) { std::free(obj); };
+            addCaptured(myd, del, sizeof(T));
             new (ptr) T(std::forward<Args>(args)...);  // new placement
             del.reclaim = [](void* obj) { static_cast<T*>(obj)->~T(); std::free(obj); };
         } else {
@@ -419,6 +891,93 @@ public:
         return ptr;
     }
 
+    // With OBJECT_LOCKS, tmbase objects are aligned to a lock block and take whole blocks, so
+    // that they don't share locks with other objects. Types declared with alignas() get their alignment.
+    // Either way, the memory is freed with std::free().
+    template <typename T> static T* allocObject() {
+        if (OBJECT_LOCKS && std::is_base_of<twoplsf::tmbase, T>::value) {
+            const size_t block = (alignof(T) > (1ULL << LOCK_SHIFT)) ? alignof(T) : (1ULL << LOCK_SHIFT);
+            return (T*)aligned_alloc(block, (sizeof(T)+block-1) & ~(block-1));
+        }
+        if (alignof(T) > alignof(std::max_align_t)) {
+            return (T*)aligned_alloc(alignof(T), (sizeof(T)+alignof(T)-1) & ~(alignof(T)-1));
+        }
+        return (T*)std::malloc(sizeof(T));
+    }
+
+    // Registers a callback to be executed after the current transaction commits, once all its locks have been
+    // released. If async is set, the callback is executed later by the AsyncExecutor thread instead.
+    // Outside of a transaction, the callback is executed (or handed to the AsyncExecutor) immediately.
+    static void onCommit(std::function<void()> fn, bool async=false) {
+        OpData* myopd = tl_opdata;
+        std::vector<Callback> hooks;
+        if (myopd == nullptr) {
+            hooks.push_back({std::move(fn), async});
+            runCallbacks(hooks);
+            return;
+        }
+        myopd->commitHooks.push_back({std::move(fn), async});
+    }
+
+    // Registers a callback to be executed if the current attempt of the transaction aborts, after the
+    // rollback and the release of the locks. The transaction will be retried right after, therefore,
+    // a synchronous abort callback must not execute transactions. Asynchronous callbacks can.
+    // Outside of a transaction there is nothing to abort and the callback is discarded.
+    static void onAbort(std::function<void()> fn, bool async=false) {
+        OpData* myopd = tl_opdata;
+        if (myopd == nullptr) return;
+        myopd->abortHooks.push_back({std::move(fn), async});
+    }
+
+    // Aborts the current transaction and blocks the thread until another transaction commits a modification
+    // to one of the stripes that this one has read (or written), and then restarts it. Use it to wait for a
+    // condition, like an item in an empty queue, without polling. If the transaction hasn't read anything
+    // there is nothing to wait for, and it is restarted immediately.
+    // Outside of a transaction it does nothing.
+    static void retry() {
+        OpData* myopd = tl_opdata;
+        if (myopd == nullptr) return;
+        if (myopd->parent != nullptr) {
+            fprintf(stderr, "2PLSF: retry() can not be called in the workers of a fork\n");
+            std::abort();
+        }
+        myopd->stm->retryTx(myopd);
+    }
+
+    [[noreturn]] void __attribute__ ((noinline)) retryTx(OpData* myd) {
+        uint64_t filter = 0;
+        for (uint32_t i=0; i < myd->readSet.size; i++) filter |= retryBit(myd->readSet.entries[i].widx);
+        for (uint64_t i=0; i < myd->writeSet.size; i++) filter |= retryBit(addr2writeIdx(myd->writeSet.entries[i].addr));
+        {
+            std::lock_guard<std::mutex> lock(myd->retryMutex);
+            myd->retryWake = false;
+        }
+        // Publish the stripes before releasing the locks. A transaction that modifies one of them has
+        // to take the write-lock after we release it, and will see our filter when it commits.
+        numRetryWaiters.fetch_add(1);
+        myd->retryFilter.store(filter);
+        // The optimistic protocol has no read-locks. If one of the stripes was modified after we read it,
+        // the transaction that did it may have missed our filter, and we shouldn't wait.
+        if (myd->optimistic && !optValidate(myd)) filter = 0;
+        abortTx(myd);
+        // Don't hold back other transactions while we're blocked
+        txnTS[myd->tid*CLPAD].store(NO_TIMESTAMP, std::memory_order_release);
+        myd->myTS = NO_TIMESTAMP;
+        myd->attempt = 0;
+        if (filter != 0) {
+            std::unique_lock<std::mutex> lock(myd->retryMutex);
+            myd->retryCV.wait(lock, [myd] { return myd->retryWake; });
+        }
+        myd->retryFilter.store(0, std::memory_order_release);
+        numRetryWaiters.fetch_sub(1);
+        // The coroutine transactions restart right away (see isConflictOver())
+        myd->waitWidx = NO_WIDX;
+        myd->otid = myd->tid;
+        myd->oTS = 0;
+        if (myd->restartFn != nullptr) myd->restartFn(myd);
+        std::longjmp(myd->env, 1);
+    }
+
     // The user can not directly delete objects in the transaction because the
     // transaction may fail and needs to be retried and other threads may be
     // using those objects.
@@ -445,6 +1004,7 @@ public:
             Deletable& del = myopd->alog[myopd->numAllocs++];
             del.obj = ptr;
             del.reclaim = [](void* obj) { std::free(obj); };
+            addCaptured(myopd, del, size);
         }
         return ptr;
     }
@@ -460,6 +1020,20 @@ public:
         assert(myopd->numFrees != TX_MAX_RETIRES);
         myopd->flog[myopd->numFrees++] = (tmbase*)obj;
     }
+
+    // Loads n consecutive tmtypes into dst, like the keys of a node of a tree. The stripes that cover them are
+    // read-locked once for the whole block, instead of once for each word, and the values are copied in one go.
+    template<typename T> static void ploadBlock(const tmtype<T>* src, T* dst, size_t n) {
+        OpData* const myd = tl_opdata;
+        if (myd != nullptr && !myd->stm->isCaptured(myd, src)) {
+            if (myd->optimistic) {
+                for (size_t i = 0; i < n; i++) dst[i] = myd->stm->optLoad(myd, &src[i].val);
+                return;
+            }
+            if (!myd->stm->tryWaitReadLockRange(myd, src, n*sizeof(tmtype<T>))) twoplsf::abortTx(myd);
+        }
+        for (size_t i = 0; i < n; i++) dst[i] = src[i].val;
+    }
 /*
     static void* tmMemcpy(void* dst, const void* src, std::size_t count) {
         OpData* const myd = tl_opdata;
@@ -495,6 +1069,22 @@ public:
     }
 */
 
+    // Memory allocated in the current transaction is 'captured': nobody else can see it until we commit.
+    // Accesses to it don't need locks nor undo log entries because the allocation is reverted on abort.
+    // Only the most recent allocation is checked, which covers the constructor and the initialization of a new
+    // node, and keeps the check on every load and store to a single range comparison.
+    static inline void addCaptured(OpData* myd, Deletable& del, uint64_t size) {
+        del.size = size;
+        myd->capLo = (uintptr_t)del.obj;
+        myd->capHi = (uintptr_t)del.obj + size;
+    }
+
+    // Returns true if addr is in the most recent allocation of the current transaction
+    inline bool isCaptured(OpData* myd, const void* addr) {
+        const uintptr_t uaddr = (uintptr_t)addr;
+        return uaddr >= myd->capLo && uaddr < myd->capHi;
+    }
+
     inline bool tryWaitReadLock(OpData* myd, const void* addr) {
         uint32_t widx = addr2writeIdx(addr);
         // Get the word of the ri based on the widx and the tid
@@ -502,11 +1092,25 @@ public:
         // Don't set the bit if it's already set
         uint64_t ri = readIndicators[ridx].load(std::memory_order_relaxed);
         uint64_t newri = (ri | ribit(widx));
-        // If we already arrived, it means we have the read-lock
-        if (newri == ri) return true;
-        myd->readSet.addEntry(addr);
-        // Arrive on the read-indicator. Exchange is faster than fetch_add() on x86
-        readIndicators[ridx].exchange(newri);
+        if (newri == ri) {
+            // If we already arrived, it means we have the read-lock. Not for a worker of a fork: the workers share
+            // the read-indicators of the transaction and a sibling may have arrived and still be waiting for a writer.
+            if (myd->parent == nullptr) return true;
+        } else {
+            myd->readSet.addEntry(widx);
+            if (myd->parent != nullptr) {
+                // The workers of a fork share the read-indicators of the transaction
+                readIndicators[ridx].fetch_or(ribit(widx));
+            } else if (asymmetricFence) {
+                // Arrive on the read-indicator without a fence. The writer that could miss our
+                // arrival calls heavyFence() before checking the read-indicator (see isEmpty()).
+                readIndicators[ridx].store(newri, std::memory_order_relaxed);
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            } else {
+                // Arrive on the read-indicator. Exchange is faster than fetch_add() on x86
+                readIndicators[ridx].exchange(newri);
+            }
+        }
         // Check the writer's cohort lock state
         uint16_t wstate = wlocks[widx].load(std::memory_order_acquire);
         if (wstate == UNLOCKED || wstate == myd->tid) return true;
@@ -519,19 +1123,85 @@ public:
     inline bool tryWaitWriteLock(OpData* myd, const void* addr) {
         uint32_t widx = addr2writeIdx(addr);
         uint64_t wstate = wlocks[widx].load(std::memory_order_acquire);
-        // Check if it's already write-locked by me, or if can take the lock
-        if ((wstate == myd->tid) ||
+        // Check if it's already write-locked by me, or if can take the lock. A worker of a fork must
+        // check the readers too, because the sibling that took the lock may still be waiting for them,
+        // unless the worker has already checked them for this lock.
+        if ((wstate == myd->tid && (myd->parent == nullptr || myd->forkLocks[widx%FORK_LOCK_CACHE] == widx || isEmpty(widx, myd->tid))) ||
             (wstate == UNLOCKED && wlocks[widx].compare_exchange_strong(wstate, myd->tid) && isEmpty(widx, myd->tid))) {
+            if (myd->parent != nullptr) myd->forkLocks[widx%FORK_LOCK_CACHE] = widx;
             myd->writeSet.addEntry(addr);
             return true;
         }
-        if (tryWaitWriteLockSlowPath(myd, widx)) {
+        if (tryWaitWriteLockSlowPath(myd, widx, addr)) {
+            if (myd->parent != nullptr) myd->forkLocks[widx%FORK_LOCK_CACHE] = widx;
             myd->writeSet.addEntry(addr);
             return true;
         }
         return false;
     }
 
+    // Read-locks all the stripes in [addr, addr+len)
+    inline bool tryWaitReadLockRange(OpData* myd, const void* addr, size_t len) {
+        const uintptr_t end = (uintptr_t)addr + len;
+        const uintptr_t block = 1ULL << LOCK_SHIFT;
+        for (uintptr_t a = (uintptr_t)addr & ~(block-1); a < end; a += block) {
+            if (!tryWaitReadLock(myd, (void*)a)) return false;
+        }
+        return true;
+    }
+
+    // Write-locks [addr, addr+len). The undo log is made of aligned 64 bit words, which never cross a stripe,
+    // so that the rollback doesn't overwrite bytes of a neighbouring stripe locked by another transaction.
+    inline bool tryWaitWriteLockRange(OpData* myd, const void* addr, size_t len) {
+        const uintptr_t end = (uintptr_t)addr + len;
+        for (uintptr_t a = (uintptr_t)addr & ~(uintptr_t)7; a < end; a += 8) {
+            if (!tryWaitWriteLock(myd, (void*)a)) return false;
+        }
+        return true;
+    }
+
+    // Commutative increment of a tmcounter. The counter is read-locked, which is compatible with
+    // other incrementers, and the delta is buffered until commit. If we already have the write-lock
+    // then there is nobody else incrementing and we can modify it in-place with an undo log entry.
+    inline bool tryWaitCounterAdd(OpData* myd, const void* addr, uint64_t delta) {
+        uint32_t widx = addr2writeIdx(addr);
+        if (wlocks[widx].load(std::memory_order_relaxed) == myd->tid) {
+            myd->writeSet.addEntry(addr);
+            *(uint64_t*)addr += delta;
+            return true;
+        }
+        if (!tryWaitReadLock(myd, addr)) return false;
+        myd->counterSet.add((uint64_t*)addr, delta);
+        return true;
+    }
+
+    // Exact access to a tmcounter (load or store). The counter is write-locked, which waits for all
+    // incrementers to commit, and any delta we buffered before is moved to the value in-place.
+    inline bool tryWaitCounterExclusive(OpData* myd, const void* addr) {
+        if (!tryWaitWriteLock(myd, addr)) return false;
+        *(uint64_t*)addr += myd->counterSet.take((uint64_t*)addr);
+        return true;
+    }
+
+    // Load in the optimistic mode of a hybrid domain. Types smaller than 64 bits are read from the aligned word that contains them.
+    template<typename T> inline T optLoad(OpData* myd, const T* addr) {
+        const uintptr_t uaddr = (uintptr_t)addr;
+        const uint64_t word = optReadWord(myd, (void*)(uaddr & ~(uintptr_t)7));
+        T v;
+        std::memcpy(&v, (const char*)&word + (uaddr & 7), sizeof(T));
+        return v;
+    }
+
+    // Store in the optimistic mode of a hybrid domain. The store is buffered in the redo log until the commit.
+    template<typename T> inline void optStore(OpData* myd, T* addr, T v) {
+        const uintptr_t uaddr = (uintptr_t)addr;
+        void* waddr = (void*)(uaddr & ~(uintptr_t)7);
+        uint64_t word = 0;
+        if (sizeof(T) != sizeof(uint64_t)) word = optReadWord(myd, waddr);
+        std::memcpy((char*)&word + (uaddr & 7), &v, sizeof(T));
+        myd->writeSet.addRedo(waddr, word);
+    }
+
     // Unlocks both write locks with store release
     inline void unlockWrite(const void *addr, uint16_t tid) {
         uint64_t widx = addr2writeIdx(addr);
@@ -555,13 +1225,225 @@ public:
         for (uint32_t i=0; i < myd->readSet.size; i++) {
             unlockRead(myd->readSet.entries[i].widx, tid);
         }
+        if (myd->asymReading.load(std::memory_order_relaxed)) myd->asymReading.store(false, std::memory_order_release);
     }
 
 private:
 
+    // A transaction nested in a transaction of another domain would not be atomic, because the
+    // locks of each domain are independent. It's a bug in the application.
+    static void __attribute__ ((noinline)) crossDomainError() {
+        fprintf(stderr, "2PLSF: a transaction can not span multiple domains\n");
+        std::abort();
+    }
+
+    // Hybrid domains.
+    // Transactions announce the protocol they run with in hyState. Switching the protocol blocks the new
+    // transactions and waits for all the announced ones to finish, which means that the two protocols never
+    // run at the same time and don't have to know about each other's locks.
+    inline void hyBegin(OpData* myd) {
+        if (myd->hyOverflow) {
+            myd->hyOverflow = false;
+            hySwitch(HY_PESSIMISTIC);
+        }
+        while (true) {
+            const uint64_t mode = hyMode.load();
+            if (mode & HY_SWITCHING) {
+                Pause();
+                continue;
+            }
+            myd->hySeq++;
+            myd->hyState.exchange((myd->hySeq << 2) | (mode+1));
+            if (hyMode.load() != mode) {
+                myd->hyState.store(0, std::memory_order_release);
+                continue;
+            }
+            myd->optimistic = (mode == HY_OPTIMISTIC);
+            if (myd->optimistic) myd->rv = optClock.load(std::memory_order_acquire);
+            return;
+        }
+    }
+
+    inline void hyCommit(OpData* myd) {
+        myd->hyState.store(0, std::memory_order_release);
+        // Objects retired by the optimistic protocol may still be read by the transactions that started before us
+        if (myd->optimistic && myd->numFrees != 0) optWaitForReaders(myd);
+        if (myd->hyWindowMode != myd->optimistic) {
+            // The statistics of the other protocol are not comparable
+            myd->hyWindowMode = myd->optimistic;
+            myd->hyCommits = myd->hyAborts = myd->hyWaits = myd->hyReads = myd->hyWrites = 0;
+        }
+        myd->hyReads += myd->readSet.size;
+        myd->hyWrites += myd->writeSet.size;
+        if (++myd->hyCommits == HY_WINDOW) hyEvaluate(myd);
+    }
+
+    // Picks the protocol from the statistics of the last HY_WINDOW commits of this thread.
+    // The optimistic protocol has no read-locks, which makes it faster when stores and conflicts are rare.
+    void __attribute__ ((noinline)) hyEvaluate(OpData* myd) {
+        const uint64_t accesses = myd->hyReads + myd->hyWrites;
+        uint64_t next = hyMode.load();
+        if (next == HY_PESSIMISTIC) {
+            if (myd->hyWrites*100 < accesses*HY_OPT_MAX_WRITES && (myd->hyWaits+myd->hyAborts)*100 < myd->hyCommits*HY_OPT_MAX_CONFLICTS) next = HY_OPTIMISTIC;
+        } else if (next == HY_OPTIMISTIC) {
+            if (myd->hyWrites*100 > accesses*HY_PES_MIN_WRITES || myd->hyAborts*100 > myd->hyCommits*HY_PES_MIN_ABORTS) next = HY_PESSIMISTIC;
+        }
+        myd->hyCommits = myd->hyAborts = myd->hyWaits = myd->hyReads = myd->hyWrites = 0;
+        if (next != hyMode.load()) hySwitch(next);
+    }
+
+    // Switches the protocol once all the ongoing transactions are done. Must be called outside of a transaction.
+    void hySwitch(uint64_t next) {
+        uint64_t mode = next ^ HY_OPTIMISTIC;
+        if (!hyMode.compare_exchange_strong(mode, mode | HY_SWITCHING)) return;
+        const uint32_t maxThreads = gThreadRegistry.getMaxThreads();
+        for (uint32_t itid = 0; itid < maxThreads; itid++) {
+            while (opDesc[itid].hyState.load() != 0) Pause();
+        }
+        numSwitches.fetch_add(1, std::memory_order_relaxed);
+        hyMode.store(next);
+    }
+
+    // Optimistic protocol (TL2 with timestamp extension).
+    // Reads check that the orec of the word is unlocked and not newer than the snapshot. Stores go to the redo
+    // log. The commit locks the orecs of the redo log, validates the read-set and writes back the redo log.
+    uint64_t optReadWord(OpData* myd, const void* addr) {
+        uint64_t val;
+        if (myd->writeSet.lookupRedo(addr, val)) return val;
+        const uint32_t widx = addr2writeIdx(addr);
+        uint64_t spins = 0;
+        while (true) {
+            const uint64_t o1 = orecs[widx].load(std::memory_order_acquire);
+            val = __atomic_load_n((uint64_t*)addr, __ATOMIC_RELAXED);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t o2 = orecs[widx].load(std::memory_order_relaxed);
+            if (o1 == o2 && (o1 & 1) == 0) {
+                if ((o1 >> 1) <= myd->rv) break;
+                // Modified after our snapshot. Move the snapshot forward if nothing we've read has changed.
+                if (!optExtend(myd)) twoplsf::abortTx(myd);
+                continue;
+            }
+            // Locked by a committing transaction, which will release it shortly
+            if (++spins == OPT_MAX_SPINS) twoplsf::abortTx(myd);
+            Pause();
+        }
+        // Consecutive reads of the same object need a single entry
+        const uint32_t rsize = myd->readSet.size;
+        if (rsize == 0 || myd->readSet.entries[rsize-1].widx != widx) {
+            if (rsize == ReadSet::MAX_READ_SET_ENTRIES) {
+                // This transaction is too large for the optimistic protocol
+                myd->hyOverflow = true;
+                twoplsf::abortTx(myd);
+            }
+            myd->readSet.addEntry(widx);
+        }
+        return val;
+    }
+
+    bool optExtend(OpData* myd) {
+        const uint64_t now = optClock.load();
+        if (!optValidate(myd)) return false;
+        myd->rv = now;
+        return true;
+    }
+
+    // Returns true if none of the orecs in the read-set changed since the snapshot
+    bool optValidate(OpData* myd) {
+        const uint64_t mine = (myd->tid << 1) | 1;
+        for (uint32_t i = 0; i < myd->readSet.size; i++) {
+            const uint32_t widx = myd->readSet.entries[i].widx;
+            uint64_t o = orecs[widx].load(std::memory_order_acquire);
+            if (o == mine) {
+                // Locked by our commit, check the version it had before
+                for (size_t j = 0; j < myd->orecLocks.size(); j++) {
+                    if (myd->orecLocks[j].first == widx) o = myd->orecLocks[j].second;
+                }
+            }
+            if ((o & 1) || (o >> 1) > myd->rv) return false;
+        }
+        return true;
+    }
+
+    void optCommit(OpData* myd) {
+        // Read-only transactions are consistent with their snapshot
+        if (myd->writeSet.size == 0) return;
+        const uint64_t mine = (myd->tid << 1) | 1;
+        for (int32_t i = 0; i < myd->writeSet.size; i++) {
+            const uint32_t widx = addr2writeIdx(myd->writeSet.entries[i].addr);
+            uint64_t o = orecs[widx].load(std::memory_order_acquire);
+            if (o == mine) continue;
+            if ((o & 1) || !orecs[widx].compare_exchange_strong(o, mine)) twoplsf::abortTx(myd);
+            myd->orecLocks.push_back({widx, o});
+        }
+        const uint64_t wv = optClock.fetch_add(1)+1;
+        if (wv != myd->rv+1 && !optValidate(myd)) twoplsf::abortTx(myd);
+        for (int32_t i = 0; i < myd->writeSet.size; i++) {
+            __atomic_store_n((uint64_t*)myd->writeSet.entries[i].addr, myd->writeSet.entries[i].data, __ATOMIC_RELAXED);
+        }
+        if (commitLog != nullptr) commitLog->append(myd);
+        for (size_t j = 0; j < myd->orecLocks.size(); j++) orecs[myd->orecLocks[j].first].store(wv << 1, std::memory_order_release);
+        myd->orecLocks.clear();
+    }
+
+    void optAbort(OpData* myd) {
+        for (size_t j = 0; j < myd->orecLocks.size(); j++) orecs[myd->orecLocks[j].first].store(myd->orecLocks[j].second, std::memory_order_release);
+        myd->orecLocks.clear();
+        // There is no conflicting transaction to wait for
+        myd->attempt = 0;
+    }
+
+    // Waits until the optimistic transactions that are ongoing have finished
+    void __attribute__ ((noinline)) optWaitForReaders(OpData* myd) {
+        const uint32_t maxThreads = gThreadRegistry.getMaxThreads();
+        for (uint32_t itid = 0; itid < maxThreads; itid++) {
+            const uint64_t state = opDesc[itid].hyState.load();
+            if ((state & 3) != HY_OPTIMISTIC+1) continue;
+            while (opDesc[itid].hyState.load() == state) Pause();
+        }
+    }
+
+    // Wakes up the threads blocked in retry() that may be waiting on one of the stripes modified by
+    // this transaction. Stripes share bits of the filter, so some of the wake-ups may be unnecessary.
+    void __attribute__ ((noinline)) wakeRetryWaiters(OpData* myd) {
+        uint64_t filter = 0;
+        for (uint64_t i=0; i < myd->writeSet.size; i++) filter |= retryBit(addr2writeIdx(myd->writeSet.entries[i].addr));
+        for (int32_t i=0; i < myd->counterSet.size; i++) filter |= retryBit(addr2writeIdx(myd->counterSet.entries[i].addr));
+        if (filter == 0) return;
+        const uint32_t maxThreads = gThreadRegistry.getMaxThreads();
+        for (uint32_t itid = 0; itid < maxThreads; itid++) {
+            OpData* od = &opDesc[itid];
+            if ((od->retryFilter.load() & filter) == 0) continue;
+            std::lock_guard<std::mutex> lock(od->retryMutex);
+            od->retryWake = true;
+            od->retryCV.notify_one();
+        }
+    }
+
     // Return true if the read-indicator is empty. Skip my own tid.
-    // This is optimized to not have any branches inside the loop.
+    // Must be called after taking the write-lock.
     inline bool isEmpty(uint32_t widx, uint32_t tid) {
+        if (!scanReadIndicators(widx, tid)) return false;
+        if (!asymmetricFence || !hasAsymmetricReaders(tid)) return true;
+        // A reader may have arrived with a store that isn't visible yet, and have seen the lock as
+        // unlocked. After the heavyFence() its arrival is visible, or it will see our write-lock.
+        heavyFence();
+        return scanReadIndicators(widx, tid);
+    }
+
+    // Returns true if a transaction of another thread may have arrived on a read-indicator without a fence.
+    // A reader announces it with an exchange() before its first arrival, which means that if we don't see
+    // the announcement after taking the write-lock, the reader will see our write-lock.
+    inline bool hasAsymmetricReaders(uint32_t tid) {
+        const uint32_t maxThreads = gThreadRegistry.getMaxThreads();
+        for (uint32_t itid = 0; itid < maxThreads; itid++) {
+            if (itid != tid && opDesc[itid].asymReading.load()) return true;
+        }
+        return false;
+    }
+
+    // Return true if the visible read-indicator is empty. Skip my own tid.
+    // This is optimized to not have any branches inside the loop.
+    inline bool scanReadIndicators(uint32_t widx, uint32_t tid) {
         const uint32_t maxThreads = gThreadRegistry.getMaxThreads();
         uint64_t rmask = ribit(widx);
         uint64_t andmask = 1ULL << (widx%64);
@@ -575,22 +1457,33 @@ private:
 
     // This is the slow path of the tryReadLock. It's the place where we decide if it's "Wait-Or-Die"
     bool __attribute__ ((noinline)) tryWaitReadLockSlowPath(OpData* myd, uint32_t widx, uint32_t ridx, uint64_t ri) {
+        myd->hyWaits++;
         // If we got here, we have a conflict, which means we need to take a timestamp from the conflict clock and publish it
         if (myd->myTS == NO_TIMESTAMP) myd->myTS = conflictClock.fetch_add(1);
         // We remove the announcement when we're not waiting, therefore, re-announce if needed
         if (txnTS[myd->tid*CLPAD].load(std::memory_order_relaxed) == NO_TIMESTAMP) txnTS[myd->tid*CLPAD].exchange(myd->myTS);
         while (true) {
-            // Check the writer's cohort lock state
-            if (wlocks[widx].load(std::memory_order_acquire) == UNLOCKED) {
-                txnTS[myd->tid*CLPAD].store(NO_TIMESTAMP, std::memory_order_release);
+            // Check the writer's cohort lock state. A worker of a fork can read once a sibling has the write-lock.
+            const uint16_t wstate = wlocks[widx].load(std::memory_order_acquire);
+            if (wstate == UNLOCKED || wstate == myd->tid) {
+                // The timestamp of a fork stays announced until the join
+                if (myd->parent == nullptr) txnTS[myd->tid*CLPAD].store(NO_TIMESTAMP, std::memory_order_release);
                 return true;
             }
             // Find the timestamp of the writer
             myd->oTS = getTSOfWLock(widx, myd->tid, myd->otid);
             if (myd->oTS < myd->myTS) {
                 // The announced writer has a lower timestamp, therefore, our thread must "Die".
-                // Depart from the read-indicator.
+                // Depart from the read-indicator. A worker of a fork may be sharing the read-lock with
+                // its siblings, and leaves it to the abort of the transaction (it's in the read-set).
+                if (myd->parent == nullptr) readIndicators[ridx].store(ri & (~ribit(widx)), std::memory_order_release);
+                return false;
+            }
+            if (myd->noWait) {
+                // Abort instead of waiting. The caller will wait for the lock without holding the thread.
                 readIndicators[ridx].store(ri & (~ribit(widx)), std::memory_order_release);
+                myd->waitWidx = widx;
+                myd->waitWrite = false;
                 return false;
             }
             // We're in "Wait" mode for now
@@ -599,7 +1492,8 @@ private:
     }
 
     // This is the slow path of the tryWriteLock. It's the place where we decide if it's "Wait-Or-Die"
-    bool __attribute__ ((noinline)) tryWaitWriteLockSlowPath(OpData* myd, uint32_t widx) {
+    bool __attribute__ ((noinline)) tryWaitWriteLockSlowPath(OpData* myd, uint32_t widx, const void* addr) {
+        myd->hyWaits++;
         // If we got here, we have a conflict, which means we need to take a timestamp from the conflict clock and publish it
         if (myd->myTS == NO_TIMESTAMP) myd->myTS = conflictClock.fetch_add(1);
         // We remove the announcement when we're not waiting, therefore, re-announce if needed
@@ -608,7 +1502,12 @@ private:
         // Arrive on the read-indicator, if we're not there already (if we're read-locked).
         uint32_t ridx = writeIdx2readIdx(widx, myd->tid);
         uint64_t ri = readIndicators[ridx].load(std::memory_order_relaxed);
-        readIndicators[ridx].exchange(ri | ribit(widx));
+        if (myd->parent != nullptr) {
+            // The workers of a fork share the read-indicators of the transaction
+            if ((readIndicators[ridx].fetch_or(ribit(widx)) & ribit(widx)) == 0) myd->readSet.addEntry(widx);
+        } else {
+            readIndicators[ridx].exchange(ri | ribit(widx));
+        }
         // Loop until we get the write-lock or "die"
         while (true) {
             // Check the writer's cohort lock state and if unlocked, try to acquire the cohort
@@ -616,6 +1515,10 @@ private:
             if (wstate == UNLOCKED) wlocks[widx].compare_exchange_strong(wstate, myd->tid);
             wstate = wlocks[widx].load(std::memory_order_acquire);
             if (wstate == myd->tid && isEmpty(widx, myd->tid)) {
+                // A worker of a fork doesn't depart from the read-indicator, because its siblings may be sharing the
+                // read-lock. The bit is in the read-set of the one that set it and is cleared at the commit or abort of
+                // the transaction, when all the workers are done. Until then, our write-lock makes it harmless.
+                if (myd->parent != nullptr) return true;
                 // Even if we had the read-lock before, it's ok to unlock it now because we have the write-lock
                 readIndicators[ridx].store(ri & (~ribit(widx)), std::memory_order_release);
                 txnTS[myd->tid*CLPAD].store(NO_TIMESTAMP, std::memory_order_release);
@@ -623,6 +1526,12 @@ private:
             }
             // Find the lowest timestamp of the writers and readers
             myd->oTS = getLowestTS(widx, myd->tid, myd->otid);
+            if (myd->oTS < myd->myTS && myd->parent != nullptr) {
+                // A worker of a fork leaves the locks to the abort of the transaction, because its siblings
+                // may be sharing them. The write-set entry makes sure the write-lock is released.
+                if (wlocks[widx].load() == myd->tid) myd->writeSet.addEntry(addr);
+                return false;
+            }
             if (myd->oTS < myd->myTS) {
                 // At least one of the announced writers/writers has a lower timestamp, therefore, our thread must "Die".
                 // Depart from the read-indicator.
@@ -631,6 +1540,14 @@ private:
                 if (wlocks[widx].load() == myd->tid) wlocks[widx].store(UNLOCKED, std::memory_order_release);
                 return false;
             }
+            if (myd->noWait) {
+                // Abort instead of waiting. The caller will wait for the lock without holding the thread.
+                readIndicators[ridx].store(ri & (~ribit(widx)), std::memory_order_release);
+                if (wlocks[widx].load() == myd->tid) wlocks[widx].store(UNLOCKED, std::memory_order_release);
+                myd->waitWidx = widx;
+                myd->waitWrite = true;
+                return false;
+            }
             // We're in "Wait" mode for now
             Pause();
         }
@@ -733,7 +1650,7 @@ template<typename T> struct tmtype {
     // Operator arrow ->
     T operator->() { return pload(); }
     // Copy constructor
-    tmtype<T>(const tmtype<T>& other) { pstore(other.pload()); }
+    tmtype(const tmtype<T>& other) { pstore(other.pload()); }
     // Operator &
     T* operator&() { return (T*)this; }
 
@@ -751,35 +1668,139 @@ template<typename T> struct tmtype {
 
     inline void pstore(T newVal) {
         OpData* const myd = tl_opdata;
-        if (myd == nullptr || gSTM.tryWaitWriteLock(myd, &val)) {
+        if (myd == nullptr || myd->stm->isCaptured(myd, &val)) {
             val = newVal;
             return;
         }
-        abortTx(myd);
+        if (myd->optimistic) {
+            myd->stm->optStore(myd, &val, newVal);
+            return;
+        }
+        if (!myd->stm->tryWaitWriteLock(myd, &val)) abortTx(myd);
+        val = newVal;
     }
 
     inline T pload() const {
         OpData* const myd = tl_opdata;
         // Check if we're outside a transaction
         if (myd == nullptr) return val;
-        if (!gSTM.tryWaitReadLock(myd, &val)) abortTx(myd);
+        if (myd->stm->isCaptured(myd, &val)) return val;
+        if (myd->optimistic) return myd->stm->optLoad(myd, &val);
+        if (!myd->stm->tryWaitReadLock(myd, &val)) abortTx(myd);
         return val;
     }
 };
 
 
 
+// A counter with escrow updates, for hot counters like the size of a data structure.
+// T can be any 64 bit integer type.
+// Increments (add(), +=, ++, ...) take the lock in shared mode and are applied at commit time, which
+// means that concurrent transactions incrementing the same counter do not conflict with each other.
+// Reading or storing the exact value takes the write-lock and therefore waits for (or aborts) all
+// the ongoing incrementers, which keeps the transactions serializable.
+// Keep tmcounter away from frequently accessed fields, because all accesses to its stripe are serialized
+// with the exact reads of the counter.
+template<typename T> struct tmcounter {
+    static_assert(sizeof(T) == sizeof(uint64_t), "tmcounter<T> requires a 64 bit integer type");
+    T val;
+
+    tmcounter() { }
+    tmcounter(T initVal) { pstore(initVal); }
+    // Casting operator
+    operator T() { return pload(); }
+    // Casting to const
+    operator T() const { return pload(); }
+    // Increments and decrements are commutative
+    void operator++ () { add(1); }
+    void operator-- () { add((T)0-1); }
+    void operator++ (int) { add(1); }
+    void operator-- (int) { add((T)0-1); }
+    tmcounter<T>& operator+= (const T& rhs) { add(rhs); return *this; }
+    tmcounter<T>& operator-= (const T& rhs) { add((T)0-rhs); return *this; }
+    // Copy constructor
+    tmcounter(const tmcounter<T>& other) { pstore(other.pload()); }
+
+    // Assignment operator from a tmcounter<T>
+    tmcounter<T>& operator=(const tmcounter<T>& other) {
+        pstore(other.pload());
+        return *this;
+    }
+
+    // Assignment operator from a value
+    tmcounter<T>& operator=(T value) {
+        pstore(value);
+        return *this;
+    }
+
+    inline void add(T delta) {
+        OpData* const myd = tl_opdata;
+        if (myd == nullptr) {
+            __atomic_fetch_add(&val, delta, __ATOMIC_SEQ_CST);
+            return;
+        }
+        if (myd->stm->isCaptured(myd, &val)) {
+            val += delta;
+            return;
+        }
+        // The optimistic protocol has no shared mode, increments are a load and a store
+        if (myd->optimistic) {
+            myd->stm->optStore(myd, &val, (T)(myd->stm->optLoad(myd, &val) + delta));
+            return;
+        }
+        if (!myd->stm->tryWaitCounterAdd(myd, &val, (uint64_t)delta)) abortTx(myd);
+    }
+
+    inline void pstore(T newVal) {
+        OpData* const myd = tl_opdata;
+        if (myd == nullptr || myd->stm->isCaptured(myd, &val)) {
+            val = newVal;
+            return;
+        }
+        if (myd->optimistic) {
+            myd->stm->optStore(myd, &val, newVal);
+            return;
+        }
+        if (!myd->stm->tryWaitCounterExclusive(myd, &val)) abortTx(myd);
+        val = newVal;
+    }
+
+    inline T pload() const {
+        OpData* const myd = tl_opdata;
+        // Check if we're outside a transaction
+        if (myd == nullptr) return __atomic_load_n(&val, __ATOMIC_ACQUIRE);
+        if (myd->stm->isCaptured(myd, &val)) return val;
+        if (myd->optimistic) return myd->stm->optLoad(myd, &val);
+        if (!myd->stm->tryWaitCounterExclusive(myd, &val)) abortTx(myd);
+        return val;
+    }
+
+    // Returns the last committed value without taking any lock. This is not serializable and
+    // does not include the increments of the current transaction. Use it only for heuristics.
+    inline T estimate() const { return __atomic_load_n(&val, __ATOMIC_RELAXED); }
+};
+
+
 //
 // Wrapper methods to the global TM instance. The user should use these:
+// (nested in a transaction of another domain, they join it)
 //
-template<typename R, typename F> static R updateTx(F&& func) { return gSTM.transaction<R>(func, TX_IS_UPDATE); }
-template<typename R, typename F> static R readTx(F&& func) { return gSTM.transaction<R>(func, TX_IS_READ); }
-template<typename F> static void updateTx(F&& func) { gSTM.transaction(func, TX_IS_UPDATE); }
-template<typename F> static void readTx(F&& func) { gSTM.transaction(func, TX_IS_READ); }
+template<typename R, typename F> static R updateTx(F&& func) { return STM::updateTx<R>(func); }
+template<typename R, typename F> static R readTx(F&& func) { return STM::readTx<R>(func); }
+template<typename F> static void updateTx(F&& func) { STM::updateTx(func); }
+template<typename F> static void readTx(F&& func) { STM::readTx(func); }
+// Same as above, but on a given domain
+template<typename R, typename F> static R updateTx(STM& domain, F&& func) { return domain.transaction<R>(func, TX_IS_UPDATE); }
+template<typename R, typename F> static R readTx(STM& domain, F&& func) { return domain.transaction<R>(func, TX_IS_READ); }
+template<typename F> static void updateTx(STM& domain, F&& func) { domain.transaction(func, TX_IS_UPDATE); }
+template<typename F> static void readTx(STM& domain, F&& func) { domain.transaction(func, TX_IS_READ); }
 template<typename T, typename... Args> T* tmNew(Args&&... args) { return STM::tmNew<T>(args...); }
 template<typename T> void tmDelete(T* obj) { STM::tmDelete<T>(obj); }
 static void* tmMalloc(size_t size) { return STM::tmMalloc(size); }
 static void tmFree(void* obj) { STM::tmFree(obj); }
+static void onCommit(std::function<void()> fn, bool async=false) { STM::onCommit(std::move(fn), async); }
+static void onAbort(std::function<void()> fn, bool async=false) { STM::onAbort(std::move(fn), async); }
+static void retry() { STM::retry(); }
 
 // These are used by DBx1000
 static inline bool tryReadLock(const void* addr, size_t length) { return gSTM.tryWaitReadLock(tl_opdata, addr); }
@@ -814,7 +1835,10 @@ void thread_registry_deregister_thread(const int tid) {
 
 
 [[noreturn]] void __attribute__ ((noinline)) abortTx(OpData* myd) {
-    gSTM.abortTx(myd);
+    // The workers of a fork don't abort on their own. The transaction is aborted at the join.
+    if (myd->parent != nullptr) std::longjmp(myd->env, 1);
+    myd->stm->abortTx(myd);
+    if (myd->restartFn != nullptr) myd->restartFn(myd);
     std::longjmp(myd->env, 1);
 }
 #endif // INCLUDED_FROM_MULTIPLE_CPP
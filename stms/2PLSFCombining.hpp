@@ -0,0 +1,154 @@
+/*
+ * Copyright 2021-2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#pragma once
+
+#include "2PLSF.hpp"
+
+// Flat-combining for hot call sites in 2PLSF (experimental)
+//
+// Small update transactions that all modify the same data (the head/tail of a queue, a hot key)
+// conflict with each other and most of the time is spent acquiring, waiting for and releasing
+// the same locks. A Combiner is an opt-in for one such call site:
+//   static twoplsf::Combiner fcEnqueue {};
+//   fcEnqueue.updateTx<bool>([&] () { return queue->enqueue(item); });
+// While a thread sees no aborts on the call site, it executes its transactions as usual. Once one
+// of its transactions is aborted, the next FC_COMBINING_OPS operations are announced in the
+// Combiner instead. One of the announcing threads becomes the combiner and executes up to
+// FC_MAX_BATCH announced operations inside a single 2PLSF transaction, handing back the results
+// after the commit. The other threads spin on their own request while waiting.
+//
+// The lambdas may be executed more than once (if the combined transaction restarts) and by a
+// different thread, just like the body of any 2PLSF transaction.
+//
+// This is experimental: so far, q-ll-combining has not shown it to be faster than the plain transactions.
+//
+// The transactions of a Combiner run on gSTM, or on the domain passed to its constructor.
+//
+namespace twoplsf {
+
+// Maximum number of operations executed in a combined transaction
+static const int FC_MAX_BATCH = 64;
+// Number of operations that a thread announces after seeing an abort on the call site
+static const uint64_t FC_COMBINING_OPS = 64;
+
+
+class Combiner {
+
+private:
+    struct Request {
+        void                (*fn)(void*);     // Type-erased lambda
+        void*               ctx;              // Lambda instance, in the stack of the announcing thread
+        std::atomic<bool>   done {false};
+    };
+
+    struct Slot {
+        alignas(128) std::atomic<Request*> req {nullptr};
+        uint64_t                           score {0};   // Number of operations to announce (owner thread only)
+    };
+
+    alignas(128) std::atomic<bool>  lock {false};
+    alignas(128) Slot               slots[REGISTRY_MAX_THREADS];
+    const bool                      alwaysCombine;
+    STM&                            domain;
+
+    template<typename C> static void invoke(void* ctx) { (*(C*)ctx)(); }
+
+    // Executes the announced requests (including ours) in a single transaction. Must be called with the lock held.
+    void runBatch() {
+        Request* batch[FC_MAX_BATCH];
+        int numReqs = 0;
+        const int maxTid = ThreadRegistry::getMaxThreads();
+        for (int itid = 0; itid < maxTid && numReqs < FC_MAX_BATCH; itid++) {
+            Request* req = slots[itid].req.load(std::memory_order_acquire);
+            if (req == nullptr) continue;
+            slots[itid].req.store(nullptr, std::memory_order_relaxed);
+            batch[numReqs++] = req;
+        }
+        if (numReqs == 0) return;
+        domain.transaction([&] () {
+            for (int i = 0; i < numReqs; i++) batch[i]->fn(batch[i]->ctx);
+        }, TX_IS_UPDATE);
+        // Hand back the results, only after the commit
+        for (int i = 0; i < numReqs; i++) batch[i]->done.store(true, std::memory_order_release);
+    }
+
+    // Announces the request and waits for it to be executed, either by us or by another combiner
+    void combine(const int tid, Request* req) {
+        slots[tid].req.store(req, std::memory_order_release);
+        while (!req->done.load(std::memory_order_acquire)) {
+            if (!lock.load(std::memory_order_relaxed) && !lock.exchange(true, std::memory_order_acquire)) {
+                // We're the combiner. Our request may not fit in the batch, in which case we will go again.
+                if (!req->done.load(std::memory_order_acquire)) runBatch();
+                lock.store(false, std::memory_order_release);
+                continue;
+            }
+            Pause();
+        }
+    }
+
+    // Returns true if the operation should be announced instead of executed in its own transaction
+    inline bool shouldCombine(Slot& slot) {
+        if (alwaysCombine) return true;
+        if (slot.score == 0) return false;
+        slot.score--;
+        return true;
+    }
+
+public:
+    // If alwaysCombine is set, all operations are announced, regardless of aborts
+    Combiner(bool alwaysCombine=false, STM& domain=gSTM) : alwaysCombine{alwaysCombine}, domain{domain} { }
+    Combiner(STM& domain, bool alwaysCombine=false) : alwaysCombine{alwaysCombine}, domain{domain} { }
+
+    // Transaction with a non-void return
+    template<typename R, typename F> R updateTx(F&& func) {
+        // Nested in a transaction, there is nothing to combine
+        if (tl_opdata != nullptr) return func();
+        const int tid = ThreadRegistry::getTID();
+        Slot& slot = slots[tid];
+        if (!shouldCombine(slot)) {
+            OpData* myd = &domain.opDesc[tid];
+            const uint64_t numAborts = myd->numAborts;
+            R retval = domain.transaction<R>(func, TX_IS_UPDATE);
+            if (myd->numAborts != numAborts) slot.score = FC_COMBINING_OPS;
+            return retval;
+        }
+        R retval {};
+        auto call = [&] () { retval = func(); };
+        Request req;
+        req.fn = &invoke<decltype(call)>;
+        req.ctx = &call;
+        combine(tid, &req);
+        return retval;
+    }
+
+    // Same as above, but returns void
+    template<typename F> void updateTx(F&& func) {
+        // Nested in a transaction, there is nothing to combine
+        if (tl_opdata != nullptr) {
+            func();
+            return;
+        }
+        const int tid = ThreadRegistry::getTID();
+        Slot& slot = slots[tid];
+        if (!shouldCombine(slot)) {
+            OpData* myd = &domain.opDesc[tid];
+            const uint64_t numAborts = myd->numAborts;
+            domain.transaction(func, TX_IS_UPDATE);
+            if (myd->numAborts != numAborts) slot.score = FC_COMBINING_OPS;
+            return;
+        }
+        auto call = [&] () { func(); };
+        Request req;
+        req.fn = &invoke<decltype(call)>;
+        req.ctx = &call;
+        combine(tid, &req);
+    }
+};
+
+}
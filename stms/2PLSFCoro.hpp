@@ -0,0 +1,278 @@
+/*
+ * Copyright 2021-2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#pragma once
+
+#if !defined(__cpp_impl_coroutine)
+#error "2PLSFCoro.hpp needs C++20 coroutines. Compile with -std=c++20 (and -fcoroutines on g++-10)"
+#endif
+
+#include <coroutine>
+#include <deque>
+#include <optional>
+#include <exception>
+
+#include "2PLSF.hpp"
+
+// Coroutine transactions for 2PLSF
+//
+// A regular 2PLSF transaction that has to wait for another transaction spins on the OS thread.
+// The transactions in this file are coroutines that, instead of spinning, suspend and give the
+// thread back to a per-thread Scheduler, which resumes them once the conflict is over. This
+// allows a single thread to multiplex many logical clients.
+//
+// The body of the transaction (the lambda) is still a regular function that is executed
+// synchronously, which means a transaction attempt never suspends while holding locks:
+// - If the attempt has to "Die" because of an older transaction, it aborts and suspends until
+//   the txnTS of the older transaction changes, which is what waitForConflictingTxn() spins on;
+// - If the attempt would "Wait" for a younger transaction, it aborts instead (noWait mode) and
+//   suspends until the lock is released;
+// - The timestamp is kept across attempts so that the transaction doesn't lose its priority.
+//   After CORO_MAX_SUSPENDS attempts it goes back to waiting on the lock, just like 2PLSF, to keep
+//   the starvation-freedom guarantee.
+//
+// Usage:
+//   twoplsf::coro::Task<void> client(...) {
+//       uint64_t v = co_await twoplsf::coro::updateTx<uint64_t>([&] () { ... return x; });
+//   }
+//   twoplsf::coro::Scheduler::current().spawn(client(...));
+//   twoplsf::coro::Scheduler::current().run();
+// The transactions run on gSTM, or on the domain passed as first argument: coro::updateTx<R>(domain, func).
+//
+namespace twoplsf {
+namespace coro {
+
+// Number of times a transaction aborts in noWait mode before waiting on locks with the thread
+static const uint64_t CORO_MAX_SUSPENDS = 16;
+
+
+// A lazily started coroutine with a continuation, which can be co_awaited by another coroutine
+template<typename T> class Task;
+
+template<typename T, typename P> struct TaskPromiseBase {
+    std::coroutine_handle<> continuation {nullptr};
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        // Symmetric transfer to whoever is awaiting on us
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            std::coroutine_handle<> cont = h.promise().continuation;
+            return cont ? cont : std::noop_coroutine();
+        }
+        void await_resume() noexcept { }
+    };
+
+    Task<T> get_return_object() { return Task<T>{std::coroutine_handle<P>::from_promise(*static_cast<P*>(this))}; }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+};
+
+template<typename T> struct TaskPromise : public TaskPromiseBase<T,TaskPromise<T>> {
+    std::optional<T> value;
+    void return_value(T v) { value.emplace(std::move(v)); }
+};
+
+template<> struct TaskPromise<void> : public TaskPromiseBase<void,TaskPromise<void>> {
+    void return_void() { }
+};
+
+template<typename T> class Task {
+public:
+    using promise_type = TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> h) : handle{h} { }
+    Task(Task&& other) noexcept : handle{other.handle} { other.handle = nullptr; }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { if (handle) handle.destroy(); }
+
+    bool await_ready() noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle.promise().continuation = awaiter;
+        return handle;
+    }
+    T await_resume() {
+        if constexpr (!std::is_void<T>::value) return std::move(*handle.promise().value);
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+
+// Information about the conflict that aborted an attempt
+struct Conflict {
+    STM*     stm;
+    uint16_t tid;
+    uint16_t otid;
+    uint64_t oTS;
+    uint32_t widx;
+    bool     isWrite;
+
+    bool isOver() const { return stm->isConflictOver(tid, otid, oTS, widx, isWrite); }
+};
+
+
+/*
+ * <h1> Per-thread scheduler for coroutine transactions </h1>
+ *
+ * Round-robin over the coroutines that are ready, polling the conflicts of the suspended
+ * transactions in between. run() returns when all the spawned coroutines have completed.
+ */
+class Scheduler {
+private:
+    // Top level coroutine, destroys itself when it completes
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() { }
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        Conflict                conflict;
+    };
+
+    std::deque<std::coroutine_handle<>> ready;
+    std::vector<Waiter>                 waiting;
+    uint64_t                            numTasks {0};
+
+    static Detached root(Scheduler* sched, Task<void> task) {
+        co_await task;
+        sched->numTasks--;
+    }
+
+public:
+    static Scheduler& current() {
+        static thread_local Scheduler sched {};
+        return sched;
+    }
+
+    // Starts running the task until its first suspension and keeps track of it until it completes
+    void spawn(Task<void>&& task) {
+        numTasks++;
+        root(this, std::move(task));
+    }
+
+    void schedule(std::coroutine_handle<> h) { ready.push_back(h); }
+
+    void waitFor(std::coroutine_handle<> h, const Conflict& conflict) { waiting.push_back({h, conflict}); }
+
+    uint64_t getNumTasks() const { return numTasks; }
+
+    void run() {
+        while (numTasks != 0) {
+            // Move the transactions whose conflicts are over to the ready queue
+            for (size_t i = 0; i < waiting.size(); ) {
+                if (waiting[i].conflict.isOver()) {
+                    ready.push_back(waiting[i].handle);
+                    waiting[i] = waiting.back();
+                    waiting.pop_back();
+                } else {
+                    i++;
+                }
+            }
+            if (ready.empty()) {
+                Pause();
+                continue;
+            }
+            // Resume only the ones that are ready now, the others will be polled again first
+            for (size_t n = ready.size(); n > 0; n--) {
+                std::coroutine_handle<> h = ready.front();
+                ready.pop_front();
+                h.resume();
+            }
+        }
+    }
+};
+
+
+// Suspends until the conflict is over
+struct ConflictAwaiter {
+    Conflict conflict;
+    bool await_ready() { return conflict.isOver(); }
+    void await_suspend(std::coroutine_handle<> h) { Scheduler::current().waitFor(h, conflict); }
+    void await_resume() { }
+};
+
+// Gives the thread to the other coroutines in the scheduler
+struct YieldAwaiter {
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) { Scheduler::current().schedule(h); }
+    void await_resume() { }
+};
+
+inline YieldAwaiter yield() { return {}; }
+
+
+// Transaction with a non-void return, in the given domain
+template<typename R, typename F> Task<R> transaction(STM& domain, F func) {
+    // Nested in a regular transaction
+    if (tl_opdata != nullptr) co_return func();
+    const int tid = ThreadRegistry::getTID();
+    OpData* myd = &domain.opDesc[tid];
+    std::optional<R> retval;
+    uint64_t myTS = NO_TIMESTAMP;
+    for (uint64_t isuspend = 0; ; isuspend++) {
+        myd->myTS = myTS;
+        myd->noWait = (isuspend < CORO_MAX_SUSPENDS);
+        bool committed = domain.transactionAttempt(myd, [&] () { retval.emplace(func()); });
+        myd->noWait = false;
+        if (committed) break;
+        // Keep our timestamp for the next attempt, so that we don't lose our priority
+        myTS = myd->myTS;
+        Conflict conflict {&domain, (uint16_t)tid, myd->otid, myd->oTS, myd->waitWidx, myd->waitWrite};
+        domain.suspendTx(myd);
+        co_await ConflictAwaiter{conflict};
+    }
+    co_return std::move(*retval);
+}
+
+// Same as above, but returns void
+template<typename F> Task<void> transaction(STM& domain, F func) {
+    // Nested in a regular transaction
+    if (tl_opdata != nullptr) {
+        func();
+        co_return;
+    }
+    const int tid = ThreadRegistry::getTID();
+    OpData* myd = &domain.opDesc[tid];
+    uint64_t myTS = NO_TIMESTAMP;
+    for (uint64_t isuspend = 0; ; isuspend++) {
+        myd->myTS = myTS;
+        myd->noWait = (isuspend < CORO_MAX_SUSPENDS);
+        bool committed = domain.transactionAttempt(myd, func);
+        myd->noWait = false;
+        if (committed) break;
+        // Keep our timestamp for the next attempt, so that we don't lose our priority
+        myTS = myd->myTS;
+        Conflict conflict {&domain, (uint16_t)tid, myd->otid, myd->oTS, myd->waitWidx, myd->waitWrite};
+        domain.suspendTx(myd);
+        co_await ConflictAwaiter{conflict};
+    }
+}
+
+template<typename R, typename F> Task<R> transaction(F func) { return transaction<R>(gSTM, std::move(func)); }
+template<typename F> Task<void> transaction(F func) { return transaction(gSTM, std::move(func)); }
+
+template<typename R, typename F> Task<R> updateTx(F func) { return transaction<R>(gSTM, std::move(func)); }
+template<typename R, typename F> Task<R> readTx(F func) { return transaction<R>(gSTM, std::move(func)); }
+template<typename F> Task<void> updateTx(F func) { return transaction(gSTM, std::move(func)); }
+template<typename F> Task<void> readTx(F func) { return transaction(gSTM, std::move(func)); }
+template<typename R, typename F> Task<R> updateTx(STM& domain, F func) { return transaction<R>(domain, std::move(func)); }
+template<typename R, typename F> Task<R> readTx(STM& domain, F func) { return transaction<R>(domain, std::move(func)); }
+template<typename F> Task<void> updateTx(STM& domain, F func) { return transaction(domain, std::move(func)); }
+template<typename F> Task<void> readTx(STM& domain, F func) { return transaction(domain, std::move(func)); }
+
+}
+}
@@ -0,0 +1,684 @@
+/*
+ * Copyright 2021-2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <string>
+
+#include "2PLSF.hpp"
+
+// Durable transactions for 2PLSF
+//
+// A DurableStore keeps its data in a heap that is backed by a file in the directory of the store:
+//   twoplsf::DurableStore store {"/path/to/dir"};
+//   store.updateTx([&] () { ... store.tmNew<Node>() ... store.setRoot(0, node); });
+// The transactions of the store run on their own 2PLSF domain. When an update transaction commits,
+// while it still holds its locks, the words it modified and the objects it allocated are appended
+// to the redo log of its thread, a memory-mapped file, and updateTx() returns once the record is
+// on disk:
+// - With SyncMode::EachCommit, the committing thread calls fdatasync() on the logs itself. Threads
+//   that commit at the same time share the fdatasync();
+// - With SyncMode::GroupCommit, the committing threads ask a thread of the store to call fdatasync()
+//   for them. The transactions that commit while it is syncing go in the next batch. The thread
+//   also syncs every DURABLE_GROUP_COMMIT_US, if there is anything to sync.
+// Read-only transactions don't wait, and may see the effects of transactions that are not durable yet.
+// Use sync() to wait for them.
+//
+// The heap is mapped privately at DURABLE_HEAP_BASE, which means that the file is only modified by
+// checkpoints, that write a consistent image of the heap. A checkpoint is taken when a log is nearly
+// full, and when the store is closed. Opening a store replays the logs on top of the image, in commit
+// order, up to the first transaction that is missing (not durable). The pointers in the image are
+// valid as they are, because the heap is always mapped at the same address.
+//
+// Checkpoints are online: new transactions are blocked only while the ongoing ones finish and the
+// process is forked. The child process has a copy-on-write snapshot of the heap, which it writes to
+// the file, while the transactions of the parent continue. Each thread has two logs and the
+// transactions that commit during the checkpoint go in the other log, with the next epoch.
+// snapshot() writes the same consistent image to another file, for backups. To load a backup, use
+// restore() and then open the store.
+//
+// Objects in the heap must be allocated with tmNew() of the store, and must not point to objects
+// outside of the heap. The memory allocator keeps its metadata in the heap, in transactional variables.
+//
+namespace twoplsf {
+
+// Address where the durable heap is mapped, so that the pointers in the heap stay valid across restarts
+static const uintptr_t DURABLE_HEAP_BASE = 0x600000000000ULL;
+// Default size of the heap
+static const uint64_t DURABLE_HEAP_SIZE = 4ULL*1024*1024*1024;
+// Size of the redo log of each thread. A checkpoint is taken before a transaction starts if its
+// thread has less than DURABLE_LOG_RESERVE bytes left in the log. This is the maximum size of a record.
+static const uint64_t DURABLE_LOG_SIZE = 64*1024*1024;
+static const uint64_t DURABLE_LOG_RESERVE = 8*1024*1024;
+// Maximum interval between two fdatasync() of the group-commit thread, in microseconds
+static const uint64_t DURABLE_GROUP_COMMIT_US = 200;
+// Number of root pointers of the heap
+static const int DURABLE_NUM_ROOTS = 64;
+// Allocations are done in chunks of the heap, one chunk per thread at a time
+static const uint64_t DURABLE_CHUNK_SIZE = 1024*1024;
+// Size classes of the allocator: multiples of 16 bytes up to 1 kB, then powers of 2
+static const int DURABLE_SMALL_CLASSES = 64;
+static const int DURABLE_NUM_CLASSES = DURABLE_SMALL_CLASSES + 40;
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+enum class SyncMode { EachCommit, GroupCommit };
+
+
+class DurableStore : public CommitLog {
+
+private:
+    static const uint64_t HEAP_MAGIC = 0x3246534C50324844ULL;
+    static const uint64_t BLOCK_HEADER = 16;
+
+    // Allocator of a thread
+    struct Arena {
+        alignas(128) tmtype<uint64_t>   cur;                             // Free space in the chunk of the thread (offsets in the heap)
+        tmtype<uint64_t>                end;
+        tmtype<void*>                   freeLists[DURABLE_NUM_CLASSES];  // Freed blocks of each size class
+    };
+
+    // The beginning of the heap
+    struct Header {
+        uint64_t                        magic;
+        uint64_t                        heapBase;                   // Address where the heap must be mapped
+        uint64_t                        heapSize;
+        uint64_t                        epoch;                      // Incremented by each checkpoint. The recovery only uses records of this epoch and the next one.
+        uint64_t                        lastSeq;                    // Last transaction in the image
+        alignas(128) tmtype<uint64_t>   top;                        // Heap space given to the arenas (offset)
+        tmtype<void*>                   roots[DURABLE_NUM_ROOTS];
+        Arena                           arenas[REGISTRY_MAX_THREADS];
+    };
+
+    // A log record is a RecordHeader followed by numEntries pairs of (offset, value). Offsets with the
+    // lowest bit set are increments of a tmcounter.
+    struct RecordHeader {
+        uint64_t seq;
+        uint64_t epoch;
+        uint64_t numEntries;
+        uint64_t checksum;
+    };
+
+    // The records of a thread go in fd[epoch%2]
+    struct ThreadLog {
+        alignas(128) int        fd[2] {-1, -1};
+        uint8_t*                map[2] {nullptr, nullptr};
+        uint64_t                pos {0};                // Where the next record goes (owner thread only, or checkpoints)
+        uint64_t                lastSeq {0};            // Sequence of the last transaction committed by this thread
+        std::atomic<bool>       appending {false};      // Set while a record is being written
+        std::atomic<bool>       dirty[2] {{false}, {false}}; // Set if there are records to sync
+        std::atomic<bool>       inTx {false};           // Set while the thread executes a transaction
+    };
+
+    STM                         stm {NUM_RWL, ASYMMETRIC_FENCE, false};
+    const std::string           dir;
+    const SyncMode              syncMode;
+    uint8_t*                    base {nullptr};
+    uint64_t                    heapSize;
+    Header*                     hdr {nullptr};
+    ThreadLog                   logs[REGISTRY_MAX_THREADS];
+    alignas(128) std::atomic<uint64_t> seqCounter {0};   // Sequence of the last committed update transaction
+    alignas(128) std::atomic<uint64_t> durableSeq {0};   // All the transactions up to this one are on disk
+    alignas(128) std::atomic<bool>     ckptPending {false};
+    std::mutex                  ckptMutex;
+    std::mutex                  syncMutex;              // Serializes the syncs of the logs
+    std::mutex                  groupMutex;             // Protects syncRequested and the waits on durableCV
+    std::condition_variable     durableCV;
+    std::condition_variable     groupCV;
+    bool                        syncRequested {false};  // Set when a thread waits for the group-commit thread
+    bool                        quit {false};
+    std::thread                 groupThread;
+    uint64_t                    numCheckpoints {0};
+    uint64_t                    maxPauseUs {0};         // Longest time that a checkpoint blocked new transactions
+    uint64_t                    numRecovered {0};
+
+    static void __attribute__ ((noinline)) fatal(const char* msg, const std::string& path) {
+        fprintf(stderr, "2PLSF: %s %s\n", msg, path.c_str());
+        std::abort();
+    }
+
+    static inline uint64_t checksum(const uint64_t* words, uint64_t numWords) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (uint64_t i = 0; i < numWords; i++) h = (h ^ words[i]) * 0x100000001b3ULL;
+        return h;
+    }
+
+    static inline int sizeClass(uint64_t size) {
+        if (size <= DURABLE_SMALL_CLASSES*16) return (int)((size+15)/16) - 1;
+        int sc = DURABLE_SMALL_CLASSES;
+        while ((2048ULL << (sc - DURABLE_SMALL_CLASSES)) < size) sc++;
+        return sc;
+    }
+
+    static inline uint64_t classSize(int sc) {
+        if (sc < DURABLE_SMALL_CLASSES) return (uint64_t)(sc+1)*16;
+        return 2048ULL << (sc - DURABLE_SMALL_CLASSES);
+    }
+
+    inline bool inHeap(const void* addr) const { return (uint8_t*)addr >= base && (uint8_t*)addr < base + heapSize; }
+
+    // Announces that the thread is executing a transaction. Checkpoints wait for the announced transactions and block new ones.
+    void enter(const int tid) {
+        ThreadLog& log = logs[tid];
+        if (log.map[0] == nullptr) openLog(tid);
+        if (log.pos > DURABLE_LOG_SIZE - DURABLE_LOG_RESERVE) {
+            std::lock_guard<std::mutex> lock(ckptMutex);
+            // Another thread may have done the checkpoint while we were waiting for it
+            if (log.pos > DURABLE_LOG_SIZE - DURABLE_LOG_RESERVE) doCheckpoint();
+        }
+        while (true) {
+            log.inTx.exchange(true);
+            if (!ckptPending.load()) return;
+            log.inTx.store(false, std::memory_order_release);
+            while (ckptPending.load()) std::this_thread::yield();
+        }
+    }
+
+    // Waits until the transaction seq and all the ones before it are on disk
+    void waitDurable(uint64_t seq) {
+        if (durableSeq.load(std::memory_order_acquire) >= seq) return;
+        if (syncMode == SyncMode::EachCommit) {
+            syncLogs(seq);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(groupMutex);
+        if (!syncRequested) {
+            syncRequested = true;
+            groupCV.notify_one();
+        }
+        durableCV.wait(lock, [&] () { return durableSeq.load() >= seq; });
+    }
+
+    // Syncs the logs with all the transactions that have committed so far, unless seq is already on disk
+    void syncLogs(uint64_t seq) {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        if (durableSeq.load() >= seq) return;
+        const uint64_t target = seqCounter.load();
+        const uint32_t maxThreads = gThreadRegistry.getMaxThreads();
+        // The transactions up to target have taken their sequence. Wait for their records to be written.
+        for (uint32_t itid = 0; itid < maxThreads; itid++) {
+            while (logs[itid].appending.load()) Pause();
+        }
+        for (uint32_t itid = 0; itid < maxThreads; itid++) {
+            for (int i = 0; i < 2; i++) {
+                if (logs[itid].dirty[i].exchange(false)) fdatasync(logs[itid].fd[i]);
+            }
+        }
+        durableSeq.store(target);
+    }
+
+    void groupCommitLoop() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(groupMutex);
+                groupCV.wait_for(lock, std::chrono::microseconds(DURABLE_GROUP_COMMIT_US), [this] () { return quit || syncRequested; });
+                if (quit) return;
+                syncRequested = false;
+            }
+            if (durableSeq.load() == seqCounter.load()) continue;
+            syncLogs(seqCounter.load());
+            { std::lock_guard<std::mutex> lock(groupMutex); }
+            durableCV.notify_all();
+        }
+    }
+
+    std::string logPath(int tid, int i) const { return dir + "/wal-" + std::to_string(tid) + "-" + std::to_string(i); }
+
+    void openLog(const int tid) {
+        ThreadLog& log = logs[tid];
+        for (int i = 0; i < 2; i++) {
+            const std::string path = logPath(tid, i);
+            log.fd[i] = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (log.fd[i] < 0 || ftruncate(log.fd[i], DURABLE_LOG_SIZE) != 0) fatal("can not create the log", path);
+            log.map[i] = (uint8_t*)mmap(nullptr, DURABLE_LOG_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, log.fd[i], 0);
+            if (log.map[i] == MAP_FAILED) fatal("can not map the log", path);
+        }
+        log.pos = 0;
+    }
+
+    // Blocks new transactions and waits for the ongoing ones to finish
+    void quiesce() {
+        ckptPending.store(true);
+        for (int itid = 0; itid < REGISTRY_MAX_THREADS; itid++) {
+            while (logs[itid].inTx.load()) std::this_thread::yield();
+        }
+    }
+
+    void resume(std::chrono::steady_clock::time_point start) {
+        ckptPending.store(false);
+        const uint64_t pauseUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        if (pauseUs > maxPauseUs) maxPauseUs = pauseUs;
+    }
+
+    // Forks a process that writes the heap, as it is now, to path, with lastSeq as the last transaction
+    // of the image. Must be called while the transactions are blocked. The child only makes system calls,
+    // because the other threads may have been holding locks of the C library when we forked.
+    pid_t forkImage(const char* path, uint64_t lastSeq) {
+        const uint64_t used = hdr->top.val;
+        const pid_t pid = fork();
+        if (pid < 0) fatal("can not fork the checkpoint of", dir);
+        if (pid > 0) return pid;
+        hdr->lastSeq = lastSeq;
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) _exit(1);
+        for (uint64_t off = 0; off < used; ) {
+            const ssize_t n = pwrite(fd, base + off, std::min<uint64_t>(used - off, 64*1024*1024), off);
+            if (n <= 0) _exit(1);
+            off += n;
+        }
+        if (ftruncate(fd, heapSize) != 0 || fdatasync(fd) != 0) _exit(1);
+        _exit(0);
+    }
+
+    // Waits for the child process of forkImage() to write the image
+    void waitImage(pid_t pid, const std::string& path) {
+        int status;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) fatal("can not wait for the checkpoint", path);
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) fatal("can not write the image", path);
+    }
+
+    // Writes a new image of the heap, which replaces the old one. Must be called with ckptMutex.
+    void doCheckpoint() {
+        const std::string path = dir + "/heap";
+        const std::string tmpPath = dir + "/heap.new";
+        const auto start = std::chrono::steady_clock::now();
+        quiesce();
+        // The transactions that commit from now on go in the other log of each thread, with the next epoch
+        const uint64_t lastSeq = seqCounter.load();
+        hdr->epoch++;
+        hdr->lastSeq = lastSeq;
+        for (int itid = 0; itid < REGISTRY_MAX_THREADS; itid++) logs[itid].pos = 0;
+        const pid_t pid = forkImage(tmpPath.c_str(), lastSeq);
+        resume(start);
+        waitImage(pid, tmpPath);
+        if (rename(tmpPath.c_str(), path.c_str()) != 0) fatal("can not rename the image", tmpPath);
+        int dfd = open(dir.c_str(), O_RDONLY);
+        if (dfd >= 0) {
+            fsync(dfd);
+            close(dfd);
+        }
+        numCheckpoints++;
+    }
+
+    // Replays the durable records of the logs, in the order of their sequence
+    void recover() {
+        std::vector<std::pair<uint64_t,const RecordHeader*>> records;
+        std::vector<std::pair<uint8_t*,uint64_t>> maps;
+        for (int ilog = 0; ilog < 2*REGISTRY_MAX_THREADS; ilog++) {
+            const std::string path = logPath(ilog/2, ilog%2);
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) continue;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(RecordHeader)) {
+                close(fd);
+                continue;
+            }
+            uint8_t* map = (uint8_t*)mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (map == MAP_FAILED) fatal("can not map the log", path);
+            maps.push_back({map, (uint64_t)st.st_size});
+            for (uint64_t pos = 0; pos + sizeof(RecordHeader) <= (uint64_t)st.st_size; ) {
+                const RecordHeader* rec = (const RecordHeader*)(map + pos);
+                const uint64_t numWords = rec->numEntries*2;
+                // A checkpoint in progress has moved on to the next epoch. Older records were already in the image.
+                if (rec->seq == 0 || rec->epoch < hdr->epoch || rec->epoch > hdr->epoch+1) break;
+                if (pos + sizeof(RecordHeader) + numWords*8 > (uint64_t)st.st_size) break;
+                const uint64_t* entries = (const uint64_t*)(rec+1);
+                if (rec->checksum != (checksum(entries, numWords) ^ rec->seq ^ rec->epoch)) break;
+                records.push_back({rec->seq, rec});
+                pos += sizeof(RecordHeader) + numWords*8;
+            }
+        }
+        std::sort(records.begin(), records.end(), [] (const std::pair<uint64_t,const RecordHeader*>& a, const std::pair<uint64_t,const RecordHeader*>& b) { return a.first < b.first; });
+        uint64_t next = hdr->lastSeq+1;
+        for (size_t i = 0; i < records.size(); i++) {
+            if (records[i].first < next) continue;
+            if (records[i].first != next) break;   // The transactions after a missing one are not durable
+            const uint64_t* entries = (const uint64_t*)(records[i].second+1);
+            for (uint64_t j = 0; j < records[i].second->numEntries; j++) {
+                const uint64_t off = entries[2*j];
+                if ((off & ~1ULL) + 8 > heapSize) break;
+                uint64_t* addr = (uint64_t*)(base + (off & ~1ULL));
+                if (off & 1) *addr += entries[2*j+1];
+                else *addr = entries[2*j+1];
+            }
+            next++;
+            numRecovered++;
+        }
+        for (size_t i = 0; i < maps.size(); i++) munmap(maps[i].first, maps[i].second);
+        seqCounter.store(next-1);
+        // The records of the next epoch that were not replayed must not be mixed with new ones, in case
+        // we crash again before the next checkpoint
+        hdr->epoch++;
+    }
+
+public:
+    // Opens the store in dir, creating it with a heap of heapSize bytes if it doesn't exist yet.
+    // Only one store can be open at a time, because the heap is always mapped at the same address.
+    DurableStore(const std::string& dir, uint64_t heapSize=DURABLE_HEAP_SIZE, SyncMode syncMode=SyncMode::GroupCommit) :
+        dir{dir}, syncMode{syncMode}, heapSize{heapSize} {
+        // The processes forked by the checkpoints only need the heap
+        stm.excludeFromFork();
+        mkdir(dir.c_str(), 0755);
+        const std::string path = dir + "/heap";
+        int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) fatal("can not open the heap", path);
+        const bool isNew = (st.st_size == 0);
+        if (isNew) {
+            if (ftruncate(fd, heapSize) != 0) fatal("can not create the heap", path);
+        } else {
+            this->heapSize = st.st_size;
+        }
+        // Private mapping: the modifications to the heap reach the file only with the checkpoints
+        base = (uint8_t*)mmap((void*)DURABLE_HEAP_BASE, this->heapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd, 0);
+        close(fd);
+        if (base != (uint8_t*)DURABLE_HEAP_BASE) fatal("can not map the heap at its address", path);
+        hdr = (Header*)base;
+        if (isNew) {
+            hdr->magic = HEAP_MAGIC;
+            hdr->heapBase = DURABLE_HEAP_BASE;
+            hdr->heapSize = heapSize;
+            hdr->epoch = 1;
+            hdr->lastSeq = 0;
+            hdr->top.val = (sizeof(Header) + 4095) & ~4095ULL;
+        } else {
+            if (hdr->magic != HEAP_MAGIC) fatal("not a heap of a durable store", path);
+            if (hdr->heapBase != DURABLE_HEAP_BASE) fatal("the heap was created for another address", path);
+            recover();
+        }
+        // Start with an image that has all the durable transactions
+        checkpoint();
+        stm.commitLog = this;
+        if (syncMode == SyncMode::GroupCommit) groupThread = std::thread(&DurableStore::groupCommitLoop, this);
+    }
+
+    // Closes the store, with a checkpoint
+    ~DurableStore() {
+        if (groupThread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(groupMutex);
+                quit = true;
+            }
+            groupCV.notify_all();
+            groupThread.join();
+        }
+        checkpoint();
+        for (int itid = 0; itid < REGISTRY_MAX_THREADS; itid++) {
+            if (logs[itid].map[0] == nullptr) continue;
+            for (int i = 0; i < 2; i++) {
+                munmap(logs[itid].map[i], DURABLE_LOG_SIZE);
+                close(logs[itid].fd[i]);
+            }
+        }
+        munmap(base, heapSize);
+    }
+
+    static std::string className() { return "2PLSF-Durable"; }
+
+    // Called by the 2PLSF domain of the store on the commit of each update transaction, while it holds its locks
+    void append(OpData* myd) override {
+        uint64_t numEntries = 0;
+        for (int32_t i = 0; i < myd->writeSet.size; i++) numEntries += inHeap(myd->writeSet.entries[i].addr);
+        for (int32_t i = 0; i < myd->counterSet.size; i++) numEntries += inHeap(myd->counterSet.entries[i].addr);
+        for (uint64_t i = 0; i < myd->numAllocs; i++) {
+            if (inHeap(myd->alog[i].obj)) numEntries += myd->alog[i].size/8;
+        }
+        if (numEntries == 0) return;
+        ThreadLog& log = logs[myd->tid];
+        const uint64_t recordSize = sizeof(RecordHeader) + numEntries*16;
+        if (log.pos + recordSize > DURABLE_LOG_SIZE) fatal("transaction too large for the log of", dir);
+        log.appending.store(true);
+        const uint64_t seq = seqCounter.fetch_add(1)+1;
+        const int ilog = hdr->epoch % 2;
+        RecordHeader* rec = (RecordHeader*)(log.map[ilog] + log.pos);
+        uint64_t* entries = (uint64_t*)(rec+1);
+        uint64_t k = 0;
+        for (int32_t i = 0; i < myd->writeSet.size; i++) {
+            uint64_t* addr = (uint64_t*)myd->writeSet.entries[i].addr;
+            if (!inHeap(addr)) continue;
+            entries[k++] = (uint8_t*)addr - base;
+            entries[k++] = *addr;
+        }
+        for (int32_t i = 0; i < myd->counterSet.size; i++) {
+            uint64_t* addr = myd->counterSet.entries[i].addr;
+            if (!inHeap(addr)) continue;
+            entries[k++] = ((uint8_t*)addr - base) | 1;
+            entries[k++] = myd->counterSet.entries[i].delta;
+        }
+        // The objects allocated in this transaction were modified without locks, we log all of their words
+        for (uint64_t i = 0; i < myd->numAllocs; i++) {
+            uint64_t* obj = (uint64_t*)myd->alog[i].obj;
+            if (!inHeap(obj)) continue;
+            for (uint64_t j = 0; j < myd->alog[i].size/8; j++) {
+                entries[k++] = (uint8_t*)&obj[j] - base;
+                entries[k++] = obj[j];
+            }
+        }
+        rec->epoch = hdr->epoch;
+        rec->numEntries = numEntries;
+        rec->checksum = checksum(entries, numEntries*2) ^ seq ^ rec->epoch;
+        rec->seq = seq;
+        log.pos += recordSize;
+        log.lastSeq = seq;
+        log.dirty[ilog].store(true, std::memory_order_relaxed);
+        log.appending.store(false, std::memory_order_release);
+    }
+
+    // Update transaction. Returns once the transaction is durable.
+    template<typename R, typename F> R updateTx(F&& func) {
+        if (tl_opdata != nullptr) return stm.transaction<R>(func, TX_IS_UPDATE);
+        const int tid = ThreadRegistry::getTID();
+        enter(tid);
+        R retval = stm.transaction<R>(func, TX_IS_UPDATE);
+        logs[tid].inTx.store(false, std::memory_order_release);
+        waitDurable(logs[tid].lastSeq);
+        return retval;
+    }
+
+    template<typename F> void updateTx(F&& func) {
+        if (tl_opdata != nullptr) {
+            stm.transaction(func, TX_IS_UPDATE);
+            return;
+        }
+        const int tid = ThreadRegistry::getTID();
+        enter(tid);
+        stm.transaction(func, TX_IS_UPDATE);
+        logs[tid].inTx.store(false, std::memory_order_release);
+        waitDurable(logs[tid].lastSeq);
+    }
+
+    // Read-only transaction. It doesn't wait for the transactions it has seen to be durable.
+    template<typename R, typename F> R readTx(F&& func) {
+        if (tl_opdata != nullptr) return stm.transaction<R>(func, TX_IS_READ);
+        const int tid = ThreadRegistry::getTID();
+        enter(tid);
+        R retval = stm.transaction<R>(func, TX_IS_READ);
+        logs[tid].inTx.store(false, std::memory_order_release);
+        return retval;
+    }
+
+    template<typename F> void readTx(F&& func) {
+        if (tl_opdata != nullptr) {
+            stm.transaction(func, TX_IS_READ);
+            return;
+        }
+        const int tid = ThreadRegistry::getTID();
+        enter(tid);
+        stm.transaction(func, TX_IS_READ);
+        logs[tid].inTx.store(false, std::memory_order_release);
+    }
+
+    // Waits until all the transactions committed so far are durable
+    void sync() {
+        waitDurable(seqCounter.load());
+    }
+
+    // Allocates size bytes in the heap. Must be called in a transaction of the store.
+    void* tmMalloc(size_t size, size_t align=16) {
+        OpData* myd = tl_opdata;
+        assert(myd != nullptr && myd->stm == &stm);
+        const uint64_t extra = (align > 16) ? align : 0;
+        const int sc = sizeClass(size + BLOCK_HEADER + extra);
+        const uint64_t bsize = classSize(sc);
+        Arena& arena = hdr->arenas[myd->tid];
+        uint8_t* block = (uint8_t*)arena.freeLists[sc].pload();
+        if (block != nullptr) {
+            arena.freeLists[sc] = ((tmtype<void*>*)block)->pload();
+        } else if (bsize <= DURABLE_CHUNK_SIZE) {
+            if (arena.cur + bsize > arena.end) {
+                const uint64_t chunk = hdr->top;
+                if (chunk + DURABLE_CHUNK_SIZE > heapSize) fatal("out of memory in the heap of", dir);
+                hdr->top = chunk + DURABLE_CHUNK_SIZE;
+                arena.cur = chunk;
+                arena.end = chunk + DURABLE_CHUNK_SIZE;
+            }
+            block = base + arena.cur;
+            arena.cur += bsize;
+        } else {
+            const uint64_t off = hdr->top;
+            if (off + bsize > heapSize) fatal("out of memory in the heap of", dir);
+            hdr->top = off + bsize;
+            block = base + off;
+        }
+        uint8_t* ptr = block + BLOCK_HEADER;
+        if (extra != 0) ptr = (uint8_t*)(((uintptr_t)ptr + align-1) & ~(uintptr_t)(align-1));
+        // Size class and block of the allocation, just before it. The header is written with locks, before
+        // the block is captured, so that a freed block gets back its link in the free list on an abort.
+        ((tmtype<uint64_t>*)ptr)[-2] = sc;
+        ((tmtype<uint64_t>*)ptr)[-1] = ptr - block;
+        // The rest of the block is captured by the transaction: it is logged as a whole if the transaction commits
+        assert(myd->numAllocs != TX_MAX_ALLOCS);
+        Deletable& del = myd->alog[myd->numAllocs++];
+        del.obj = block;
+        del.reclaim = [](void* obj) { };
+        STM::addCaptured(myd, del, bsize);
+        return ptr;
+    }
+
+    // Frees memory allocated with tmMalloc(). Must be called in a transaction of the store.
+    // The first word of a free block links it to the next one in the free list of its size class.
+    void tmFree(void* ptr) {
+        if (ptr == nullptr) return;
+        OpData* myd = tl_opdata;
+        assert(myd != nullptr && myd->stm == &stm);
+        const int sc = (int)((tmtype<uint64_t>*)ptr)[-2].pload();
+        uint8_t* block = (uint8_t*)ptr - ((tmtype<uint64_t>*)ptr)[-1].pload();
+        Arena& arena = hdr->arenas[myd->tid];
+        *(tmtype<void*>*)block = arena.freeLists[sc].pload();
+        arena.freeLists[sc] = block;
+    }
+
+    // Allocates and constructs an object in the heap, in a transaction of the store
+    template <typename T, typename... Args> T* tmNew(Args&&... args) {
+        if (tl_opdata == nullptr) return updateTx<T*>([&] () { return tmNew<T>(std::forward<Args>(args)...); });
+        T* ptr = (T*)tmMalloc(sizeof(T), alignof(T));
+        new (ptr) T(std::forward<Args>(args)...);
+        return ptr;
+    }
+
+    template<typename T> void tmDelete(T* obj) {
+        if (obj == nullptr) return;
+        if (tl_opdata == nullptr) {
+            updateTx([&] () { tmDelete(obj); });
+            return;
+        }
+        obj->~T();
+        tmFree(obj);
+    }
+
+    // The roots are the entry points to the data in the heap
+    template<typename T> T* getRoot(int idx) { return readTx<T*>([&] () { return (T*)hdr->roots[idx].pload(); }); }
+    void setRoot(int idx, void* obj) { updateTx([&] () { hdr->roots[idx] = obj; }); }
+
+    // Writes an image of the heap with all the committed transactions, which replaces the old one, and
+    // returns once it is on disk. The other threads can execute transactions during the checkpoint.
+    // Must be called outside of a transaction.
+    void checkpoint() {
+        std::lock_guard<std::mutex> lock(ckptMutex);
+        doCheckpoint();
+    }
+
+    // Writes a consistent image of the heap to path, for backups. The other threads can execute
+    // transactions meanwhile. Must be called outside of a transaction.
+    void snapshot(const std::string& path) {
+        std::lock_guard<std::mutex> lock(ckptMutex);
+        const auto start = std::chrono::steady_clock::now();
+        quiesce();
+        const pid_t pid = forkImage(path.c_str(), seqCounter.load());
+        resume(start);
+        waitImage(pid, path);
+    }
+
+    // Replaces the heap of the store in dir with an image written by snapshot(), and removes the logs.
+    // The store must be closed.
+    static void restore(const std::string& imagePath, const std::string& dir) {
+        mkdir(dir.c_str(), 0755);
+        const std::string tmpPath = dir + "/heap.new";
+        int src = open(imagePath.c_str(), O_RDONLY);
+        int dst = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        struct stat st;
+        if (src < 0 || dst < 0 || fstat(src, &st) != 0) fatal("can not restore the image", imagePath);
+        std::vector<uint8_t> buf(1024*1024);
+        uint64_t off = 0;
+        for (ssize_t n; (n = read(src, buf.data(), buf.size())) > 0; off += n) {
+            // Skip the zeroes to keep the file sparse
+            bool zero = true;
+            for (ssize_t k = 0; k < n && zero; k += 8) zero = (*(uint64_t*)&buf[k] == 0);
+            if (!zero && pwrite(dst, buf.data(), n, off) != n) fatal("can not restore the image", tmpPath);
+        }
+        if (off != (uint64_t)st.st_size || ftruncate(dst, off) != 0 || fdatasync(dst) != 0) fatal("can not restore the image", tmpPath);
+        close(src);
+        close(dst);
+        for (int ilog = 0; ilog < 2*REGISTRY_MAX_THREADS; ilog++) {
+            unlink((dir + "/wal-" + std::to_string(ilog/2) + "-" + std::to_string(ilog%2)).c_str());
+        }
+        if (rename(tmpPath.c_str(), (dir + "/heap").c_str()) != 0) fatal("can not rename the image", tmpPath);
+    }
+
+    uint64_t getNumCheckpoints() const { return numCheckpoints; }
+    // Longest time that new transactions were blocked by a checkpoint or a snapshot, in microseconds
+    uint64_t getMaxPauseUs() const { return maxPauseUs; }
+    // Number of transactions replayed from the logs when the store was opened
+    uint64_t getNumRecovered() const { return numRecovered; }
+};
+
+
+// Static interface to the open DurableStore, for the data structures in pdatastructures/
+struct DurableTM {
+    struct tmbase : public twoplsf::tmbase { };
+
+    static DurableStore*& store() {
+        static DurableStore* s {nullptr};
+        return s;
+    }
+
+    static std::string className() { return DurableStore::className(); }
+    template<typename R, typename F> static R updateTx(F&& func) { return store()->updateTx<R>(func); }
+    template<typename R, typename F> static R readTx(F&& func) { return store()->readTx<R>(func); }
+    template<typename F> static void updateTx(F&& func) { store()->updateTx(func); }
+    template<typename F> static void readTx(F&& func) { store()->readTx(func); }
+    template<typename T, typename... Args> static T* tmNew(Args&&... args) { return store()->tmNew<T>(std::forward<Args>(args)...); }
+    template<typename T> static void tmDelete(T* obj) { store()->tmDelete<T>(obj); }
+    static void* tmMalloc(size_t size) { return store()->updateTx<void*>([&] () { return store()->tmMalloc(size); }); }
+    static void tmFree(void* obj) { store()->updateTx([&] () { store()->tmFree(obj); }); }
+};
+
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2021-2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+
+#include "2PLSF.hpp"
+
+// Parallel nested transactions (fork/join) for 2PLSF
+//
+// A large transaction, like rebuilding a data structure or a bulk insertion, executes on a single
+// thread while holding all of its locks. forkJoin() splits the work of the current transaction
+// into tasks that are executed in parallel by the worker threads of a ForkPool:
+//   twoplsf::updateTx([&] () {
+//       twoplsf::forkJoin(numTasks, [&] (int itask) { ... });
+//   });
+// The workers join the transaction: they lock with its tid and its timestamp, which stays announced
+// until the join, and they keep their own undo log, read-set and allocation logs, which are appended
+// to the ones of the transaction at the join. The tasks commit or abort with the transaction:
+// - If a worker has to "Die", it stops and the transaction is aborted at the join, after the other
+//   workers have finished their tasks. The whole transaction is then restarted, tasks included;
+// - Workers never conflict with each other because they share the locks. The tasks must access
+//   disjoint data, or only read the data they share;
+// - A forkJoin() in a task, outside of a transaction, or in the optimistic mode of a hybrid domain,
+//   executes the tasks one after the other;
+// - retry() and nested transactions of other domains can not be used in the tasks.
+//
+namespace twoplsf {
+
+// A forkJoin() in progress
+struct ForkGroup {
+    void                (*fn)(void*, int);  // Type-erased lambda
+    void*               ctx;                // Lambda instance, in the stack of the transaction's thread
+    int                 numTasks;
+    OpData*             parent;             // OpData of the transaction
+    std::atomic<int>    next {0};           // Next task to execute
+    std::atomic<bool>   aborted {false};    // Set if one of the workers had to "Die"
+    int                 active {0};         // Number of workers executing tasks of this group. Protected by the pool's mutex
+    std::mutex          mergeMutex;         // Protects the logs of the parent while the workers append to them
+};
+
+
+class ForkPool {
+private:
+    std::mutex                  mtx;
+    std::condition_variable     cv;
+    std::deque<ForkGroup*>      groups;         // Groups with tasks left to execute
+    bool                        quit {false};
+    std::vector<std::thread>    workers;
+
+    void workerLoop() {
+        std::unique_ptr<OpData> child {new OpData()};
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            cv.wait(lock, [this] () { return quit || !groups.empty(); });
+            if (groups.empty()) return;
+            ForkGroup* g = groups.front();
+            g->active++;
+            lock.unlock();
+            runTasks(g, child.get());
+            lock.lock();
+            // There are no more tasks to take from this group
+            if (!groups.empty() && groups.front() == g) groups.pop_front();
+            g->active--;
+            cv.notify_all();
+        }
+    }
+
+    // Sets up the OpData of a worker to execute tasks on behalf of the transaction
+    static void beginChild(OpData* parent, OpData* child) {
+        child->stm = parent->stm;
+        child->tid = parent->tid;
+        child->myTS = parent->myTS;
+        child->oTS = NO_TIMESTAMP;
+        child->otid = REGISTRY_MAX_THREADS;
+        child->parent = parent;
+        child->numAllocs = 0;
+        child->capLo = UINTPTR_MAX;
+        child->capHi = 0;
+        child->numFrees = 0;
+        for (uint32_t i = 0; i < FORK_LOCK_CACHE; i++) child->forkLocks[i] = NO_WIDX;
+        child->writeSet.reset();
+        child->readSet.reset();
+        child->counterSet.reset();
+        child->commitHooks.clear();
+        child->abortHooks.clear();
+    }
+
+    // Appends the logs of the worker to the ones of the transaction. If the worker had to "Die",
+    // the transaction will wait for the same conflicting transaction before restarting.
+    static void mergeChild(ForkGroup* g, OpData* child) {
+        OpData* parent = g->parent;
+        std::lock_guard<std::mutex> lock(g->mergeMutex);
+        assert(parent->writeSet.size + child->writeSet.size <= WriteSet::MAX_WRITE_SET_ENTRIES);
+        std::memcpy(&parent->writeSet.entries[parent->writeSet.size], child->writeSet.entries, child->writeSet.size*sizeof(WriteSet::WriteSetEntry));
+        parent->writeSet.size += child->writeSet.size;
+        assert(parent->readSet.size + child->readSet.size <= ReadSet::MAX_READ_SET_ENTRIES);
+        std::memcpy(&parent->readSet.entries[parent->readSet.size], child->readSet.entries, child->readSet.size*sizeof(ReadSet::ReadSetEntry));
+        parent->readSet.size += child->readSet.size;
+        for (int32_t i = 0; i < child->counterSet.size; i++) parent->counterSet.add(child->counterSet.entries[i].addr, child->counterSet.entries[i].delta);
+        assert(parent->numAllocs + child->numAllocs <= TX_MAX_ALLOCS);
+        for (uint64_t i = 0; i < child->numAllocs; i++) parent->alog[parent->numAllocs++] = child->alog[i];
+        // The captured range of the transaction stays its own most recent allocation
+        assert(parent->numFrees + child->numFrees <= TX_MAX_RETIRES);
+        for (uint64_t i = 0; i < child->numFrees; i++) parent->flog[parent->numFrees++] = child->flog[i];
+        for (size_t i = 0; i < child->commitHooks.size(); i++) parent->commitHooks.push_back(std::move(child->commitHooks[i]));
+        for (size_t i = 0; i < child->abortHooks.size(); i++) parent->abortHooks.push_back(std::move(child->abortHooks[i]));
+        if (child->oTS < parent->oTS) {
+            parent->oTS = child->oTS;
+            parent->otid = child->otid;
+        }
+    }
+
+    // Executes tasks of the group until there are none left, or one of the workers had to "Die"
+    static void runTasks(ForkGroup* g, OpData* child) {
+        OpData* const prev = tl_opdata;
+        beginChild(g->parent, child);
+        tl_opdata = child;
+        // An abort of a worker comes back here
+        if (setjmp(child->env) != 0) g->aborted.store(true);
+        while (!g->aborted.load(std::memory_order_relaxed)) {
+            const int itask = g->next.fetch_add(1);
+            if (itask >= g->numTasks) break;
+            g->fn(g->ctx, itask);
+        }
+        tl_opdata = prev;
+        mergeChild(g, child);
+    }
+
+public:
+    ForkPool(int numWorkers) {
+        for (int i = 0; i < numWorkers; i++) workers.emplace_back(&ForkPool::workerLoop, this);
+    }
+
+    ~ForkPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            quit = true;
+        }
+        cv.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    }
+
+    // One worker per core, besides the thread of the transaction, which also executes tasks
+    static ForkPool& get() {
+        static ForkPool pool {std::max(1, (int)std::thread::hardware_concurrency()-1)};
+        return pool;
+    }
+
+    // Executes the tasks of the group with the workers and the calling thread, and returns once they are all done
+    void run(ForkGroup* g) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            groups.push_back(g);
+        }
+        cv.notify_all();
+        static thread_local std::unique_ptr<OpData> child {new OpData()};
+        runTasks(g, child.get());
+        std::unique_lock<std::mutex> lock(mtx);
+        for (auto it = groups.begin(); it != groups.end(); ++it) {
+            if (*it != g) continue;
+            groups.erase(it);
+            break;
+        }
+        cv.wait(lock, [g] () { return g->active == 0; });
+    }
+};
+
+
+template<typename F> static void forkInvoke(void* ctx, int itask) { (*(F*)ctx)(itask); }
+
+// Executes func(0), ..., func(numTasks-1) in parallel, as part of the current transaction
+template<typename F> static void forkJoin(int numTasks, F&& func) {
+    OpData* myd = tl_opdata;
+    if (myd == nullptr || myd->parent != nullptr || myd->optimistic || numTasks <= 1) {
+        for (int itask = 0; itask < numTasks; itask++) func(itask);
+        return;
+    }
+    STM* stm = myd->stm;
+    // The workers resolve their conflicts with the timestamp of the transaction
+    if (myd->myTS == NO_TIMESTAMP) myd->myTS = stm->conflictClock.fetch_add(1);
+    stm->txnTS[myd->tid*STM::CLPAD].store(myd->myTS);
+    ForkGroup g;
+    g.fn = &forkInvoke<typename std::remove_reference<F>::type>;
+    g.ctx = (void*)&func;
+    g.numTasks = numTasks;
+    g.parent = myd;
+    ForkPool::get().run(&g);
+    stm->txnTS[myd->tid*STM::CLPAD].store(NO_TIMESTAMP, std::memory_order_release);
+    // The undo log has the modifications of all the workers, so we can rollback everything
+    if (g.aborted.load()) abortTx(myd);
+}
+
+}
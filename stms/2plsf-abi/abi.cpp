@@ -0,0 +1,468 @@
+/*
+ * Copyright 2021-2022
+ *   Andreia Correia <andreia.veiga@unine.ch>
+ *   Pedro Ramalhete <pramalhe@gmail.com>
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *
+ * This work is published under the MIT license. See LICENSE.txt
+ */
+
+// GCC libitm ABI on top of 2PLSF
+//
+// Code compiled with "gcc -fgnu-tm" turns each __transaction_atomic block into a call to
+// _ITM_beginTransaction() followed by calls to _ITM_RU8(), _ITM_WU8(), _ITM_memcpyRtWt(), ...
+// for each access to shared memory. Linking with the libitm.a built from this file (instead of
+// GCC's libitm) runs those transactions on twoplsf::STM, without rewriting the code with tmtype.
+//
+// - Loads take the read-lock of the stripe(s) and stores take the write-lock of each aligned
+//   64 bit word they touch, which is then saved in the undo log;
+// - Memory allocated in the transaction and the stack frames below _ITM_beginTransaction()
+//   are private to the thread and accessed without locks;
+// - On a conflict, abortTx() rolls back and releases the locks, then calls abiRestart() which
+//   jumps back to where _ITM_beginTransaction() returned, with the registers saved by arch.S;
+// - Nesting is flat. __transaction_cancel is supported only on the outermost transaction;
+// - There is no serial-irrevocable mode in 2PLSF, so transactions that need it (calls to unsafe
+//   functions in __transaction_relaxed) are a fatal error.
+//
+// - The transactions run on gSTM. A __transaction_atomic block inside a twoplsf::updateTx(domain, ...)
+//   is flattened into it and runs on that domain;
+//
+// arch.S and libitm.h are the ones from TinySTM's GCC ABI, see stms/tinystm/abi/gcc/
+//
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+
+#include "libitm.h"
+#include "../2PLSF.hpp"
+
+#if !defined(__x86_64__)
+#error "The 2PLSF libitm ABI is only implemented for x86_64"
+#endif
+
+using namespace twoplsf;
+
+// Registers saved by _ITM_beginTransaction() in arch.S, in this order
+struct AbiJmpBuf {
+    uint64_t rsp;
+    uint64_t rbx;
+    uint64_t rbp;
+    uint64_t r12;
+    uint64_t r13;
+    uint64_t r14;
+    uint64_t r15;
+    uint64_t rip;
+};
+
+// outerAbort in GCC's _ITM_abortReason, it's missing from TinySTM's libitm.h
+static const uint32_t ABI_OUTER_ABORT = 0x10;
+
+// Thread-local state of the ABI transaction
+struct AbiTx {
+    AbiJmpBuf   jb;                // Where to go back on restart or cancel
+    uintptr_t   stackTop {0};      // Stack pointer of the caller of _ITM_beginTransaction()
+    uint64_t    nesting {0};       // Number of flattened nested transactions
+};
+
+static thread_local AbiTx tl_abi {};
+
+extern "C" uint32_t _ITM_CALL_CONVENTION GTM_begin_transaction(uint32_t prop, const AbiJmpBuf* jb);
+extern "C" void _ITM_CALL_CONVENTION _ITM_siglongjmp(int val, const AbiJmpBuf* jb) __attribute__ ((noreturn));
+
+
+[[noreturn]] static void abiFatal(const char* msg) {
+    fprintf(stderr, "2PLSF libitm ABI: %s\n", msg);
+    std::abort();
+}
+
+// Called by abortTx() after the rollback and the release of the locks
+[[noreturn]] static void abiRestart(OpData* myd) {
+    tl_abi.nesting = 0;
+    myd->stm->beginTx(myd);
+    _ITM_siglongjmp(a_runInstrumentedCode | a_restoreLiveVariables, &tl_abi.jb);
+}
+
+// Memory allocated in this transaction and the stack frames of the transaction are not visible to other threads
+static inline bool isPrivate(OpData* myd, const void* addr) {
+    const uintptr_t uaddr = (uintptr_t)addr;
+    if (uaddr < tl_abi.stackTop && uaddr >= (uintptr_t)__builtin_frame_address(0)) return true;
+    return myd->stm->isCaptured(myd, addr);
+}
+
+static inline void abiReadBytes(const void* addr, size_t len) {
+    OpData* const myd = tl_opdata;
+    if (myd == nullptr || len == 0 || isPrivate(myd, addr)) return;
+    if (!myd->stm->tryWaitReadLockRange(myd, addr, len)) abortTx(myd);
+}
+
+static inline void abiWriteBytes(const void* addr, size_t len) {
+    OpData* const myd = tl_opdata;
+    if (myd == nullptr || len == 0 || isPrivate(myd, addr)) return;
+    if (!myd->stm->tryWaitWriteLockRange(myd, addr, len)) abortTx(myd);
+}
+
+template<typename T> static inline T abiLoad(const T* addr) {
+    abiReadBytes(addr, sizeof(T));
+    return *addr;
+}
+
+template<typename T> static inline void abiStore(const T* addr, T val) {
+    abiWriteBytes(addr, sizeof(T));
+    *(T*)addr = val;
+}
+
+template<typename T> static inline void abiLog(const T* addr) {
+    abiWriteBytes(addr, sizeof(T));
+}
+
+
+/**** CLONE TABLES (for indirect calls of transaction_safe functions) ****/
+
+struct CloneEntry {
+    void* orig;
+    void* clone;
+};
+
+struct CloneTable {
+    CloneEntry* table;
+    size_t      size;
+    CloneTable* next;
+};
+
+// The tables are registered by crtbegin.o before main() and by dlopen()
+static std::mutex  cloneMutex;
+static CloneTable* allTables {nullptr};
+
+static void* findClone(void* ptr) {
+    std::lock_guard<std::mutex> lock(cloneMutex);
+    for (CloneTable* table = allTables; table != nullptr; table = table->next) {
+        CloneEntry* t = table->table;
+        if (table->size == 0 || ptr < t[0].orig || ptr > t[table->size-1].orig) continue;
+        CloneEntry* e = std::lower_bound(t, t+table->size, ptr, [] (const CloneEntry& a, void* p) { return a.orig < p; });
+        if (e != t+table->size && e->orig == ptr) return e->clone;
+    }
+    return nullptr;
+}
+
+
+extern "C" {
+
+/**** TRANSACTIONS ****/
+
+// The _ITM_beginTransaction() is defined in assembly (stms/tinystm/abi/gcc/arch.S)
+uint32_t _ITM_CALL_CONVENTION GTM_begin_transaction(uint32_t prop, const AbiJmpBuf* jb) {
+    // Nested transaction, it's flattened into the outer one
+    if (tl_opdata != nullptr) {
+        tl_abi.nesting++;
+        return a_runInstrumentedCode;
+    }
+    if (!(prop & pr_instrumentedCode)) abiFatal("irrevocable transactions are not supported");
+    OpData* myd = &gSTM.opDesc[ThreadRegistry::getTID()];
+    tl_abi.jb = *jb;
+    tl_abi.stackTop = jb->rsp;
+    tl_abi.nesting = 0;
+    myd->restartFn = abiRestart;
+    tl_opdata = myd;
+    myd->stm->beginTx(myd);
+    return a_runInstrumentedCode | a_saveLiveVariables;
+}
+
+void _ITM_CALL_CONVENTION _ITM_commitTransaction(void) {
+    if (tl_abi.nesting > 0) {
+        tl_abi.nesting--;
+        return;
+    }
+    OpData* myd = tl_opdata;
+    myd->restartFn = nullptr;
+    tl_abi.stackTop = 0;
+    myd->stm->endTx(myd, (int)myd->tid);
+}
+
+bool _ITM_CALL_CONVENTION _ITM_tryCommitTransaction(const _ITM_srcLocation* __src) {
+    _ITM_commitTransaction();
+    return true;
+}
+
+void _ITM_CALL_CONVENTION _ITM_commitTransactionToId(const _ITM_transactionId tid, const _ITM_srcLocation* __src) {
+    while (_ITM_getTransactionId() > tid) _ITM_commitTransaction();
+}
+
+void _ITM_CALL_CONVENTION _ITM_commitTransactionEH(void* exc_ptr) {
+    _ITM_commitTransaction();
+}
+
+void _ITM_CALL_CONVENTION _ITM_abortTransaction(_ITM_abortReason __reason, const _ITM_srcLocation* __src) {
+    OpData* myd = tl_opdata;
+    if (myd == nullptr) abiFatal("_ITM_abortTransaction() outside of a transaction");
+    // Anything other than __transaction_cancel restarts the transaction
+    if (!(__reason & userAbort)) abortTx(myd);
+    if (tl_abi.nesting > 0 && !(__reason & ABI_OUTER_ABORT)) abiFatal("__transaction_cancel of a nested transaction is not supported (nesting is flat)");
+    if (myd->restartFn == nullptr) abiFatal("__transaction_cancel inside a twoplsf::updateTx() is not supported");
+    // Rollback and finish the transaction without retrying it
+    myd->stm->abortTx(myd);
+    myd->attempt = 0;
+    myd->restartFn = nullptr;
+    myd->stm->suspendTx(myd);
+    tl_opdata = nullptr;
+    tl_abi.stackTop = 0;
+    tl_abi.nesting = 0;
+    _ITM_siglongjmp(a_abortTransaction | a_restoreLiveVariables, &tl_abi.jb);
+}
+
+void _ITM_CALL_CONVENTION _ITM_rollbackTransaction(const _ITM_srcLocation* __src) {
+    abiFatal("_ITM_rollbackTransaction() is not supported");
+}
+
+void _ITM_CALL_CONVENTION _ITM_changeTransactionMode(_ITM_transactionState __mode, const _ITM_srcLocation* __loc) {
+    if (__mode == modeSerialIrrevocable) abiFatal("irrevocable transactions are not supported");
+}
+
+void _ITM_CALL_CONVENTION _ITM_registerThrownObject(const void* __obj, size_t __size) {
+    // Nothing to do: the exception object is not part of the undo log
+}
+
+
+/**** INFORMATION AND USER ACTIONS ****/
+
+_ITM_transaction* _ITM_CALL_CONVENTION _ITM_getTransaction(void) {
+    return (_ITM_transaction*)tl_opdata;
+}
+
+_ITM_howExecuting _ITM_CALL_CONVENTION _ITM_inTransaction() {
+    return (tl_opdata == nullptr) ? outsideTransaction : inRetryableTransaction;
+}
+
+int _ITM_CALL_CONVENTION _ITM_getThreadnum(void) {
+    return ThreadRegistry::getTID();
+}
+
+_ITM_transactionId _ITM_CALL_CONVENTION _ITM_getTransactionId() {
+    if (tl_opdata == nullptr) return _ITM_noTransactionId;
+    return (_ITM_transactionId)(tl_abi.nesting + 2);
+}
+
+void _ITM_CALL_CONVENTION _ITM_addUserCommitAction(_ITM_userCommitFunction __commit, _ITM_transactionId resumingTransactionId, void* __arg) {
+    STM::onCommit([__commit,__arg] () { __commit(__arg); });
+}
+
+void _ITM_CALL_CONVENTION _ITM_addUserUndoAction(const _ITM_userUndoFunction __undo, void* __arg) {
+    STM::onAbort([__undo,__arg] () { __undo(__arg); });
+}
+
+void _ITM_CALL_CONVENTION _ITM_dropReferences(const void* __start, size_t __size) { }
+
+void _ITM_CALL_CONVENTION _ITM_userError(const char* errString, int exitCode) {
+    fprintf(stderr, "%s\n", errString);
+    exit(exitCode);
+}
+
+void _ITM_CALL_CONVENTION _ITM_error(const _ITM_srcLocation* __src, int errorCode) {
+    fprintf(stderr, "Error: %s (%d)\n", (__src == NULL || __src->psource == NULL ? "?" : __src->psource), errorCode);
+    exit(1);
+}
+
+const char* _ITM_CALL_CONVENTION _ITM_libraryVersion(void) {
+    return _ITM_VERSION_NO_STR " using 2PLSF";
+}
+
+int _ITM_CALL_CONVENTION _ITM_versionCompatible(int version) {
+    return version == _ITM_VERSION_NO;
+}
+
+// Threads are registered in 2PLSF the first time they start a transaction
+int _ITM_CALL_CONVENTION _ITM_initializeThread(void) { return 0; }
+void _ITM_CALL_CONVENTION _ITM_finalizeThread(void) { }
+int _ITM_CALL_CONVENTION _ITM_initializeProcess(void) { return 0; }
+void _ITM_CALL_CONVENTION _ITM_finalizeProcess(void) { }
+
+
+/**** CLONE TABLES ****/
+
+void _ITM_registerTMCloneTable(void* xent, size_t size) {
+    CloneEntry* t = (CloneEntry*)xent;
+    std::sort(t, t+size, [] (const CloneEntry& a, const CloneEntry& b) { return a.orig < b.orig; });
+    CloneTable* table = (CloneTable*)std::malloc(sizeof(CloneTable));
+    table->table = t;
+    table->size = size;
+    std::lock_guard<std::mutex> lock(cloneMutex);
+    table->next = allTables;
+    allTables = table;
+}
+
+void _ITM_deregisterTMCloneTable(void* xent) {
+    std::lock_guard<std::mutex> lock(cloneMutex);
+    for (CloneTable** prev = &allTables; *prev != nullptr; prev = &(*prev)->next) {
+        CloneTable* table = *prev;
+        if (table->table != (CloneEntry*)xent) continue;
+        *prev = table->next;
+        std::free(table);
+        return;
+    }
+}
+
+void* _ITM_CALL_CONVENTION _ITM_getTMCloneOrIrrevocable(void* ptr) {
+    void* clone = findClone(ptr);
+    if (clone == nullptr) abiFatal("call to a function without a transactional clone (irrevocable transactions are not supported)");
+    return clone;
+}
+
+void* _ITM_CALL_CONVENTION _ITM_getTMCloneSafe(void* ptr) {
+    void* clone = findClone(ptr);
+    if (clone == nullptr) abiFatal("call to a function without a transactional clone");
+    return clone;
+}
+
+
+/**** MEMORY ALLOCATION ****/
+
+// Allocations are reverted on abort and de-allocations are deferred to the commit
+void* _ITM_malloc(size_t size) { return STM::tmMalloc(size); }
+void* _ITM_calloc(size_t nm, size_t size) { return STM::tmMalloc(nm*size); }   // tmMalloc() zeroes the memory
+void _ITM_free(void* ptr) { STM::tmFree(ptr); }
+
+// Transactional clones of operator new and delete
+void* _ZGTtnwm(size_t size) { return STM::tmMalloc(size); }
+void* _ZGTtnam(size_t size) { return STM::tmMalloc(size); }
+void _ZGTtdlPv(void* ptr) { STM::tmFree(ptr); }
+void _ZGTtdaPv(void* ptr) { STM::tmFree(ptr); }
+void _ZGTtdlPvm(void* ptr, size_t size) { STM::tmFree(ptr); }
+void _ZGTtdaPvm(void* ptr, size_t size) { STM::tmFree(ptr); }
+
+
+/**** LOAD STORE LOG FUNCTIONS ****/
+
+#define ABI_LOAD(F, T) \
+    T _ITM_CALL_CONVENTION F(const T* addr) { return abiLoad<T>(addr); }
+
+#define ABI_STORE(F, T) \
+    void _ITM_CALL_CONVENTION F(const T* addr, T val) { abiStore<T>(addr, val); }
+
+#define ABI_LOG(F, T) \
+    void _ITM_CALL_CONVENTION F(const T* addr) { abiLog<T>(addr); }
+
+#define ABI_LOAD_ALL(E, T) \
+    ABI_LOAD(_ITM_R##E, T) \
+    ABI_LOAD(_ITM_RaR##E, T) \
+    ABI_LOAD(_ITM_RaW##E, T) \
+    ABI_LOAD(_ITM_RfW##E, T)
+
+#define ABI_STORE_ALL(E, T) \
+    ABI_STORE(_ITM_W##E, T) \
+    ABI_STORE(_ITM_WaR##E, T) \
+    ABI_STORE(_ITM_WaW##E, T)
+
+// Transactional destination, non-transactional source
+#define ABI_STORE_BYTES(F, OP) \
+    void _ITM_CALL_CONVENTION F(void* dst, const void* src, size_t size) { \
+        abiWriteBytes(dst, size); \
+        OP(dst, src, size); \
+    }
+
+// Transactional source, non-transactional destination
+#define ABI_LOAD_BYTES(F, OP) \
+    void _ITM_CALL_CONVENTION F(void* dst, const void* src, size_t size) { \
+        abiReadBytes(src, size); \
+        OP(dst, src, size); \
+    }
+
+// Both transactional
+#define ABI_COPY_BYTES(F, OP) \
+    void _ITM_CALL_CONVENTION F(void* dst, const void* src, size_t size) { \
+        abiReadBytes(src, size); \
+        abiWriteBytes(dst, size); \
+        OP(dst, src, size); \
+    }
+
+#define ABI_SET_BYTES(F) \
+    void _ITM_CALL_CONVENTION F(void* dst, int val, size_t count) { \
+        abiWriteBytes(dst, count); \
+        std::memset(dst, val, count); \
+    }
+
+ABI_LOAD_ALL(U1, uint8_t)
+ABI_LOAD_ALL(U2, uint16_t)
+ABI_LOAD_ALL(U4, uint32_t)
+ABI_LOAD_ALL(U8, uint64_t)
+ABI_LOAD_ALL(F, float)
+ABI_LOAD_ALL(D, double)
+#ifdef __SSE__
+ABI_LOAD_ALL(M64, __m64)
+ABI_LOAD_ALL(M128, __m128)
+#endif /* __SSE__ */
+ABI_LOAD_ALL(CF, float _Complex)
+ABI_LOAD_ALL(CD, double _Complex)
+ABI_LOAD_ALL(CE, long double _Complex)
+
+ABI_STORE_ALL(U1, uint8_t)
+ABI_STORE_ALL(U2, uint16_t)
+ABI_STORE_ALL(U4, uint32_t)
+ABI_STORE_ALL(U8, uint64_t)
+ABI_STORE_ALL(F, float)
+ABI_STORE_ALL(D, double)
+#ifdef __SSE__
+ABI_STORE_ALL(M64, __m64)
+ABI_STORE_ALL(M128, __m128)
+#endif /* __SSE__ */
+ABI_STORE_ALL(CF, float _Complex)
+ABI_STORE_ALL(CD, double _Complex)
+ABI_STORE_ALL(CE, long double _Complex)
+
+ABI_LOG(_ITM_LU1, uint8_t)
+ABI_LOG(_ITM_LU2, uint16_t)
+ABI_LOG(_ITM_LU4, uint32_t)
+ABI_LOG(_ITM_LU8, uint64_t)
+ABI_LOG(_ITM_LF, float)
+ABI_LOG(_ITM_LD, double)
+ABI_LOG(_ITM_LE, long double)
+#ifdef __SSE__
+ABI_LOG(_ITM_LM64, __m64)
+ABI_LOG(_ITM_LM128, __m128)
+#endif /* __SSE__ */
+ABI_LOG(_ITM_LCF, float _Complex)
+ABI_LOG(_ITM_LCD, double _Complex)
+ABI_LOG(_ITM_LCE, long double _Complex)
+
+void _ITM_CALL_CONVENTION _ITM_LB(const void* addr, size_t size) { abiWriteBytes(addr, size); }
+
+ABI_STORE_BYTES(_ITM_memcpyRnWt, std::memcpy)
+ABI_STORE_BYTES(_ITM_memcpyRnWtaR, std::memcpy)
+ABI_STORE_BYTES(_ITM_memcpyRnWtaW, std::memcpy)
+
+ABI_LOAD_BYTES(_ITM_memcpyRtWn, std::memcpy)
+ABI_LOAD_BYTES(_ITM_memcpyRtaRWn, std::memcpy)
+ABI_LOAD_BYTES(_ITM_memcpyRtaWWn, std::memcpy)
+
+ABI_COPY_BYTES(_ITM_memcpyRtWt, std::memcpy)
+ABI_COPY_BYTES(_ITM_memcpyRtWtaR, std::memcpy)
+ABI_COPY_BYTES(_ITM_memcpyRtWtaW, std::memcpy)
+ABI_COPY_BYTES(_ITM_memcpyRtaRWt, std::memcpy)
+ABI_COPY_BYTES(_ITM_memcpyRtaRWtaR, std::memcpy)
+ABI_COPY_BYTES(_ITM_memcpyRtaRWtaW, std::memcpy)
+ABI_COPY_BYTES(_ITM_memcpyRtaWWt, std::memcpy)
+ABI_COPY_BYTES(_ITM_memcpyRtaWWtaR, std::memcpy)
+ABI_COPY_BYTES(_ITM_memcpyRtaWWtaW, std::memcpy)
+
+ABI_SET_BYTES(_ITM_memsetW)
+ABI_SET_BYTES(_ITM_memsetWaR)
+ABI_SET_BYTES(_ITM_memsetWaW)
+
+ABI_STORE_BYTES(_ITM_memmoveRnWt, std::memmove)
+ABI_STORE_BYTES(_ITM_memmoveRnWtaR, std::memmove)
+ABI_STORE_BYTES(_ITM_memmoveRnWtaW, std::memmove)
+
+ABI_LOAD_BYTES(_ITM_memmoveRtWn, std::memmove)
+ABI_LOAD_BYTES(_ITM_memmoveRtaRWn, std::memmove)
+ABI_LOAD_BYTES(_ITM_memmoveRtaWWn, std::memmove)
+
+ABI_COPY_BYTES(_ITM_memmoveRtWt, std::memmove)
+ABI_COPY_BYTES(_ITM_memmoveRtWtaR, std::memmove)
+ABI_COPY_BYTES(_ITM_memmoveRtWtaW, std::memmove)
+ABI_COPY_BYTES(_ITM_memmoveRtaRWt, std::memmove)
+ABI_COPY_BYTES(_ITM_memmoveRtaRWtaR, std::memmove)
+ABI_COPY_BYTES(_ITM_memmoveRtaRWtaW, std::memmove)
+ABI_COPY_BYTES(_ITM_memmoveRtaWWt, std::memmove)
+ABI_COPY_BYTES(_ITM_memmoveRtaWWtaR, std::memmove)
+ABI_COPY_BYTES(_ITM_memmoveRtaWWtaW, std::memmove)
+
+} // extern "C"
@@ -14,6 +14,7 @@
 #include <iostream>
 #include <vector>
 #include <functional>
+#include <malloc.h>
 
 
 namespace tinystm {
@@ -140,8 +141,10 @@ public:
 
     static std::string className() { return "TinySTM"; }
 
+    // An abort longjmp()s back to the sigsetjmp() of the transaction. These are never inlined, otherwise
+    // the compiler may reuse a stack slot of the caller in between, which wouldn't be restored by the longjmp().
     template<typename R, class F>
-    static R updateTx(F&& func) {
+    static R __attribute__ ((noinline)) updateTx(F&& func) {
         if (tl_nested_trans > 0) {
             return func();
         }
@@ -159,7 +162,7 @@ public:
     }
 
     template<class F>
-    static void updateTx(F&& func) {
+    static void __attribute__ ((noinline)) updateTx(F&& func) {
         if (tl_nested_trans > 0) {
             func();
             return;
@@ -176,7 +179,7 @@ public:
     }
 
     template<typename R, class F>
-    static R readTx(F&& func) {
+    static R __attribute__ ((noinline)) readTx(F&& func) {
         if (tl_nested_trans > 0) {
             return func();
         }
@@ -194,7 +197,7 @@ public:
     }
 
     template<class F>
-    static void readTx(F&& func) {
+    static void __attribute__ ((noinline)) readTx(F&& func) {
         if (tl_nested_trans > 0) {
             func();
             return;
@@ -229,8 +232,11 @@ public:
         return stm_malloc(size);
     }
 
+    // TinySTM overwrites the freed words to abort the transactions that are still reading them, which it can't do
+    // with size 0. Without it, a transaction can read the block after it was freed and reused, and not abort.
     static void tmFree(void* obj) {
-        stm_free(obj, 0);
+        if (obj == nullptr) return;
+        stm_free(obj, malloc_usable_size(obj));
     }
 };
 